@@ -0,0 +1,536 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "capture.h"
+#include "histogram.h"
+#include "probe.h"
+#include "seqtrack.h"
+
+#define BLOCKS_PER_SLICE  16
+#define SLICE_CAPACITY    (BLOCKS_PER_SLICE * (CAPTURE_BLOCK_SIZE / sizeof(capture_record_t)))
+#define NO_SEQ            UINT64_MAX
+
+/*
+ * Offline analysis of a capture file (see capture.h).
+ *
+ * The file is processed in one streaming pass, window by window. Each
+ * window is BLOCKS_PER_SLICE blocks per thread:
+ *
+ *  1. Every thread parses its own slice of blocks into a struct-of-arrays
+ *     batch (timestamps, probe send times, sequence numbers, lengths and
+ *     board keys). The per-column math, i.e. latency, throughput bucket
+ *     and key-to-owner mapping, runs as plain loops over those arrays,
+ *     which the compiler vectorizes.
+ *  2. After a barrier, every thread walks all slices of the window in
+ *     file order but only updates the boards it owns (key % threads).
+ *     Per-board state such as sequence tracking and jitter therefore sees
+ *     frames in order without any locking.
+ */
+
+typedef struct {
+    uint8_t  addr[16];
+    uint16_t port;
+    uint8_t  family;
+    uint32_t board_id;      /* probe board id, UINT32_MAX if none */
+} board_key_t;
+
+typedef struct {
+    uint64_t    hash;
+    board_key_t key;
+    uint64_t    frames;
+    uint64_t    bytes;
+    int64_t     first_ts;
+    int64_t     last_ts;
+    int64_t     prev_transit;
+    double      jitter_ns;      /* RFC 3550 interarrival jitter */
+    int         have_transit;
+    seqtrack_t  seq;
+    histogram_t latency;
+} board_t;
+
+/* Struct-of-arrays batch of one slice */
+typedef struct {
+    size_t        count;
+    int64_t      *ts;
+    int64_t      *send_ns;      /* 0 if the payload carried no probe */
+    int64_t      *latency;
+    uint64_t     *seq;
+    uint64_t     *hash;
+    uint32_t     *board;        /* probe board id, UINT32_MAX if none */
+    uint32_t     *len;
+    uint32_t     *owner;
+    const capture_record_t **rec;
+} batch_t;
+
+typedef struct {
+    unsigned   id;
+    pthread_t  thread;
+    batch_t    batch;
+
+    /* Boards owned by this thread, open addressing on hash */
+    board_t   *boards;
+    size_t     board_cap;
+    size_t     board_count;
+
+    /* Bytes per throughput bucket */
+    uint64_t  *series;
+    size_t     series_len;
+} worker_t;
+
+static capture_reader_t  reader;
+static worker_t         *workers;
+static unsigned          thread_count;
+static pthread_barrier_t barrier;
+static int64_t           t0_ns;
+static double            inv_bucket;    /* 1 / bucket width in ns */
+
+/* ---- board table --------------------------------------------------------- */
+
+static void key_init(board_key_t *key, const capture_record_t *rec, int has_probe, uint32_t board_id)
+{
+    /* Zeroed padding, keys are hashed and compared as bytes */
+    memset(key, 0, sizeof(*key));
+    memcpy(key->addr, rec->addr, sizeof(key->addr));
+    key->family   = rec->family;
+    key->port     = has_probe ? 0 : rec->port;   /* boards keep their id across reconnects */
+    key->board_id = has_probe ? board_id : UINT32_MAX;
+}
+
+static uint64_t key_hash(const board_key_t *key)
+{
+    /* FNV-1a over the key bytes */
+    const uint8_t *p = (const uint8_t *)key;
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < sizeof(*key); i++) {
+        h = (h ^ p[i]) * 1099511628211ULL;
+    }
+    return h | 1;  /* 0 marks an empty slot */
+}
+
+static void board_table_grow(worker_t *w)
+{
+    board_t *old = w->boards;
+    size_t old_cap = w->board_cap;
+
+    w->board_cap   = old_cap ? old_cap * 2 : 64;
+    w->boards      = calloc(w->board_cap, sizeof(board_t));
+    w->board_count = 0;
+    if (w->boards == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i].hash != 0) {
+            size_t slot = old[i].hash & (w->board_cap - 1);
+            while (w->boards[slot].hash != 0) {
+                slot = (slot + 1) & (w->board_cap - 1);
+            }
+            w->boards[slot] = old[i];
+            w->board_count++;
+        }
+    }
+    free(old);
+}
+
+static board_t *board_lookup(worker_t *w, uint64_t hash, const capture_record_t *rec, int has_probe,
+                             uint32_t board_id)
+{
+    board_key_t key;
+
+    if (2 * (w->board_count + 1) > w->board_cap) {
+        board_table_grow(w);
+    }
+    key_init(&key, rec, has_probe, board_id);
+
+    /* The hash only narrows the search, colliding boards keep their own rows */
+    size_t slot = hash & (w->board_cap - 1);
+    while (w->boards[slot].hash != 0 &&
+           (w->boards[slot].hash != hash || memcmp(&w->boards[slot].key, &key, sizeof(key)) != 0)) {
+        slot = (slot + 1) & (w->board_cap - 1);
+    }
+
+    board_t *b = &w->boards[slot];
+    if (b->hash == 0) {
+        memset(b, 0, sizeof(*b));
+        b->hash     = hash;
+        memcpy(&b->key, &key, sizeof(key));
+        b->first_ts = rec->ts_ns;
+        seqtrack_init(&b->seq);
+        hist_init(&b->latency);
+        w->board_count++;
+    }
+    return b;
+}
+
+/* ---- phase 1: parse into columns ----------------------------------------- */
+
+static void batch_alloc(batch_t *b)
+{
+    b->ts      = malloc(SLICE_CAPACITY * sizeof(*b->ts));
+    b->send_ns = malloc(SLICE_CAPACITY * sizeof(*b->send_ns));
+    b->latency = malloc(SLICE_CAPACITY * sizeof(*b->latency));
+    b->seq     = malloc(SLICE_CAPACITY * sizeof(*b->seq));
+    b->hash    = malloc(SLICE_CAPACITY * sizeof(*b->hash));
+    b->board   = malloc(SLICE_CAPACITY * sizeof(*b->board));
+    b->len     = malloc(SLICE_CAPACITY * sizeof(*b->len));
+    b->owner   = malloc(SLICE_CAPACITY * sizeof(*b->owner));
+    b->rec     = malloc(SLICE_CAPACITY * sizeof(*b->rec));
+    if (!b->ts || !b->send_ns || !b->latency || !b->seq || !b->hash || !b->board || !b->len || !b->owner || !b->rec) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void batch_free(batch_t *b)
+{
+    free(b->ts);
+    free(b->send_ns);
+    free(b->latency);
+    free(b->seq);
+    free(b->hash);
+    free(b->board);
+    free(b->len);
+    free(b->owner);
+    free(b->rec);
+}
+
+static void parse_slice(worker_t *w, uint64_t first_block, uint64_t last_block)
+{
+    batch_t *b = &w->batch;
+    capture_iter_t it;
+    const capture_record_t *rec;
+    size_t n = 0;
+
+    capture_iter_init(&it, &reader, first_block, last_block);
+    while ((rec = capture_next(&it)) != NULL && n < SLICE_CAPACITY) {
+        board_key_t key;
+        probe_t probe;
+        int has_probe = probe_parse((const char *)capture_payload(rec), rec->cap_len, &probe) == 0;
+
+        key_init(&key, rec, has_probe, has_probe ? probe.board : 0);
+
+        b->ts[n]      = rec->ts_ns;
+        b->send_ns[n] = has_probe ? probe.send_ns : 0;
+        b->seq[n]     = has_probe ? probe.seq : NO_SEQ;
+        b->len[n]     = rec->cap_len;
+        b->hash[n]    = key_hash(&key);
+        b->board[n]   = key.board_id;
+        b->rec[n]     = rec;
+        n++;
+    }
+    b->count = n;
+}
+
+/* Column kernels: no branches on data, restrict pointers, vectorizable */
+static void column_latency(const int64_t *restrict ts, const int64_t *restrict send,
+                           int64_t *restrict latency, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        int64_t valid = -(int64_t)(send[i] != 0);
+        latency[i] = (ts[i] - send[i]) & valid;
+    }
+}
+
+static void column_owner(const uint64_t *restrict hash, uint32_t *restrict owner, size_t n, uint32_t threads)
+{
+    for (size_t i = 0; i < n; i++) {
+        owner[i] = (uint32_t)((hash[i] >> 32) % threads);
+    }
+}
+
+static void column_series(worker_t *w, const int64_t *restrict ts, const uint32_t *restrict len, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        double rel = (double)(ts[i] - t0_ns) * inv_bucket;
+        size_t bucket = rel > 0.0 ? (size_t)rel : 0;
+
+        if (bucket >= w->series_len) {
+            size_t new_len = w->series_len ? w->series_len : 1024;
+            while (new_len <= bucket) {
+                new_len *= 2;
+            }
+            w->series = realloc(w->series, new_len * sizeof(*w->series));
+            if (w->series == NULL) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+            memset(w->series + w->series_len, 0, (new_len - w->series_len) * sizeof(*w->series));
+            w->series_len = new_len;
+        }
+        w->series[bucket] += len[i];
+    }
+}
+
+/* ---- phase 2: ordered per-board statistics ------------------------------- */
+
+static void apply_slice(worker_t *w, const batch_t *b)
+{
+    for (size_t i = 0; i < b->count; i++) {
+        if (b->owner[i] != w->id) {
+            continue;
+        }
+
+        int has_probe = b->seq[i] != NO_SEQ;
+        board_t *board = board_lookup(w, b->hash[i], b->rec[i], has_probe, b->board[i]);
+
+        board->frames++;
+        board->bytes  += b->len[i];
+        board->last_ts = b->ts[i];
+
+        if (has_probe) {
+            seqtrack_update(&board->seq, b->seq[i]);
+            hist_record(&board->latency, b->latency[i]);
+
+            /* RFC 3550: J += (|D| - J) / 16 with D the change in transit time */
+            if (board->have_transit) {
+                double d = fabs((double)(b->latency[i] - board->prev_transit));
+                board->jitter_ns += (d - board->jitter_ns) / 16.0;
+            }
+            board->prev_transit = b->latency[i];
+            board->have_transit = 1;
+        }
+    }
+}
+
+static void *worker_run(void *arg)
+{
+    worker_t *w = arg;
+    uint64_t window_blocks = (uint64_t)thread_count * BLOCKS_PER_SLICE;
+
+    for (uint64_t base = 0; base < reader.block_count; base += window_blocks) {
+        uint64_t first = base + (uint64_t)w->id * BLOCKS_PER_SLICE;
+        uint64_t last  = first + BLOCKS_PER_SLICE;
+
+        w->batch.count = 0;
+        if (first < reader.block_count) {
+            parse_slice(w, first, last);
+            column_latency(w->batch.ts, w->batch.send_ns, w->batch.latency, w->batch.count);
+            column_owner(w->batch.hash, w->batch.owner, w->batch.count, thread_count);
+            column_series(w, w->batch.ts, w->batch.len, w->batch.count);
+        }
+
+        pthread_barrier_wait(&barrier);
+
+        for (unsigned t = 0; t < thread_count; t++) {
+            apply_slice(w, &workers[t].batch);
+        }
+
+        pthread_barrier_wait(&barrier);
+    }
+    return NULL;
+}
+
+/* ---- report -------------------------------------------------------------- */
+
+static int compare_boards(const void *a, const void *b)
+{
+    const board_t *x = *(const board_t *const *)a;
+    const board_t *y = *(const board_t *const *)b;
+    int c = memcmp(x->key.addr, y->key.addr, sizeof(x->key.addr));
+    if (c != 0) return c;
+    if (x->key.board_id != y->key.board_id) return x->key.board_id < y->key.board_id ? -1 : 1;
+    return (int)x->key.port - (int)y->key.port;
+}
+
+static void board_name(const board_t *b, char *out, size_t size)
+{
+    char ip[INET6_ADDRSTRLEN];
+    inet_ntop(b->key.family == AF_INET6 ? AF_INET6 : AF_INET, b->key.addr, ip, sizeof(ip));
+    if (b->key.board_id != UINT32_MAX) {
+        snprintf(out, size, "%s#%u", ip, b->key.board_id);
+    } else {
+        snprintf(out, size, "%s:%u", ip, b->key.port);
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <capture-file>\n"
+            "  -T <threads>  worker threads (default: online CPUs)\n"
+            "  -i <seconds>  throughput bucket width (default 1)\n"
+            "  -o <file>     write the throughput time series as CSV\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    double bucket_s = 1.0;
+    const char *series_path = NULL;
+    int c;
+
+    while ((c = getopt(argc, argv, "T:i:o:h")) != -1) {
+        switch (c) {
+        case 'T': threads     = atol(optarg); break;
+        case 'i': bucket_s    = atof(optarg); break;
+        case 'o': series_path = optarg; break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind >= argc || threads < 1 || bucket_s <= 0.0) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (capture_reader_open(&reader, argv[optind]) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    /* Time series start at the first frame */
+    capture_iter_t it;
+    capture_iter_init(&it, &reader, 0, reader.block_count);
+    const capture_record_t *first = capture_next(&it);
+    if (first == NULL) {
+        printf("[Analyze] %s contains no frames\n", argv[optind]);
+        capture_reader_close(&reader);
+        return 0;
+    }
+    t0_ns      = first->ts_ns;
+    inv_bucket = 1.0 / (bucket_s * 1e9);
+
+    thread_count = (unsigned)threads;
+    workers = calloc(thread_count, sizeof(worker_t));
+    if (workers == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    pthread_barrier_init(&barrier, NULL, thread_count);
+
+    for (unsigned t = 0; t < thread_count; t++) {
+        workers[t].id = t;
+        batch_alloc(&workers[t].batch);
+        board_table_grow(&workers[t]);
+    }
+    for (unsigned t = 0; t < thread_count; t++) {
+        pthread_create(&workers[t].thread, NULL, worker_run, &workers[t]);
+    }
+    for (unsigned t = 0; t < thread_count; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+
+    /* Collect boards and merge the throughput series */
+    size_t board_total = 0, series_len = 0;
+    for (unsigned t = 0; t < thread_count; t++) {
+        board_total += workers[t].board_count;
+        if (workers[t].series_len > series_len) {
+            series_len = workers[t].series_len;
+        }
+    }
+
+    board_t **boards = calloc(board_total ? board_total : 1, sizeof(board_t *));
+    uint64_t *series = calloc(series_len ? series_len : 1, sizeof(uint64_t));
+    size_t n = 0;
+    for (unsigned t = 0; t < thread_count; t++) {
+        for (size_t i = 0; i < workers[t].board_cap; i++) {
+            if (workers[t].boards[i].hash != 0) {
+                boards[n++] = &workers[t].boards[i];
+            }
+        }
+        for (size_t i = 0; i < workers[t].series_len; i++) {
+            series[i] += workers[t].series[i];
+        }
+    }
+    qsort(boards, n, sizeof(*boards), compare_boards);
+
+    histogram_t total_latency;
+    hist_init(&total_latency);
+    uint64_t frames = 0, bytes = 0, missing = 0, reordered = 0, duplicates = 0;
+
+    printf("[Analyze] %s: %llu frames in %llu blocks, %u threads\n", argv[optind],
+           (unsigned long long)reader.header->record_count,
+           (unsigned long long)reader.block_count, thread_count);
+    printf("%-26s %9s %11s %8s %7s %7s %6s %9s %9s %9s %9s %9s\n",
+           "board", "frames", "bytes", "lost", "loss%", "reorder", "dup",
+           "rate/s", "jit_us", "p50_us", "p99_us", "max_us");
+
+    for (size_t i = 0; i < n; i++) {
+        const board_t *b = boards[i];
+        char name[64];
+        double span = (double)(b->last_ts - b->first_ts) / 1e9;
+
+        board_name(b, name, sizeof(name));
+        printf("%-26s %9llu %11llu %8llu %7.3f %7llu %6llu %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+               name,
+               (unsigned long long)b->frames,
+               (unsigned long long)b->bytes,
+               (unsigned long long)b->seq.missing,
+               100.0 * seqtrack_loss_ratio(&b->seq),
+               (unsigned long long)b->seq.reordered,
+               (unsigned long long)b->seq.duplicates,
+               span > 0.0 ? (double)b->frames / span : 0.0,
+               b->jitter_ns / 1000.0,
+               hist_percentile(&b->latency, 0.50) / 1000.0,
+               hist_percentile(&b->latency, 0.99) / 1000.0,
+               b->latency.max_ns / 1000.0);
+
+        frames     += b->frames;
+        bytes      += b->bytes;
+        missing    += b->seq.missing;
+        reordered  += b->seq.reordered;
+        duplicates += b->seq.duplicates;
+        hist_merge(&total_latency, &b->latency);
+    }
+
+    printf("[Analyze] total: %llu frames, %llu bytes, lost=%llu reordered=%llu duplicates=%llu\n",
+           (unsigned long long)frames, (unsigned long long)bytes,
+           (unsigned long long)missing, (unsigned long long)reordered,
+           (unsigned long long)duplicates);
+    printf("[Analyze] latency (capture - probe send time): p50=%.1f us p90=%.1f us p99=%.1f us p99.9=%.1f us max=%.1f us\n",
+           hist_percentile(&total_latency, 0.50) / 1000.0,
+           hist_percentile(&total_latency, 0.90) / 1000.0,
+           hist_percentile(&total_latency, 0.99) / 1000.0,
+           hist_percentile(&total_latency, 0.999) / 1000.0,
+           total_latency.max_ns / 1000.0);
+
+    /* Trim empty buckets at the end of the series */
+    while (series_len > 0 && series[series_len - 1] == 0) {
+        series_len--;
+    }
+    uint64_t peak = 0;
+    for (size_t i = 0; i < series_len; i++) {
+        if (series[i] > peak) {
+            peak = series[i];
+        }
+    }
+    printf("[Analyze] throughput: %zu buckets of %.3f s, mean %.1f kB/s, peak %.1f kB/s\n",
+           series_len, bucket_s,
+           series_len ? (double)bytes / ((double)series_len * bucket_s) / 1000.0 : 0.0,
+           (double)peak / bucket_s / 1000.0);
+
+    if (series_path != NULL) {
+        FILE *out = fopen(series_path, "w");
+        if (out == NULL) {
+            perror("fopen");
+        } else {
+            fprintf(out, "t_s,bytes,kbytes_per_s\n");
+            for (size_t i = 0; i < series_len; i++) {
+                fprintf(out, "%.3f,%llu,%.3f\n", (double)i * bucket_s,
+                        (unsigned long long)series[i], (double)series[i] / bucket_s / 1000.0);
+            }
+            fclose(out);
+        }
+    }
+
+    for (unsigned t = 0; t < thread_count; t++) {
+        batch_free(&workers[t].batch);
+        free(workers[t].boards);
+        free(workers[t].series);
+    }
+    free(series);
+    free(boards);
+    free(workers);
+    pthread_barrier_destroy(&barrier);
+    capture_reader_close(&reader);
+    return 0;
+}
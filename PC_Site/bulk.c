@@ -0,0 +1,67 @@
+#include "bulk.h"
+#include "crc32c.h"
+
+#include <string.h>
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    put16(p, (uint16_t)v);
+    put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return (uint32_t)get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+size_t bulk_build(uint8_t *out, uint8_t type, uint16_t id, uint32_t index, uint16_t flags,
+                  const void *payload, size_t len)
+{
+    out[0] = BULK_MAGIC;
+    out[1] = type;
+    put16(&out[2], id);
+    put32(&out[4], index);
+    put16(&out[8], (uint16_t)len);
+    put16(&out[10], flags);
+    if (len > 0 && payload != out + BULK_HEADER) {
+        memcpy(out + BULK_HEADER, payload, len);
+    }
+    put32(&out[12], crc32c(crc32c(0, out, 12), out + BULK_HEADER, len));
+    return BULK_HEADER + len;
+}
+
+int bulk_parse(const uint8_t *buf, size_t len, bulk_packet_t *pkt)
+{
+    if (len < BULK_HEADER || buf[0] != BULK_MAGIC) {
+        return -1;
+    }
+    pkt->len = get16(&buf[8]);
+    if (BULK_HEADER + pkt->len != len ||
+        get32(&buf[12]) != crc32c(crc32c(0, buf, 12), buf + BULK_HEADER, pkt->len)) {
+        return -1;
+    }
+    pkt->type    = buf[1];
+    pkt->id      = get16(&buf[2]);
+    pkt->index   = get32(&buf[4]);
+    pkt->flags   = get16(&buf[10]);
+    pkt->payload = buf + BULK_HEADER;
+    return 0;
+}
+
+const char *bulk_type_name(uint8_t type)
+{
+    static const char *const names[] = { "?", "PUT", "GET", "INFO", "DATA", "ACK", "ERROR" };
+
+    return type < sizeof(names) / sizeof(names[0]) ? names[type] : "?";
+}
@@ -0,0 +1,56 @@
+#ifndef BULK_H
+#define BULK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Packets of the board's chunked bulk transfer (CONFIG_COMM_ENGINE_BULK,
+ * modules/comm_engine/comm_bulk.c). A 16 byte little endian header:
+ *
+ *   0   BULK_MAGIC, type
+ *   2   transfer id
+ *   4   chunk index; in ACK the first chunk still missing
+ *   8   payload length (16 bit), flags (16 bit)
+ *   12  CRC32C of header bytes 0..11 and the payload (crc32c.h)
+ *
+ * An ACK carries a bitmap of BULK_MAX_WINDOW bits: bit i is set when
+ * chunk index + i has arrived.
+ */
+
+#define BULK_MAGIC          0xB8
+#define BULK_HEADER         16
+#define BULK_MAX_WINDOW     256
+#define BULK_MAP_BYTES      (BULK_MAX_WINDOW / 8)
+#define BULK_MAX_PAYLOAD    (UINT16_MAX - BULK_HEADER)
+#define BULK_ACK_EVERY      8
+#define BULK_FLAG_COMPLETE  0x0001
+
+typedef enum {
+    BULK_PUT = 1,
+    BULK_GET,
+    BULK_INFO,
+    BULK_DATA,
+    BULK_ACK,
+    BULK_ERROR,
+} bulk_type_t;
+
+typedef struct {
+    uint8_t        type;
+    uint16_t       id;
+    uint32_t       index;
+    uint16_t       flags;
+    size_t         len;
+    const uint8_t *payload;     /* inside the parsed buffer */
+} bulk_packet_t;
+
+/* Build a packet into out (BULK_HEADER + len bytes), returns its size */
+size_t bulk_build(uint8_t *out, uint8_t type, uint16_t id, uint32_t index, uint16_t flags,
+                  const void *payload, size_t len);
+
+/* Check magic, length and CRC. Returns 0 and fills pkt, -1 otherwise. */
+int bulk_parse(const uint8_t *buf, size_t len, bulk_packet_t *pkt);
+
+const char *bulk_type_name(uint8_t type);
+
+#endif /* BULK_H */
@@ -0,0 +1,647 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "bulk.h"
+#include "crc32c.h"
+#include "netaddr.h"
+
+#define PORT             8080
+#define DEFAULT_STORE    "ram"
+#define DEFAULT_WINDOW   64
+#define OPEN_RETRY_MS    1000
+#define OPEN_TIMEOUT_MS  15000  /* a PUT to flash erases first */
+#define IDLE_TIMEOUT_MS  10000
+#define RTO_INIT_MS      250
+#define RTO_MIN_MS       20
+#define RTO_MAX_MS       2000
+#define ACK_IDLE_MS      200    /* receiver: repeat the ACK after this much silence */
+#define SAVE_EVERY       256    /* receiver: chunks between two sidecar saves */
+#define LINGER_MS        1000   /* receiver: answer late chunks after completion */
+#define PART_MAGIC       0x54524150u    /* "PART" */
+#define PACKET_MAX       (BULK_HEADER + 65536)
+
+/*
+ * Client of the board's bulk transfer (CONFIG_UDP_SOCKET_DEMO_BULK).
+ *
+ * put: sends a file to a store on the board. The sender keeps a window of
+ * chunks in flight, measures the RTT from chunks sent once (Karn) and
+ * resends a chunk when its RTO expires or when a chunk sent after it was
+ * acked first. The transfer id is derived from the file's name, size and
+ * mtime, so running the same put again after an interruption resumes
+ * where the board stopped.
+ *
+ * get: reads a blob from the board into a file. The chunks received so
+ * far are kept in <file>.part; a get that finds it asks only for the rest.
+ */
+
+typedef struct {
+    int                fd;
+    uint16_t           id;
+    uint32_t           size;
+    uint32_t           chunk;
+    uint32_t           chunks;
+    uint16_t           window;
+    uint8_t           *done;            /* bitmap over all chunks */
+    uint32_t           base;            /* first chunk not done */
+    uint32_t           done_count;
+    uint64_t           sent;            /* chunks sent, including resends */
+    uint64_t           resent;
+    double             srtt_ms;
+    double             rttvar_ms;
+    double             rto_ms;
+} xfer_t;
+
+static volatile sig_atomic_t stop;
+static uint8_t rx_buf[PACKET_MAX];
+static uint8_t tx_buf[PACKET_MAX];
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-p <port>] [-s <store>] [-w <window>] [-n] put|get <file> <board-ip>\n"
+            "  -p <port>    port (default %d)\n"
+            "  -s <store>   store on the board: ram, null, flash (default %s)\n"
+            "  -w <window>  chunks in flight, the board may lower it (default %d)\n"
+            "  -n           start over instead of resuming\n",
+            prog, PORT, DEFAULT_STORE, DEFAULT_WINDOW);
+}
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static double now_msf(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static int is_done(const xfer_t *x, uint32_t c)
+{
+    return x->done[c / 8] & (1u << (c % 8));
+}
+
+static void mark_done(xfer_t *x, uint32_t c)
+{
+    if (!is_done(x, c)) {
+        x->done[c / 8] |= (uint8_t)(1u << (c % 8));
+        x->done_count++;
+    }
+}
+
+static void advance_base(xfer_t *x)
+{
+    while (x->base < x->chunks && is_done(x, x->base)) {
+        x->base++;
+    }
+}
+
+static uint32_t chunk_len(const xfer_t *x, uint32_t c)
+{
+    return c + 1 < x->chunks ? x->chunk : x->size - c * x->chunk;
+}
+
+static int send_packet(const xfer_t *x, uint8_t type, uint32_t index, uint16_t flags,
+                       const void *payload, size_t len)
+{
+    size_t n = bulk_build(tx_buf, type, x->id, index, flags, payload, len);
+
+    if (send(x->fd, tx_buf, n, 0) < 0 && errno != ECONNREFUSED && errno != ENOBUFS) {
+        perror("send");
+        return -1;
+    }
+    return 0;
+}
+
+/* Next packet of this transfer: 1, 0 on timeout or signal, -1 on error */
+static int wait_packet(const xfer_t *x, int timeout_ms, bulk_packet_t *pkt)
+{
+    int64_t deadline = now_ms() + timeout_ms;
+
+    for (;;) {
+        struct pollfd pfd = { .fd = x->fd, .events = POLLIN };
+        int64_t left = deadline - now_ms();
+
+        if (stop || left < 0) {
+            return 0;
+        }
+        int ret = poll(&pfd, 1, (int)left);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            return -1;
+        }
+        if (ret == 0) {
+            return 0;
+        }
+        ssize_t n = recv(x->fd, rx_buf, sizeof(rx_buf), 0);
+        if (n < 0) {
+            /* An ICMP unreachable from an earlier send, the board may still come up */
+            if (errno == ECONNREFUSED || errno == EINTR) {
+                continue;
+            }
+            perror("recv");
+            return -1;
+        }
+        /* Echo replies and packets of an older transfer */
+        if (bulk_parse(rx_buf, (size_t)n, pkt) < 0 || pkt->id != x->id) {
+            continue;
+        }
+        if (pkt->type == BULK_ERROR) {
+            int32_t err = 0;
+            if (pkt->len >= 4) {
+                err = (int32_t)(pkt->payload[0] | pkt->payload[1] << 8 | pkt->payload[2] << 16 |
+                                (uint32_t)pkt->payload[3] << 24);
+            }
+            fprintf(stderr, "[Bulk] Board refused the transfer: %s (%d)\n", strerror(-err), err);
+            return -1;
+        }
+        return 1;
+    }
+}
+
+/* Send PUT / GET until the board answers with INFO */
+static int open_transfer(xfer_t *x, uint8_t type, const char *store, uint32_t size)
+{
+    uint8_t req[6 + 32];
+    size_t len = 0;
+    bulk_packet_t pkt;
+
+    if (type == BULK_PUT) {
+        req[len++] = (uint8_t)size;
+        req[len++] = (uint8_t)(size >> 8);
+        req[len++] = (uint8_t)(size >> 16);
+        req[len++] = (uint8_t)(size >> 24);
+    }
+    req[len++] = (uint8_t)x->window;
+    req[len++] = (uint8_t)(x->window >> 8);
+    size_t name = strlen(store);
+    if (name == 0 || name > 32) {
+        fprintf(stderr, "Invalid store name '%s'\n", store);
+        return -1;
+    }
+    memcpy(&req[len], store, name);
+    len += name;
+
+    int64_t start = now_ms();
+    while (!stop && now_ms() - start < OPEN_TIMEOUT_MS) {
+        if (send_packet(x, type, 0, 0, req, len) < 0) {
+            return -1;
+        }
+        int64_t sent = now_ms();
+        int ret;
+        while ((ret = wait_packet(x, (int)(sent + OPEN_RETRY_MS - now_ms()), &pkt)) > 0) {
+            if (pkt.type != BULK_INFO || pkt.len < 8) {
+                continue;
+            }
+            const uint8_t *p = pkt.payload;
+            x->size = (uint32_t)(p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24);
+            x->chunk = (uint32_t)(p[4] | p[5] << 8);
+            x->window = (uint16_t)(p[6] | p[7] << 8);
+            if (x->chunk == 0 || x->window == 0 || x->window > BULK_MAX_WINDOW ||
+                (type == BULK_PUT && x->size != size)) {
+                fprintf(stderr, "[Bulk] Invalid INFO from the board\n");
+                return -1;
+            }
+            x->chunks = (uint32_t)(((uint64_t)x->size + x->chunk - 1) / x->chunk);
+            return 0;
+        }
+        if (ret < 0) {
+            return -1;
+        }
+    }
+    if (!stop) {
+        fprintf(stderr, "[Bulk] No answer from the board\n");
+    }
+    return -1;
+}
+
+/* counters: what sent and resent mean on this side */
+static void print_summary(const xfer_t *x, const char *what, const char *counters, uint64_t bytes,
+                          double secs)
+{
+    if (secs <= 0) {
+        secs = 1e-6;
+    }
+    printf("\n=== Bulk %s summary ===\n", what);
+    printf("Transferred       : %llu bytes in %.2f s\n", (unsigned long long)bytes, secs);
+    printf("Throughput        : %.2f MB/s, %.2f Mbit/s\n", (double)bytes / secs / 1e6,
+           (double)bytes * 8 / secs / 1e6);
+    printf("Chunks            : %u of %u bytes, window %u\n", x->chunks, x->chunk, x->window);
+    printf("%-18s: %llu / %llu (%.2f%%)\n", counters, (unsigned long long)x->sent,
+           (unsigned long long)x->resent, x->sent ? 100.0 * (double)x->resent / (double)x->sent : 0.0);
+    if (x->srtt_ms > 0) {
+        printf("SRTT / RTO        : %.2f ms / %.2f ms\n", x->srtt_ms, x->rto_ms);
+    }
+}
+
+/* ---- put ---- */
+
+/* RFC 6298, only from chunks that were sent once */
+static void rtt_sample(xfer_t *x, double rtt)
+{
+    if (x->srtt_ms == 0) {
+        x->srtt_ms = rtt;
+        x->rttvar_ms = rtt / 2;
+    } else {
+        x->rttvar_ms = 0.75 * x->rttvar_ms + 0.25 * (rtt > x->srtt_ms ? rtt - x->srtt_ms : x->srtt_ms - rtt);
+        x->srtt_ms = 0.875 * x->srtt_ms + 0.125 * rtt;
+    }
+    x->rto_ms = x->srtt_ms + 4 * x->rttvar_ms;
+    x->rto_ms = x->rto_ms < RTO_MIN_MS ? RTO_MIN_MS : x->rto_ms > RTO_MAX_MS ? RTO_MAX_MS : x->rto_ms;
+}
+
+/* sent_ms[c] = 0: not sent yet, < 0: lost, resend at once */
+static int on_put_ack(xfer_t *x, const bulk_packet_t *pkt, double *sent_ms, uint8_t *tries)
+{
+    double now = now_msf();
+    double newest = 0;
+
+    for (uint32_t c = x->base; c < pkt->index && c < x->chunks; c++) {
+        if (!is_done(x, c) && tries[c] == 1) {
+            rtt_sample(x, now - sent_ms[c]);
+        }
+        mark_done(x, c);
+    }
+    for (uint32_t i = 0; i < pkt->len * 8 && pkt->index + i < x->chunks; i++) {
+        uint32_t c = pkt->index + i;
+
+        if (!(pkt->payload[i / 8] & (1u << (i % 8))) || is_done(x, c)) {
+            continue;
+        }
+        if (sent_ms[c] > 0) {
+            if (tries[c] == 1) {
+                rtt_sample(x, now - sent_ms[c]);
+            }
+            newest = sent_ms[c] > newest ? sent_ms[c] : newest;
+        }
+        mark_done(x, c);
+    }
+    advance_base(x);
+
+    /* Sent well before a chunk that got through: lost, not late */
+    double reorder = x->srtt_ms / 4;
+    for (uint32_t c = x->base; newest > 0 && c < x->base + x->window && c < x->chunks; c++) {
+        if (!is_done(x, c) && sent_ms[c] > 0 && sent_ms[c] + reorder < newest) {
+            sent_ms[c] = -1;
+        }
+    }
+    return (pkt->flags & BULK_FLAG_COMPLETE) || x->base == x->chunks;
+}
+
+static uint16_t file_id(const char *path, const struct stat *st)
+{
+    const char *name = strrchr(path, '/');
+    name = name != NULL ? name + 1 : path;
+
+    uint32_t crc = crc32c(0, name, strlen(name));
+    uint64_t size = (uint64_t)st->st_size;
+    int64_t mtime = (int64_t)st->st_mtime;
+    crc = crc32c(crc, &size, sizeof(size));
+    crc = crc32c(crc, &mtime, sizeof(mtime));
+    uint16_t id = (uint16_t)(crc ^ crc >> 16);
+    return id != 0 ? id : 1;
+}
+
+static int run_put(xfer_t *x, const char *path, const char *store, int fresh)
+{
+    int file = open(path, O_RDONLY);
+    if (file < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(file, &st) < 0 || st.st_size > UINT32_MAX) {
+        fprintf(stderr, "%s: not a file below 4 GiB\n", path);
+        close(file);
+        return -1;
+    }
+    const uint8_t *data = NULL;
+    if (st.st_size > 0) {
+        data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (data == MAP_FAILED) {
+            perror("mmap");
+            close(file);
+            return -1;
+        }
+    }
+    close(file);
+
+    x->id = fresh ? (uint16_t)(1 + (uint32_t)(now_ms() ^ getpid()) % 0xFFFF) : file_id(path, &st);
+    if (open_transfer(x, BULK_PUT, store, (uint32_t)st.st_size) < 0) {
+        return -1;
+    }
+    printf("[Bulk] PUT %s to %s: %u bytes, %u chunks of %u, window %u, id %u\n", path, store, x->size,
+           x->chunks, x->chunk, x->window, x->id);
+
+    double *sent_ms = calloc(x->chunks + 1, sizeof(*sent_ms));
+    uint8_t *tries = calloc(x->chunks + 1, 1);
+    x->done = calloc(x->chunks / 8 + 1, 1);
+    if (sent_ms == NULL || tries == NULL || x->done == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    double start = now_msf();
+    int64_t last_rx = now_ms();
+    uint64_t bytes = 0;
+    int complete = x->chunks == 0;
+    bulk_packet_t pkt;
+
+    while (!complete && !stop) {
+        double now = now_msf();
+        double deadline = now + RTO_MAX_MS;
+        uint32_t end = x->base + x->window < x->chunks ? x->base + x->window : x->chunks;
+
+        for (uint32_t c = x->base; c < end; c++) {
+            if (is_done(x, c)) {
+                continue;
+            }
+            if (sent_ms[c] > 0 && now - sent_ms[c] < x->rto_ms) {
+                deadline = sent_ms[c] + x->rto_ms < deadline ? sent_ms[c] + x->rto_ms : deadline;
+                continue;
+            }
+            uint32_t len = chunk_len(x, c);
+            if (send_packet(x, BULK_DATA, c, 0, data + (size_t)c * x->chunk, len) < 0) {
+                return -1;
+            }
+            x->resent += sent_ms[c] != 0;
+            bytes += sent_ms[c] == 0 ? len : 0;
+            x->sent++;
+            tries[c] = tries[c] < UINT8_MAX ? tries[c] + 1 : UINT8_MAX;
+            sent_ms[c] = now;
+            deadline = now + x->rto_ms < deadline ? now + x->rto_ms : deadline;
+        }
+
+        int ret = wait_packet(x, (int)(deadline - now_msf()) + 1, &pkt);
+        if (ret < 0) {
+            return -1;
+        }
+        if (ret > 0) {
+            last_rx = now_ms();
+            if (pkt.type == BULK_ACK) {
+                complete = on_put_ack(x, &pkt, sent_ms, tries);
+            }
+            continue;
+        }
+        if (now_ms() - last_rx > IDLE_TIMEOUT_MS) {
+            fprintf(stderr, "[Bulk] Board silent, stopped at chunk %u of %u; run again to resume\n",
+                    x->base, x->chunks);
+            return -1;
+        }
+        /* Resend what timed out, then back off */
+        now = now_msf();
+        for (uint32_t c = x->base; c < end; c++) {
+            if (!is_done(x, c) && sent_ms[c] > 0 && now - sent_ms[c] >= x->rto_ms) {
+                sent_ms[c] = -1;
+            }
+        }
+        x->rto_ms = x->rto_ms * 2 > RTO_MAX_MS ? RTO_MAX_MS : x->rto_ms * 2;
+    }
+    if (!complete) {
+        printf("[Bulk] Interrupted at chunk %u of %u; run again to resume\n", x->base, x->chunks);
+        return -1;
+    }
+    print_summary(x, "PUT", "Sent / resent", bytes, (now_msf() - start) / 1000.0);
+    return 0;
+}
+
+/* ---- get ---- */
+
+/* <file>.part: magic, size, chunk, store, then the bitmap of chunks written */
+typedef struct {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t chunk;
+    char     store[32];
+} part_header_t;
+
+static void save_part(const xfer_t *x, const char *part, const char *store)
+{
+    part_header_t hdr = { .magic = PART_MAGIC, .size = x->size, .chunk = x->chunk };
+    snprintf(hdr.store, sizeof(hdr.store), "%s", store);
+
+    FILE *f = fopen(part, "wb");
+    if (f == NULL || fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+        fwrite(x->done, x->chunks / 8 + 1, 1, f) != 1) {
+        perror(part);
+    }
+    if (f != NULL) {
+        fclose(f);
+    }
+}
+
+/* The chunks of an earlier get of the same blob, if any */
+static void load_part(xfer_t *x, const char *part, const char *store)
+{
+    part_header_t hdr;
+    FILE *f = fopen(part, "rb");
+
+    if (f == NULL) {
+        return;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, f) == 1 && hdr.magic == PART_MAGIC && hdr.size == x->size &&
+        hdr.chunk == x->chunk && strncmp(hdr.store, store, sizeof(hdr.store)) == 0 &&
+        fread(x->done, x->chunks / 8 + 1, 1, f) == 1) {
+        for (uint32_t c = 0; c < x->chunks; c++) {
+            x->done_count += is_done(x, c) != 0;
+        }
+        advance_base(x);
+        printf("[Bulk] Resuming: %u of %u chunks already here\n", x->done_count, x->chunks);
+    } else {
+        memset(x->done, 0, x->chunks / 8 + 1);
+    }
+    fclose(f);
+}
+
+static int send_ack(const xfer_t *x)
+{
+    uint8_t map[BULK_MAP_BYTES] = { 0 };
+
+    for (uint32_t i = 0; i < BULK_MAX_WINDOW && x->base + i < x->chunks; i++) {
+        if (is_done(x, x->base + i)) {
+            map[i / 8] |= (uint8_t)(1u << (i % 8));
+        }
+    }
+    return send_packet(x, BULK_ACK, x->base, x->done_count == x->chunks ? BULK_FLAG_COMPLETE : 0,
+                       map, sizeof(map));
+}
+
+static int run_get(xfer_t *x, const char *path, const char *store, int fresh)
+{
+    char part[4096];
+    snprintf(part, sizeof(part), "%s.part", path);
+
+    x->id = (uint16_t)(1 + (uint32_t)(now_ms() ^ getpid()) % 0xFFFF);
+    if (open_transfer(x, BULK_GET, store, 0) < 0) {
+        return -1;
+    }
+    printf("[Bulk] GET %s from %s: %u bytes, %u chunks of %u, window %u\n", path, store, x->size,
+           x->chunks, x->chunk, x->window);
+
+    x->done = calloc(x->chunks / 8 + 1, 1);
+    if (x->done == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    if (!fresh) {
+        load_part(x, part, store);
+    }
+    int file = open(path, O_RDWR | O_CREAT | (x->done_count == 0 ? O_TRUNC : 0), 0644);
+    if (file < 0 || ftruncate(file, x->size) < 0) {
+        perror(path);
+        return -1;
+    }
+
+    double start = now_msf();
+    int64_t last_rx = now_ms();
+    uint64_t bytes = 0;
+    uint32_t since_ack = 0, since_save = 0, next_expected = x->base;
+    int ret = 0;
+    bulk_packet_t pkt;
+
+    /* Tells the board what is here already and starts the stream */
+    send_ack(x);
+    while (x->done_count < x->chunks && !stop) {
+        ret = wait_packet(x, ACK_IDLE_MS, &pkt);
+        if (ret < 0) {
+            break;
+        }
+        if (ret == 0) {
+            if (now_ms() - last_rx > IDLE_TIMEOUT_MS) {
+                fprintf(stderr, "[Bulk] Board silent, stopped at chunk %u of %u\n", x->base, x->chunks);
+                ret = -1;
+                break;
+            }
+            send_ack(x);
+            continue;
+        }
+        last_rx = now_ms();
+        if (pkt.type != BULK_DATA || pkt.index >= x->chunks || pkt.len != chunk_len(x, pkt.index)) {
+            continue;
+        }
+        int in_order = pkt.index == next_expected;
+        next_expected = pkt.index + 1;
+        x->sent++;
+        if (is_done(x, pkt.index)) {
+            x->resent++;
+            send_ack(x);
+            continue;
+        }
+        if (pwrite(file, pkt.payload, pkt.len, (off_t)pkt.index * x->chunk) != (ssize_t)pkt.len) {
+            perror("pwrite");
+            ret = -1;
+            break;
+        }
+        mark_done(x, pkt.index);
+        advance_base(x);
+        bytes += pkt.len;
+        if (++since_save >= SAVE_EVERY) {
+            save_part(x, part, store);
+            since_save = 0;
+        }
+        if (!in_order || ++since_ack >= BULK_ACK_EVERY || x->done_count == x->chunks) {
+            send_ack(x);
+            since_ack = 0;
+        }
+    }
+    double secs = (now_msf() - start) / 1000.0;
+    close(file);
+
+    if (x->done_count < x->chunks) {
+        save_part(x, part, store);
+        printf("[Bulk] %u of %u chunks here, saved to %s; run again to resume\n", x->done_count,
+               x->chunks, part);
+        return -1;
+    }
+    unlink(part);
+
+    /* The last ACK may get lost: answer chunks the board still resends */
+    int64_t linger = now_ms() + LINGER_MS;
+    send_ack(x);
+    while (!stop && now_ms() < linger && wait_packet(x, (int)(linger - now_ms()), &pkt) > 0) {
+        if (pkt.type == BULK_DATA) {
+            send_ack(x);
+        }
+    }
+    print_summary(x, "GET", "Received / dups", bytes, secs);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = PORT;
+    const char *store = DEFAULT_STORE;
+    int window = DEFAULT_WINDOW;
+    int fresh = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "p:s:w:nh")) != -1) {
+        switch (c) {
+        case 'p': port = (uint16_t)atoi(optarg); break;
+        case 's': store = optarg; break;
+        case 'w': window = atoi(optarg); break;
+        case 'n': fresh = 1; break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc - 3 || window < 1 || window > BULK_MAX_WINDOW ||
+        (strcmp(argv[optind], "put") != 0 && strcmp(argv[optind], "get") != 0)) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    const char *path = argv[optind + 1];
+    const char *ip = argv[optind + 2];
+
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    if (netaddr_resolve(ip, port, SOCK_DGRAM, &addr, &addr_len) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    xfer_t x = { .window = (uint16_t)window, .rto_ms = RTO_INIT_MS };
+    x.fd = socket(addr.ss_family, SOCK_DGRAM, 0);
+    if (x.fd < 0) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(x.fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (connect(x.fd, (struct sockaddr *)&addr, addr_len) < 0) {
+        perror("connect");
+        exit(EXIT_FAILURE);
+    }
+
+    /* No SA_RESTART: poll() returns so the state can be saved */
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int ret = argv[optind][0] == 'p' ? run_put(&x, path, store, fresh) : run_get(&x, path, store, fresh);
+    close(x.fd);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
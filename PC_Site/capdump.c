@@ -0,0 +1,60 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "capture.h"
+
+#define PREVIEW_LEN 48
+
+/* Print a capture file recorded with the servers' -w option */
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <capture-file>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    capture_reader_t reader;
+    if (capture_reader_open(&reader, argv[1]) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    time_t created = (time_t)(reader.header->created_ns / 1000000000LL);
+    printf("# %s: created %s", argv[1], ctime(&created));
+    printf("# %llu records, %llu data bytes in %llu blocks\n",
+           (unsigned long long)reader.header->record_count,
+           (unsigned long long)reader.header->data_bytes,
+           (unsigned long long)reader.block_count);
+
+    capture_iter_t it;
+    const capture_record_t *rec;
+    capture_iter_init(&it, &reader, 0, reader.block_count);
+
+    while ((rec = capture_next(&it)) != NULL) {
+        char ip[INET6_ADDRSTRLEN];
+        char preview[PREVIEW_LEN + 1];
+        size_t n = rec->cap_len < PREVIEW_LEN ? rec->cap_len : PREVIEW_LEN;
+        const uint8_t *payload = capture_payload(rec);
+
+        inet_ntop(rec->family == AF_INET6 ? AF_INET6 : AF_INET, rec->addr, ip, sizeof(ip));
+        for (size_t i = 0; i < n; i++) {
+            preview[i] = isprint(payload[i]) ? (char)payload[i] : '.';
+        }
+        preview[n] = '\0';
+
+        printf("%lld.%09lld %s %s:%u %5u %c %s\n",
+               (long long)(rec->ts_ns / 1000000000LL),
+               (long long)(rec->ts_ns % 1000000000LL),
+               rec->proto == IPPROTO_TCP ? "tcp" : "udp",
+               ip, rec->port, rec->cap_len,
+               (rec->flags & CAPTURE_F_KERNEL_TS) ? 'k' : 'u',
+               preview);
+    }
+
+    capture_reader_close(&reader);
+    return 0;
+}
@@ -0,0 +1,271 @@
+#include "capture.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "netaddr.h"
+
+static uint64_t align8(uint64_t v)
+{
+    return (v + 7u) & ~(uint64_t)7u;
+}
+
+/* Preallocate the next chunk and map it, pre-faulting all pages at once */
+static int map_chunk(capture_writer_t *w, uint64_t chunk_off)
+{
+    if (w->chunk != NULL) {
+        munmap(w->chunk, CAPTURE_CHUNK_SIZE);
+        w->chunk = NULL;
+    }
+
+    int err = posix_fallocate(w->fd, (off_t)chunk_off, CAPTURE_CHUNK_SIZE);
+    if (err != 0) {
+        fprintf(stderr, "capture: posix_fallocate: %s\n", strerror(err));
+        return -1;
+    }
+
+    void *map = mmap(NULL, CAPTURE_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, w->fd, (off_t)chunk_off);
+    if (map == MAP_FAILED) {
+        perror("capture: mmap");
+        return -1;
+    }
+
+    w->chunk     = map;
+    w->chunk_off = chunk_off;
+    return 0;
+}
+
+int capture_writer_open(capture_writer_t *w, const char *path)
+{
+    memset(w, 0, sizeof(*w));
+
+    w->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0) {
+        perror("capture: open");
+        return -1;
+    }
+
+    if (ftruncate(w->fd, CAPTURE_HEADER_SIZE) < 0) {
+        perror("capture: ftruncate");
+        close(w->fd);
+        return -1;
+    }
+
+    void *hdr = mmap(NULL, CAPTURE_HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, w->fd, 0);
+    if (hdr == MAP_FAILED) {
+        perror("capture: mmap");
+        close(w->fd);
+        return -1;
+    }
+    w->header = hdr;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    memcpy(w->header->magic, CAPTURE_MAGIC, sizeof(w->header->magic));
+    w->header->version      = CAPTURE_VERSION;
+    w->header->header_size  = CAPTURE_HEADER_SIZE;
+    w->header->block_size   = CAPTURE_BLOCK_SIZE;
+    w->header->created_ns   = (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+    w->header->data_bytes   = 0;
+    w->header->record_count = 0;
+
+    w->write_off = CAPTURE_HEADER_SIZE;
+    if (map_chunk(w, CAPTURE_HEADER_SIZE) < 0) {
+        munmap(w->header, CAPTURE_HEADER_SIZE);
+        close(w->fd);
+        return -1;
+    }
+    return 0;
+}
+
+int capture_write(capture_writer_t *w, int64_t ts_ns, uint16_t flags, uint8_t proto,
+                  const struct sockaddr *peer, const void *data, size_t len)
+{
+    if (len > CAPTURE_MAX_PAYLOAD) {
+        len = CAPTURE_MAX_PAYLOAD;
+    }
+
+    uint64_t rec_len  = align8(sizeof(capture_record_t) + len);
+    uint64_t in_block = (w->write_off - CAPTURE_HEADER_SIZE) % CAPTURE_BLOCK_SIZE;
+
+    /* Leave the tail of the block zero and start the next one */
+    if (in_block + rec_len > CAPTURE_BLOCK_SIZE) {
+        w->write_off += CAPTURE_BLOCK_SIZE - in_block;
+    }
+    if (w->write_off + rec_len > w->chunk_off + CAPTURE_CHUNK_SIZE) {
+        if (map_chunk(w, w->chunk_off + CAPTURE_CHUNK_SIZE) < 0) {
+            return -1;
+        }
+    }
+
+    capture_record_t *rec = (capture_record_t *)(w->chunk + (w->write_off - w->chunk_off));
+    memset(rec, 0, sizeof(*rec));
+    rec->cap_len = (uint32_t)len;
+    rec->ts_ns   = ts_ns;
+    rec->proto   = proto;
+    rec->flags   = flags;
+
+    struct in_addr v4;
+
+    /* IPv4 clients of a dual-stack server are recorded as IPv4 */
+    if (peer != NULL && netaddr_ipv4(peer, &v4)) {
+        rec->family = AF_INET;
+        rec->port   = netaddr_port(peer);
+        memcpy(rec->addr, &v4, 4);
+    } else if (peer != NULL && peer->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)peer;
+        rec->family = AF_INET6;
+        rec->port   = ntohs(in6->sin6_port);
+        memcpy(rec->addr, &in6->sin6_addr, 16);
+    }
+
+    memcpy(rec + 1, data, len);
+    rec->rec_len = (uint32_t)rec_len;
+
+    w->write_off += rec_len;
+    w->header->data_bytes = w->write_off - CAPTURE_HEADER_SIZE;
+    w->header->record_count++;
+    return 0;
+}
+
+void capture_writer_close(capture_writer_t *w)
+{
+    if (w->chunk != NULL) {
+        munmap(w->chunk, CAPTURE_CHUNK_SIZE);
+        w->chunk = NULL;
+    }
+
+    /* Drop the preallocated but unused tail */
+    if (ftruncate(w->fd, (off_t)w->write_off) < 0) {
+        perror("capture: ftruncate");
+    }
+
+    if (w->header != NULL) {
+        munmap(w->header, CAPTURE_HEADER_SIZE);
+        w->header = NULL;
+    }
+    close(w->fd);
+    w->fd = -1;
+}
+
+int capture_reader_open(capture_reader_t *r, const char *path)
+{
+    struct stat st;
+
+    memset(r, 0, sizeof(*r));
+
+    r->fd = open(path, O_RDONLY);
+    if (r->fd < 0) {
+        perror("capture: open");
+        return -1;
+    }
+    if (fstat(r->fd, &st) < 0 || (size_t)st.st_size < CAPTURE_HEADER_SIZE) {
+        fprintf(stderr, "capture: %s is not a capture file\n", path);
+        close(r->fd);
+        return -1;
+    }
+
+    r->size = (size_t)st.st_size;
+    void *map = mmap(NULL, r->size, PROT_READ, MAP_SHARED, r->fd, 0);
+    if (map == MAP_FAILED) {
+        perror("capture: mmap");
+        close(r->fd);
+        return -1;
+    }
+    r->base = map;
+    madvise(map, r->size, MADV_SEQUENTIAL);
+
+    r->header = (const capture_file_header_t *)r->base;
+    if (memcmp(r->header->magic, CAPTURE_MAGIC, sizeof(r->header->magic)) != 0 ||
+        r->header->version != CAPTURE_VERSION ||
+        r->header->header_size != CAPTURE_HEADER_SIZE ||
+        r->header->block_size != CAPTURE_BLOCK_SIZE) {
+        fprintf(stderr, "capture: %s has an unsupported format\n", path);
+        capture_reader_close(r);
+        return -1;
+    }
+
+    r->data_end = CAPTURE_HEADER_SIZE + r->header->data_bytes;
+    if (r->data_end > r->size) {
+        r->data_end = r->size;
+    }
+    r->block_count = (r->data_end - CAPTURE_HEADER_SIZE + CAPTURE_BLOCK_SIZE - 1) / CAPTURE_BLOCK_SIZE;
+    return 0;
+}
+
+void capture_reader_close(capture_reader_t *r)
+{
+    if (r->base != NULL) {
+        munmap((void *)r->base, r->size);
+        r->base = NULL;
+    }
+    if (r->fd >= 0) {
+        close(r->fd);
+        r->fd = -1;
+    }
+}
+
+void capture_iter_init(capture_iter_t *it, const capture_reader_t *r,
+                       uint64_t first_block, uint64_t last_block)
+{
+    it->reader = r;
+    it->off    = CAPTURE_HEADER_SIZE + first_block * CAPTURE_BLOCK_SIZE;
+    it->end    = CAPTURE_HEADER_SIZE + last_block * CAPTURE_BLOCK_SIZE;
+    if (it->end > r->data_end) {
+        it->end = r->data_end;
+    }
+}
+
+const capture_record_t *capture_next(capture_iter_t *it)
+{
+    while (it->off < it->end) {
+        uint64_t in_block  = (it->off - CAPTURE_HEADER_SIZE) % CAPTURE_BLOCK_SIZE;
+        uint64_t remaining = CAPTURE_BLOCK_SIZE - in_block;
+
+        if (remaining < sizeof(capture_record_t) || it->off + sizeof(capture_record_t) > it->end) {
+            it->off += remaining;
+            continue;
+        }
+
+        const capture_record_t *rec = (const capture_record_t *)(it->reader->base + it->off);
+        if (rec->rec_len < sizeof(capture_record_t) || rec->rec_len > remaining ||
+            it->off + rec->rec_len > it->end ||
+            rec->cap_len > rec->rec_len - sizeof(capture_record_t)) {
+            /* End of block (zero fill) or a torn record: skip to the next block */
+            it->off += remaining;
+            continue;
+        }
+
+        it->off += rec->rec_len;
+        return rec;
+    }
+    return NULL;
+}
+
+socklen_t capture_peer(const capture_record_t *rec, struct sockaddr_storage *out)
+{
+    memset(out, 0, sizeof(*out));
+
+    if (rec->family == AF_INET6) {
+        struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)out;
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port   = htons(rec->port);
+        memcpy(&in6->sin6_addr, rec->addr, 16);
+        return sizeof(*in6);
+    }
+
+    struct sockaddr_in *in = (struct sockaddr_in *)out;
+    in->sin_family = AF_INET;
+    in->sin_port   = htons(rec->port);
+    memcpy(&in->sin_addr, rec->addr, 4);
+    return sizeof(*in);
+}
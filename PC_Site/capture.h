@@ -0,0 +1,114 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+/*
+ * Append-only capture file for board traffic.
+ *
+ * Layout:
+ *
+ *   [file header, CAPTURE_HEADER_SIZE bytes]
+ *   [block 0][block 1]...          each CAPTURE_BLOCK_SIZE bytes
+ *
+ * A block holds back-to-back records (capture_record_t followed by the
+ * payload, padded to 8 bytes). Records never straddle a block: the rest
+ * of a block that cannot fit the next record stays zero, and rec_len == 0
+ * means "continue at the next block". Blocks can therefore be processed
+ * independently, e.g. by several threads.
+ *
+ * The writer preallocates and maps the file in CAPTURE_CHUNK_SIZE pieces,
+ * so recording a frame is a memcpy into the mapping. There is one mmap
+ * per chunk, not one syscall per packet. The header counters are updated
+ * in place after every record, so a crashed recorder still leaves a
+ * readable file.
+ *
+ * All fields are little-endian (host order on every platform we record on).
+ */
+
+#define CAPTURE_MAGIC        "IRISCAP1"
+#define CAPTURE_VERSION      1
+#define CAPTURE_HEADER_SIZE  4096u
+#define CAPTURE_BLOCK_SIZE   (1u << 20)
+#define CAPTURE_CHUNK_SIZE   (64u * CAPTURE_BLOCK_SIZE)
+
+/* capture_record_t.flags */
+#define CAPTURE_F_KERNEL_TS  0x0001  /* ts_ns is a SO_TIMESTAMPING kernel stamp */
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t block_size;
+    uint32_t reserved;
+    int64_t  created_ns;
+    uint64_t data_bytes;     /* bytes used after the header */
+    uint64_t record_count;
+} capture_file_header_t;
+
+typedef struct {
+    uint32_t rec_len;        /* header + payload + padding, 0 = end of block */
+    uint32_t cap_len;        /* payload bytes */
+    int64_t  ts_ns;          /* receive time, CLOCK_REALTIME */
+    uint8_t  addr[16];       /* peer address, IPv4 uses the first 4 bytes */
+    uint16_t port;           /* peer port */
+    uint8_t  family;         /* AF_INET or AF_INET6 */
+    uint8_t  proto;          /* IPPROTO_UDP or IPPROTO_TCP */
+    uint16_t flags;
+    uint16_t reserved;
+} capture_record_t;
+
+_Static_assert(sizeof(capture_record_t) == 40, "capture record header must stay 40 bytes");
+_Static_assert(sizeof(capture_file_header_t) <= CAPTURE_HEADER_SIZE, "capture header too large");
+
+#define CAPTURE_MAX_PAYLOAD  (CAPTURE_BLOCK_SIZE - sizeof(capture_record_t))
+
+typedef struct {
+    int                     fd;
+    capture_file_header_t  *header;     /* mapped first page */
+    uint8_t                *chunk;      /* mapped current chunk */
+    uint64_t                chunk_off;  /* file offset of the chunk */
+    uint64_t                write_off;  /* file offset of the next record */
+} capture_writer_t;
+
+typedef struct {
+    int                          fd;
+    const uint8_t               *base;
+    size_t                       size;
+    const capture_file_header_t *header;
+    uint64_t                     data_end;
+    uint64_t                     block_count;
+} capture_reader_t;
+
+/* Iterates the records of blocks [first, last) */
+typedef struct {
+    const capture_reader_t *reader;
+    uint64_t                off;
+    uint64_t                end;
+} capture_iter_t;
+
+int  capture_writer_open(capture_writer_t *w, const char *path);
+int  capture_write(capture_writer_t *w, int64_t ts_ns, uint16_t flags, uint8_t proto,
+                   const struct sockaddr *peer, const void *data, size_t len);
+void capture_writer_close(capture_writer_t *w);
+
+int  capture_reader_open(capture_reader_t *r, const char *path);
+void capture_reader_close(capture_reader_t *r);
+
+void capture_iter_init(capture_iter_t *it, const capture_reader_t *r,
+                       uint64_t first_block, uint64_t last_block);
+
+/* Returns the next record or NULL at the end; payload follows the header */
+const capture_record_t *capture_next(capture_iter_t *it);
+
+static inline const uint8_t *capture_payload(const capture_record_t *rec)
+{
+    return (const uint8_t *)(rec + 1);
+}
+
+/* Rebuild a sockaddr for the record's peer, returns its length */
+socklen_t capture_peer(const capture_record_t *rec, struct sockaddr_storage *out);
+
+#endif /* CAPTURE_H */
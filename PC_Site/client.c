@@ -4,6 +4,8 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 
+#include "netaddr.h"
+
 #define PORT        8080
 #define BUFFER_SIZE 1024
 
@@ -15,29 +17,24 @@ int main(int argc, char *argv[])
     }
     const char *server_ip = argv[1];
     int sock_fd;
-    struct sockaddr_in server_addr;
+    struct sockaddr_storage server_addr;
+    socklen_t addr_len;
     char buffer[BUFFER_SIZE];
 
-    /* Create TCP socket */
-    sock_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock_fd < 0) {
-        perror("socket");
+    /* Build server address, IPv4 or IPv6 */
+    if (netaddr_resolve(server_ip, PORT, SOCK_STREAM, &server_addr, &addr_len) < 0) {
         exit(EXIT_FAILURE);
     }
 
-    /* Build server address */
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port   = htons(PORT);
-
-    if (inet_pton(AF_INET, server_ip, &server_addr.sin_addr) <= 0) {
-        perror("inet_pton");
-        close(sock_fd);
+    /* Create socket of the server's family */
+    sock_fd = socket(server_addr.ss_family, SOCK_STREAM, 0);
+    if (sock_fd < 0) {
+        perror("socket");
         exit(EXIT_FAILURE);
     }
 
     /* Connect to server */
-    if (connect(sock_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+    if (connect(sock_fd, (struct sockaddr *)&server_addr, addr_len) < 0) {
         perror("connect");
         close(sock_fd);
         exit(EXIT_FAILURE);
@@ -0,0 +1,236 @@
+#include "codec.h"
+
+#include <string.h>
+
+/* Must match modules/comm_engine/comm_codec.c byte for byte */
+static const char dictionary[] =
+    "Hello, Server!How are you?Socket demo working.Goodbye!"
+    "{\"seq\":,\"uptime_ms\":,\"rssi\":,\"rtt_us\":,\"state\":\"EXCHANGING\"}"
+    "WIFI_CONNECTING WAITING_FOR_IP ESTABLISHING_LINK RECONNECTING ";
+
+#define DICT_LEN  (sizeof(dictionary) - 1)
+#define MIN_MATCH 4
+
+int codec_is_frame(const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+
+    return len >= CODEC_HEADER && (p[0] & ~CODEC_MASK) == CODEC_MAGIC && (p[0] & CODEC_MASK) < CODEC_COUNT;
+}
+
+size_t codec_next_message(const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    size_t n = 0;
+
+    if (len > 0 && p[0] >= CODEC_MAGIC) {
+        return len >= CODEC_HEADER ? CODEC_HEADER + (p[1] | (size_t)p[2] << 8) : 0;
+    }
+    while (n < len && p[n] < CODEC_MAGIC) {
+        n++;
+    }
+    return n;
+}
+
+/* LZ4 length continuation: 255 means another byte follows */
+static int read_length(const uint8_t **ip, const uint8_t *iend, size_t *len)
+{
+    uint8_t b;
+
+    do {
+        if (*ip >= iend) {
+            return -1;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+static int lz_decode(const uint8_t *ip, const uint8_t *iend, uint8_t *out, size_t cap, size_t *decoded)
+{
+    uint8_t *op = out;
+    uint8_t *oend = out + cap;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t lit_len = token >> 4;
+
+        if (lit_len == 15 && read_length(&ip, iend, &lit_len) < 0) {
+            return -1;
+        }
+        if (lit_len > (size_t)(iend - ip) || lit_len > (size_t)(oend - op)) {
+            return -1;
+        }
+        memcpy(op, ip, lit_len);
+        op += lit_len;
+        ip += lit_len;
+        if (ip == iend) {
+            break;      /* the last sequence has no match */
+        }
+
+        if (iend - ip < 2) {
+            return -1;
+        }
+        size_t offset = ip[0] | (size_t)ip[1] << 8;
+        size_t match_len = token & 0x0F;
+        ip += 2;
+        if (match_len == 15 && read_length(&ip, iend, &match_len) < 0) {
+            return -1;
+        }
+        match_len += MIN_MATCH;
+
+        size_t produced = (size_t)(op - out);
+        if (offset == 0 || offset > produced + DICT_LEN || match_len > (size_t)(oend - op)) {
+            return -1;
+        }
+        /* Byte by byte: a match may overlap its own output, or start in
+         * the dictionary and continue into the output */
+        for (size_t i = 0; i < match_len; i++, op++) {
+            size_t pos = (size_t)(op - out);
+            *op = pos >= offset ? op[-(ptrdiff_t)offset] : (uint8_t)dictionary[DICT_LEN - (offset - pos)];
+        }
+    }
+    *decoded = (size_t)(op - out);
+    return 0;
+}
+
+static int delta_decode(const uint8_t *ip, const uint8_t *iend, int32_t *out, size_t cap,
+                        unsigned *channels, size_t *count)
+{
+    uint32_t prev[CODEC_MAX_CHANNELS] = { 0 };
+
+    if (ip >= iend || *ip == 0 || *ip > CODEC_MAX_CHANNELS) {
+        return -1;
+    }
+    *channels = *ip++;
+
+    size_t i = 0;
+    for (size_t ch = 0; ip < iend; i++) {
+        uint32_t zz = 0;
+        unsigned shift = 0;
+        uint8_t b;
+
+        if (i == cap) {
+            return -1;
+        }
+        do {
+            if (ip >= iend || shift > 28) {
+                return -1;
+            }
+            b = *ip++;
+            zz |= (uint32_t)(b & 0x7F) << shift;
+            shift += 7;
+        } while (b & 0x80);
+
+        prev[ch] += (zz >> 1) ^ (0U - (zz & 1));
+        out[i] = (int32_t)prev[ch];
+        if (++ch == *channels) {
+            ch = 0;
+        }
+    }
+    *count = i;
+    return 0;
+}
+
+int codec_decode(const void *buf, size_t len, void *out, size_t cap, codec_frame_t *info)
+{
+    const uint8_t *p = buf;
+
+    if (!codec_is_frame(buf, len)) {
+        return -1;
+    }
+
+    codec_t codec = (codec_t)(p[0] & CODEC_MASK);
+    size_t payload = p[1] | (size_t)p[2] << 8;
+    const uint8_t *ip = p + CODEC_HEADER;
+    const uint8_t *iend = p + len;
+    size_t samples;
+
+    if (len != CODEC_HEADER + payload) {
+        return -1;
+    }
+
+    info->codec = codec;
+    info->channels = 0;
+    info->wire_len = len;
+
+    switch (codec) {
+    case CODEC_NONE:
+        if (payload > cap) {
+            return -1;
+        }
+        memcpy(out, ip, payload);
+        info->decoded_len = payload;
+        return 0;
+    case CODEC_LZ:
+        return lz_decode(ip, iend, out, cap, &info->decoded_len);
+    case CODEC_DELTA:
+        if (delta_decode(ip, iend, out, cap / sizeof(int32_t), &info->channels, &samples) < 0) {
+            return -1;
+        }
+        info->decoded_len = samples * sizeof(int32_t);
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+int codec_render(codec_stats_t *st, const void *buf, size_t len, char *text, size_t cap)
+{
+    static int32_t decoded[CODEC_MAX_DECODED / sizeof(int32_t) + 1];
+    codec_frame_t info;
+
+    if (cap == 0) {
+        return -1;
+    }
+    if (!codec_is_frame(buf, len)) {
+        len = len < cap - 1 ? len : cap - 1;
+        memcpy(text, buf, len);
+        text[len] = '\0';
+        return (int)len;
+    }
+    if (codec_decode(buf, len, decoded, sizeof(decoded), &info) < 0) {
+        st->corrupt++;
+        return -1;
+    }
+    st->frames[info.codec]++;
+    st->wire_bytes[info.codec] += info.wire_len;
+    st->decoded_bytes[info.codec] += info.decoded_len;
+
+    size_t n;
+    if (info.codec == CODEC_DELTA) {
+        n = (size_t)snprintf(text, cap, "[delta/%u]", info.channels);
+        for (size_t i = 0; i < info.decoded_len / sizeof(int32_t) && n < cap; i++) {
+            n += (size_t)snprintf(text + n, cap - n, " %d", decoded[i]);
+        }
+    } else {
+        n = info.decoded_len < cap - 1 ? info.decoded_len : cap - 1;
+        memcpy(text, decoded, n);
+        text[n] = '\0';
+    }
+    return (int)(n < cap ? n : cap - 1);
+}
+
+void codec_print_stats(FILE *f, const char *prefix, const codec_stats_t *st)
+{
+    for (int c = 0; c < CODEC_COUNT; c++) {
+        if (st->frames[c] == 0) {
+            continue;
+        }
+        fprintf(f, "%s Codec %-5s: %llu frames, %llu bytes on the wire for %llu decoded (%.0f%%)\n", prefix,
+                codec_name((codec_t)c), (unsigned long long)st->frames[c], (unsigned long long)st->wire_bytes[c],
+                (unsigned long long)st->decoded_bytes[c],
+                st->decoded_bytes[c] > 0 ? 100.0 * (double)st->wire_bytes[c] / (double)st->decoded_bytes[c] : 0.0);
+    }
+    if (st->corrupt > 0) {
+        fprintf(f, "%s Codec: %llu corrupt frames\n", prefix, (unsigned long long)st->corrupt);
+    }
+}
+
+const char *codec_name(codec_t codec)
+{
+    static const char *const names[CODEC_COUNT] = { "none", "lz", "delta" };
+
+    return codec < CODEC_COUNT ? names[codec] : "?";
+}
@@ -0,0 +1,79 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Decoders for the board's compression stage (CONFIG_COMM_ENGINE_COMPRESS,
+ * modules/comm_engine/comm_codec.c).
+ *
+ * A frame starts with CODEC_MAGIC | codec and the length of the payload
+ * that follows the header as 16 bit little endian, so a frame can be cut
+ * out of a TCP stream before it is decoded. 0xF8-0xFF never occur in
+ * UTF-8, so the servers can tell frames from the text messages of boards
+ * without compression, "°" and "£" included.
+ *
+ *   CODEC_NONE   payload stored as is
+ *   CODEC_LZ     LZ4 block format; matches may reach back into a built-in
+ *                dictionary that precedes the output
+ *   CODEC_DELTA  one byte channel count, then one zigzag varint per int32
+ *                sample: the difference to the previous sample of the same
+ *                channel (the first one to 0)
+ */
+
+#define CODEC_MAGIC        0xF8
+#define CODEC_MASK         0x07    /* codec bits of the first byte */
+#define CODEC_HEADER       3
+#define CODEC_MAX_DECODED  UINT16_MAX
+#define CODEC_MAX_FRAME    (CODEC_HEADER + UINT16_MAX)
+#define CODEC_MAX_CHANNELS 16
+
+typedef enum {
+    CODEC_NONE,
+    CODEC_LZ,
+    CODEC_DELTA,
+    CODEC_COUNT,
+} codec_t;
+
+typedef struct {
+    codec_t  codec;
+    unsigned channels;          /* CODEC_DELTA only */
+    size_t   wire_len;          /* frame size including the header */
+    size_t   decoded_len;       /* bytes written to out */
+} codec_frame_t;
+
+/* What the compression saved, per codec */
+typedef struct {
+    uint64_t frames[CODEC_COUNT];
+    uint64_t wire_bytes[CODEC_COUNT];
+    uint64_t decoded_bytes[CODEC_COUNT];
+    uint64_t corrupt;
+} codec_stats_t;
+
+/* 1 when buf starts with a frame header */
+int codec_is_frame(const void *buf, size_t len);
+
+/* For byte streams: the size of the message at the start of buf, a frame
+ * including its header, text up to the next frame or the end of buf. The
+ * message is complete when the result is <= len. Returns 0 while a frame
+ * header is still incomplete. */
+size_t codec_next_message(const void *buf, size_t len);
+
+/* Decode the frame in buf into out. CODEC_DELTA writes int32 samples.
+ * Returns -1 for a corrupt frame or when out is too small. */
+int codec_decode(const void *buf, size_t len, void *out, size_t cap, codec_frame_t *info);
+
+/* For the servers' message log: decode a frame into NUL-terminated text
+ * (samples as "[delta/<channels>] v0 v1 ..."), or copy buf unchanged when
+ * it is no frame. buf holds exactly one message. Returns the text length,
+ * -1 for a corrupt frame. */
+int codec_render(codec_stats_t *st, const void *buf, size_t len, char *text, size_t cap);
+
+/* One line per codec that was seen, nothing when no frame arrived */
+void codec_print_stats(FILE *f, const char *prefix, const codec_stats_t *st);
+
+const char *codec_name(codec_t codec);
+
+#endif /* CODEC_H */
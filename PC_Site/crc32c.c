@@ -0,0 +1,197 @@
+#include "crc32c.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#define HAVE_X86 1
+#endif
+
+#define POLY        0x82F63B78u         /* reflected Castagnoli polynomial */
+#define LANE_LONG   4096                /* bytes per stream, three streams */
+#define LANE_SHORT  256
+
+static uint32_t table[8][256];
+static crc32c_impl_t impls[4];
+static size_t impl_count;
+static const crc32c_impl_t *best;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+/* ---- tables ---- */
+
+static uint32_t crc_bytes(uint32_t crc, const uint8_t *p, size_t len)
+{
+    while (len-- > 0) {
+        crc = table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static uint32_t slice1(uint32_t crc, const void *buf, size_t len)
+{
+    return ~crc_bytes(~crc, buf, len);
+}
+
+static uint32_t slice8(uint32_t crc, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+
+    crc = ~crc;
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF] ^
+              table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24] ^
+              table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF] ^
+              table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    return ~crc_bytes(crc, p, len);
+}
+
+/* ---- x86 ---- */
+
+#ifdef HAVE_X86
+static uint64_t k_long, k_short;
+
+/* x^n mod P, reflected */
+static uint32_t xpow(uint32_t n)
+{
+    uint32_t p = 0x80000000u;
+
+    while (n-- > 0) {
+        p = (p & 1) ? (p >> 1) ^ POLY : p >> 1;
+    }
+    return p;
+}
+
+static uint64_t load64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t hw_bytes(uint32_t crc, const uint8_t *p, size_t len)
+{
+    while (len >= 8) {
+        crc = (uint32_t)_mm_crc32_u64(crc, load64(p));
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t sse42(uint32_t crc, const void *buf, size_t len)
+{
+    return ~hw_bytes(~crc, buf, len);
+}
+
+/* crc * x^(8 lane) mod P: the product with k = x^(8 lane - 33) is reduced
+ * by the crc32 instruction, which multiplies by x^32 on the way */
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t shift(uint32_t crc, uint64_t k)
+{
+    __m128i prod = _mm_clmulepi64_si128(_mm_cvtsi32_si128((int)crc), _mm_cvtsi64_si128((long long)k), 0);
+
+    return (uint32_t)_mm_crc32_u64(0, (uint64_t)_mm_cvtsi128_si64(prod));
+}
+
+/* The crc32 instruction has a latency of 3 cycles but can start one per
+ * cycle: three independent streams keep it busy */
+#define THREE_WAY(lane, k)                                                     \
+    while (len >= 3 * (lane)) {                                                \
+        uint64_t a = crc, b = 0, c = 0;                                        \
+        for (size_t i = 0; i < (lane); i += 8) {                               \
+            a = _mm_crc32_u64(a, load64(p + i));                               \
+            b = _mm_crc32_u64(b, load64(p + (lane) + i));                      \
+            c = _mm_crc32_u64(c, load64(p + 2 * (lane) + i));                  \
+        }                                                                      \
+        crc = shift((uint32_t)a, k) ^ (uint32_t)b;                             \
+        crc = shift(crc, k) ^ (uint32_t)c;                                     \
+        p += 3 * (lane);                                                       \
+        len -= 3 * (lane);                                                     \
+    }
+
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t sse42_pclmul(uint32_t crc, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+
+    crc = ~crc;
+    THREE_WAY(LANE_LONG, k_long)
+    THREE_WAY(LANE_SHORT, k_short)
+    return ~hw_bytes(crc, p, len);
+}
+#endif
+
+/* ---- dispatch ---- */
+
+/* Run once through pthread_once(), which also publishes the tables to
+ * every thread that calls it afterwards */
+static void init_once(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (c >> 1) ^ POLY : c >> 1;
+        }
+        table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+        }
+    }
+
+    size_t n = 0;
+    impls[n++] = (crc32c_impl_t){ "slice1", slice1 };
+    impls[n++] = (crc32c_impl_t){ "slice8", slice8 };
+#ifdef HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        impls[n++] = (crc32c_impl_t){ "sse4.2", sse42 };
+        if (__builtin_cpu_supports("pclmul")) {
+            k_long = xpow(8 * LANE_LONG - 33);
+            k_short = xpow(8 * LANE_SHORT - 33);
+            impls[n++] = (crc32c_impl_t){ "sse4.2+pclmul", sse42_pclmul };
+        }
+    }
+#endif
+    impl_count = n;
+    best = &impls[n - 1];
+}
+
+static void init(void)
+{
+    pthread_once(&once, init_once);
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+    init();
+    return best->fn(crc, buf, len);
+}
+
+const char *crc32c_name(void)
+{
+    init();
+    return best->name;
+}
+
+size_t crc32c_impls(const crc32c_impl_t **list)
+{
+    init();
+    *list = impls;
+    return impl_count;
+}
@@ -0,0 +1,37 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * CRC32C (Castagnoli, as in iSCSI, ext4 and SCTP), the checksum of the
+ * board's bulk transfers. crc32c() uses the fastest implementation the
+ * CPU supports, chosen on first use:
+ *
+ *   sse4.2+pclmul  crc32 instruction on three streams at once, combined
+ *                  with a carry-less multiply
+ *   sse4.2         crc32 instruction, 8 bytes at a time
+ *   slice8         slicing-by-8 tables, on any CPU
+ *
+ * Like zlib's crc32(): start with 0 and feed the result back in to
+ * continue over more data.
+ */
+
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const void *buf, size_t len);
+
+typedef struct {
+    const char *name;
+    crc32c_fn   fn;
+} crc32c_impl_t;
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+/* Name of the implementation crc32c() uses */
+const char *crc32c_name(void);
+
+/* All implementations this CPU can run, slowest first, for benchmarks.
+ * The first one, slice1, is the byte-at-a-time reference. */
+size_t crc32c_impls(const crc32c_impl_t **impls);
+
+#endif /* CRC32C_H */
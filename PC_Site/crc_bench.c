@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "crc32c.h"
+
+#define MAX_SIZE        65536
+#define DEFAULT_MIB     64      /* data checksummed per size and implementation */
+#define CHECK_ROUNDS    2000
+
+/*
+ * Checks every CRC32C implementation the CPU can run against the bytewise
+ * reference (random lengths, misaligned starts, split buffers), then
+ * measures each one on payloads from 16 B to 64 KiB.
+ */
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-m <MiB>]\n"
+            "  -m <MiB>  data to checksum per size and implementation (default %d)\n",
+            prog, DEFAULT_MIB);
+}
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int self_test(const crc32c_impl_t *impls, size_t count, const uint8_t *buf)
+{
+    int errors = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        /* RFC 3720 B.4 check value */
+        if (impls[i].fn(0, "123456789", 9) != 0xE3069283u) {
+            fprintf(stderr, "[Crc] %s: wrong check value\n", impls[i].name);
+            errors++;
+        }
+    }
+    for (int r = 0; r < CHECK_ROUNDS; r++) {
+        size_t off = (size_t)rand() % 8;
+        size_t len = (size_t)rand() % (MAX_SIZE - 8 + 1);
+        size_t split = len > 0 ? (size_t)rand() % len : 0;
+        uint32_t ref = impls[0].fn(0, buf + off, len);
+
+        for (size_t i = 1; i < count; i++) {
+            uint32_t crc = impls[i].fn(0, buf + off, split);
+            crc = impls[i].fn(crc, buf + off + split, len - split);
+            if (crc != ref) {
+                fprintf(stderr, "[Crc] %s: mismatch at offset %zu, %zu bytes, split %zu\n",
+                        impls[i].name, off, len, split);
+                errors++;
+            }
+        }
+    }
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    static uint8_t buf[MAX_SIZE + 8];
+    const crc32c_impl_t *impls;
+    long mib = DEFAULT_MIB;
+    int c;
+
+    while ((c = getopt(argc, argv, "m:h")) != -1) {
+        switch (c) {
+        case 'm': mib = strtol(optarg, NULL, 10); break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (mib <= 0 || optind != argc) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    srand(1);
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = (uint8_t)rand();
+    }
+    size_t count = crc32c_impls(&impls);
+    if (self_test(impls, count, buf) != 0) {
+        return EXIT_FAILURE;
+    }
+    printf("[Crc] %zu implementations agree, crc32c() uses %s\n\n", count, crc32c_name());
+
+    printf("%8s", "bytes");
+    for (size_t i = 0; i < count; i++) {
+        printf("  %25s", impls[i].name);
+    }
+    printf("\n");
+
+    volatile uint32_t sink = 0;
+    for (size_t size = 16; size <= MAX_SIZE; size *= 4) {
+        long rounds = (long)(((uint64_t)mib << 20) / size);
+
+        printf("%8zu", size);
+        for (size_t i = 0; i < count; i++) {
+            uint32_t crc = 0;
+            int64_t t0 = now_ns();
+            for (long r = 0; r < rounds; r++) {
+                crc = impls[i].fn(crc, buf, size);
+            }
+            int64_t ns = now_ns() - t0;
+            sink ^= crc;
+            printf("  %9.1f ns %7.2f GB/s", (double)ns / (double)rounds,
+                   (double)size * (double)rounds / (double)ns);
+        }
+        printf("\n");
+    }
+    (void)sink;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,113 @@
+#include "discovery.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "netaddr.h"
+
+#define DISCOVERY_MSG_MAX 128
+
+static void *responder_thread(void *arg)
+{
+    discovery_t *d = arg;
+    char msg[DISCOVERY_MSG_MAX];
+    char reply[DISCOVERY_MSG_MAX];
+
+    while (!atomic_load(&d->stop)) {
+        struct sockaddr_storage peer;
+        socklen_t peer_len = sizeof(peer);
+        ssize_t n = recvfrom(d->fd, msg, sizeof(msg) - 1, 0, (struct sockaddr *)&peer, &peer_len);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("discovery: recvfrom");
+            }
+            continue;
+        }
+        msg[n] = '\0';
+
+        int len = -1;
+        if (strncmp(msg, "PING ", 5) == 0) {
+            /* Echo the token right away, this is what the board times */
+            memcpy(msg, "PONG", 4);
+            if (sendto(d->fd, msg, (size_t)n, 0, (struct sockaddr *)&peer, peer_len) < 0) {
+                perror("discovery: sendto");
+            }
+            atomic_fetch_add(&d->pings, 1);
+            continue;
+        }
+
+        char service[32];
+        unsigned long nonce;
+        if (sscanf(msg, "DISCOVER %31s %lu", service, &nonce) == 2 &&
+            (strcmp(service, d->service) == 0 || strcmp(service, "*") == 0)) {
+            len = snprintf(reply, sizeof(reply), "OFFER %s %u %lu", d->service, d->port, nonce);
+        }
+        if (len < 0) {
+            continue;
+        }
+
+        if (sendto(d->fd, reply, (size_t)len, 0, (struct sockaddr *)&peer, peer_len) < 0) {
+            perror("discovery: sendto");
+            continue;
+        }
+        atomic_fetch_add(&d->offers, 1);
+
+        char ip[NETADDR_STRLEN];
+        printf("[Discovery] Offered %s on port %u to %s\n", d->service, d->port,
+               netaddr_str((struct sockaddr *)&peer, ip, sizeof(ip)));
+    }
+    return NULL;
+}
+
+int discovery_start(discovery_t *d, const char *service, uint16_t port)
+{
+    int one = 1;
+
+    memset(d, 0, sizeof(*d));
+    d->service = service;
+    d->port    = port;
+
+    /* Both servers may run on one PC, broadcasts (and queries to ff02::1)
+     * reach every socket on the port thanks to SO_REUSEADDR */
+    d->fd = netaddr_server_socket(SOCK_DGRAM, DISCOVERY_PORT);
+    if (d->fd < 0) {
+        fprintf(stderr, "discovery: no responder\n");
+        return -1;
+    }
+    setsockopt(d->fd, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+
+    /* Wake up regularly to notice discovery_stop() */
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 200000 };
+    setsockopt(d->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    /* Signals are for the server's main loop */
+    sigset_t block, old;
+    sigfillset(&block);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    int err = pthread_create(&d->thread, NULL, responder_thread, d);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) {
+        fprintf(stderr, "discovery: pthread_create: %s\n", strerror(err));
+        close(d->fd);
+        return -1;
+    }
+
+    printf("[Discovery] Answering for %s on UDP port %d\n", service, DISCOVERY_PORT);
+    return 0;
+}
+
+void discovery_stop(discovery_t *d)
+{
+    atomic_store(&d->stop, 1);
+    pthread_join(d->thread, NULL);
+    close(d->fd);
+    printf("[Discovery] %llu offers, %llu pings answered\n",
+           (unsigned long long)atomic_load(&d->offers),
+           (unsigned long long)atomic_load(&d->pings));
+}
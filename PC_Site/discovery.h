@@ -0,0 +1,38 @@
+#ifndef DISCOVERY_H
+#define DISCOVERY_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * Answers the boards' server discovery (see modules/comm_engine).
+ *
+ * A board broadcasts "DISCOVER <service> <nonce>" to DISCOVERY_PORT, or
+ * sends it to ff02::1 while it only has an IPv6 link-local address. Every
+ * server offering that service answers "OFFER <service> <port> <nonce>"
+ * from the address the board should connect to. The board then sends
+ * "PING <token>" to each candidate, gets "PONG <token>" back and connects
+ * to the one with the lowest RTT.
+ *
+ * The responder runs on its own thread, so a busy server still answers
+ * with its real network latency rather than its queueing delay.
+ */
+
+#define DISCOVERY_PORT 8081
+
+typedef struct {
+    int              fd;
+    const char      *service;
+    uint16_t         port;
+    pthread_t        thread;
+    _Atomic int      stop;
+    _Atomic uint64_t offers;
+    _Atomic uint64_t pings;
+} discovery_t;
+
+/* Bind DISCOVERY_PORT and start answering for service, reachable on port */
+int  discovery_start(discovery_t *d, const char *service, uint16_t port);
+void discovery_stop(discovery_t *d);
+
+#endif /* DISCOVERY_H */
@@ -0,0 +1,66 @@
+#include "histogram.h"
+
+#include <string.h>
+
+void hist_init(histogram_t *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+void hist_record(histogram_t *h, int64_t value_ns)
+{
+    uint64_t v = value_ns < 0 ? 0 : (uint64_t)value_ns;
+
+    h->bucket[hist_bucket_index(v)]++;
+    h->count++;
+    h->sum_ns += (double)v;
+    if (v > h->max_ns) {
+        h->max_ns = v;
+    }
+}
+
+void hist_merge(histogram_t *dst, const histogram_t *src)
+{
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+        dst->bucket[i] += src->bucket[i];
+    }
+    dst->count  += src->count;
+    dst->sum_ns += src->sum_ns;
+    if (src->max_ns > dst->max_ns) {
+        dst->max_ns = src->max_ns;
+    }
+}
+
+/* Midpoint of a bucket, i.e. the inverse of hist_bucket_index() */
+static uint64_t bucket_value(unsigned idx)
+{
+    if (idx < HIST_SUB_COUNT) {
+        return idx;
+    }
+    unsigned shift = (idx - HIST_SUB_COUNT) / HIST_SUB_COUNT;
+    uint64_t sub   = (idx - HIST_SUB_COUNT) % HIST_SUB_COUNT;
+    uint64_t low   = (HIST_SUB_COUNT + sub) << shift;
+    return low + ((1ULL << shift) >> 1);
+}
+
+uint64_t hist_percentile(const histogram_t *h, double q)
+{
+    if (h->count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(q * (double)h->count);
+    if (rank >= h->count) {
+        rank = h->count - 1;
+    }
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->bucket[i];
+        if (seen > rank) {
+            uint64_t v = bucket_value(i);
+            return v > h->max_ns ? h->max_ns : v;
+        }
+    }
+    return h->max_ns;
+}
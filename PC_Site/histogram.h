@@ -0,0 +1,46 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+/*
+ * Log-linear latency histogram (values in ns).
+ *
+ * Values below 32 ns get their own bucket, above that every power of two is
+ * split into 32 sub-buckets, so percentiles are accurate to ~3% without
+ * storing individual samples. Recording is a couple of shifts and an add.
+ */
+
+#define HIST_SUB_BITS    5
+#define HIST_SUB_COUNT   (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP     40  /* ~18 minutes, larger values are clamped */
+#define HIST_BUCKETS     (HIST_SUB_COUNT + (HIST_MAX_EXP - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+typedef struct {
+    uint64_t count;
+    uint64_t max_ns;
+    double   sum_ns;
+    uint64_t bucket[HIST_BUCKETS];
+} histogram_t;
+
+void hist_init(histogram_t *h);
+void hist_record(histogram_t *h, int64_t value_ns);
+void hist_merge(histogram_t *dst, const histogram_t *src);
+
+/* Value at quantile q (0.0 .. 1.0), 0 if the histogram is empty */
+uint64_t hist_percentile(const histogram_t *h, double q);
+
+static inline unsigned hist_bucket_index(uint64_t v)
+{
+    if (v < HIST_SUB_COUNT) {
+        return (unsigned)v;
+    }
+    unsigned exp = 63u - (unsigned)__builtin_clzll(v);
+    if (exp > HIST_MAX_EXP) {
+        return HIST_BUCKETS - 1;
+    }
+    unsigned shift = exp - HIST_SUB_BITS;
+    return HIST_SUB_COUNT + shift * HIST_SUB_COUNT + (unsigned)((v >> shift) & (HIST_SUB_COUNT - 1));
+}
+
+#endif /* HISTOGRAM_H */
@@ -0,0 +1,504 @@
+#include "impair.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Profile format, one setting per line or separated by ';' ('#' starts a
+ * comment):
+ *
+ *   seed 42                      random seed, the same seed replays the
+ *                                same losses for the same traffic
+ *   delay 5                      settings before the first phase are
+ *   phase good 30s               where the first phase starts from
+ *     jitter 2 normal
+ *   phase fade 10s               every phase starts from the settings of
+ *     delay 40                   the phase before it
+ *     loss_ge 2 25 80
+ *     down.rate 2000
+ *   phase recover 5s
+ *     clear
+ *   loop                         after the last phase start over, else
+ *                                the last phase stays
+ *
+ * Settings apply to both directions, or to one with an up. (client to
+ * server) or down. prefix:
+ *
+ *   delay <ms>
+ *   jitter <ms> [uniform|normal]   uniform +-ms (default), or normal with
+ *                                  ms as standard deviation
+ *   loss <%>
+ *   loss_ge <p%> <r%> [<bad%> [<good%>]]
+ *                                  Gilbert-Elliott: p = good to bad,
+ *                                  r = bad to good, loss in the bad state
+ *                                  (default 100) and good state (default
+ *                                  0); loss_ge 0 turns it off
+ *   reorder <%>
+ *   duplicate <%>
+ *   rate <kbit/s>                  0 = unlimited
+ *   limit <packets>                in flight per direction, held for
+ *                                  the delay or queued for the rate
+ *                                  (default 50000: 100k pps x 0.5 s);
+ *                                  TCP: per connection, reading pauses
+ *                                  instead
+ *   rto <ms>                       TCP: stall per lost segment
+ *   clear                          back to no impairment
+ *
+ * Durations take ms, s or m; a bare number is seconds. A phase without a
+ * duration runs until the proxy stops, so only the last one may omit it.
+ */
+
+#define DEFAULT_LIMIT  50000
+#define DEFAULT_RTO_MS 200.0
+#define MAX_DELAY_MS   60000.0
+#define MAX_TOKENS     8
+
+void impair_params_default(impair_params_t *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->dist        = JITTER_UNIFORM;
+    p->ge_loss_bad = 1.0;
+    p->limit       = DEFAULT_LIMIT;
+    p->rto_ms      = DEFAULT_RTO_MS;
+}
+
+/* ---- parser -------------------------------------------------------------- */
+
+typedef struct {
+    const char *origin;
+    unsigned    line;
+} where_t;
+
+static int fail(const where_t *w, const char *what, const char *token)
+{
+    fprintf(stderr, "%s:%u: %s '%s'\n", w->origin, w->line, what, token);
+    return -1;
+}
+
+static int parse_number(const char *s, double min, double max, double *out)
+{
+    char *end;
+
+    errno = 0;
+    double v = strtod(s, &end);
+    if (errno != 0 || end == s || *end != '\0' || !(v >= min && v <= max)) {
+        return -1;
+    }
+    *out = v;
+    return 0;
+}
+
+static int parse_duration(const char *s, double *seconds)
+{
+    char *end;
+    double scale = 1.0;
+
+    errno = 0;
+    double v = strtod(s, &end);
+    if (errno != 0 || end == s || !(v > 0.0)) {
+        return -1;
+    }
+    if (strcmp(end, "ms") == 0) {
+        scale = 0.001;
+    } else if (strcmp(end, "m") == 0) {
+        scale = 60.0;
+    } else if (*end != '\0' && strcmp(end, "s") != 0) {
+        return -1;
+    }
+    *seconds = v * scale;
+    return 0;
+}
+
+/* Percentages as probabilities */
+static int parse_percents(const where_t *w, char **tok, int n, double *out)
+{
+    for (int i = 0; i < n; i++) {
+        if (parse_number(tok[i], 0.0, 100.0, &out[i]) < 0) {
+            return fail(w, "expected a percentage, got", tok[i]);
+        }
+        out[i] /= 100.0;
+    }
+    return 0;
+}
+
+static int apply(const where_t *w, impair_params_t *p, char **tok, int n)
+{
+    const char *key = tok[0];
+    double v[4];
+
+    if (strcmp(key, "clear") == 0 && n == 1) {
+        impair_params_default(p);
+    } else if (strcmp(key, "delay") == 0 && n == 2) {
+        if (parse_number(tok[1], 0.0, MAX_DELAY_MS, &p->delay_ms) < 0) {
+            return fail(w, "invalid delay", tok[1]);
+        }
+    } else if (strcmp(key, "jitter") == 0 && (n == 2 || n == 3)) {
+        if (parse_number(tok[1], 0.0, MAX_DELAY_MS, &p->jitter_ms) < 0) {
+            return fail(w, "invalid jitter", tok[1]);
+        }
+        p->dist = JITTER_UNIFORM;
+        if (n == 3 && strcmp(tok[2], "normal") == 0) {
+            p->dist = JITTER_NORMAL;
+        } else if (n == 3 && strcmp(tok[2], "uniform") != 0) {
+            return fail(w, "unknown distribution", tok[2]);
+        }
+    } else if (strcmp(key, "loss") == 0 && n == 2) {
+        return parse_percents(w, &tok[1], 1, &p->loss);
+    } else if (strcmp(key, "loss_ge") == 0 && n >= 2 && n <= 5) {
+        v[1] = 1.0;
+        v[2] = 1.0;
+        v[3] = 0.0;
+        if (parse_percents(w, &tok[1], n - 1, v) < 0) {
+            return -1;
+        }
+        if (v[0] > 0.0 && (n < 3 || v[1] <= 0.0)) {
+            return fail(w, "loss_ge needs p and r > 0, got", tok[1]);
+        }
+        p->ge_p         = v[0];
+        p->ge_r         = v[1];
+        p->ge_loss_bad  = v[2];
+        p->ge_loss_good = v[3];
+    } else if (strcmp(key, "reorder") == 0 && n == 2) {
+        return parse_percents(w, &tok[1], 1, &p->reorder);
+    } else if (strcmp(key, "duplicate") == 0 && n == 2) {
+        return parse_percents(w, &tok[1], 1, &p->duplicate);
+    } else if (strcmp(key, "rate") == 0 && n == 2) {
+        if (parse_number(tok[1], 0.0, 1e8, &p->rate_kbit) < 0) {
+            return fail(w, "invalid rate", tok[1]);
+        }
+    } else if (strcmp(key, "limit") == 0 && n == 2) {
+        if (parse_number(tok[1], 1.0, 1e7, &v[0]) < 0) {
+            return fail(w, "invalid limit", tok[1]);
+        }
+        p->limit = (uint32_t)v[0];
+    } else if (strcmp(key, "rto") == 0 && n == 2) {
+        if (parse_number(tok[1], 0.0, MAX_DELAY_MS, &p->rto_ms) < 0) {
+            return fail(w, "invalid rto", tok[1]);
+        }
+    } else {
+        return fail(w, "unknown setting or wrong number of values", key);
+    }
+    return 0;
+}
+
+static impair_phase_t *add_phase(impair_profile_t *prof, const char *name)
+{
+    impair_phase_t *ph = realloc(prof->phases, (prof->count + 1) * sizeof(*ph));
+
+    if (ph == NULL) {
+        perror("realloc");
+        return NULL;
+    }
+    prof->phases = ph;
+    ph = &prof->phases[prof->count++];
+    memset(ph, 0, sizeof(*ph));
+    snprintf(ph->name, sizeof(ph->name), "%s", name);
+    return ph;
+}
+
+static int parse_line(impair_profile_t *prof, impair_params_t cur[IMPAIR_DIRS],
+                      const where_t *w, char *line)
+{
+    char *tok[MAX_TOKENS];
+    char *save = NULL;
+    int n = 0;
+
+    for (char *t = strtok_r(line, " \t\r", &save); t != NULL; t = strtok_r(NULL, " \t\r", &save)) {
+        if (n == MAX_TOKENS) {
+            return fail(w, "too many values for", tok[0]);
+        }
+        tok[n++] = t;
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    if (strcmp(tok[0], "phase") == 0) {
+        /* The phase that ends keeps what was set up to here */
+        if (prof->count > 0) {
+            memcpy(prof->phases[prof->count - 1].dir, cur, sizeof(impair_params_t) * IMPAIR_DIRS);
+        }
+        if (n < 2 || n > 3 || strlen(tok[1]) >= IMPAIR_NAME_LEN) {
+            return fail(w, "expected phase <name> [<duration>], got", tok[n > 1 ? 1 : 0]);
+        }
+        impair_phase_t *ph = add_phase(prof, tok[1]);
+        if (ph == NULL) {
+            return -1;
+        }
+        if (n == 3 && parse_duration(tok[2], &ph->duration_s) < 0) {
+            return fail(w, "invalid duration", tok[2]);
+        }
+        return 0;
+    }
+    if (strcmp(tok[0], "loop") == 0 && n == 1) {
+        prof->loop = 1;
+        return 0;
+    }
+    if (strcmp(tok[0], "seed") == 0 && n == 2) {
+        char *end;
+        prof->seed = strtoull(tok[1], &end, 0);
+        return *end == '\0' ? 0 : fail(w, "invalid seed", tok[1]);
+    }
+
+    if (strncmp(tok[0], "up.", 3) == 0) {
+        tok[0] += 3;
+        return apply(w, &cur[IMPAIR_UP], tok, n);
+    }
+    if (strncmp(tok[0], "down.", 5) == 0) {
+        tok[0] += 5;
+        return apply(w, &cur[IMPAIR_DOWN], tok, n);
+    }
+    for (int d = 0; d < IMPAIR_DIRS; d++) {
+        /* apply() may not leave one direction changed and the other not */
+        impair_params_t p = cur[d];
+        if (apply(w, &p, tok, n) < 0) {
+            return -1;
+        }
+        cur[d] = p;
+    }
+    return 0;
+}
+
+int impair_profile_parse(impair_profile_t *prof, const char *text, const char *origin)
+{
+    impair_params_t cur[IMPAIR_DIRS];
+    where_t w = { .origin = origin, .line = 1 };
+    char *copy = strdup(text);
+    char *line = copy;
+    int ret = 0;
+
+    if (copy == NULL) {
+        perror("strdup");
+        return -1;
+    }
+    memset(prof, 0, sizeof(*prof));
+    prof->seed = 1;
+    for (int d = 0; d < IMPAIR_DIRS; d++) {
+        impair_params_default(&cur[d]);
+    }
+
+    /* Lines, then the ';' separated settings of a line */
+    while (line != NULL && ret == 0) {
+        char *next = strchr(line, '\n');
+        char *save = NULL;
+
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        line[strcspn(line, "#")] = '\0';
+        for (char *s = strtok_r(line, ";", &save); s != NULL && ret == 0; s = strtok_r(NULL, ";", &save)) {
+            ret = parse_line(prof, cur, &w, s);
+        }
+        w.line++;
+        line = next;
+    }
+    free(copy);
+
+    if (ret == 0 && prof->count == 0 && add_phase(prof, "static") == NULL) {
+        ret = -1;
+    }
+    if (ret == 0) {
+        memcpy(prof->phases[prof->count - 1].dir, cur, sizeof(cur));
+        for (size_t i = 0; i < prof->count; i++) {
+            const impair_phase_t *ph = &prof->phases[i];
+            if (ph->duration_s == 0.0 && (i + 1 < prof->count || prof->loop)) {
+                fprintf(stderr, "%s: phase '%s' needs a duration\n", origin, ph->name);
+                ret = -1;
+            }
+        }
+    }
+    if (ret < 0) {
+        impair_profile_free(prof);
+    }
+    return ret;
+}
+
+int impair_profile_load(impair_profile_t *prof, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char *text = NULL;
+    size_t len = 0;
+    int ret = -1;
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    if (fseek(f, 0, SEEK_END) == 0) {
+        long size = ftell(f);
+        rewind(f);
+        text = size >= 0 ? malloc((size_t)size + 1) : NULL;
+        if (text != NULL) {
+            len = fread(text, 1, (size_t)size, f);
+            text[len] = '\0';
+            ret = impair_profile_parse(prof, text, path);
+        }
+    }
+    if (text == NULL) {
+        perror(path);
+    }
+    free(text);
+    fclose(f);
+    return ret;
+}
+
+void impair_profile_free(impair_profile_t *prof)
+{
+    free(prof->phases);
+    prof->phases = NULL;
+    prof->count  = 0;
+}
+
+void impair_params_print(const impair_params_t *p, char *buf, size_t len)
+{
+    int n = snprintf(buf, len, "delay %.1f ms", p->delay_ms);
+
+#define APPEND(...)                                                       \
+    do {                                                                  \
+        if (n >= 0 && (size_t)n < len) {                                  \
+            n += snprintf(buf + n, len - (size_t)n, __VA_ARGS__);         \
+        }                                                                 \
+    } while (0)
+
+    if (p->jitter_ms > 0.0) {
+        APPEND(" %s %.1f ms", p->dist == JITTER_NORMAL ? "sd" : "+-", p->jitter_ms);
+    }
+    if (p->loss > 0.0) {
+        APPEND(", loss %.2f%%", p->loss * 100.0);
+    }
+    if (p->ge_p > 0.0) {
+        APPEND(", GE loss p %.2f%% r %.2f%% (%.0f%%/%.0f%%)", p->ge_p * 100.0, p->ge_r * 100.0,
+               p->ge_loss_bad * 100.0, p->ge_loss_good * 100.0);
+    }
+    if (p->reorder > 0.0) {
+        APPEND(", reorder %.2f%%", p->reorder * 100.0);
+    }
+    if (p->duplicate > 0.0) {
+        APPEND(", duplicate %.2f%%", p->duplicate * 100.0);
+    }
+    if (p->rate_kbit > 0.0) {
+        APPEND(", rate %.0f kbit/s", p->rate_kbit);
+    }
+#undef APPEND
+}
+
+/* ---- model --------------------------------------------------------------- */
+
+void impair_link_init(impair_link_t *l, const impair_params_t *p, uint64_t seed)
+{
+    memset(l, 0, sizeof(*l));
+    l->p   = p;
+    l->rng = seed != 0 ? seed : 1;
+}
+
+/* xorshift64*, one stream per direction so each replays on its own */
+static double uniform(impair_link_t *l)
+{
+    l->rng ^= l->rng >> 12;
+    l->rng ^= l->rng << 25;
+    l->rng ^= l->rng >> 27;
+    return (double)((l->rng * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+static int chance(impair_link_t *l, double p)
+{
+    return p > 0.0 && uniform(l) < p;
+}
+
+static int64_t delay_ns(impair_link_t *l)
+{
+    const impair_params_t *p = l->p;
+    double ms = p->delay_ms;
+
+    if (p->jitter_ms > 0.0) {
+        if (p->dist == JITTER_NORMAL) {
+            double u = uniform(l);
+            ms += p->jitter_ms * sqrt(-2.0 * log(u > 0.0 ? u : 1e-12)) * cos(2.0 * M_PI * uniform(l));
+        } else {
+            ms += p->jitter_ms * (2.0 * uniform(l) - 1.0);
+        }
+    }
+    return ms > 0.0 ? (int64_t)(ms * 1e6) : 0;
+}
+
+static int lose(impair_link_t *l)
+{
+    const impair_params_t *p = l->p;
+
+    if (p->ge_p > 0.0) {
+        l->ge_bad = l->ge_bad ? !chance(l, p->ge_r) : chance(l, p->ge_p);
+        if (chance(l, l->ge_bad ? p->ge_loss_bad : p->ge_loss_good)) {
+            return 1;
+        }
+    }
+    return chance(l, p->loss);
+}
+
+/* End of the packet's transmission over the capped link */
+static int64_t transmit(impair_link_t *l, size_t len, int64_t now_ns)
+{
+    if (l->p->rate_kbit <= 0.0) {
+        return now_ns;
+    }
+    int64_t start = l->link_free_ns > now_ns ? l->link_free_ns : now_ns;
+    l->link_free_ns = start + (int64_t)((double)len * 8e6 / l->p->rate_kbit);
+    return l->link_free_ns;
+}
+
+static int64_t in_order(impair_link_t *l, int64_t t)
+{
+    if (t < l->last_ns) {
+        t = l->last_ns;
+    }
+    l->last_ns = t;
+    return t;
+}
+
+int impair_datagram(impair_link_t *l, size_t len, int64_t now_ns, int64_t when[2])
+{
+    l->packets++;
+    l->bytes += len;
+    if (l->in_flight >= l->p->limit) {
+        l->overflow++;
+        return 0;
+    }
+    if (lose(l)) {
+        l->lost++;
+        return 0;
+    }
+
+    int64_t sent = transmit(l, len, now_ns);
+    int copies = chance(l, l->p->duplicate) ? 2 : 1;
+
+    if (chance(l, l->p->reorder)) {
+        when[0] = sent;
+        l->reordered++;
+    } else {
+        when[0] = in_order(l, sent + delay_ns(l));
+    }
+    if (copies == 2) {
+        when[1] = in_order(l, sent + delay_ns(l));
+        l->duplicated++;
+    }
+    return copies;
+}
+
+int64_t impair_segment(impair_link_t *l, size_t len, int64_t now_ns, int64_t *last_ns)
+{
+    int64_t t = transmit(l, len, now_ns) + delay_ns(l);
+
+    l->packets++;
+    l->bytes += len;
+    if (lose(l)) {
+        l->stalls++;
+        t += (int64_t)(l->p->rto_ms * 1e6);
+    }
+    if (t < *last_ns) {
+        t = *last_ns;
+    }
+    *last_ns = t;
+    return t;
+}
@@ -0,0 +1,99 @@
+#ifndef IMPAIR_H
+#define IMPAIR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Network impairment model of impair_proxy: the fate of every packet that
+ * crosses one direction of the proxy.
+ *
+ * A packet first waits for the bandwidth cap (a serializing link, like a
+ * radio at a fixed PHY rate), then for the delay plus jitter. Jitter never
+ * reorders on its own: a packet leaves no earlier than the one before it,
+ * as on a WiFi link where the MAC retries in place. Reordering is separate
+ * and explicit: a reordered packet skips the delay and overtakes the
+ * packets in flight. Loss is either independent or bursty (Gilbert-
+ * Elliott). A duplicate is a second copy with its own delay.
+ *
+ * Streams (TCP) cannot lose, duplicate or reorder bytes. There a lost
+ * segment stalls the stream for the retransmission timeout instead, which
+ * is what the application sees of a loss on a real link.
+ *
+ * Probabilities are 0..1; the profile file takes percentages.
+ */
+
+typedef enum { IMPAIR_UP, IMPAIR_DOWN, IMPAIR_DIRS } impair_dir_t;  /* client->server, back */
+typedef enum { JITTER_UNIFORM, JITTER_NORMAL } jitter_dist_t;
+
+typedef struct {
+    double        delay_ms;
+    double        jitter_ms;    /* uniform: +-jitter, normal: standard deviation */
+    jitter_dist_t dist;
+    double        loss;         /* independent loss */
+    double        ge_p;         /* Gilbert-Elliott: good -> bad, 0 = off */
+    double        ge_r;         /* bad -> good, mean burst length 1 / r */
+    double        ge_loss_bad;
+    double        ge_loss_good;
+    double        reorder;
+    double        duplicate;
+    double        rate_kbit;    /* 0 = unlimited */
+    uint32_t      limit;        /* packets in flight, more are tail dropped */
+    double        rto_ms;       /* streams: stall per lost segment */
+} impair_params_t;
+
+#define IMPAIR_NAME_LEN 32
+
+typedef struct {
+    char            name[IMPAIR_NAME_LEN];
+    double          duration_s; /* 0 = until the end */
+    impair_params_t dir[IMPAIR_DIRS];
+} impair_phase_t;
+
+typedef struct {
+    impair_phase_t *phases;
+    size_t          count;
+    int             loop;       /* start over after the last phase */
+    uint64_t        seed;
+} impair_profile_t;
+
+void impair_params_default(impair_params_t *p);
+
+/* Profile file, see impair.c for the format. Errors are printed
+ * with origin and line number; returns 0 or -1. */
+int  impair_profile_load(impair_profile_t *prof, const char *path);
+/* The same from a string, lines may also be separated by ';' */
+int  impair_profile_parse(impair_profile_t *prof, const char *text, const char *origin);
+void impair_profile_free(impair_profile_t *prof);
+void impair_params_print(const impair_params_t *p, char *buf, size_t len);
+
+/* One direction of the proxy, shared by all its flows like a radio link */
+typedef struct {
+    const impair_params_t *p;
+    uint64_t rng;
+    int      ge_bad;
+    int64_t  link_free_ns;      /* bandwidth cap: end of the last transmission */
+    int64_t  last_ns;           /* departure of the last datagram in order */
+    uint32_t in_flight;         /* maintained by the caller, see limit */
+
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t lost;
+    uint64_t overflow;
+    uint64_t duplicated;
+    uint64_t reordered;
+    uint64_t stalls;
+} impair_link_t;
+
+void impair_link_init(impair_link_t *l, const impair_params_t *p, uint64_t seed);
+
+/* Departure times of a datagram of len bytes that arrived at now_ns.
+ * Returns the number of copies to send, 0 when it is dropped. */
+int impair_datagram(impair_link_t *l, size_t len, int64_t now_ns, int64_t when[2]);
+
+/* Departure time of a stream segment, never earlier than the previous
+ * segment of its stream (*last_ns, updated). A stall holds back only its
+ * own stream, as a retransmission does. */
+int64_t impair_segment(impair_link_t *l, size_t len, int64_t now_ns, int64_t *last_ns);
+
+#endif /* IMPAIR_H */
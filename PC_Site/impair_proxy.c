@@ -0,0 +1,978 @@
+#define _GNU_SOURCE  /* recvmmsg, sendmmsg, accept4 */
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+#include "impair.h"
+#include "netaddr.h"
+#include "timer_wheel.h"
+
+#define DEFAULT_LISTEN_PORT 9080
+#define DEFAULT_MAX_FLOWS   4096
+#define DEFAULT_IDLE_S      60.0
+#define MAX_EVENTS          64
+#define BATCH               64      /* datagrams per recvmmsg / sendmmsg */
+#define RX_BATCHES          16      /* recvmmsg calls per socket and wakeup */
+#define MAX_DATAGRAM        65536
+#define PACKET_SIZE         2048    /* pooled packets, larger ones are malloc'd */
+#define SEGMENT_SIZE        1448    /* TCP is impaired per MSS sized segment */
+#define SOCKET_BUFFER       (4 * 1024 * 1024)
+#define FLOW_BUCKETS        4096
+#define GC_NS               1000000000LL
+
+/*
+ * Impairment proxy: relays UDP datagrams or TCP connections between
+ * clients and one server, and on the way makes a wired link behave like
+ * WiFi: delay and jitter, bursty loss, reordering, duplication and a
+ * bandwidth cap, per direction (see impair.h). The conditions come from
+ * a profile of timed phases (see impair.c), so a test replays the same
+ * fade, outage or congestion every run; with the same seed and the same
+ * traffic even the same packets are lost.
+ *
+ *   loadgen -u -p 9080 127.0.0.1  ->  impair_proxy :9080  ->  server :8080
+ *
+ * Each direction is one shared link, like the radio of a board, so all
+ * flows share its bandwidth and its loss bursts. UDP peers get their own
+ * upstream socket, which the server sees as one client per peer.
+ *
+ * Everything runs in one epoll loop. Datagrams are read and written in
+ * batches with recvmmsg() and sendmmsg(), and packets wait for their
+ * departure in a timer wheel (timer_wheel.h) rather than a heap, so a
+ * packet costs O(1) however many are in flight. The wheel wakes the loop
+ * through an absolute timerfd with minimal timer slack; packets leave at
+ * most one tick (0.1 ms) plus the wakeup latency late, never early.
+ */
+
+typedef enum { PROTO_UDP, PROTO_TCP } proto_t;
+typedef enum { H_LISTEN, H_TIMER, H_FLOW, H_CONN } handle_kind_t;
+
+typedef struct {
+    handle_kind_t kind;
+    int           side;
+    void         *obj;
+} handle_t;
+
+typedef struct packet {
+    tw_entry_t     timer;       /* first, the wheel hands back tw_entry_t */
+    struct packet *next;        /* pool, TCP output queue */
+    void          *owner;       /* flow_t or conn_t */
+    impair_dir_t   dir;
+    int            big;         /* malloc'd beyond PACKET_SIZE */
+    uint32_t       len;
+    uint32_t       off;         /* TCP: bytes written so far, UDP: 1 = not sent */
+    uint8_t        data[];
+} packet_t;
+
+/* UDP peer, with its own socket connected to the server */
+typedef struct flow {
+    handle_t           h;
+    struct flow       *next;    /* hash chain */
+    struct sockaddr_storage client;
+    int                fd;
+    int64_t            last_ns;
+    uint32_t           refs;    /* packets in flight */
+} flow_t;
+
+/* TCP connection: side 0 is the client, side 1 the server. Data read
+ * from side s travels in direction s (IMPAIR_UP from the client). */
+typedef struct conn {
+    handle_t      h[2];
+    int           fd[2];
+    uint32_t      events[2];
+    int           connected;    /* side 1 */
+    int           eof[2];       /* read side got FIN */
+    int           shut[2];      /* FIN passed on to this side */
+    int           paused[2];    /* reading stopped, too much in flight */
+    packet_t     *out_head[2];  /* due, waiting to be written to this side */
+    packet_t     *out_tail[2];
+    uint32_t      queued[IMPAIR_DIRS];
+    int64_t       last_ns[IMPAIR_DIRS]; /* departure of the last segment */
+    uint32_t      refs;         /* packets in the wheel */
+    int           dead;
+    struct conn  *next;         /* dead list */
+} conn_t;
+
+typedef struct {
+    proto_t            proto;
+    uint16_t           listen_port;
+    struct sockaddr_storage server;
+    socklen_t          server_len;
+    impair_profile_t   profile;
+    int                seed_set;
+    uint64_t           seed;
+    double             stats_s;
+    size_t             max_flows;
+    int64_t            idle_ns;
+} config_t;
+
+static config_t cfg;
+static volatile sig_atomic_t stop_requested = 0;
+
+static int epfd = -1;
+static int listen_fd = -1;
+static int timer_fd = -1;
+static handle_t listen_h = { H_LISTEN, 0, NULL };
+static handle_t timer_h = { H_TIMER, 0, NULL };
+static int64_t armed_ns = INT64_MAX;
+
+static timer_wheel_t wheel;
+static impair_link_t links[IMPAIR_DIRS];
+static uint32_t in_wheel[IMPAIR_DIRS];
+static size_t phase;
+static int64_t phase_end_ns;
+
+static packet_t *pool;
+static packet_t *due[BATCH];
+static unsigned due_count;
+static uint8_t rx_buf[BATCH][MAX_DATAGRAM];
+
+static flow_t *flows[FLOW_BUCKETS];
+static size_t flow_count;
+static conn_t *dead_conns;
+static size_t conn_count;
+
+static struct {
+    uint64_t sent[IMPAIR_DIRS];
+    uint64_t send_errors;
+    uint64_t send_dropped;      /* socket buffer full */
+    uint64_t peers;
+    uint64_t peers_rejected;
+    uint64_t conns;
+    uint64_t conns_failed;
+} stats;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static int64_t mono_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void arm_timer(int64_t at_ns)
+{
+    struct itimerspec its;
+
+    if (at_ns == armed_ns) {
+        return;
+    }
+    armed_ns = at_ns;
+    memset(&its, 0, sizeof(its));
+    if (at_ns != INT64_MAX) {
+        its.it_value.tv_sec  = at_ns / 1000000000LL;
+        its.it_value.tv_nsec = at_ns % 1000000000LL;
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+            its.it_value.tv_nsec = 1;  /* zero would disarm */
+        }
+    }
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static void watch(int fd, int op, uint32_t events, handle_t *h)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = events;
+    ev.data.ptr = h;
+    if (epoll_ctl(epfd, op, fd, &ev) < 0) {
+        perror("epoll_ctl");
+    }
+}
+
+static void buffers(int fd)
+{
+    int size = SOCKET_BUFFER;
+    /* Capped by net.core.[rw]mem_max, raise those for the full size */
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+}
+
+/* ---- packets ------------------------------------------------------------- */
+
+static packet_t *packet_alloc(size_t len)
+{
+    packet_t *p = pool;
+
+    if (len <= PACKET_SIZE && p != NULL) {
+        pool = p->next;
+    } else {
+        p = malloc(sizeof(*p) + (len > PACKET_SIZE ? len : PACKET_SIZE));
+        if (p == NULL) {
+            return NULL;
+        }
+        p->big = len > PACKET_SIZE;
+    }
+    p->next = NULL;
+    p->len  = (uint32_t)len;
+    p->off  = 0;
+    return p;
+}
+
+static void packet_free(packet_t *p)
+{
+    if (p->big) {
+        free(p);
+        return;
+    }
+    p->next = pool;
+    pool = p;
+}
+
+/* Into the wheel, or straight out when it is due and nothing of its
+ * direction waits before it */
+static void schedule(packet_t *p, int64_t when_ns, int64_t now_ns)
+{
+    links[p->dir].in_flight++;
+    if (cfg.proto == PROTO_UDP && when_ns <= now_ns && in_wheel[p->dir] == 0) {
+        due[due_count++] = p;
+        return;
+    }
+    in_wheel[p->dir]++;
+    tw_add(&wheel, &p->timer, when_ns);
+}
+
+/* ---- UDP ----------------------------------------------------------------- */
+
+static unsigned flow_hash(const struct sockaddr_storage *a)
+{
+    const void *addr = &((const struct sockaddr_in *)a)->sin_addr;
+    size_t words = 1;
+    uint32_t h = netaddr_port((const struct sockaddr *)a);
+
+    /* The listener is dual-stack, IPv4 clients arrive IPv4-mapped */
+    if (a->ss_family == AF_INET6) {
+        addr  = &((const struct sockaddr_in6 *)a)->sin6_addr;
+        words = 4;
+    }
+    for (size_t i = 0; i < words; i++) {
+        uint32_t w;
+        memcpy(&w, (const uint8_t *)addr + 4 * i, sizeof(w));
+        h = (h ^ w) * 2654435761u;
+    }
+    return (h ^ (h >> 16)) & (FLOW_BUCKETS - 1);
+}
+
+static flow_t *flow_get(const struct sockaddr_storage *client, int64_t now_ns)
+{
+    flow_t **bucket = &flows[flow_hash(client)];
+
+    for (flow_t *f = *bucket; f != NULL; f = f->next) {
+        if (netaddr_equal((const struct sockaddr *)&f->client, (const struct sockaddr *)client)) {
+            return f;
+        }
+    }
+    if (flow_count == cfg.max_flows) {
+        stats.peers_rejected++;
+        return NULL;
+    }
+
+    flow_t *f = calloc(1, sizeof(*f));
+    if (f == NULL) {
+        return NULL;
+    }
+    f->fd = socket(cfg.server.ss_family, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (f->fd < 0 || connect(f->fd, (const struct sockaddr *)&cfg.server, cfg.server_len) < 0) {
+        perror("upstream socket");
+        if (f->fd >= 0) {
+            close(f->fd);
+        }
+        free(f);
+        stats.peers_rejected++;
+        return NULL;
+    }
+    buffers(f->fd);
+    f->h.kind = H_FLOW;
+    f->h.obj  = f;
+    f->client = *client;
+    f->last_ns = now_ns;
+    f->next = *bucket;
+    *bucket = f;
+    flow_count++;
+    stats.peers++;
+    watch(f->fd, EPOLL_CTL_ADD, EPOLLIN, &f->h);
+    return f;
+}
+
+/* Forget peers that were idle for too long and have nothing in flight */
+static void flow_gc(int64_t now_ns)
+{
+    for (unsigned i = 0; i < FLOW_BUCKETS; i++) {
+        flow_t **link = &flows[i];
+        while (*link != NULL) {
+            flow_t *f = *link;
+            if (f->refs == 0 && now_ns - f->last_ns > cfg.idle_ns) {
+                *link = f->next;
+                close(f->fd);
+                free(f);
+                flow_count--;
+            } else {
+                link = &f->next;
+            }
+        }
+    }
+}
+
+static void flush_due(void)
+{
+    struct mmsghdr msgs[BATCH];
+    struct iovec iov[BATCH];
+    unsigned i = 0;
+
+    memset(msgs, 0, sizeof(msgs));
+    while (i < due_count) {
+        /* A run of packets for the same socket goes out in one call */
+        unsigned first = i;
+        int fd = -1;
+        for (; i < due_count; i++) {
+            packet_t *p = due[i];
+            flow_t *f = p->owner;
+            int to = p->dir == IMPAIR_UP ? f->fd : listen_fd;
+            if (fd >= 0 && to != fd) {
+                break;
+            }
+            fd = to;
+            iov[i].iov_base = p->data;
+            iov[i].iov_len  = p->len;
+            msgs[i].msg_hdr.msg_iov     = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen  = 1;
+            msgs[i].msg_hdr.msg_name    = p->dir == IMPAIR_UP ? NULL : &f->client;
+            msgs[i].msg_hdr.msg_namelen = p->dir == IMPAIR_UP ? 0 : sizeof(f->client);
+        }
+        for (unsigned done = first; done < i;) {
+            int n = sendmmsg(fd, msgs + done, i - done, MSG_DONTWAIT);
+            if (n > 0) {
+                done += (unsigned)n;
+                continue;
+            }
+            /* Skip the datagram that failed, e.g. ECONNREFUSED of an
+             * earlier one or a full socket buffer */
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+                stats.send_dropped++;
+            } else {
+                stats.send_errors++;
+            }
+            due[done]->off = 1;
+            done++;
+        }
+    }
+
+    for (i = 0; i < due_count; i++) {
+        packet_t *p = due[i];
+        flow_t *f = p->owner;
+        if (p->off == 0) {
+            stats.sent[p->dir]++;
+        }
+        f->refs--;
+        links[p->dir].in_flight--;
+        packet_free(p);
+    }
+    due_count = 0;
+}
+
+static void dispatch_datagram(flow_t *f, impair_dir_t dir, const uint8_t *data, size_t len, int64_t now_ns)
+{
+    int64_t when[2];
+    int copies = impair_datagram(&links[dir], len, now_ns, when);
+
+    for (int i = 0; i < copies; i++) {
+        packet_t *p = packet_alloc(len);
+        if (p == NULL) {
+            links[dir].overflow++;
+            continue;
+        }
+        memcpy(p->data, data, len);
+        p->owner = f;
+        p->dir   = dir;
+        f->refs++;
+        if (due_count == BATCH) {
+            flush_due();
+        }
+        schedule(p, when[i], now_ns);
+    }
+}
+
+static void udp_receive(int fd, flow_t *from, int64_t now_ns)
+{
+    struct mmsghdr msgs[BATCH];
+    struct iovec iov[BATCH];
+    struct sockaddr_storage peers[BATCH];
+
+    for (int round = 0; round < RX_BATCHES; round++) {
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < BATCH; i++) {
+            iov[i].iov_base = rx_buf[i];
+            iov[i].iov_len  = sizeof(rx_buf[i]);
+            msgs[i].msg_hdr.msg_iov     = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen  = 1;
+            msgs[i].msg_hdr.msg_name    = &peers[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(peers[i]);
+        }
+        int n = recvmmsg(fd, msgs, BATCH, MSG_DONTWAIT, NULL);
+        if (n <= 0) {
+            /* ECONNREFUSED: the server is not up, its replies are all we lose */
+            return;
+        }
+        for (int i = 0; i < n; i++) {
+            flow_t *f = from != NULL ? from : flow_get(&peers[i], now_ns);
+            if (f == NULL) {
+                continue;
+            }
+            f->last_ns = now_ns;
+            dispatch_datagram(f, from != NULL ? IMPAIR_DOWN : IMPAIR_UP,
+                              rx_buf[i], msgs[i].msg_len, now_ns);
+        }
+        if (n < BATCH) {
+            return;
+        }
+    }
+}
+
+/* ---- TCP ----------------------------------------------------------------- */
+
+static void conn_watch(conn_t *c, int side)
+{
+    impair_dir_t in = (impair_dir_t)side;
+    uint32_t events = 0;
+
+    if (!c->eof[in] && !c->paused[in]) {
+        events |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (c->out_head[side] != NULL || (side == 1 && !c->connected)) {
+        events |= EPOLLOUT;
+    }
+    if (events != c->events[side]) {
+        c->events[side] = events;
+        watch(c->fd[side], EPOLL_CTL_MOD, events, &c->h[side]);
+    }
+}
+
+/* Connection reset or failed: reset the other side as well */
+static void conn_fail(conn_t *c)
+{
+    struct linger lg = { .l_onoff = 1, .l_linger = 0 };
+
+    if (c->dead) {
+        return;
+    }
+    for (int side = 0; side < 2; side++) {
+        setsockopt(c->fd[side], SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        close(c->fd[side]);
+        while (c->out_head[side] != NULL) {
+            packet_t *p = c->out_head[side];
+            c->out_head[side] = p->next;
+            links[p->dir].in_flight--;
+            packet_free(p);
+        }
+    }
+    c->dead = 1;
+    c->next = dead_conns;
+    dead_conns = c;
+    conn_count--;
+}
+
+static void conn_close(conn_t *c)
+{
+    close(c->fd[0]);
+    close(c->fd[1]);
+    c->fd[0] = c->fd[1] = -1;
+    c->dead = 1;
+    c->next = dead_conns;
+    dead_conns = c;
+    conn_count--;
+}
+
+/* Pass a FIN on once everything before it is written */
+static void conn_finish(conn_t *c)
+{
+    for (int dir = 0; dir < IMPAIR_DIRS; dir++) {
+        int side = 1 - dir;
+        if (c->eof[dir] && c->queued[dir] == 0 && !c->shut[side]) {
+            shutdown(c->fd[side], SHUT_WR);
+            c->shut[side] = 1;
+        }
+    }
+    if (c->shut[0] && c->shut[1]) {
+        conn_close(c);
+    }
+}
+
+static void conn_flush(conn_t *c, int side)
+{
+    impair_dir_t dir = (impair_dir_t)(1 - side);
+
+    if (side == 1 && !c->connected) {
+        return;
+    }
+    while (c->out_head[side] != NULL) {
+        packet_t *p = c->out_head[side];
+        ssize_t n = send(c->fd[side], p->data + p->off, p->len - p->off, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            conn_fail(c);
+            return;
+        }
+        p->off += (uint32_t)n;
+        if (p->off < p->len) {
+            continue;
+        }
+        c->out_head[side] = p->next;
+        if (c->out_head[side] == NULL) {
+            c->out_tail[side] = NULL;
+        }
+        c->queued[dir]--;
+        links[dir].in_flight--;
+        stats.sent[dir]++;
+        packet_free(p);
+    }
+
+    /* Reading resumes when half of the limit has drained */
+    if (c->paused[dir] && c->queued[dir] <= links[dir].p->limit / 2) {
+        c->paused[dir] = 0;
+        conn_watch(c, dir);
+    }
+    conn_finish(c);
+    if (!c->dead) {
+        conn_watch(c, side);
+    }
+}
+
+static void conn_read(conn_t *c, int side, int64_t now_ns)
+{
+    impair_dir_t dir = (impair_dir_t)side;
+
+    while (c->queued[dir] < links[dir].p->limit) {
+        packet_t *p = packet_alloc(SEGMENT_SIZE);
+        if (p == NULL) {
+            break;
+        }
+        ssize_t n = recv(c->fd[side], p->data, SEGMENT_SIZE, MSG_DONTWAIT);
+        if (n <= 0) {
+            packet_free(p);
+            if (n == 0) {
+                c->eof[dir] = 1;
+                conn_finish(c);
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                conn_fail(c);
+            }
+            if (!c->dead) {
+                conn_watch(c, side);
+            }
+            return;
+        }
+        p->len   = (uint32_t)n;
+        p->owner = c;
+        p->dir   = dir;
+        c->queued[dir]++;
+        c->refs++;
+        schedule(p, impair_segment(&links[dir], (size_t)n, now_ns, &c->last_ns[dir]), now_ns);
+    }
+    c->paused[dir] = 1;
+    conn_watch(c, side);
+}
+
+static void conn_connected(conn_t *c)
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    if (getsockopt(c->fd[1], SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+        stats.conns_failed++;
+        conn_fail(c);
+        return;
+    }
+    c->connected = 1;
+    conn_flush(c, 1);
+}
+
+static void tcp_accept(void)
+{
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("accept");
+            }
+            return;
+        }
+        if (conn_count == cfg.max_flows) {
+            stats.conns_failed++;
+            close(fd);
+            continue;
+        }
+
+        conn_t *c = calloc(1, sizeof(*c));
+        int up = socket(cfg.server.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (c == NULL || up < 0 ||
+            (connect(up, (const struct sockaddr *)&cfg.server, cfg.server_len) < 0 &&
+             errno != EINPROGRESS)) {
+            stats.conns_failed++;
+            if (up >= 0) {
+                close(up);
+            }
+            close(fd);
+            free(c);
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        setsockopt(up, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        c->fd[0] = fd;
+        c->fd[1] = up;
+        for (int side = 0; side < 2; side++) {
+            c->h[side].kind = H_CONN;
+            c->h[side].side = side;
+            c->h[side].obj  = c;
+            c->events[side] = EPOLLIN | EPOLLRDHUP | (side == 1 ? EPOLLOUT : 0);
+            watch(c->fd[side], EPOLL_CTL_ADD, c->events[side], &c->h[side]);
+        }
+        conn_count++;
+        stats.conns++;
+    }
+}
+
+static void conn_event(conn_t *c, int side, uint32_t events, int64_t now_ns)
+{
+    if (c->dead) {
+        return;
+    }
+    if (side == 1 && !c->connected && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        conn_connected(c);
+        return;
+    }
+    if (events & EPOLLERR) {
+        conn_fail(c);
+        return;
+    }
+    if (events & EPOLLOUT) {
+        conn_flush(c, side);
+    }
+    if (!c->dead && (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) && !c->eof[side] && !c->paused[side]) {
+        conn_read(c, side, now_ns);
+    }
+}
+
+/* Dead connections go once the wheel holds none of their packets */
+static void conn_sweep(void)
+{
+    conn_t **link = &dead_conns;
+
+    while (*link != NULL) {
+        conn_t *c = *link;
+        if (c->refs == 0) {
+            *link = c->next;
+            free(c);
+        } else {
+            link = &c->next;
+        }
+    }
+}
+
+/* ---- wheel and phases ---------------------------------------------------- */
+
+static void expire(tw_entry_t *e, void *ctx)
+{
+    packet_t *p = (packet_t *)e;
+
+    (void)ctx;
+    in_wheel[p->dir]--;
+    if (cfg.proto == PROTO_UDP) {
+        if (due_count == BATCH) {
+            flush_due();
+        }
+        due[due_count++] = p;
+        return;
+    }
+
+    conn_t *c = p->owner;
+    int side = 1 - (int)p->dir;
+    c->refs--;
+    if (c->dead) {
+        links[p->dir].in_flight--;
+        packet_free(p);
+        return;
+    }
+    if (c->out_tail[side] != NULL) {
+        c->out_tail[side]->next = p;
+    } else {
+        c->out_head[side] = p;
+    }
+    c->out_tail[side] = p;
+    /* Behind a partial write the socket is full already */
+    if (c->out_head[side] == p) {
+        conn_flush(c, side);
+    }
+}
+
+static void phase_start(size_t i, int64_t start_ns)
+{
+    const impair_phase_t *ph = &cfg.profile.phases[i];
+    char up[256], down[256];
+
+    phase = i;
+    phase_end_ns = ph->duration_s > 0.0 ? start_ns + (int64_t)(ph->duration_s * 1e9) : INT64_MAX;
+    for (int d = 0; d < IMPAIR_DIRS; d++) {
+        links[d].p = &ph->dir[d];
+    }
+    impair_params_print(&ph->dir[IMPAIR_UP], up, sizeof(up));
+    impair_params_print(&ph->dir[IMPAIR_DOWN], down, sizeof(down));
+    if (ph->duration_s > 0.0) {
+        printf("[Impair] phase %s (%.1f s)\n", ph->name, ph->duration_s);
+    } else {
+        printf("[Impair] phase %s\n", ph->name);
+    }
+    printf("[Impair]   up  : %s\n[Impair]   down: %s\n", up, down);
+    fflush(stdout);
+}
+
+static void phase_check(int64_t now_ns)
+{
+    while (now_ns >= phase_end_ns) {
+        if (phase + 1 < cfg.profile.count) {
+            phase_start(phase + 1, phase_end_ns);
+        } else if (cfg.profile.loop) {
+            phase_start(0, phase_end_ns);
+        } else {
+            phase_end_ns = INT64_MAX;   /* the last phase stays */
+        }
+    }
+}
+
+static void print_stats(double seconds)
+{
+    static const char *names[IMPAIR_DIRS] = { "up  ", "down" };
+
+    for (int d = 0; d < IMPAIR_DIRS; d++) {
+        const impair_link_t *l = &links[d];
+        printf("[Impair] %s: %llu pkts (%.0f pkt/s), %.1f kB, sent %llu, lost %llu, "
+               "overflow %llu, dup %llu, reordered %llu, stalls %llu, in flight %u\n",
+               names[d],
+               (unsigned long long)l->packets,
+               seconds > 0.0 ? (double)l->packets / seconds : 0.0,
+               (double)l->bytes / 1000.0,
+               (unsigned long long)stats.sent[d],
+               (unsigned long long)l->lost,
+               (unsigned long long)l->overflow,
+               (unsigned long long)l->duplicated,
+               (unsigned long long)l->reordered,
+               (unsigned long long)l->stalls,
+               l->in_flight);
+    }
+    if (cfg.proto == PROTO_UDP) {
+        printf("[Impair] peers: %zu active, %llu total, %llu rejected; send errors %llu, "
+               "dropped at full socket %llu\n",
+               flow_count, (unsigned long long)stats.peers,
+               (unsigned long long)stats.peers_rejected,
+               (unsigned long long)stats.send_errors,
+               (unsigned long long)stats.send_dropped);
+    } else {
+        printf("[Impair] connections: %zu active, %llu total, %llu failed\n",
+               conn_count, (unsigned long long)stats.conns,
+               (unsigned long long)stats.conns_failed);
+    }
+    fflush(stdout);
+}
+
+/* ---- main ---------------------------------------------------------------- */
+
+static int open_listener(void)
+{
+    listen_fd = netaddr_server_socket((cfg.proto == PROTO_UDP ? SOCK_DGRAM : SOCK_STREAM) | SOCK_NONBLOCK,
+                                      cfg.listen_port);
+    if (listen_fd < 0) {
+        return -1;
+    }
+    if (cfg.proto == PROTO_TCP && listen(listen_fd, SOMAXCONN) < 0) {
+        perror("listen");
+        return -1;
+    }
+    if (cfg.proto == PROTO_UDP) {
+        buffers(listen_fd);
+    }
+    watch(listen_fd, EPOLL_CTL_ADD, EPOLLIN, &listen_h);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <server-ip> <server-port>\n"
+            "  -t            relay TCP (default UDP)\n"
+            "  -l <port>     port to listen on (default %d)\n"
+            "  -f <file>     impairment profile, see impair.c\n"
+            "  -e <profile>  the profile inline, e.g. \"delay 20; jitter 5; loss 1\"\n"
+            "  -s <seed>     random seed, overrides the profile's\n"
+            "  -i <seconds>  print statistics at this interval (default on exit only)\n"
+            "  -F <count>    UDP peers or TCP connections at most (default %d)\n"
+            "  -I <seconds>  UDP: forget a peer after this idle time (default %.0f)\n"
+            "Without -f or -e packets are relayed unimpaired.\n",
+            prog, DEFAULT_LISTEN_PORT, DEFAULT_MAX_FLOWS, DEFAULT_IDLE_S);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *profile_file = NULL;
+    const char *profile_text = NULL;
+    int c;
+
+    cfg.proto       = PROTO_UDP;
+    cfg.listen_port = DEFAULT_LISTEN_PORT;
+    cfg.max_flows   = DEFAULT_MAX_FLOWS;
+    cfg.idle_ns     = (int64_t)(DEFAULT_IDLE_S * 1e9);
+
+    while ((c = getopt(argc, argv, "tl:f:e:s:i:F:I:h")) != -1) {
+        switch (c) {
+        case 't': cfg.proto       = PROTO_TCP; break;
+        case 'l': cfg.listen_port = (uint16_t)atoi(optarg); break;
+        case 'f': profile_file    = optarg; break;
+        case 'e': profile_text    = optarg; break;
+        case 's': cfg.seed = strtoull(optarg, NULL, 0); cfg.seed_set = 1; break;
+        case 'i': cfg.stats_s     = atof(optarg); break;
+        case 'F': cfg.max_flows   = (size_t)atol(optarg); break;
+        case 'I': cfg.idle_ns     = (int64_t)(atof(optarg) * 1e9); break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind + 2 != argc || cfg.max_flows == 0 || (profile_file != NULL && profile_text != NULL)) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (netaddr_resolve(argv[optind], (uint16_t)atoi(argv[optind + 1]),
+                        cfg.proto == PROTO_UDP ? SOCK_DGRAM : SOCK_STREAM,
+                        &cfg.server, &cfg.server_len) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    int ret = profile_file != NULL ? impair_profile_load(&cfg.profile, profile_file) :
+              impair_profile_parse(&cfg.profile, profile_text != NULL ? profile_text : "", "-e");
+    if (ret < 0) {
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.seed_set) {
+        cfg.profile.seed = cfg.seed;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    /* Default timer slack is 50 us, ten times the precision we are after */
+    prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+
+    epfd = epoll_create1(0);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (epfd < 0 || timer_fd < 0) {
+        perror("epoll/timerfd");
+        exit(EXIT_FAILURE);
+    }
+    watch(timer_fd, EPOLL_CTL_ADD, EPOLLIN, &timer_h);
+    if (open_listener() < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    int64_t start_ns = mono_ns();
+    tw_init(&wheel, start_ns);
+    for (int d = 0; d < IMPAIR_DIRS; d++) {
+        /* A stream per direction, so one direction replays on its own */
+        impair_link_init(&links[d], &cfg.profile.phases[0].dir[d],
+                         cfg.profile.seed * 0x9E3779B97F4A7C15ULL + (uint64_t)d + 1);
+    }
+    char server[NETADDR_STRLEN];
+    printf("[Impair] %s :%u -> %s, %zu phase%s%s, seed %llu\n",
+           cfg.proto == PROTO_UDP ? "UDP" : "TCP", cfg.listen_port,
+           netaddr_str((const struct sockaddr *)&cfg.server, server, sizeof(server)), cfg.profile.count,
+           cfg.profile.count == 1 ? "" : "s", cfg.profile.loop ? " (loop)" : "",
+           (unsigned long long)cfg.profile.seed);
+    phase_start(0, start_ns);
+
+    int64_t next_stats_ns = cfg.stats_s > 0.0 ? start_ns + (int64_t)(cfg.stats_s * 1e9) : INT64_MAX;
+    int64_t next_gc_ns = start_ns + GC_NS;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (!stop_requested) {
+        int64_t next = tw_next(&wheel);
+        if (phase_end_ns < next) next = phase_end_ns;
+        if (next_stats_ns < next) next = next_stats_ns;
+        if (next_gc_ns < next) next = next_gc_ns;
+        arm_timer(next);
+
+        int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+
+        int64_t now = mono_ns();
+        phase_check(now);
+        for (int i = 0; i < n; i++) {
+            handle_t *h = events[i].data.ptr;
+            switch (h->kind) {
+            case H_TIMER: {
+                uint64_t expirations;
+                /* EAGAIN when it was re-armed since, nothing to clear then */
+                ssize_t r = read(timer_fd, &expirations, sizeof(expirations));
+                (void)r;
+                armed_ns = INT64_MAX;
+                break;
+            }
+            case H_LISTEN:
+                if (cfg.proto == PROTO_UDP) {
+                    udp_receive(listen_fd, NULL, now);
+                } else {
+                    tcp_accept();
+                }
+                break;
+            case H_FLOW:
+                udp_receive(((flow_t *)h->obj)->fd, h->obj, now);
+                break;
+            case H_CONN:
+                conn_event(h->obj, h->side, events[i].events, now);
+                break;
+            }
+        }
+
+        tw_advance(&wheel, mono_ns(), expire, NULL);
+        flush_due();
+        conn_sweep();
+
+        if (now >= next_gc_ns) {
+            flow_gc(now);
+            next_gc_ns = now + GC_NS;
+        }
+        if (now >= next_stats_ns) {
+            print_stats((double)(now - start_ns) / 1e9);
+            next_stats_ns += (int64_t)(cfg.stats_s * 1e9);
+        }
+    }
+
+    printf("\n[Impair] stopped after %.1f s\n", (double)(mono_ns() - start_ns) / 1e9);
+    print_stats((double)(mono_ns() - start_ns) / 1e9);
+    impair_profile_free(&cfg.profile);
+    return 0;
+}
@@ -0,0 +1,1010 @@
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "histogram.h"
+#include "netaddr.h"
+#include "probe.h"
+#include "telemetry.h"
+#include "timestamping.h"
+
+#define PORT        8080
+#define BUFFER_SIZE 1024
+#define MAX_MIX     16
+#define MAX_EVENTS  64
+#define DRAIN_NS    1000000000LL
+#define RETRY_NS    1000000000LL
+#define TIMER_KEY   UINT32_MAX
+#define MAX_PROFILES     8
+#define PROFILE_RETRIES  5
+#define MAX_CLASSES      16
+#define CLASS_PREFIX_LEN 4      /* "@vo " */
+
+/*
+ * Load generator that simulates a fleet of boards talking to the PC_Site
+ * echo servers. Every virtual board owns one TCP connection or UDP source
+ * port and sends probes (see probe.h) at a constant or Poisson rate with a
+ * configurable size mix. Boards are spread over a few worker threads, each
+ * running a non-blocking epoll loop with a timer heap for the send
+ * schedule. RTT is taken from the send timestamp echoed back in the probe.
+ *
+ * With -Q every board is given a priority class. Its socket carries the
+ * DSCP value of the class and its probes start with "@<class> ", which
+ * the echo demo uses to pick the queue of the reply (CONFIG_COMM_ENGINE_
+ * PRIORITY). -F asks the board for a telemetry flood in the background
+ * class meanwhile, so the report shows what the flood costs each class.
+ */
+
+/* Same names and DSCP values as modules/comm_engine/comm_prio.c */
+static const struct {
+    const char *name;
+    int         dscp;
+} classes[] = {
+    { "be", 0 },
+    { "bk", 8 },
+    { "vi", 34 },
+    { "vo", 46 },
+};
+#define CLASS_COUNT (int)(sizeof(classes) / sizeof(classes[0]))
+
+typedef enum { PROTO_TCP, PROTO_UDP } proto_t;
+typedef enum { ARRIVAL_CONSTANT, ARRIVAL_POISSON } arrival_t;
+
+typedef struct {
+    size_t   size;
+    unsigned weight;
+} mix_entry_t;
+
+typedef struct {
+    const char  *server_ip;
+    uint16_t     port;
+    proto_t      proto;
+    arrival_t    arrival;
+    unsigned     boards;
+    unsigned     threads;
+    double       rate;          /* messages per second and board */
+    double       duration_s;
+    double       reconnect_s;   /* mean time between random reconnects, 0 = never */
+    mix_entry_t  mix[MAX_MIX];
+    unsigned     mix_count;
+    unsigned     mix_total;
+    struct sockaddr_storage server_addr;
+    socklen_t    server_addr_len;
+    const char  *profiles[MAX_PROFILES];    /* power profiles to sweep, see -W */
+    unsigned     profile_count;
+    double       settle_s;      /* pause after a profile switch */
+    int          board_class[MAX_CLASSES];  /* assigned to boards round robin, see -Q */
+    unsigned     board_class_count;
+    long         flood_batches; /* telemetry batches requested per run, see -F */
+} config_t;
+
+typedef enum { BOARD_IDLE, BOARD_CONNECTING, BOARD_CONNECTED } board_state_t;
+
+typedef struct {
+    uint32_t      id;
+    int           cls;          /* index into classes[], -1 = untagged */
+    int           fd;
+    board_state_t state;
+    int64_t       next_send_ns;
+    int64_t       reconnect_at_ns;
+    uint64_t      seq;
+
+    uint64_t      sent;
+    uint64_t      received;
+    uint64_t      bytes_sent;
+    uint64_t      bytes_received;
+    uint64_t      connect_errors;
+    uint64_t      send_errors;
+    uint64_t      recv_errors;
+    uint64_t      reconnects;
+    uint64_t      stalls;       /* send slots skipped while (re)connecting or blocked */
+
+    char          rx_buf[2 * BUFFER_SIZE];
+    size_t        rx_len;
+    char          tx_buf[BUFFER_SIZE];
+    size_t        tx_len;
+    size_t        tx_off;
+
+    histogram_t   rtt;
+} board_t;
+
+typedef struct {
+    const config_t *cfg;
+    board_t        *boards;
+    unsigned        count;
+    unsigned       *heap;       /* board indices ordered by next_send_ns */
+    unsigned        heap_len;
+    int             epfd;
+    int             timer_fd;
+    uint64_t        rng;
+    pthread_t       thread;
+} worker_t;
+
+static int64_t mono_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* xorshift64*, one stream per worker thread */
+static double rng_uniform(worker_t *w)
+{
+    w->rng ^= w->rng >> 12;
+    w->rng ^= w->rng << 25;
+    w->rng ^= w->rng >> 27;
+    return (double)((w->rng * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+static int64_t exp_interval_ns(worker_t *w, double rate)
+{
+    double u = rng_uniform(w);
+    if (u <= 0.0) {
+        u = 1e-12;
+    }
+    return (int64_t)(-log(u) / rate * 1e9);
+}
+
+static int64_t next_interval_ns(worker_t *w)
+{
+    if (w->cfg->arrival == ARRIVAL_POISSON) {
+        return exp_interval_ns(w, w->cfg->rate);
+    }
+    return (int64_t)(1e9 / w->cfg->rate);
+}
+
+static size_t pick_size(worker_t *w)
+{
+    unsigned pick = (unsigned)(rng_uniform(w) * w->cfg->mix_total);
+    for (unsigned i = 0; i < w->cfg->mix_count; i++) {
+        if (pick < w->cfg->mix[i].weight) {
+            return w->cfg->mix[i].size;
+        }
+        pick -= w->cfg->mix[i].weight;
+    }
+    return w->cfg->mix[w->cfg->mix_count - 1].size;
+}
+
+/* ---- timer heap ---------------------------------------------------------- */
+
+static int heap_less(const worker_t *w, unsigned a, unsigned b)
+{
+    return w->boards[w->heap[a]].next_send_ns < w->boards[w->heap[b]].next_send_ns;
+}
+
+static void heap_swap(worker_t *w, unsigned a, unsigned b)
+{
+    unsigned tmp = w->heap[a];
+    w->heap[a] = w->heap[b];
+    w->heap[b] = tmp;
+}
+
+static void heap_push(worker_t *w, unsigned board)
+{
+    unsigned i = w->heap_len++;
+    w->heap[i] = board;
+    while (i > 0 && heap_less(w, i, (i - 1) / 2)) {
+        heap_swap(w, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static unsigned heap_pop(worker_t *w)
+{
+    unsigned top = w->heap[0];
+    unsigned i = 0;
+
+    w->heap[0] = w->heap[--w->heap_len];
+    for (;;) {
+        unsigned l = 2 * i + 1, r = l + 1, m = i;
+        if (l < w->heap_len && heap_less(w, l, m)) m = l;
+        if (r < w->heap_len && heap_less(w, r, m)) m = r;
+        if (m == i) break;
+        heap_swap(w, i, m);
+        i = m;
+    }
+    return top;
+}
+
+static void arm_timer(worker_t *w, int64_t at_ns)
+{
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec  = at_ns / 1000000000LL;
+    its.it_value.tv_nsec = at_ns % 1000000000LL;
+    if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+        its.it_value.tv_nsec = 1;  /* zero would disarm */
+    }
+    timerfd_settime(w->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/* ---- board connection handling ------------------------------------------- */
+
+static void board_watch(worker_t *w, board_t *b, unsigned idx, int op, uint32_t events)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = events;
+    ev.data.u32 = idx;
+    epoll_ctl(w->epfd, op, b->fd, &ev);
+}
+
+static void board_close(worker_t *w, board_t *b)
+{
+    if (b->fd >= 0) {
+        epoll_ctl(w->epfd, EPOLL_CTL_DEL, b->fd, NULL);
+        close(b->fd);
+    }
+    b->fd     = -1;
+    b->state  = BOARD_IDLE;
+    b->reconnect_at_ns = 0;
+    b->rx_len = 0;
+    b->tx_len = 0;
+    b->tx_off = 0;
+}
+
+static void board_connect(worker_t *w, board_t *b, unsigned idx, int64_t now)
+{
+    const config_t *cfg = w->cfg;
+    int type = cfg->proto == PROTO_TCP ? SOCK_STREAM : SOCK_DGRAM;
+
+    b->fd = socket(cfg->server_addr.ss_family, type | SOCK_NONBLOCK, 0);
+    if (b->fd < 0) {
+        b->connect_errors++;
+        b->reconnect_at_ns = now + RETRY_NS;
+        return;
+    }
+
+    if (cfg->proto == PROTO_TCP) {
+        int one = 1;
+        setsockopt(b->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    if (b->cls >= 0) {
+        int tos = classes[b->cls].dscp << 2;
+        if (cfg->server_addr.ss_family == AF_INET6) {
+            setsockopt(b->fd, IPPROTO_IPV6, IPV6_TCLASS, &tos, sizeof(tos));
+        } else {
+            setsockopt(b->fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+        }
+    }
+
+    /* UDP: connect() binds a private source port and filters replies */
+    if (connect(b->fd, (const struct sockaddr *)&cfg->server_addr, cfg->server_addr_len) == 0) {
+        b->state = BOARD_CONNECTED;
+        board_watch(w, b, idx, EPOLL_CTL_ADD, EPOLLIN);
+    } else if (errno == EINPROGRESS) {
+        b->state = BOARD_CONNECTING;
+        board_watch(w, b, idx, EPOLL_CTL_ADD, EPOLLOUT);
+    } else {
+        b->connect_errors++;
+        close(b->fd);
+        b->fd = -1;
+        b->reconnect_at_ns = now + RETRY_NS;
+        return;
+    }
+
+    b->reconnect_at_ns = cfg->reconnect_s > 0.0 ?
+                         now + exp_interval_ns(w, 1.0 / cfg->reconnect_s) : INT64_MAX;
+}
+
+static void board_flush(worker_t *w, board_t *b, unsigned idx)
+{
+    while (b->tx_off < b->tx_len) {
+        ssize_t n = send(b->fd, b->tx_buf + b->tx_off, b->tx_len - b->tx_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                board_watch(w, b, idx, EPOLL_CTL_MOD, EPOLLIN | EPOLLOUT);
+                return;
+            }
+            b->send_errors++;
+            board_close(w, b);
+            return;
+        }
+        b->tx_off += (size_t)n;
+    }
+
+    if (b->tx_len != 0) {
+        b->tx_len = 0;
+        b->tx_off = 0;
+        board_watch(w, b, idx, EPOLL_CTL_MOD, EPOLLIN);
+    }
+}
+
+static void board_send(worker_t *w, board_t *b, unsigned idx, int64_t now)
+{
+    if (b->state == BOARD_IDLE) {
+        if (now >= b->reconnect_at_ns) {
+            board_connect(w, b, idx, now);
+        }
+        b->stalls++;
+        return;
+    }
+
+    if (now >= b->reconnect_at_ns) {
+        board_close(w, b);
+        b->reconnects++;
+        board_connect(w, b, idx, now);
+    }
+
+    if (b->state != BOARD_CONNECTED || b->tx_len != 0) {
+        b->stalls++;
+        return;
+    }
+
+    probe_t probe = { .board = b->id, .seq = b->seq++, .send_ns = ts_now_ns() };
+    size_t prefix = 0;
+    size_t size = pick_size(w);
+
+    if (b->cls >= 0) {
+        prefix = (size_t)snprintf(b->tx_buf, sizeof(b->tx_buf), "@%s ", classes[b->cls].name);
+        size = size > prefix ? size - prefix : 0;
+    }
+    size_t len = prefix + probe_format(b->tx_buf + prefix, sizeof(b->tx_buf) - prefix, size, &probe);
+
+    b->tx_len = len;
+    b->tx_off = 0;
+    b->sent++;
+    b->bytes_sent += len;
+
+    if (w->cfg->proto == PROTO_UDP) {
+        if (send(b->fd, b->tx_buf, len, 0) < 0) {
+            b->send_errors++;
+        }
+        b->tx_len = 0;
+        return;
+    }
+    board_flush(w, b, idx);
+}
+
+static void board_account(board_t *b, const char *data, size_t len)
+{
+    probe_t probe;
+
+    if (probe_parse(data, len, &probe) == 0 && probe.board == b->id) {
+        hist_record(&b->rtt, ts_now_ns() - probe.send_ns);
+        b->received++;
+    }
+}
+
+/* TCP replies may be split or merged by the server, so re-frame on '\n' */
+static void board_account_stream(board_t *b)
+{
+    size_t start = 0;
+
+    for (size_t i = 0; i < b->rx_len; i++) {
+        if (b->rx_buf[i] == '\n') {
+            board_account(b, b->rx_buf + start, i - start);
+            start = i + 1;
+        }
+    }
+
+    if (start == 0 && b->rx_len == sizeof(b->rx_buf)) {
+        start = b->rx_len;  /* garbage without newline, drop it */
+    }
+    memmove(b->rx_buf, b->rx_buf + start, b->rx_len - start);
+    b->rx_len -= start;
+}
+
+static void board_receive(worker_t *w, board_t *b)
+{
+    for (;;) {
+        ssize_t n;
+
+        if (w->cfg->proto == PROTO_UDP) {
+            char datagram[BUFFER_SIZE + 16];
+            n = recv(b->fd, datagram, sizeof(datagram), 0);
+            if (n > 0) {
+                b->bytes_received += (uint64_t)n;
+                board_account(b, datagram, (size_t)n);
+                continue;
+            }
+        } else {
+            n = recv(b->fd, b->rx_buf + b->rx_len, sizeof(b->rx_buf) - b->rx_len, 0);
+            if (n > 0) {
+                b->bytes_received += (uint64_t)n;
+                b->rx_len += (size_t)n;
+                board_account_stream(b);
+                continue;
+            }
+        }
+
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (n < 0 && w->cfg->proto == PROTO_UDP) {
+            b->recv_errors++;  /* e.g. ECONNREFUSED from an ICMP error */
+            return;
+        }
+
+        /* TCP: server closed the connection or hard error */
+        b->recv_errors++;
+        board_close(w, b);
+        return;
+    }
+}
+
+static void board_event(worker_t *w, unsigned idx, uint32_t events)
+{
+    board_t *b = &w->boards[idx];
+
+    if (b->fd < 0) {
+        return;
+    }
+
+    if (b->state == BOARD_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(b->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+            b->connect_errors++;
+            board_close(w, b);
+            b->reconnect_at_ns = mono_ns() + RETRY_NS;
+            return;
+        }
+        b->state = BOARD_CONNECTED;
+        board_watch(w, b, idx, EPOLL_CTL_MOD, EPOLLIN);
+        return;
+    }
+
+    if (events & EPOLLOUT) {
+        board_flush(w, b, idx);
+    }
+    if (b->fd >= 0 && (events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+        board_receive(w, b);
+    }
+}
+
+/* ---- worker loop --------------------------------------------------------- */
+
+static void *worker_run(void *arg)
+{
+    worker_t *w = arg;
+    const config_t *cfg = w->cfg;
+    struct epoll_event events[MAX_EVENTS];
+    int64_t start    = mono_ns();
+    int64_t end_send = start + (int64_t)(cfg->duration_s * 1e9);
+    int64_t end      = end_send + DRAIN_NS;
+
+    for (unsigned i = 0; i < w->count; i++) {
+        board_t *b = &w->boards[i];
+        board_connect(w, b, i, start);
+        /* Spread the first sends so boards do not fire in lockstep */
+        b->next_send_ns = start + (int64_t)(rng_uniform(w) * 1e9 / cfg->rate);
+        heap_push(w, i);
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = TIMER_KEY };
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->timer_fd, &ev);
+
+    for (;;) {
+        int64_t now = mono_ns();
+        if (now >= end) {
+            break;
+        }
+
+        while (now < end_send && w->heap_len > 0 && w->boards[w->heap[0]].next_send_ns <= now) {
+            unsigned idx = heap_pop(w);
+            board_t *b = &w->boards[idx];
+            board_send(w, b, idx, now);
+            b->next_send_ns += next_interval_ns(w);
+            heap_push(w, idx);
+        }
+
+        arm_timer(w, (now < end_send && w->heap_len > 0) ?
+                  w->boards[w->heap[0]].next_send_ns : end);
+
+        int n = epoll_wait(w->epfd, events, MAX_EVENTS, -1);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.u32 == TIMER_KEY) {
+                uint64_t expirations;
+                ssize_t r = read(w->timer_fd, &expirations, sizeof(expirations));
+                (void)r;
+                continue;
+            }
+            board_event(w, events[i].data.u32, events[i].events);
+        }
+    }
+
+    for (unsigned i = 0; i < w->count; i++) {
+        board_close(w, &w->boards[i]);
+    }
+    return NULL;
+}
+
+/* ---- command line and report --------------------------------------------- */
+
+static int parse_mix(config_t *cfg, const char *spec)
+{
+    char *copy = strdup(spec);
+    char *save = NULL;
+
+    cfg->mix_count = 0;
+    cfg->mix_total = 0;
+
+    for (char *tok = strtok_r(copy, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        unsigned long size = strtoul(tok, NULL, 10);
+        char *colon = strchr(tok, ':');
+        unsigned long weight = colon != NULL ? strtoul(colon + 1, NULL, 10) : 1;
+
+        if (cfg->mix_count == MAX_MIX || size == 0 || size > BUFFER_SIZE - 16 || weight == 0) {
+            free(copy);
+            return -1;
+        }
+        cfg->mix[cfg->mix_count].size   = size;
+        cfg->mix[cfg->mix_count].weight = (unsigned)weight;
+        cfg->mix_total += (unsigned)weight;
+        cfg->mix_count++;
+    }
+
+    free(copy);
+    return cfg->mix_count > 0 ? 0 : -1;
+}
+
+/* Comma separated profile names, kept as given for the board to check */
+static int parse_profiles(config_t *cfg, const char *spec)
+{
+    char *copy = strdup(spec);
+    char *save = NULL;
+
+    cfg->profile_count = 0;
+    for (char *tok = strtok_r(copy, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        if (cfg->profile_count == MAX_PROFILES || strlen(tok) > 32) {
+            free(copy);
+            return -1;
+        }
+        cfg->profiles[cfg->profile_count++] = strdup(tok);
+    }
+
+    free(copy);
+    return cfg->profile_count > 0 ? 0 : -1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <server-ip>\n"
+            "  -u            use UDP (default TCP)\n"
+            "  -p <port>     server port (default %d)\n"
+            "  -n <boards>   number of simulated boards (default 10)\n"
+            "  -T <threads>  worker threads (default 2)\n"
+            "  -r <rate>     messages per second per board (default 10)\n"
+            "  -P            Poisson arrivals (default constant rate)\n"
+            "  -m <mix>      message size mix, size:weight[,...] (default 64:1)\n"
+            "  -c <seconds>  mean time between random reconnects (default 0 = never)\n"
+            "  -d <seconds>  test duration (default 10)\n"
+            "  -W <list>     run once per board power profile, e.g.\n"
+            "                low-latency,balanced,low-power\n"
+            "  -s <seconds>  settle time after a profile switch (default 2)\n"
+            "  -Q <list>     priority classes assigned to the boards in turn,\n"
+            "                e.g. vo,be,bk (board firmware with priority classes)\n"
+            "  -F <batches>  UDP only: flood of telemetry batches from the board\n"
+            "                during each run (CONFIG_UDP_SOCKET_DEMO_TELEMETRY)\n",
+            prog, PORT);
+}
+
+static void print_board_line(const char *name, const board_t *b)
+{
+    uint64_t errors = b->connect_errors + b->send_errors + b->recv_errors;
+    uint64_t lost   = b->sent > b->received ? b->sent - b->received : 0;
+
+    printf("%-11s %9llu %9llu %7llu %6llu %6llu %7llu %9.1f %9.1f %9.1f %9.1f\n",
+           name,
+           (unsigned long long)b->sent,
+           (unsigned long long)b->received,
+           (unsigned long long)lost,
+           (unsigned long long)errors,
+           (unsigned long long)b->reconnects,
+           (unsigned long long)b->stalls,
+           hist_percentile(&b->rtt, 0.50) / 1000.0,
+           hist_percentile(&b->rtt, 0.90) / 1000.0,
+           hist_percentile(&b->rtt, 0.99) / 1000.0,
+           b->rtt.max_ns / 1000.0);
+}
+
+static void print_header(const char *first)
+{
+    printf("%-11s %9s %9s %7s %6s %6s %7s %9s %9s %9s %9s\n",
+           first, "sent", "recv", "lost", "errors", "reconn", "stalls",
+           "p50_us", "p90_us", "p99_us", "max_us");
+}
+
+static int parse_classes(config_t *cfg, const char *spec)
+{
+    char *copy = strdup(spec);
+    char *save = NULL;
+
+    cfg->board_class_count = 0;
+    for (char *tok = strtok_r(copy, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        int cls = -1;
+        for (int i = 0; i < CLASS_COUNT; i++) {
+            if (strcmp(tok, classes[i].name) == 0) {
+                cls = i;
+            }
+        }
+        if (cls < 0 || cfg->board_class_count == MAX_CLASSES) {
+            free(copy);
+            return -1;
+        }
+        cfg->board_class[cfg->board_class_count++] = cls;
+    }
+
+    free(copy);
+    return cfg->board_class_count > 0 ? 0 : -1;
+}
+
+/* ---- telemetry flood ------------------------------------------------------ */
+
+typedef struct {
+    const config_t *cfg;
+    int             fd;
+    atomic_int      stop;
+    uint64_t        batches;
+    uint64_t        bytes;
+    int64_t         first_ns;
+    int64_t         last_ns;
+    pthread_t       thread;
+} flood_t;
+
+static void *flood_drain(void *arg)
+{
+    flood_t *f = arg;
+    char datagram[2048];
+
+    while (!atomic_load(&f->stop)) {
+        ssize_t n = recv(f->fd, datagram, sizeof(datagram), 0);
+        if (n <= 0 || !telemetry_is_batch(datagram, (size_t)n)) {
+            continue;   /* timeout (check stop) or no batch */
+        }
+        f->last_ns = mono_ns();
+        if (f->batches++ == 0) {
+            f->first_ns = f->last_ns;
+        }
+        f->bytes += (uint64_t)n;
+    }
+    return NULL;
+}
+
+static void flood_request(const flood_t *f, long batches)
+{
+    char msg[32];
+    int  len = snprintf(msg, sizeof(msg), "TELEMETRY %ld", batches);
+
+    if (send(f->fd, msg, (size_t)len, 0) < 0) {
+        perror("send");
+    }
+}
+
+/* Ask the board for the flood and count what arrives on a separate socket */
+static int flood_start(flood_t *f, const config_t *cfg)
+{
+    memset(f, 0, sizeof(*f));
+    f->cfg = cfg;
+    f->fd  = socket(cfg->server_addr.ss_family, SOCK_DGRAM, 0);
+    if (f->fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    struct timeval tv = { .tv_usec = 200000 };
+    int rcvbuf = 4 << 20;
+    setsockopt(f->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(f->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (connect(f->fd, (const struct sockaddr *)&cfg->server_addr, cfg->server_addr_len) < 0) {
+        perror("connect");
+        close(f->fd);
+        return -1;
+    }
+
+    flood_request(f, cfg->flood_batches);
+    pthread_create(&f->thread, NULL, flood_drain, f);
+    return 0;
+}
+
+static void flood_stop(flood_t *f)
+{
+    flood_request(f, 0);
+    usleep(200000);
+    atomic_store(&f->stop, 1);
+    pthread_join(f->thread, NULL);
+    close(f->fd);
+
+    double span_s = (double)(f->last_ns - f->first_ns) / 1e9;
+    printf("[Loadgen] flood: %llu batches, %.1f kB, %.1f kB/s from the board\n",
+           (unsigned long long)f->batches, (double)f->bytes / 1000.0,
+           span_s > 0.0 ? (double)f->bytes / span_s / 1000.0 : 0.0);
+}
+
+/* Ask the board to switch its power profile with the PROFILE control
+ * message of the echo demo, over the protocol under test */
+static int request_profile(const config_t *cfg, const char *profile)
+{
+    char msg[64];
+    char expect[80];
+    char reply[BUFFER_SIZE];
+    int  len = snprintf(msg, sizeof(msg), "PROFILE %s", profile);
+    snprintf(expect, sizeof(expect), "PROFILE %s OK", profile);
+
+    int fd = socket(cfg->server_addr.ss_family, cfg->proto == PROTO_TCP ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    struct timeval tv = { .tv_sec = 1 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (connect(fd, (const struct sockaddr *)&cfg->server_addr, cfg->server_addr_len) < 0) {
+        perror("connect");
+        close(fd);
+        return -1;
+    }
+
+    /* Switching twice is harmless, so a lost request or reply is simply resent */
+    for (int attempt = 0; attempt < PROFILE_RETRIES; attempt++) {
+        if (send(fd, msg, (size_t)len, 0) < 0) {
+            perror("send");
+            break;
+        }
+        ssize_t n = recv(fd, reply, sizeof(reply) - 1, 0);
+        if (n <= 0) {
+            continue;
+        }
+        reply[n] = '\0';
+        if (strncmp(reply, expect, strlen(expect)) == 0) {
+            close(fd);
+            printf("[Loadgen] board switched to %s\n", profile);
+            return 0;
+        }
+        if (strncmp(reply, "PROFILE ", 8) == 0) {
+            fprintf(stderr, "[Loadgen] board refused: %s\n", reply);
+            close(fd);
+            return -1;
+        }
+    }
+
+    close(fd);
+    fprintf(stderr, "[Loadgen] no acknowledgement for profile %s, skipping it\n", profile);
+    return -1;
+}
+
+/* Run the configured load once, print the per-board report and return the total */
+static board_t run_phase(const config_t *cfg)
+{
+    board_t  *boards  = calloc(cfg->boards, sizeof(board_t));
+    unsigned *heap    = calloc(cfg->boards, sizeof(unsigned));
+    worker_t *workers = calloc(cfg->threads, sizeof(worker_t));
+    if (boards == NULL || heap == NULL || workers == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (unsigned i = 0; i < cfg->boards; i++) {
+        boards[i].id  = i;
+        boards[i].fd  = -1;
+        boards[i].cls = cfg->board_class_count > 0 ?
+                        cfg->board_class[i % cfg->board_class_count] : -1;
+        hist_init(&boards[i].rtt);
+    }
+
+    flood_t flood;
+    int     flooding = cfg->flood_batches > 0 && flood_start(&flood, cfg) == 0;
+
+    printf("[Loadgen] %u %s boards -> %s:%u, %.1f msg/s each (%s), %u threads, %.0f s\n",
+           cfg->boards, cfg->proto == PROTO_TCP ? "TCP" : "UDP", cfg->server_ip, cfg->port,
+           cfg->rate, cfg->arrival == ARRIVAL_POISSON ? "Poisson" : "constant",
+           cfg->threads, cfg->duration_s);
+
+    /* Contiguous board ranges per worker */
+    unsigned first = 0;
+    for (unsigned t = 0; t < cfg->threads; t++) {
+        worker_t *w = &workers[t];
+        w->cfg      = cfg;
+        w->count    = cfg->boards / cfg->threads + (t < cfg->boards % cfg->threads ? 1 : 0);
+        w->boards   = &boards[first];
+        w->heap     = &heap[first];
+        w->rng      = 0x9E3779B97F4A7C15ULL ^ ((uint64_t)(t + 1) * (uint64_t)mono_ns());
+        w->epfd     = epoll_create1(0);
+        w->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+        if (w->epfd < 0 || w->timer_fd < 0) {
+            perror("epoll/timerfd");
+            exit(EXIT_FAILURE);
+        }
+        first += w->count;
+        pthread_create(&w->thread, NULL, worker_run, w);
+    }
+
+    for (unsigned t = 0; t < cfg->threads; t++) {
+        pthread_join(workers[t].thread, NULL);
+        close(workers[t].epfd);
+        close(workers[t].timer_fd);
+    }
+    if (flooding) {
+        flood_stop(&flood);
+    }
+
+    board_t total;
+    memset(&total, 0, sizeof(total));
+    hist_init(&total.rtt);
+
+    print_header("board");
+    for (unsigned i = 0; i < cfg->boards; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "%u", boards[i].id);
+        print_board_line(name, &boards[i]);
+
+        total.sent           += boards[i].sent;
+        total.received       += boards[i].received;
+        total.connect_errors += boards[i].connect_errors;
+        total.send_errors    += boards[i].send_errors;
+        total.recv_errors    += boards[i].recv_errors;
+        total.reconnects     += boards[i].reconnects;
+        total.stalls         += boards[i].stalls;
+        total.bytes_sent     += boards[i].bytes_sent;
+        hist_merge(&total.rtt, &boards[i].rtt);
+    }
+    print_board_line("total", &total);
+
+    /* The point of -Q: latency per class, e.g. while -F floods the board */
+    if (cfg->board_class_count > 0) {
+        printf("\n");
+        print_header("class");
+        for (int c = 0; c < CLASS_COUNT; c++) {
+            board_t sum;
+            int     used = 0;
+
+            memset(&sum, 0, sizeof(sum));
+            hist_init(&sum.rtt);
+            for (unsigned i = 0; i < cfg->boards; i++) {
+                if (boards[i].cls != c) {
+                    continue;
+                }
+                used = 1;
+                sum.sent           += boards[i].sent;
+                sum.received       += boards[i].received;
+                sum.connect_errors += boards[i].connect_errors;
+                sum.send_errors    += boards[i].send_errors;
+                sum.recv_errors    += boards[i].recv_errors;
+                sum.reconnects     += boards[i].reconnects;
+                sum.stalls         += boards[i].stalls;
+                hist_merge(&sum.rtt, &boards[i].rtt);
+            }
+            if (used) {
+                print_board_line(classes[c].name, &sum);
+            }
+        }
+    }
+
+    printf("[Loadgen] errors: connect=%llu send=%llu recv=%llu, %.1f msg/s, %.1f kB/s sent\n",
+           (unsigned long long)total.connect_errors,
+           (unsigned long long)total.send_errors,
+           (unsigned long long)total.recv_errors,
+           (double)total.received / cfg->duration_s,
+           (double)total.bytes_sent / cfg->duration_s / 1000.0);
+
+    free(workers);
+    free(heap);
+    free(boards);
+    return total;
+}
+
+int main(int argc, char *argv[])
+{
+    config_t cfg = {
+        .port        = PORT,
+        .proto       = PROTO_TCP,
+        .arrival     = ARRIVAL_CONSTANT,
+        .boards      = 10,
+        .threads     = 2,
+        .rate        = 10.0,
+        .duration_s  = 10.0,
+        .reconnect_s = 0.0,
+        .settle_s    = 2.0,
+    };
+    int c;
+
+    parse_mix(&cfg, "64:1");
+
+    while ((c = getopt(argc, argv, "up:n:T:r:Pm:c:d:W:s:Q:F:h")) != -1) {
+        switch (c) {
+        case 'u': cfg.proto       = PROTO_UDP; break;
+        case 'p': cfg.port        = (uint16_t)atoi(optarg); break;
+        case 'n': cfg.boards      = (unsigned)atoi(optarg); break;
+        case 'T': cfg.threads     = (unsigned)atoi(optarg); break;
+        case 'r': cfg.rate        = atof(optarg); break;
+        case 'P': cfg.arrival     = ARRIVAL_POISSON; break;
+        case 'c': cfg.reconnect_s = atof(optarg); break;
+        case 'd': cfg.duration_s  = atof(optarg); break;
+        case 's': cfg.settle_s    = atof(optarg); break;
+        case 'F': cfg.flood_batches = atol(optarg); break;
+        case 'Q':
+            if (parse_classes(&cfg, optarg) < 0) {
+                fprintf(stderr, "Invalid class list '%s' (be, bk, vi, vo)\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'W':
+            if (parse_profiles(&cfg, optarg) < 0) {
+                fprintf(stderr, "Invalid profile list '%s' (at most %d)\n", optarg, MAX_PROFILES);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'm':
+            if (parse_mix(&cfg, optarg) < 0) {
+                fprintf(stderr, "Invalid mix '%s' (sizes 1..%d)\n", optarg, BUFFER_SIZE - 16);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind >= argc || cfg.boards == 0 || cfg.threads == 0 || cfg.rate <= 0.0) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.flood_batches > 0 && cfg.proto != PROTO_UDP) {
+        fprintf(stderr, "-F needs -u, the TCP echo server takes one client at a time\n");
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.threads > cfg.boards) {
+        cfg.threads = cfg.boards;
+    }
+    cfg.server_ip = argv[optind];
+
+    if (netaddr_resolve(cfg.server_ip, cfg.port, cfg.proto == PROTO_TCP ? SOCK_STREAM : SOCK_DGRAM,
+                        &cfg.server_addr, &cfg.server_addr_len) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (cfg.profile_count == 0) {
+        run_phase(&cfg);
+        return 0;
+    }
+
+    /* One run per profile, then the latency/throughput trade-off side by side */
+    board_t *summary = calloc(cfg.profile_count, sizeof(board_t));
+    int     *valid   = calloc(cfg.profile_count, sizeof(int));
+    if (summary == NULL || valid == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (unsigned i = 0; i < cfg.profile_count; i++) {
+        printf("\n[Loadgen] ==== profile %s ====\n", cfg.profiles[i]);
+        if (request_profile(&cfg, cfg.profiles[i]) < 0) {
+            continue;
+        }
+        usleep((useconds_t)(cfg.settle_s * 1e6));
+        summary[i] = run_phase(&cfg);
+        valid[i]   = 1;
+    }
+
+    printf("\n[Loadgen] profile summary (%.1f msg/s per board, %.0f s each)\n", cfg.rate, cfg.duration_s);
+    print_header("profile");
+    for (unsigned i = 0; i < cfg.profile_count; i++) {
+        if (valid[i]) {
+            print_board_line(cfg.profiles[i], &summary[i]);
+        } else {
+            printf("%-11s (profile not applied)\n", cfg.profiles[i]);
+        }
+    }
+
+    free(valid);
+    free(summary);
+    return 0;
+}
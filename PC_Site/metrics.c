@@ -0,0 +1,68 @@
+#include "metrics.h"
+
+#include <string.h>
+
+static uint16_t get16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+int metrics_decode(const void *buf, size_t len, metrics_snapshot_t *s)
+{
+    const uint8_t *p = buf;
+
+    /* Later versions may append fields, older ones are refused */
+    if (len < METRICS_LEN || p[0] != METRICS_MAGIC || p[1] != METRICS_VERSION) {
+        return -1;
+    }
+    memset(s, 0, sizeof(*s));
+    s->rssi = (int8_t)p[2];
+    s->channel = p[3];
+    memcpy(s->mac, &p[4], sizeof(s->mac));
+    s->seq = get32(&p[12]);
+    s->uptime_ms = get32(&p[16]) | (uint64_t)get32(&p[20]) << 32;
+    s->resets = get32(&p[24]);
+    for (int i = 0; i < METRICS_COUNTERS; i++) {
+        s->counter[i] = get32(&p[28 + 4 * i]);
+    }
+    for (int i = 0; i < METRICS_POOLS; i++) {
+        s->pool_free[i] = get16(&p[52 + 4 * i]);
+        s->pool_total[i] = get16(&p[54 + 4 * i]);
+    }
+    s->send_us_sum = get32(&p[68]);
+    s->rtt_us_sum = get32(&p[72]);
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+        s->send_us[b] = get32(&p[76 + 4 * b]);
+        s->rtt_us[b] = get32(&p[76 + 4 * (METRICS_BUCKETS + b)]);
+    }
+    s->stack_free = get32(&p[76 + 8 * METRICS_BUCKETS]);
+    memcpy(s->stack_thread, &p[80 + 8 * METRICS_BUCKETS], METRICS_NAME_LEN);
+    /* Ends up in a Prometheus label, which must be UTF-8; the collector
+     * escapes the rest */
+    for (char *c = s->stack_thread; *c != '\0'; c++) {
+        if ((*c < 0x20 && *c != '\n') || *c > 0x7E) {
+            *c = '_';
+        }
+    }
+    return 0;
+}
+
+const char *metrics_counter_name(metrics_counter_t c)
+{
+    static const char *names[METRICS_COUNTERS] = {
+        "sent_messages", "received_messages", "sent_bytes", "received_bytes",
+        "reconnects", "errors",
+    };
+    return (unsigned)c < METRICS_COUNTERS ? names[c] : "?";
+}
+
+const char *metrics_pool_name(metrics_pool_t p)
+{
+    static const char *names[METRICS_POOLS] = { "rx_pkt", "tx_pkt", "rx_buf", "tx_buf" };
+    return (unsigned)p < METRICS_POOLS ? names[p] : "?";
+}
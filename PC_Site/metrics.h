@@ -0,0 +1,70 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Decoder for the board's metrics snapshots (CONFIG_COMM_ENGINE_METRICS,
+ * modules/comm_engine/comm_metrics.c), one UDP datagram of METRICS_LEN
+ * bytes to METRICS_PORT every few seconds.
+ *
+ * All counters are the board's raw 32-bit values, wrapping, since boot or
+ * its last `net perf reset`. Histogram bucket b counts latencies in
+ * [2^b, 2^(b+1)) us, the last bucket is open ended.
+ */
+
+#define METRICS_PORT        8082
+#define METRICS_MAGIC       0xB9
+#define METRICS_VERSION     2
+#define METRICS_BUCKETS     20
+#define METRICS_NAME_LEN    16
+#define METRICS_LEN         (76 + 2 * 4 * METRICS_BUCKETS + 4 + METRICS_NAME_LEN)
+#define METRICS_NO_RSSI     (-128)      /* not associated */
+#define METRICS_UNKNOWN     0xFFFF      /* free pool entries not tracked */
+#define METRICS_NO_STACK    0xFFFFFFFFu /* stack usage not tracked */
+
+typedef enum {
+    METRICS_TX_MSGS,
+    METRICS_RX_MSGS,
+    METRICS_TX_BYTES,
+    METRICS_RX_BYTES,
+    METRICS_RECONNECTS,
+    METRICS_ERRORS,
+    METRICS_COUNTERS,
+} metrics_counter_t;
+
+typedef enum {
+    METRICS_POOL_RX_PKT,
+    METRICS_POOL_TX_PKT,
+    METRICS_POOL_RX_BUF,
+    METRICS_POOL_TX_BUF,
+    METRICS_POOLS,
+} metrics_pool_t;
+
+typedef struct {
+    uint8_t  mac[6];
+    int8_t   rssi;
+    uint8_t  channel;
+    uint32_t seq;
+    uint64_t uptime_ms;
+    uint32_t resets;
+    uint32_t counter[METRICS_COUNTERS];
+    uint16_t pool_free[METRICS_POOLS];
+    uint16_t pool_total[METRICS_POOLS];
+    uint32_t send_us_sum;
+    uint32_t rtt_us_sum;
+    uint32_t send_us[METRICS_BUCKETS];
+    uint32_t rtt_us[METRICS_BUCKETS];
+    uint32_t stack_free;                        /* least unused stack of any thread */
+    char     stack_thread[METRICS_NAME_LEN + 1];
+} metrics_snapshot_t;
+
+/* Decode one datagram, -1 when it is not a snapshot of this version */
+int metrics_decode(const void *buf, size_t len, metrics_snapshot_t *s);
+
+/* Prometheus / label names */
+const char *metrics_counter_name(metrics_counter_t c);
+const char *metrics_pool_name(metrics_pool_t p);
+
+#endif /* METRICS_H */
@@ -0,0 +1,529 @@
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "metrics.h"
+#include "netaddr.h"
+
+#define DEFAULT_HTTP_PORT   9464
+#define DEFAULT_MAX_BOARDS  1024
+#define REQUEST_SIZE        2048
+#define HTTP_TIMEOUT_MS     1000
+
+/*
+ * Collects the metrics snapshots of every board on the network (see
+ * metrics.h) and serves them in the Prometheus text format on
+ * http://<host>:<port>/metrics.
+ *
+ * Boards are told apart by MAC address, so a board that gets a new IP
+ * address keeps its series. A board without a WiFi interface reports an
+ * all-zero MAC and is told apart by its source address instead, without
+ * the port: the board reopens its socket on a new ephemeral port after
+ * send errors and reboots, and must keep its series across both. The
+ * collector turns the board's wrapping 32-bit counters into 64-bit
+ * totals: the first snapshot of a board adds its values, every later one
+ * its increment over the previous one. A board that rebooted (uptime
+ * went back) or ran `net perf reset` counts from zero again, so its new
+ * values are added as a whole. Gaps in the sequence numbers count as
+ * lost snapshots; their increments are not lost, the next snapshot
+ * carries them.
+ *
+ * One thread serves both sockets. A scrape is answered in one go and
+ * a client gets HTTP_TIMEOUT_MS to send its request, snapshots wait in
+ * the socket buffer meanwhile.
+ */
+
+typedef struct {
+    char               name[NETADDR_STRLEN];    /* board label: MAC, or source host without one */
+    char               ip[NETADDR_STRLEN];
+    metrics_snapshot_t last;
+    int64_t            last_ms;
+    uint64_t           counter[METRICS_COUNTERS];
+    uint64_t           send_us_sum;
+    uint64_t           rtt_us_sum;
+    uint64_t           send_us[METRICS_BUCKETS];
+    uint64_t           rtt_us[METRICS_BUCKETS];
+    uint64_t           snapshots;
+    uint64_t           lost;
+    uint64_t           restarts;
+} board_t;
+
+static board_t *boards;
+static size_t board_count;
+static size_t max_boards = DEFAULT_MAX_BOARDS;
+static uint64_t invalid;        /* datagrams that were no snapshot */
+static uint64_t stale;          /* duplicated or reordered snapshots */
+static uint64_t dropped;        /* snapshots of boards beyond max_boards */
+static uint64_t scrapes;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-p <port>] [-l <port>] [-b <boards>] [-v]\n"
+            "  -p <port>    UDP port of the snapshots (default %d)\n"
+            "  -l <port>    HTTP port of the /metrics endpoint (default %d)\n"
+            "  -b <boards>  most boards tracked (default %d)\n"
+            "  -v           print every snapshot\n",
+            prog, METRICS_PORT, DEFAULT_HTTP_PORT, DEFAULT_MAX_BOARDS);
+}
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void format_mac(const uint8_t *mac, char *out, size_t len)
+{
+    snprintf(out, len, "%02x:%02x:%02x:%02x:%02x:%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+static board_t *find_board(const uint8_t *mac, const struct sockaddr *from)
+{
+    static const uint8_t no_mac[6];
+    char name[NETADDR_STRLEN];
+
+    if (memcmp(mac, no_mac, sizeof(no_mac)) == 0) {
+        netaddr_host(from, name, sizeof(name));
+    } else {
+        format_mac(mac, name, sizeof(name));
+    }
+    for (size_t i = 0; i < board_count; i++) {
+        if (strcmp(boards[i].name, name) == 0) {
+            return &boards[i];
+        }
+    }
+    if (board_count == max_boards) {
+        return NULL;
+    }
+    board_t *b = &boards[board_count++];
+    memset(b, 0, sizeof(*b));
+    memcpy(b->name, name, sizeof(b->name));
+    return b;
+}
+
+/* Increment of a wrapping counter; everything when the board restarted it */
+static uint32_t delta(uint32_t cur, uint32_t prev, int restarted)
+{
+    return restarted ? cur : cur - prev;
+}
+
+static void accumulate(board_t *b, const metrics_snapshot_t *s)
+{
+    const metrics_snapshot_t *prev = &b->last;
+    int first = b->snapshots == 0;
+    int rebooted = !first && s->uptime_ms < prev->uptime_ms;
+    int restarted = first || rebooted || s->resets != prev->resets;
+
+    if (!first) {
+        if (!rebooted && (int32_t)(s->seq - prev->seq) <= 0) {
+            stale++;
+            return;
+        }
+        b->lost += rebooted ? s->seq : s->seq - prev->seq - 1;
+        b->restarts += restarted;
+    }
+    for (int i = 0; i < METRICS_COUNTERS; i++) {
+        b->counter[i] += delta(s->counter[i], prev->counter[i], restarted);
+    }
+    b->send_us_sum += delta(s->send_us_sum, prev->send_us_sum, restarted);
+    b->rtt_us_sum += delta(s->rtt_us_sum, prev->rtt_us_sum, restarted);
+    for (int k = 0; k < METRICS_BUCKETS; k++) {
+        b->send_us[k] += delta(s->send_us[k], prev->send_us[k], restarted);
+        b->rtt_us[k] += delta(s->rtt_us[k], prev->rtt_us[k], restarted);
+    }
+    b->last = *s;
+    b->snapshots++;
+}
+
+static void on_snapshot(const uint8_t *buf, size_t len, const struct sockaddr *from, int verbose)
+{
+    metrics_snapshot_t s;
+
+    if (metrics_decode(buf, len, &s) < 0) {
+        invalid++;
+        return;
+    }
+    board_t *b = find_board(s.mac, from);
+    if (b == NULL) {
+        dropped++;
+        return;
+    }
+    netaddr_host(from, b->ip, sizeof(b->ip));
+    if (b->snapshots == 0) {
+        printf("[Metrics] New board %s at %s\n", b->name, b->ip);
+    }
+    b->last_ms = now_ms();
+    accumulate(b, &s);
+
+    if (verbose) {
+        printf("[Metrics] %s seq %u up %llu s: tx %u msgs, rx %u msgs, %u errors, RSSI %d\n",
+               b->name, s.seq, (unsigned long long)(s.uptime_ms / 1000),
+               s.counter[METRICS_TX_MSGS], s.counter[METRICS_RX_MSGS],
+               s.counter[METRICS_ERRORS], s.rssi);
+    }
+}
+
+/* ---- Prometheus text format ---- */
+
+typedef enum { HIST_SEND, HIST_RTT } hist_t;
+
+/* Label value with backslash, double quote and newline escaped */
+static const char *label(const char *in, char *out, size_t len)
+{
+    size_t n = 0;
+
+    for (; *in != '\0' && n + 2 < len; in++) {
+        if (*in == '\\' || *in == '"' || *in == '\n') {
+            out[n++] = '\\';
+            out[n++] = *in == '\n' ? 'n' : *in;
+        } else {
+            out[n++] = *in;
+        }
+    }
+    out[n] = '\0';
+    return out;
+}
+
+static void header(FILE *out, const char *name, const char *type, const char *help)
+{
+    fprintf(out, "# HELP iris_%s %s\n# TYPE iris_%s %s\n", name, help, name, type);
+}
+
+static void histogram(FILE *out, hist_t which, const char *name, const char *help)
+{
+    header(out, name, "histogram", help);
+    for (size_t i = 0; i < board_count; i++) {
+        const board_t *b = &boards[i];
+        const uint64_t *hist = which == HIST_SEND ? b->send_us : b->rtt_us;
+        uint64_t sum_us = which == HIST_SEND ? b->send_us_sum : b->rtt_us_sum;
+        const char *board = b->name;
+        uint64_t count = 0;
+
+        /* The board's buckets end at 2^(b+1) us, the last one is open */
+        for (int k = 0; k < METRICS_BUCKETS - 1; k++) {
+            count += hist[k];
+            fprintf(out, "iris_%s_bucket{board=\"%s\",le=\"%g\"} %llu\n", name, board,
+                    (double)(2u << k) / 1e6, (unsigned long long)count);
+        }
+        count += hist[METRICS_BUCKETS - 1];
+        fprintf(out, "iris_%s_bucket{board=\"%s\",le=\"+Inf\"} %llu\n", name, board,
+                (unsigned long long)count);
+        fprintf(out, "iris_%s_sum{board=\"%s\"} %.6f\n", name, board, (double)sum_us / 1e6);
+        fprintf(out, "iris_%s_count{board=\"%s\"} %llu\n", name, board, (unsigned long long)count);
+    }
+}
+
+static void write_metrics(FILE *out)
+{
+    static const char *counter_help[METRICS_COUNTERS] = {
+        "Messages sent by all engines of the board",
+        "Messages received by all engines of the board",
+        "Bytes sent by all engines of the board",
+        "Bytes received by all engines of the board",
+        "Reconnects of all engines of the board",
+        "Send and receive errors of all engines of the board",
+    };
+    int64_t now = now_ms();
+    const char *board;
+    char thread[2 * METRICS_NAME_LEN + 1];
+    char name[64];
+
+    header(out, "board_info", "gauge", "Boards seen by the collector, with their last address");
+    for (size_t i = 0; i < board_count; i++) {
+        board = boards[i].name;
+        fprintf(out, "iris_board_info{board=\"%s\",ip=\"%s\"} 1\n", board, boards[i].ip);
+    }
+
+    for (int c = 0; c < METRICS_COUNTERS; c++) {
+        snprintf(name, sizeof(name), "%s_total", metrics_counter_name(c));
+        header(out, name, "counter", counter_help[c]);
+        for (size_t i = 0; i < board_count; i++) {
+            board = boards[i].name;
+            fprintf(out, "iris_%s{board=\"%s\"} %llu\n", name, board,
+                    (unsigned long long)boards[i].counter[c]);
+        }
+    }
+
+    histogram(out, HIST_SEND, "send_seconds", "Time spent in the transport send");
+    histogram(out, HIST_RTT, "rtt_seconds", "Round trip times reported by the application");
+
+    header(out, "rssi_dbm", "gauge", "Signal strength of the WiFi link, absent while not associated");
+    for (size_t i = 0; i < board_count; i++) {
+        if (boards[i].last.rssi != METRICS_NO_RSSI) {
+            board = boards[i].name;
+            fprintf(out, "iris_rssi_dbm{board=\"%s\",channel=\"%u\"} %d\n", board,
+                    boards[i].last.channel, boards[i].last.rssi);
+        }
+    }
+
+    header(out, "pool_free", "gauge", "Free network packets and buffers, absent when not tracked");
+    for (size_t i = 0; i < board_count; i++) {
+        board = boards[i].name;
+        for (int p = 0; p < METRICS_POOLS; p++) {
+            if (boards[i].last.pool_free[p] != METRICS_UNKNOWN) {
+                fprintf(out, "iris_pool_free{board=\"%s\",pool=\"%s\"} %u\n", board,
+                        metrics_pool_name(p), boards[i].last.pool_free[p]);
+            }
+        }
+    }
+    header(out, "pool_size", "gauge", "Network packets and buffers in each pool, absent without a native stack");
+    for (size_t i = 0; i < board_count; i++) {
+        board = boards[i].name;
+        for (int p = 0; p < METRICS_POOLS; p++) {
+            if (boards[i].last.pool_total[p] != 0) {
+                fprintf(out, "iris_pool_size{board=\"%s\",pool=\"%s\"} %u\n", board,
+                        metrics_pool_name(p), boards[i].last.pool_total[p]);
+            }
+        }
+    }
+
+    header(out, "stack_free_min_bytes", "gauge",
+           "Least unused stack of any thread since boot, absent when not tracked");
+    for (size_t i = 0; i < board_count; i++) {
+        if (boards[i].last.stack_free != METRICS_NO_STACK) {
+            board = boards[i].name;
+            fprintf(out, "iris_stack_free_min_bytes{board=\"%s\",thread=\"%s\"} %u\n", board,
+                    label(boards[i].last.stack_thread, thread, sizeof(thread)),
+                    boards[i].last.stack_free);
+        }
+    }
+
+    header(out, "uptime_seconds", "gauge", "Time since the board booted");
+    for (size_t i = 0; i < board_count; i++) {
+        board = boards[i].name;
+        fprintf(out, "iris_uptime_seconds{board=\"%s\"} %.3f\n", board,
+                (double)boards[i].last.uptime_ms / 1e3);
+    }
+    header(out, "snapshot_age_seconds", "gauge", "Time since the last snapshot of the board");
+    for (size_t i = 0; i < board_count; i++) {
+        board = boards[i].name;
+        fprintf(out, "iris_snapshot_age_seconds{board=\"%s\"} %.3f\n", board,
+                (double)(now - boards[i].last_ms) / 1e3);
+    }
+    header(out, "snapshots_total", "counter", "Snapshots received from the board");
+    for (size_t i = 0; i < board_count; i++) {
+        board = boards[i].name;
+        fprintf(out, "iris_snapshots_total{board=\"%s\"} %llu\n", board,
+                (unsigned long long)boards[i].snapshots);
+    }
+    header(out, "snapshots_lost_total", "counter", "Gaps in the snapshot sequence numbers");
+    for (size_t i = 0; i < board_count; i++) {
+        board = boards[i].name;
+        fprintf(out, "iris_snapshots_lost_total{board=\"%s\"} %llu\n", board,
+                (unsigned long long)boards[i].lost);
+    }
+    header(out, "counter_restarts_total", "counter", "Reboots and `net perf reset`s of the board");
+    for (size_t i = 0; i < board_count; i++) {
+        board = boards[i].name;
+        fprintf(out, "iris_counter_restarts_total{board=\"%s\"} %llu\n", board,
+                (unsigned long long)boards[i].restarts);
+    }
+
+    header(out, "collector_boards", "gauge", "Boards tracked by the collector");
+    fprintf(out, "iris_collector_boards %zu\n", board_count);
+    header(out, "collector_invalid_total", "counter", "Datagrams that were no snapshot");
+    fprintf(out, "iris_collector_invalid_total %llu\n", (unsigned long long)invalid);
+    header(out, "collector_stale_total", "counter", "Duplicated or reordered snapshots, ignored");
+    fprintf(out, "iris_collector_stale_total %llu\n", (unsigned long long)stale);
+    header(out, "collector_dropped_total", "counter", "Snapshots of boards beyond the -b limit");
+    fprintf(out, "iris_collector_dropped_total %llu\n", (unsigned long long)dropped);
+}
+
+/* ---- HTTP ---- */
+
+static void send_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+static void respond(int fd, const char *status, const char *type, const char *body, size_t len)
+{
+    char head[256];
+    int n = snprintf(head, sizeof(head),
+                     "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                     "Connection: close\r\n\r\n", status, type, len);
+    send_all(fd, head, (size_t)n);
+    send_all(fd, body, len);
+}
+
+static void serve(int listen_fd)
+{
+    char req[REQUEST_SIZE];
+    size_t len = 0;
+    struct timeval tv = { .tv_sec = HTTP_TIMEOUT_MS / 1000, .tv_usec = (HTTP_TIMEOUT_MS % 1000) * 1000 };
+    int fd = accept(listen_fd, NULL, NULL);
+
+    if (fd < 0) {
+        return;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    /* Only the request line matters, read up to the end of the headers */
+    while (len < sizeof(req) - 1) {
+        ssize_t n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+        if (n <= 0) {
+            break;
+        }
+        len += (size_t)n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n") != NULL) {
+            break;
+        }
+    }
+    req[len] = '\0';
+
+    if (strncmp(req, "GET /metrics ", 13) == 0 || strncmp(req, "GET / ", 6) == 0) {
+        char *body = NULL;
+        size_t body_len = 0;
+        FILE *out = open_memstream(&body, &body_len);
+
+        if (out != NULL) {
+            write_metrics(out);
+            fclose(out);
+            respond(fd, "200 OK", "text/plain; version=0.0.4; charset=utf-8", body, body_len);
+            free(body);
+            scrapes++;
+        }
+    } else if (strncmp(req, "GET ", 4) == 0) {
+        respond(fd, "404 Not Found", "text/plain", "Not found\n", 10);
+    } else {
+        respond(fd, "405 Method Not Allowed", "text/plain", "Only GET\n", 9);
+    }
+    close(fd);
+}
+
+static int open_socket(int type, int port)
+{
+    int fd = netaddr_server_socket(type, (uint16_t)port);
+
+    if (fd < 0) {
+        return -1;
+    }
+    if (type == SOCK_STREAM && listen(fd, 16) < 0) {
+        perror("listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[])
+{
+    int port = METRICS_PORT;
+    int http_port = DEFAULT_HTTP_PORT;
+    int verbose = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "p:l:b:vh")) != -1) {
+        switch (c) {
+        case 'p': port = atoi(optarg); break;
+        case 'l': http_port = atoi(optarg); break;
+        case 'b': max_boards = strtoul(optarg, NULL, 10); break;
+        case 'v': verbose = 1; break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc || port <= 0 || port > 65535 || http_port <= 0 || http_port > 65535 ||
+        max_boards == 0) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    boards = calloc(max_boards, sizeof(*boards));
+    if (boards == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int udp_fd = open_socket(SOCK_DGRAM, port);
+    int http_fd = udp_fd < 0 ? -1 : open_socket(SOCK_STREAM, http_port);
+    if (udp_fd < 0 || http_fd < 0) {
+        exit(EXIT_FAILURE);
+    }
+    /* Room for a burst of snapshots while a scrape is answered */
+    int rcvbuf = 1 << 20;
+    setsockopt(udp_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    printf("[Metrics] Snapshots on UDP port %d, Prometheus endpoint http://0.0.0.0:%d/metrics\n",
+           port, http_port);
+
+    struct pollfd fds[2] = {
+        { .fd = udp_fd, .events = POLLIN },
+        { .fd = http_fd, .events = POLLIN },
+    };
+    while (!stop_requested) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            /* Drain what is queued, a scrape should see the latest values */
+            for (;;) {
+                uint8_t buf[1500];
+                struct sockaddr_storage from;
+                socklen_t from_len = sizeof(from);
+                ssize_t n = recvfrom(udp_fd, buf, sizeof(buf), MSG_DONTWAIT,
+                                     (struct sockaddr *)&from, &from_len);
+                if (n < 0) {
+                    break;
+                }
+                on_snapshot(buf, (size_t)n, (struct sockaddr *)&from, verbose);
+            }
+        }
+        if (fds[1].revents & POLLIN) {
+            serve(http_fd);
+        }
+    }
+
+    uint64_t snapshots = 0, lost = 0;
+    for (size_t i = 0; i < board_count; i++) {
+        snapshots += boards[i].snapshots;
+        lost += boards[i].lost;
+    }
+    printf("\n[Metrics] %zu boards, %llu snapshots, %llu lost, %llu invalid, %llu scrapes\n",
+           board_count, (unsigned long long)snapshots, (unsigned long long)lost,
+           (unsigned long long)invalid, (unsigned long long)scrapes);
+
+    close(http_fd);
+    close(udp_fd);
+    free(boards);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,165 @@
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "netaddr.h"
+
+int netaddr_resolve(const char *host, uint16_t port, int socktype,
+                    struct sockaddr_storage *addr, socklen_t *len)
+{
+    struct addrinfo hints, *res;
+    char service[8];
+    int ret;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = socktype;
+    hints.ai_flags    = AI_NUMERICSERV;
+    snprintf(service, sizeof(service), "%u", port);
+
+    ret = getaddrinfo(host, service, &hints, &res);
+    if (ret != 0) {
+        fprintf(stderr, "%s: %s\n", host, gai_strerror(ret));
+        return -1;
+    }
+    memcpy(addr, res->ai_addr, res->ai_addrlen);
+    *len = res->ai_addrlen;
+    freeaddrinfo(res);
+    return 0;
+}
+
+int netaddr_server_socket(int socktype, uint16_t port)
+{
+    struct sockaddr_storage addr;
+    socklen_t len;
+    int opt = 1;
+    int off = 0;
+
+    memset(&addr, 0, sizeof(addr));
+    int fd = socket(AF_INET6, socktype, 0);
+    if (fd >= 0) {
+        struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&addr;
+
+        /* net.ipv6.bindv6only may default to IPv6 only */
+        if (setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off)) < 0) {
+            perror("setsockopt(IPV6_V6ONLY)");
+        }
+        in6->sin6_family = AF_INET6;
+        in6->sin6_addr   = in6addr_any;
+        in6->sin6_port   = htons(port);
+        len = sizeof(*in6);
+    } else if (errno == EAFNOSUPPORT) {
+        struct sockaddr_in *in = (struct sockaddr_in *)&addr;
+
+        fd = socket(AF_INET, socktype, 0);
+        in->sin_family      = AF_INET;
+        in->sin_addr.s_addr = INADDR_ANY;
+        in->sin_port        = htons(port);
+        len = sizeof(*in);
+    }
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    /* Allow address reuse so we can restart quickly */
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt");
+        close(fd);
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&addr, len) < 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int netaddr_ipv4(const struct sockaddr *sa, struct in_addr *v4)
+{
+    if (sa->sa_family == AF_INET) {
+        *v4 = ((const struct sockaddr_in *)sa)->sin_addr;
+        return 1;
+    }
+    if (sa->sa_family == AF_INET6) {
+        const struct in6_addr *a6 = &((const struct sockaddr_in6 *)sa)->sin6_addr;
+
+        if (IN6_IS_ADDR_V4MAPPED(a6)) {
+            memcpy(v4, &a6->s6_addr[12], sizeof(*v4));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+uint16_t netaddr_port(const struct sockaddr *sa)
+{
+    if (sa->sa_family == AF_INET6) {
+        return ntohs(((const struct sockaddr_in6 *)sa)->sin6_port);
+    }
+    if (sa->sa_family == AF_INET) {
+        return ntohs(((const struct sockaddr_in *)sa)->sin_port);
+    }
+    return 0;
+}
+
+int netaddr_equal(const struct sockaddr *a, const struct sockaddr *b)
+{
+    struct in_addr a4 = {0}, b4 = {0};
+    int a_is_v4 = netaddr_ipv4(a, &a4);
+    int b_is_v4 = netaddr_ipv4(b, &b4);
+
+    if (netaddr_port(a) != netaddr_port(b)) {
+        return 0;
+    }
+    if (a_is_v4 || b_is_v4) {
+        return a_is_v4 && b_is_v4 && a4.s_addr == b4.s_addr;
+    }
+    if (a->sa_family != AF_INET6 || b->sa_family != AF_INET6) {
+        return 0;
+    }
+    const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)a;
+    const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *)b;
+    return IN6_ARE_ADDR_EQUAL(&a6->sin6_addr, &b6->sin6_addr) &&
+           a6->sin6_scope_id == b6->sin6_scope_id;
+}
+
+const char *netaddr_host(const struct sockaddr *sa, char *buf, size_t len)
+{
+    struct in_addr v4;
+
+    if (netaddr_ipv4(sa, &v4)) {
+        inet_ntop(AF_INET, &v4, buf, (socklen_t)len);
+    } else if (sa->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)sa;
+        char zone[IF_NAMESIZE];
+
+        inet_ntop(AF_INET6, &in6->sin6_addr, buf, (socklen_t)len);
+        /* Link-local addresses are ambiguous without their interface */
+        if (in6->sin6_scope_id != 0 && if_indextoname(in6->sin6_scope_id, zone) != NULL) {
+            size_t used = strlen(buf);
+            snprintf(buf + used, len - used, "%%%s", zone);
+        }
+    } else {
+        snprintf(buf, len, "?");
+    }
+    return buf;
+}
+
+const char *netaddr_str(const struct sockaddr *sa, char *buf, size_t len)
+{
+    char host[NETADDR_STRLEN];
+    struct in_addr v4;
+
+    netaddr_host(sa, host, sizeof(host));
+    if (sa->sa_family == AF_INET6 && !netaddr_ipv4(sa, &v4)) {
+        snprintf(buf, len, "[%s]:%u", host, netaddr_port(sa));
+    } else {
+        snprintf(buf, len, "%s:%u", host, netaddr_port(sa));
+    }
+    return buf;
+}
@@ -0,0 +1,46 @@
+#ifndef NETADDR_H
+#define NETADDR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/*
+ * Address-family agnostic sockets of the PC tools.
+ *
+ * Hosts may be names, IPv4 or IPv6 literals; a link-local IPv6 address
+ * needs its zone, e.g. "fe80::1%wlan0". Servers listen on one dual-stack
+ * socket, where IPv4 clients show up as IPv4-mapped IPv6 addresses
+ * (::ffff:a.b.c.d). Those are printed, captured and keyed as plain IPv4,
+ * so logs and capture files look the same as with an IPv4 socket.
+ */
+
+/* "[addr%zone]:port" of any family */
+#define NETADDR_STRLEN (INET6_ADDRSTRLEN + IF_NAMESIZE + 9)
+
+/* First address of host for socktype (SOCK_DGRAM / SOCK_STREAM), either
+ * family. Prints what went wrong and returns -1. */
+int netaddr_resolve(const char *host, uint16_t port, int socktype,
+                    struct sockaddr_storage *addr, socklen_t *len);
+
+/* Socket of socktype bound to the wildcard address on port, with
+ * SO_REUSEADDR: IPv6 that accepts IPv4 too, plain IPv4 on hosts without
+ * IPv6. Prints what went wrong and returns -1. */
+int netaddr_server_socket(int socktype, uint16_t port);
+
+/* 1 when the addresses and ports are equal, IPv4-mapped or not */
+int netaddr_equal(const struct sockaddr *a, const struct sockaddr *b);
+
+/* The IPv4 address of an AF_INET or IPv4-mapped AF_INET6 address */
+int netaddr_ipv4(const struct sockaddr *sa, struct in_addr *v4);
+
+uint16_t netaddr_port(const struct sockaddr *sa);
+
+/* Address only; "?" for an unknown family */
+const char *netaddr_host(const struct sockaddr *sa, char *buf, size_t len);
+/* "1.2.3.4:8080" or "[fe80::1%eth0]:8080" */
+const char *netaddr_str(const struct sockaddr *sa, char *buf, size_t len);
+
+#endif /* NETADDR_H */
@@ -0,0 +1,395 @@
+#include "output.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "netaddr.h"
+
+#define OUTPUT_LINE_MAX  1024   /* longest formatted event, escaped text included */
+
+static const char *const kind_names[] = { "rx", "tx", "connect", "disconnect" };
+
+int output_parse_format(const char *name, output_format_t *format)
+{
+    if (strcmp(name, "human") == 0) {
+        *format = OUTPUT_HUMAN;
+    } else if (strcmp(name, "csv") == 0) {
+        *format = OUTPUT_CSV;
+    } else if (strcmp(name, "ndjson") == 0) {
+        *format = OUTPUT_NDJSON;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static void write_fd(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;     /* closed pipe or full disk: nothing sensible left to do */
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+static void write_all(const output_t *o, const char *buf, size_t len)
+{
+    if (o->close_fd) {
+        write_fd(o->fd, buf, len);
+        return;
+    }
+
+    /* Whatever the servers printed before goes out first, and nothing
+     * printed meanwhile lands in the middle of the batch */
+    flockfile(stdout);
+    fflush(stdout);
+    write_fd(o->fd, buf, len);
+    funlockfile(stdout);
+}
+
+/* Sleep until the producer posts or output_close() stops the writer */
+static void wait_for_events(output_t *o, uint64_t tail)
+{
+    pthread_mutex_lock(&o->wake_lock);
+    atomic_store(&o->sleeping, 1);
+    /* Pairs with the store of head and load of sleeping in output_post():
+     * either the producer sees the flag or this sees the new head */
+    while (atomic_load(&o->head) == tail && !atomic_load(&o->stop)) {
+        pthread_cond_wait(&o->wake_cond, &o->wake_lock);
+    }
+    atomic_store_explicit(&o->sleeping, 0, memory_order_relaxed);
+    pthread_mutex_unlock(&o->wake_lock);
+}
+
+static void wake_writer(output_t *o)
+{
+    pthread_mutex_lock(&o->wake_lock);
+    pthread_cond_signal(&o->wake_cond);
+    pthread_mutex_unlock(&o->wake_lock);
+}
+
+/* Copy text for a human-readable line, without the trailing newline */
+static size_t put_plain(char *out, const char *text, size_t len)
+{
+    while (len > 0 && (text[len - 1] == '\n' || text[len - 1] == '\r')) {
+        len--;
+    }
+    for (size_t i = 0; i < len; i++) {
+        unsigned char ch = (unsigned char)text[i];
+        out[i] = (ch >= 0x20 && ch < 0x7f) ? (char)ch : '.';
+    }
+    return len;
+}
+
+static size_t put_csv(char *out, const char *text, size_t len)
+{
+    size_t n = 0;
+
+    out[n++] = '"';
+    for (size_t i = 0; i < len; i++) {
+        unsigned char ch = (unsigned char)text[i];
+        if (ch == '"') {
+            out[n++] = '"';
+        }
+        out[n++] = (ch >= 0x20 && ch < 0x7f) ? (char)ch : ' ';
+    }
+    out[n++] = '"';
+    return n;
+}
+
+static size_t put_json(char *out, const char *text, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t n = 0;
+
+    out[n++] = '"';
+    for (size_t i = 0; i < len; i++) {
+        unsigned char ch = (unsigned char)text[i];
+        if (ch == '"' || ch == '\\') {
+            out[n++] = '\\';
+            out[n++] = (char)ch;
+        } else if (ch == '\n') {
+            out[n++] = '\\';
+            out[n++] = 'n';
+        } else if (ch < 0x20 || ch >= 0x7f) {
+            memcpy(out + n, "\\u00", 4);
+            out[n + 4] = hex[ch >> 4];
+            out[n + 5] = hex[ch & 0xf];
+            n += 6;
+        } else {
+            out[n++] = (char)ch;
+        }
+    }
+    out[n++] = '"';
+    return n;
+}
+
+static size_t format_event(const output_t *o, const output_event_t *ev, char *out)
+{
+    char ip[INET6_ADDRSTRLEN] = "";
+    const char *proto = ev->proto == IPPROTO_TCP ? "tcp" : "udp";
+    int truncated = ev->len > ev->text_len;
+    size_t n = 0;
+
+    if (ev->family != 0) {
+        inet_ntop(ev->family, ev->addr, ip, sizeof(ip));
+    }
+
+    switch (o->format) {
+    case OUTPUT_HUMAN:
+        switch (ev->kind) {
+        case OUTPUT_EV_CONNECT:
+            return (size_t)sprintf(out, "[Server] Client connected from %s:%u\n", ip, ev->port);
+        case OUTPUT_EV_DISCONNECT:
+            return (size_t)sprintf(out, "[Server] Client %s:%u disconnected.\n", ip, ev->port);
+        default:
+            n = (size_t)sprintf(out, "[Server] %s %s:%u (%u bytes): ",
+                                ev->kind == OUTPUT_EV_RX ? "Received from" : "Sent to    ",
+                                ip, ev->port, ev->len);
+            n += put_plain(out + n, ev->text, ev->text_len);
+            if (truncated) {
+                memcpy(out + n, "...", 3);
+                n += 3;
+            }
+            out[n++] = '\n';
+            return n;
+        }
+
+    case OUTPUT_CSV:
+        n = (size_t)sprintf(out, "%lld,%s,%s,%s,%u,%u,", (long long)ev->ts_ns,
+                            kind_names[ev->kind], proto, ip, ev->port, ev->len);
+        n += put_csv(out + n, ev->text, ev->text_len);
+        n += (size_t)sprintf(out + n, ",%d\n", truncated);
+        return n;
+
+    case OUTPUT_NDJSON:
+    default:
+        n = (size_t)sprintf(out, "{\"ts_ns\":%lld,\"event\":\"%s\",\"proto\":\"%s\","
+                            "\"peer\":\"%s\",\"port\":%u,\"len\":%u,\"text\":",
+                            (long long)ev->ts_ns, kind_names[ev->kind], proto, ip,
+                            ev->port, ev->len);
+        n += put_json(out + n, ev->text, ev->text_len);
+        n += (size_t)sprintf(out + n, ",\"truncated\":%s}\n", truncated ? "true" : "false");
+        return n;
+    }
+}
+
+static size_t format_skipped(const output_t *o, uint64_t sampled, uint64_t dropped, char *out)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    long long ts_ns = (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+
+    switch (o->format) {
+    case OUTPUT_HUMAN:
+        return (size_t)sprintf(out, "[Output] Queue full: skipped %llu events (%llu sampled out, %llu dropped)\n",
+                               (unsigned long long)(sampled + dropped),
+                               (unsigned long long)sampled, (unsigned long long)dropped);
+    case OUTPUT_CSV:
+        return (size_t)sprintf(out, "%lld,skipped,,,0,%llu,\"sampled=%llu dropped=%llu\",0\n", ts_ns,
+                               (unsigned long long)(sampled + dropped),
+                               (unsigned long long)sampled, (unsigned long long)dropped);
+    case OUTPUT_NDJSON:
+    default:
+        return (size_t)sprintf(out, "{\"ts_ns\":%lld,\"event\":\"skipped\",\"sampled\":%llu,\"dropped\":%llu}\n",
+                               ts_ns, (unsigned long long)sampled, (unsigned long long)dropped);
+    }
+}
+
+static void *writer_thread(void *arg)
+{
+    output_t *o = arg;
+    char *batch = malloc(OUTPUT_BATCH_BYTES);
+    size_t used = 0;
+    uint64_t reported_sampled = 0, reported_dropped = 0;
+    uint64_t tail = atomic_load_explicit(&o->tail, memory_order_relaxed);
+
+    if (batch == NULL) {
+        perror("output: malloc");
+        return NULL;
+    }
+    if (o->format == OUTPUT_CSV) {
+        used = (size_t)sprintf(batch, "ts_ns,event,proto,peer,port,len,text,truncated\n");
+    }
+
+    for (;;) {
+        uint64_t head = atomic_load_explicit(&o->head, memory_order_acquire);
+
+        if (tail == head) {
+            /* Queue drained: note any gap, flush, then wait for more */
+            uint64_t sampled = atomic_load_explicit(&o->sampled, memory_order_relaxed);
+            uint64_t dropped = atomic_load_explicit(&o->dropped, memory_order_relaxed);
+            if (sampled != reported_sampled || dropped != reported_dropped) {
+                used += format_skipped(o, sampled - reported_sampled, dropped - reported_dropped,
+                                       batch + used);
+                reported_sampled = sampled;
+                reported_dropped = dropped;
+            }
+            if (used > 0) {
+                write_all(o, batch, used);
+                used = 0;
+            }
+            if (atomic_load_explicit(&o->stop, memory_order_acquire) &&
+                atomic_load_explicit(&o->head, memory_order_acquire) == tail) {
+                break;
+            }
+            wait_for_events(o, tail);
+            continue;
+        }
+
+        while (tail != head) {
+            const output_event_t *ev = &o->ring[tail & (OUTPUT_QUEUE_SIZE - 1)];
+            used += format_event(o, ev, batch + used);
+            tail++;
+            o->written++;
+
+            if (used > OUTPUT_BATCH_BYTES - 2 * OUTPUT_LINE_MAX) {
+                /* Hand the slots back before the slow part */
+                atomic_store_explicit(&o->tail, tail, memory_order_release);
+                write_all(o, batch, used);
+                used = 0;
+            }
+        }
+        atomic_store_explicit(&o->tail, tail, memory_order_release);
+    }
+
+    free(batch);
+    return NULL;
+}
+
+int output_open(output_t *o, const char *path, output_format_t format)
+{
+    memset(o, 0, sizeof(*o));
+    o->format = format;
+
+    o->ring = calloc(OUTPUT_QUEUE_SIZE, sizeof(*o->ring));
+    if (o->ring == NULL) {
+        perror("output: calloc");
+        return -1;
+    }
+
+    if (path != NULL) {
+        o->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (o->fd < 0) {
+            perror("output: open");
+            free(o->ring);
+            return -1;
+        }
+        o->close_fd = 1;
+    } else {
+        /* Anything printf() left in the buffer goes out first */
+        fflush(stdout);
+        o->fd = STDOUT_FILENO;
+    }
+
+    pthread_mutex_init(&o->wake_lock, NULL);
+    pthread_cond_init(&o->wake_cond, NULL);
+
+    int err = pthread_create(&o->thread, NULL, writer_thread, o);
+    if (err != 0) {
+        fprintf(stderr, "output: pthread_create: %s\n", strerror(err));
+        pthread_mutex_destroy(&o->wake_lock);
+        pthread_cond_destroy(&o->wake_cond);
+        if (o->close_fd) {
+            close(o->fd);
+        }
+        free(o->ring);
+        return -1;
+    }
+    return 0;
+}
+
+void output_post(output_t *o, output_event_kind_t kind, int64_t ts_ns, uint8_t proto,
+                 const struct sockaddr *peer, const void *data, size_t len)
+{
+    uint64_t head = atomic_load_explicit(&o->head, memory_order_relaxed);
+    uint64_t fill = head - o->tail_cache;
+
+    /* Only look at the consumer's cache line when the ring seems busy */
+    if (fill >= OUTPUT_QUEUE_SIZE / 2) {
+        o->tail_cache = atomic_load_explicit(&o->tail, memory_order_acquire);
+        fill = head - o->tail_cache;
+    }
+
+    if (fill >= OUTPUT_QUEUE_SIZE) {
+        atomic_fetch_add_explicit(&o->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    if (fill >= OUTPUT_QUEUE_SIZE / 2) {
+        /* Keep a reply together with the message it answers */
+        if (kind == OUTPUT_EV_RX) {
+            o->sample_keep = (o->sample_count++ % OUTPUT_SAMPLE_EVERY) == 0;
+        }
+        if ((kind == OUTPUT_EV_RX || kind == OUTPUT_EV_TX) && !o->sample_keep) {
+            atomic_fetch_add_explicit(&o->sampled, 1, memory_order_relaxed);
+            return;
+        }
+    } else {
+        o->sample_keep = 1;
+    }
+
+    output_event_t *ev = &o->ring[head & (OUTPUT_QUEUE_SIZE - 1)];
+    ev->ts_ns    = ts_ns;
+    ev->kind     = (uint8_t)kind;
+    ev->proto    = proto;
+    ev->len      = (uint32_t)len;
+    ev->text_len = (uint16_t)(len < OUTPUT_TEXT_MAX ? len : OUTPUT_TEXT_MAX);
+    ev->family   = 0;
+    ev->port     = 0;
+    if (ev->text_len > 0) {
+        memcpy(ev->text, data, ev->text_len);
+    }
+
+    struct in_addr v4;
+
+    /* IPv4 clients of a dual-stack server are logged as IPv4 */
+    if (peer != NULL && netaddr_ipv4(peer, &v4)) {
+        ev->family = AF_INET;
+        ev->port   = netaddr_port(peer);
+        memcpy(ev->addr, &v4, 4);
+    } else if (peer != NULL && peer->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)peer;
+        ev->family = AF_INET6;
+        ev->port   = ntohs(in6->sin6_port);
+        memcpy(ev->addr, &in6->sin6_addr, 16);
+    }
+
+    atomic_store(&o->head, head + 1);
+    if (atomic_load(&o->sleeping)) {
+        wake_writer(o);
+    }
+}
+
+void output_close(output_t *o)
+{
+    atomic_store(&o->stop, 1);
+    wake_writer(o);
+    pthread_join(o->thread, NULL);
+    pthread_mutex_destroy(&o->wake_lock);
+    pthread_cond_destroy(&o->wake_cond);
+
+    if (o->close_fd) {
+        close(o->fd);
+    }
+    free(o->ring);
+    o->ring = NULL;
+
+    uint64_t sampled = atomic_load_explicit(&o->sampled, memory_order_relaxed);
+    uint64_t dropped = atomic_load_explicit(&o->dropped, memory_order_relaxed);
+    printf("[Output] %llu events written, %llu sampled out, %llu dropped\n",
+           (unsigned long long)o->written, (unsigned long long)sampled,
+           (unsigned long long)dropped);
+}
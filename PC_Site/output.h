@@ -0,0 +1,100 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+/*
+ * Asynchronous message log for the servers.
+ *
+ * The network thread only copies a small event into a single-producer /
+ * single-consumer ring. A writer thread formats the events and writes
+ * them in large batches. Nothing on the network path formats text, takes
+ * a lock or blocks on the terminal.
+ *
+ * When the ring is more than half full, only every OUTPUT_SAMPLE_EVERY-th
+ * message event is kept. When it is full, events are dropped. Connect and
+ * disconnect events are never sampled. The writer reports how many events
+ * were skipped, so the log shows where it has gaps.
+ *
+ * An idle writer sleeps on a condition variable. The producer only takes
+ * the lock to wake it, when it posts into a ring the writer found empty.
+ *
+ * Writing to stdout, the writer flushes stdio first and holds the stdout
+ * lock for the batch, so lines printed with printf() keep their place.
+ */
+
+#define OUTPUT_QUEUE_SIZE   8192            /* events, power of two */
+#define OUTPUT_TEXT_MAX     104             /* payload bytes kept per event */
+#define OUTPUT_SAMPLE_EVERY 16
+#define OUTPUT_BATCH_BYTES  (64 * 1024)
+
+typedef enum {
+    OUTPUT_HUMAN,
+    OUTPUT_CSV,
+    OUTPUT_NDJSON,
+} output_format_t;
+
+typedef enum {
+    OUTPUT_EV_RX,
+    OUTPUT_EV_TX,
+    OUTPUT_EV_CONNECT,
+    OUTPUT_EV_DISCONNECT,
+} output_event_kind_t;
+
+typedef struct {
+    int64_t  ts_ns;
+    uint32_t len;                   /* full message length */
+    uint16_t text_len;              /* bytes of text[] in use */
+    uint16_t port;
+    uint8_t  addr[16];
+    uint8_t  family;
+    uint8_t  proto;
+    uint8_t  kind;
+    uint8_t  reserved;
+    char     text[OUTPUT_TEXT_MAX];
+} output_event_t;
+
+_Static_assert(sizeof(output_event_t) == 144, "output event should stay a multiple of 16 bytes");
+
+typedef struct {
+    /* Producer side */
+    _Alignas(64) _Atomic uint64_t head;
+    uint64_t         tail_cache;        /* last tail seen by the producer */
+    uint32_t         sample_count;
+    int              sample_keep;       /* sampling decision of the last rx event */
+    _Atomic uint64_t sampled;           /* events skipped by sampling */
+    _Atomic uint64_t dropped;           /* events lost to a full ring */
+    _Atomic int      sleeping;          /* writer found the ring empty */
+
+    /* Consumer side */
+    _Alignas(64) _Atomic uint64_t tail;
+    _Atomic int      stop;
+    pthread_mutex_t  wake_lock;
+    pthread_cond_t   wake_cond;
+
+    output_event_t  *ring;
+    output_format_t  format;
+    int              fd;
+    int              close_fd;
+    pthread_t        thread;
+    uint64_t         written;           /* events written by the writer */
+} output_t;
+
+/* Parse "human", "csv" or "ndjson", returns -1 for anything else */
+int  output_parse_format(const char *name, output_format_t *format);
+
+/* Start the writer thread, path == NULL writes to stdout */
+int  output_open(output_t *o, const char *path, output_format_t format);
+
+/* Queue an event, never blocks. Called from one thread only. */
+void output_post(output_t *o, output_event_kind_t kind, int64_t ts_ns, uint8_t proto,
+                 const struct sockaddr *peer, const void *data, size_t len);
+
+/* Write everything still queued and stop the writer */
+void output_close(output_t *o);
+
+#endif /* OUTPUT_H */
@@ -0,0 +1,76 @@
+#include "probe.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* "Echo: " is the longest prefix any of our servers puts in front */
+#define PROBE_SEARCH_WINDOW 16
+
+size_t probe_format(char *buf, size_t size, size_t len, const probe_t *probe)
+{
+    int n = snprintf(buf, size, PROBE_TAG "%u %llu %lld ",
+                     probe->board,
+                     (unsigned long long)probe->seq,
+                     (long long)probe->send_ns);
+    if (n < 0 || (size_t)n + 1 >= size) {
+        return size;
+    }
+
+    size_t used = (size_t)n;
+    if (len > size) {
+        len = size;
+    }
+    if (len > used + 1) {
+        memset(buf + used, 'x', len - used - 1);
+        used = len - 1;
+    }
+    buf[used++] = '\n';
+    return used;
+}
+
+static int parse_u64(const char **p, const char *end, uint64_t *out)
+{
+    uint64_t v = 0;
+    const char *s = *p;
+
+    if (s >= end || *s < '0' || *s > '9') {
+        return -1;
+    }
+    while (s < end && *s >= '0' && *s <= '9') {
+        v = v * 10 + (uint64_t)(*s - '0');
+        s++;
+    }
+    /* A field cut short by a split TCP segment must not parse */
+    if (s >= end || *s != ' ') {
+        return -1;
+    }
+    *p  = s + 1;
+    *out = v;
+    return 0;
+}
+
+int probe_parse(const char *buf, size_t len, probe_t *probe)
+{
+    const char *end = buf + len;
+    size_t window = len < PROBE_SEARCH_WINDOW ? len : PROBE_SEARCH_WINDOW;
+    const char *p = NULL;
+
+    for (size_t i = 0; i + 3 <= len && i < window; i++) {
+        if (memcmp(buf + i, PROBE_TAG, 3) == 0) {
+            p = buf + i + 3;
+            break;
+        }
+    }
+    if (p == NULL) {
+        return -1;
+    }
+
+    uint64_t board, seq, send_ns;
+    if (parse_u64(&p, end, &board) || parse_u64(&p, end, &seq) || parse_u64(&p, end, &send_ns)) {
+        return -1;
+    }
+    probe->board   = (uint32_t)board;
+    probe->seq     = seq;
+    probe->send_ns = (int64_t)send_ns;
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Text probe carried in load-test payloads:
+ *
+ *     "LG <board> <seq> <send_ns> xxxx...\n"
+ *
+ * It is plain text because the echo servers and the firmware treat
+ * payloads as C strings. The echo ("Echo: LG ...") still parses, so RTT
+ * can be computed from the reply alone and offline tools can recover
+ * per-board sequence numbers from a capture.
+ */
+
+#define PROBE_TAG "LG "
+
+typedef struct {
+    uint32_t board;
+    uint64_t seq;
+    int64_t  send_ns;
+} probe_t;
+
+/* Write a probe padded with 'x' to exactly len bytes (newline included).
+ * Returns the number of bytes written, which is larger than len if the
+ * header alone does not fit. */
+size_t probe_format(char *buf, size_t size, size_t len, const probe_t *probe);
+
+/* Find and parse a probe in the first bytes of buf. Returns 0 on success. */
+int probe_parse(const char *buf, size_t len, probe_t *probe);
+
+#endif /* PROBE_H */
@@ -0,0 +1,24 @@
+# Board at the edge of coverage: the signal fades every half minute, the
+# MAC retries and drops to a lower rate, losses come in bursts
+seed 1
+delay 3
+jitter 2 normal
+loss_ge 0.5 40 30
+
+phase steady 25s
+phase fade 8s
+    delay 15
+    jitter 12 normal
+    loss_ge 4 20 70
+    rate 6000
+phase deep_fade 3s
+    delay 40
+    jitter 30 normal
+    loss_ge 10 10 90
+    rate 1000
+phase recover 4s
+    delay 3
+    jitter 2 normal
+    loss_ge 0.5 40 30
+    rate 0
+loop
@@ -0,0 +1,7 @@
+# Board a few metres from the AP, channel shared with a few other stations
+seed 1
+delay 2
+jitter 1.5 normal
+loss_ge 0.5 40 30
+reorder 0.1
+duplicate 0.05
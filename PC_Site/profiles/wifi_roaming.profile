@@ -0,0 +1,15 @@
+# Board roaming between two APs every 20 s: a short outage while it
+# re-associates, then a burst of late frames as the new AP catches up
+seed 1
+delay 4
+jitter 2
+
+phase associated 20s
+phase roaming 300ms
+    loss 100
+phase catch_up 1s
+    loss 0
+    delay 25
+    jitter 15
+    reorder 2
+loop
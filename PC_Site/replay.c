@@ -0,0 +1,258 @@
+#define _GNU_SOURCE  /* sendmmsg */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "capture.h"
+#include "netaddr.h"
+
+#define PORT            8080
+#define BATCH           64
+#define PREFETCH_BYTES  (8u * CAPTURE_BLOCK_SIZE)
+#define SNDBUF_BYTES    (4 * 1024 * 1024)
+
+/*
+ * Replays a capture file (see capture.h) against a server or a board.
+ *
+ * The capture is mapped read-only with MADV_SEQUENTIAL and the next few
+ * blocks are prefetched with MADV_WILLNEED while sending. Payloads are
+ * never copied: the iovecs handed to sendmmsg() point straight into the
+ * mapping, and up to BATCH frames leave in one syscall whenever they are
+ * due.
+ */
+
+typedef enum {
+    TIMING_ORIGINAL,    /* original inter-arrival times */
+    TIMING_SCALED,      /* original times divided by a factor */
+    TIMING_RATE,        /* fixed packets per second */
+    TIMING_MAX,         /* as fast as possible */
+} timing_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t errors;
+    int64_t  max_lag_ns;   /* worst delay behind the schedule */
+} replay_stats_t;
+
+static int64_t mono_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_until(int64_t at_ns)
+{
+    struct timespec ts = {
+        .tv_sec  = at_ns / 1000000000LL,
+        .tv_nsec = at_ns % 1000000000LL,
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+static void flush_batch(int fd, struct mmsghdr *msgs, unsigned count, replay_stats_t *stats)
+{
+    unsigned done = 0;
+
+    while (done < count) {
+        int sent = sendmmsg(fd, msgs + done, count - done, 0);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            /* e.g. ECONNREFUSED from an earlier ICMP error: drop this frame */
+            stats->errors++;
+            done++;
+            continue;
+        }
+        for (int i = 0; i < sent; i++) {
+            stats->bytes += msgs[done + (unsigned)i].msg_len;
+        }
+        stats->frames += (uint64_t)sent;
+        done += (unsigned)sent;
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <capture-file> <target-ip>\n"
+            "  -p <port>     target port (default %d)\n"
+            "  -t            replay over TCP (default UDP)\n"
+            "  -s <factor>   scale the original timing, 2.0 = twice as fast\n"
+            "  -r <pps>      fixed rate in frames per second\n"
+            "  -f            as fast as possible\n"
+            "  -l <loops>    replay the capture <loops> times (default 1)\n"
+            "Without -s/-r/-f the original inter-arrival timing is kept.\n",
+            prog, PORT);
+}
+
+int main(int argc, char *argv[])
+{
+    timing_t timing = TIMING_ORIGINAL;
+    double   factor = 1.0;
+    double   rate   = 0.0;
+    int      use_tcp = 0;
+    long     loops  = 1;
+    uint16_t port   = PORT;
+    int c;
+
+    while ((c = getopt(argc, argv, "p:ts:r:fl:h")) != -1) {
+        switch (c) {
+        case 'p': port    = (uint16_t)atoi(optarg); break;
+        case 't': use_tcp = 1; break;
+        case 's': timing  = TIMING_SCALED; factor = atof(optarg); break;
+        case 'r': timing  = TIMING_RATE;   rate   = atof(optarg); break;
+        case 'f': timing  = TIMING_MAX; break;
+        case 'l': loops   = atol(optarg); break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind + 2 > argc || factor <= 0.0 || (timing == TIMING_RATE && rate <= 0.0) || loops < 1) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    capture_reader_t reader;
+    if (capture_reader_open(&reader, argv[optind]) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    struct sockaddr_storage target;
+    socklen_t target_len;
+    if (netaddr_resolve(argv[optind + 1], port, use_tcp ? SOCK_STREAM : SOCK_DGRAM,
+                        &target, &target_len) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    int sock_fd = socket(target.ss_family, use_tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if (sock_fd < 0) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+
+    int opt = SNDBUF_BYTES;
+    setsockopt(sock_fd, SOL_SOCKET, SO_SNDBUF, &opt, sizeof(opt));
+    if (use_tcp) {
+        opt = 1;
+        setsockopt(sock_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    }
+
+    if (connect(sock_fd, (struct sockaddr *)&target, target_len) < 0) {
+        perror("connect");
+        close(sock_fd);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("[Replay] %llu frames from %s -> %s:%u (%s)\n",
+           (unsigned long long)reader.header->record_count, argv[optind],
+           argv[optind + 1], port, use_tcp ? "TCP" : "UDP");
+
+    struct mmsghdr msgs[BATCH];
+    struct iovec   iovs[BATCH];
+    unsigned       pending = 0;
+    replay_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    memset(msgs, 0, sizeof(msgs));
+
+    int64_t  start    = mono_ns();
+    int64_t  loop_off = 0;          /* schedule offset of the current loop */
+    uint64_t index    = 0;          /* frames scheduled so far */
+
+    for (long loop = 0; loop < loops; loop++) {
+        capture_iter_t it;
+        const capture_record_t *rec;
+        int64_t  ts0 = 0, ts_last = 0;
+        uint64_t prefetched = 0;
+        int      first = 1;
+
+        capture_iter_init(&it, &reader, 0, reader.block_count);
+
+        while ((rec = capture_next(&it)) != NULL) {
+            if (first) {
+                ts0 = rec->ts_ns;
+                first = 0;
+            }
+            ts_last = rec->ts_ns;
+
+            /* Keep the kernel reading ahead of us */
+            if (it.off + PREFETCH_BYTES / 2 > prefetched && prefetched < reader.data_end) {
+                uint64_t from = it.off & ~(uint64_t)(CAPTURE_BLOCK_SIZE - 1);
+                uint64_t len  = PREFETCH_BYTES;
+                if (from + len > reader.size) {
+                    len = reader.size - from;
+                }
+                madvise((void *)(reader.base + from), len, MADV_WILLNEED);
+                prefetched = from + len;
+            }
+
+            int64_t due;
+            switch (timing) {
+            case TIMING_ORIGINAL: due = start + loop_off + (rec->ts_ns - ts0); break;
+            case TIMING_SCALED:   due = start + loop_off + (int64_t)((double)(rec->ts_ns - ts0) / factor); break;
+            case TIMING_RATE:     due = start + (int64_t)((double)index * 1e9 / rate); break;
+            default:              due = 0; break;
+            }
+            index++;
+
+            int64_t now = mono_ns();
+            if (due > now) {
+                /* Everything collected so far is due, send it before waiting */
+                if (pending > 0) {
+                    flush_batch(sock_fd, msgs, pending, &stats);
+                    pending = 0;
+                }
+                sleep_until(due);
+            } else if (due != 0 && now - due > stats.max_lag_ns) {
+                stats.max_lag_ns = now - due;
+            }
+
+            iovs[pending].iov_base = (void *)capture_payload(rec);
+            iovs[pending].iov_len  = rec->cap_len;
+            msgs[pending].msg_hdr.msg_iov    = &iovs[pending];
+            msgs[pending].msg_hdr.msg_iovlen = 1;
+            pending++;
+
+            if (pending == BATCH) {
+                flush_batch(sock_fd, msgs, pending, &stats);
+                pending = 0;
+            }
+        }
+
+        if (timing == TIMING_SCALED) {
+            loop_off += (int64_t)((double)(ts_last - ts0) / factor);
+        } else {
+            loop_off += ts_last - ts0;
+        }
+    }
+
+    if (pending > 0) {
+        flush_batch(sock_fd, msgs, pending, &stats);
+    }
+
+    double elapsed = (double)(mono_ns() - start) / 1e9;
+    printf("[Replay] sent %llu frames, %llu bytes in %.3f s: %.0f frames/s, %.1f Mbit/s\n",
+           (unsigned long long)stats.frames, (unsigned long long)stats.bytes, elapsed,
+           elapsed > 0.0 ? (double)stats.frames / elapsed : 0.0,
+           elapsed > 0.0 ? (double)stats.bytes * 8.0 / elapsed / 1e6 : 0.0);
+    printf("[Replay] errors=%llu max lag behind schedule=%.1f us\n",
+           (unsigned long long)stats.errors, (double)stats.max_lag_ns / 1000.0);
+
+    close(sock_fd);
+    capture_reader_close(&reader);
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "seqtrack.h"
+
+#include <string.h>
+
+static int bit_test(const seqtrack_t *t, uint64_t seq)
+{
+    uint64_t bit = seq % SEQ_WINDOW;
+    return (t->window[bit / 64] >> (bit % 64)) & 1u;
+}
+
+static void bit_set(seqtrack_t *t, uint64_t seq)
+{
+    uint64_t bit = seq % SEQ_WINDOW;
+    t->window[bit / 64] |= 1ULL << (bit % 64);
+}
+
+static void bit_clear(seqtrack_t *t, uint64_t seq)
+{
+    uint64_t bit = seq % SEQ_WINDOW;
+    t->window[bit / 64] &= ~(1ULL << (bit % 64));
+}
+
+void seqtrack_init(seqtrack_t *t)
+{
+    memset(t, 0, sizeof(*t));
+}
+
+void seqtrack_update(seqtrack_t *t, uint64_t seq)
+{
+    if (!t->started) {
+        t->started   = 1;
+        t->first_seq = seq;
+        t->max_seq   = seq;
+        t->received  = 1;
+        bit_set(t, seq);
+        return;
+    }
+
+    if (seq > t->max_seq) {
+        uint64_t jump = seq - t->max_seq;
+
+        /* Slots between the old and new maximum become "not seen" */
+        if (jump >= SEQ_WINDOW) {
+            memset(t->window, 0, sizeof(t->window));
+        } else {
+            for (uint64_t s = t->max_seq + 1; s < seq; s++) {
+                bit_clear(t, s);
+            }
+        }
+        t->missing += jump - 1;
+        t->max_seq  = seq;
+        t->received++;
+        bit_set(t, seq);
+        return;
+    }
+
+    if (t->max_seq - seq < SEQ_WINDOW && bit_test(t, seq)) {
+        t->duplicates++;
+        return;
+    }
+
+    /* Late arrival fills a gap; anything older than the window is assumed
+     * not to be a duplicate. A number below the first one seen was never
+     * counted as missing. */
+    if (t->max_seq - seq < SEQ_WINDOW) {
+        bit_set(t, seq);
+    }
+    if (seq < t->first_seq) {
+        t->first_seq = seq;
+    } else if (t->missing > 0) {
+        t->missing--;
+    }
+    t->reordered++;
+    t->received++;
+}
+
+double seqtrack_loss_ratio(const seqtrack_t *t)
+{
+    uint64_t expected = t->received + t->missing;
+    return expected > 0 ? (double)t->missing / (double)expected : 0.0;
+}
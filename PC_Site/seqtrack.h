@@ -0,0 +1,34 @@
+#ifndef SEQTRACK_H
+#define SEQTRACK_H
+
+#include <stdint.h>
+
+/*
+ * Per-stream sequence number tracking: loss, reordering and duplicates.
+ *
+ * A bitmap remembers which of the last SEQ_WINDOW sequence numbers were
+ * seen. A jump forward opens a gap, a late arrival inside the window
+ * closes it again (reordered), and a repeated number inside the window is
+ * a duplicate. Anything older than the window is counted as reordered.
+ */
+
+#define SEQ_WINDOW 1024
+
+typedef struct {
+    int      started;
+    uint64_t first_seq;
+    uint64_t max_seq;
+    uint64_t received;      /* unique sequence numbers */
+    uint64_t duplicates;
+    uint64_t reordered;
+    uint64_t missing;       /* gaps not (yet) filled by late arrivals */
+    uint64_t window[SEQ_WINDOW / 64];
+} seqtrack_t;
+
+void seqtrack_init(seqtrack_t *t);
+void seqtrack_update(seqtrack_t *t, uint64_t seq);
+
+/* Fraction of expected sequence numbers that never arrived */
+double seqtrack_loss_ratio(const seqtrack_t *t);
+
+#endif /* SEQTRACK_H */
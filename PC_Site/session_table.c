@@ -0,0 +1,232 @@
+#include "session_table.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#include "netaddr.h"
+
+_Static_assert(sizeof(session_slot_t) == 32, "two slots per cache line");
+
+static uint64_t peer_hash(const peer_addr_t *p)
+{
+    /* FNV-1a over the address bytes, then mix in port and family */
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < sizeof(p->addr); i++) {
+        h = (h ^ p->addr[i]) * 1099511628211ULL;
+    }
+    h = (h ^ p->port) * 1099511628211ULL;
+    h = (h ^ p->family) * 1099511628211ULL;
+    return h | 1;
+}
+
+static void peer_from_sockaddr(const struct sockaddr *sa, peer_addr_t *p)
+{
+    struct in_addr v4;
+
+    memset(p, 0, sizeof(*p));
+    /* IPv4-mapped or not, an IPv4 client keeps its session */
+    if (netaddr_ipv4(sa, &v4)) {
+        p->family = AF_INET;
+        p->port   = netaddr_port(sa);
+        memcpy(p->addr, &v4, 4);
+    } else if (sa->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)sa;
+        p->family = AF_INET6;
+        p->port   = ntohs(in6->sin6_port);
+        memcpy(p->addr, &in6->sin6_addr, 16);
+    }
+}
+
+int session_table_init(session_table_t *t, uint32_t capacity, double tau_s, double idle_s)
+{
+    uint32_t slots = 1;
+
+    memset(t, 0, sizeof(*t));
+
+    /* Keep the index at most half full */
+    while (slots < 2 * capacity) {
+        slots <<= 1;
+    }
+
+    if (posix_memalign((void **)&t->slots, 64, slots * sizeof(session_slot_t)) != 0) {
+        return -1;
+    }
+    memset(t->slots, 0, slots * sizeof(session_slot_t));
+
+    t->sessions = calloc(capacity, sizeof(session_t));
+    if (t->sessions == NULL) {
+        free(t->slots);
+        return -1;
+    }
+
+    t->slot_mask = slots - 1;
+    t->capacity  = capacity;
+    t->tau_ns    = tau_s * 1e9;
+    t->idle_ns   = (int64_t)(idle_s * 1e9);
+    return 0;
+}
+
+void session_table_free(session_table_t *t)
+{
+    free(t->slots);
+    free(t->sessions);
+    memset(t, 0, sizeof(*t));
+}
+
+static session_slot_t *find_slot(session_table_t *t, const peer_addr_t *peer, uint64_t hash)
+{
+    uint32_t i = (uint32_t)hash & t->slot_mask;
+
+    while (t->slots[i].hash != 0) {
+        session_slot_t *slot = &t->slots[i];
+        if (slot->hash == hash && slot->port == peer->port && slot->family == peer->family &&
+            memcmp(slot->addr, peer->addr, sizeof(peer->addr)) == 0) {
+            return slot;
+        }
+        i = (i + 1) & t->slot_mask;
+    }
+    return NULL;
+}
+
+/* Remove a session: backward-shift delete its slot, then move the last
+ * session into its place so the array stays dense */
+static void remove_session(session_table_t *t, uint32_t index)
+{
+    const session_t *s    = &t->sessions[index];
+    session_slot_t  *slot = find_slot(t, &s->peer, peer_hash(&s->peer));
+    uint32_t         hole = (uint32_t)(slot - t->slots);
+    uint32_t         j    = hole;
+
+    /* Pull back every following slot of the probe run whose home is not
+     * between the hole and the slot itself */
+    for (;;) {
+        j = (j + 1) & t->slot_mask;
+        if (t->slots[j].hash == 0) {
+            break;
+        }
+        uint32_t home = (uint32_t)t->slots[j].hash & t->slot_mask;
+        if (((j - home) & t->slot_mask) >= ((j - hole) & t->slot_mask)) {
+            t->slots[hole] = t->slots[j];
+            hole = j;
+        }
+    }
+    memset(&t->slots[hole], 0, sizeof(t->slots[hole]));
+
+    uint32_t last = --t->count;
+    if (index != last) {
+        const session_t *moved = &t->sessions[last];
+        find_slot(t, &moved->peer, peer_hash(&moved->peer))->index = index;
+        t->sessions[index] = *moved;
+    }
+}
+
+/* Remove the sessions that have been idle for longer than idle_ns. Runs
+ * only when the table is full, and at most every idle_ns / 8 so a table
+ * full of live peers does not scan on every packet. */
+static void expire_sessions(session_table_t *t, int64_t now_ns)
+{
+    if (now_ns < t->next_expire_ns) {
+        return;
+    }
+    t->next_expire_ns = now_ns + t->idle_ns / 8;
+
+    for (uint32_t i = 0; i < t->count;) {
+        if (now_ns - t->sessions[i].last_ns > t->idle_ns) {
+            remove_session(t, i);
+            t->expired++;
+        } else {
+            i++;
+        }
+    }
+}
+
+session_t *session_lookup(session_table_t *t, const struct sockaddr *sa, int64_t now_ns)
+{
+    peer_addr_t peer;
+    peer_from_sockaddr(sa, &peer);
+
+    uint64_t hash = peer_hash(&peer);
+    uint32_t i    = (uint32_t)hash & t->slot_mask;
+
+    for (;;) {
+        session_slot_t *slot = &t->slots[i];
+
+        if (slot->hash == hash && slot->port == peer.port && slot->family == peer.family &&
+            memcmp(slot->addr, peer.addr, sizeof(peer.addr)) == 0) {
+            return &t->sessions[slot->index];
+        }
+
+        if (slot->hash == 0) {
+            if (t->count == t->capacity) {
+                uint32_t before = t->count;
+                expire_sessions(t, now_ns);
+                if (t->count == before) {
+                    t->untracked++;
+                    return NULL;
+                }
+                /* Slots moved, probe again for the free one */
+                return session_lookup(t, sa, now_ns);
+            }
+            slot->hash   = hash;
+            slot->port   = peer.port;
+            slot->family = peer.family;
+            slot->index  = t->count;
+            memcpy(slot->addr, peer.addr, sizeof(peer.addr));
+
+            session_t *s = &t->sessions[t->count++];
+            memset(s, 0, sizeof(*s));
+            s->peer = peer;
+            seqtrack_init(&s->seq);
+            return s;
+        }
+
+        i = (i + 1) & t->slot_mask;
+    }
+}
+
+void session_update(session_table_t *t, session_t *s, int64_t now_ns, size_t bytes, uint64_t seq)
+{
+    /* Exponentially weighted count: decay by the elapsed time, then add
+     * this packet. ewma_pps converges to the arrival rate with time
+     * constant tau. */
+    if (s->packets == 0) {
+        s->first_ns = now_ns;
+    } else {
+        double decay = exp(-(double)(now_ns - s->last_ns) / t->tau_ns);
+        s->ewma_pps *= decay;
+        s->ewma_bps *= decay;
+    }
+    s->ewma_pps += 1e9 / t->tau_ns;
+    s->ewma_bps += (double)bytes * 8.0 * 1e9 / t->tau_ns;
+
+    s->packets++;
+    s->bytes  += bytes;
+    s->last_ns = now_ns;
+
+    if (seq != UINT64_MAX) {
+        seqtrack_update(&s->seq, seq);
+    }
+}
+
+uint32_t session_snapshot(const session_table_t *t, int64_t now_ns, session_health_t *out)
+{
+    for (uint32_t i = 0; i < t->count; i++) {
+        const session_t *s = &t->sessions[i];
+        double decay = exp(-(double)(now_ns - s->last_ns) / t->tau_ns);
+
+        out[i].peer       = s->peer;
+        out[i].packets    = s->packets;
+        out[i].bytes      = s->bytes;
+        out[i].missing    = s->seq.missing;
+        out[i].reordered  = s->seq.reordered;
+        out[i].duplicates = s->seq.duplicates;
+        out[i].loss_ratio = seqtrack_loss_ratio(&s->seq);
+        out[i].pps        = s->ewma_pps * decay;
+        out[i].bps        = s->ewma_bps * decay;
+        out[i].idle_ns    = now_ns - s->last_ns;
+        out[i].has_seq    = s->seq.started;
+    }
+    return t->count;
+}
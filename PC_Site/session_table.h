@@ -0,0 +1,93 @@
+#ifndef SESSION_TABLE_H
+#define SESSION_TABLE_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "seqtrack.h"
+
+/*
+ * Per-peer session table for the UDP server.
+ *
+ * Peers are found through an open-addressing (linear probing) index of
+ * 32-byte slots, two per cache line, that holds only the hash, the
+ * address, the port, and the session index. A lookup therefore normally
+ * touches a single cache line. The session state itself lives in a
+ * separate array that is allocated once, so the receive path never
+ * allocates and never rehashes.
+ *
+ * Peers come and go: a client picks a new source port for every socket
+ * and a board reboots on a new one. When the table is full, a new peer
+ * takes the place of sessions that have been idle for longer than the
+ * idle timeout. Those are removed with a backward-shift delete, so the
+ * index never fills up with tombstones.
+ */
+
+typedef struct {
+    uint8_t  addr[16];
+    uint16_t port;
+    uint8_t  family;
+} peer_addr_t;
+
+typedef struct {
+    peer_addr_t peer;
+    uint64_t    packets;
+    uint64_t    bytes;
+    int64_t     first_ns;
+    int64_t     last_ns;
+    double      ewma_pps;       /* exponentially weighted rates, see session_rate_tau */
+    double      ewma_bps;
+    seqtrack_t  seq;
+} session_t;
+
+typedef struct {
+    uint64_t hash;              /* 0 = empty */
+    uint8_t  addr[16];
+    uint16_t port;
+    uint8_t  family;
+    uint8_t  reserved;
+    uint32_t index;
+} session_slot_t;
+
+typedef struct {
+    session_slot_t *slots;
+    uint32_t        slot_mask;
+    session_t      *sessions;
+    uint32_t        capacity;
+    uint32_t        count;
+    uint64_t        untracked;  /* packets from peers that did not fit */
+    uint64_t        expired;    /* sessions removed after idling */
+    double          tau_ns;     /* EWMA time constant */
+    int64_t         idle_ns;    /* idle time after which a session may be removed */
+    int64_t         next_expire_ns;
+} session_table_t;
+
+/* Point-in-time copy of one session for reporting */
+typedef struct {
+    peer_addr_t peer;
+    uint64_t    packets;
+    uint64_t    bytes;
+    uint64_t    missing;
+    uint64_t    reordered;
+    uint64_t    duplicates;
+    double      loss_ratio;
+    double      pps;
+    double      bps;
+    int64_t     idle_ns;
+    int         has_seq;
+} session_health_t;
+
+int  session_table_init(session_table_t *t, uint32_t capacity, double tau_s, double idle_s);
+void session_table_free(session_table_t *t);
+
+/* Find or create the session of a peer, NULL if the table is full of
+ * sessions that are not idle yet */
+session_t *session_lookup(session_table_t *t, const struct sockaddr *peer, int64_t now_ns);
+
+/* Account one datagram; seq is UINT64_MAX if the payload had none */
+void session_update(session_table_t *t, session_t *s, int64_t now_ns, size_t bytes, uint64_t seq);
+
+/* Copy all sessions into out (capacity entries), returns the count */
+uint32_t session_snapshot(const session_table_t *t, int64_t now_ns, session_health_t *out);
+
+#endif /* SESSION_TABLE_H */
@@ -1,3 +1,6 @@
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,63 +9,284 @@
 #include <ifaddrs.h>
 #include <net/if.h>
 
+#include "capture.h"
+#include "codec.h"
+#include "discovery.h"
+#include "netaddr.h"
+#include "output.h"
+#include "timestamping.h"
+
 #define PORT        8080
 #define BUFFER_SIZE 1024
+#define MAX_CLIENTS 1024
+#define DEFAULT_REPORT_INTERVAL 1000
+
+/* A recv() can end inside a frame or hold several, so the bytes of each
+ * client are collected in rx_buf and cut into messages there */
+typedef struct {
+    int fd;
+    struct sockaddr_storage addr;
+    ts_tx_track_t tx_track;
+    uint8_t *rx_buf;            /* CODEC_MAX_FRAME bytes */
+    size_t rx_used;
+} client_t;
+
+/* fds[0] is the listening socket, fds[i] belongs to clients[i - 1] */
+static struct pollfd fds[MAX_CLIENTS + 1];
+static client_t clients[MAX_CLIENTS];
+static int nfds = 1;
+
+static ts_report_t report;
+static codec_stats_t codec_stats;
+static capture_writer_t capture;
+static int recording = 0;
+static output_t output;
+static unsigned long messages = 0;
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-t] [-i <iface>] [-r <n>] [-w <file>] [-o <file>] [-F <format>] [-n]\n"
+            "  -t          enable SO_TIMESTAMPING and report kernel vs. application latency\n"
+            "  -i <iface>  additionally request hardware timestamps from <iface> (implies -t)\n"
+            "  -r <n>      print the latency report every <n> messages (default %d)\n"
+            "  -w <file>   record every received segment to a capture file\n"
+            "  -o <file>   write the message log to <file> instead of stdout\n"
+            "  -F <fmt>    message log format: human (default), csv or ndjson\n"
+            "  -n          do not answer board discovery broadcasts\n",
+            prog, DEFAULT_REPORT_INTERVAL);
+}
 
-int main(void)
+static void accept_client(int server_fd, int timestamping, const char *hw_iface)
 {
-    int server_fd, client_fd;
-    struct sockaddr_in address;
+    struct sockaddr_storage address;
     socklen_t addr_len = sizeof(address);
-    char buffer[BUFFER_SIZE];
 
-    /* Create TCP socket */
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd < 0) {
-        perror("socket");
-        exit(EXIT_FAILURE);
+    int client_fd = accept(server_fd, (struct sockaddr *)&address, &addr_len);
+    if (client_fd < 0) {
+        perror("accept");
+        return;
     }
 
-    /* Allow address reuse so we can restart quickly */
-    int opt = 1;
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        perror("setsockopt");
-        close(server_fd);
-        exit(EXIT_FAILURE);
+    if (nfds > MAX_CLIENTS) {
+        printf("[Server] Too many clients, rejecting connection.\n");
+        close(client_fd);
+        return;
     }
 
-    /* Bind to all interfaces on PORT */
-    memset(&address, 0, sizeof(address));
-    address.sin_family      = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port        = htons(PORT);
+    client_t *client = &clients[nfds - 1];
+    memset(client, 0, sizeof(*client));
+    client->fd = client_fd;
+    client->addr = address;
+    client->tx_track.bytestream = 1;
 
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-        perror("bind");
-        close(server_fd);
+    if (timestamping && ts_enable(client_fd, hw_iface) < 0) {
+        close(client_fd);
+        return;
+    }
+
+    client->rx_buf = malloc(CODEC_MAX_FRAME);
+    if (client->rx_buf == NULL) {
+        perror("malloc");
+        close(client_fd);
+        return;
+    }
+
+    fds[nfds].fd      = client_fd;
+    fds[nfds].events  = POLLIN;
+    fds[nfds].revents = 0;
+    nfds++;
+    output_post(&output, OUTPUT_EV_CONNECT, ts_now_ns(), IPPROTO_TCP,
+                (struct sockaddr *)&address, NULL, 0);
+}
+
+/* Close a client and move the last one into its slot */
+static void drop_client(int i)
+{
+    close(clients[i - 1].fd);
+    free(clients[i - 1].rx_buf);
+    nfds--;
+    if (i != nfds) {
+        fds[i] = fds[nfds];
+        clients[i - 1] = clients[nfds - 1];
+    }
+}
+
+/* Echo one message, returns -1 when the client is gone */
+static int echo_message(client_t *client, const ts_rx_t *rx, const uint8_t *msg, size_t len,
+                        int timestamping, long report_interval)
+{
+    /* Boards with CONFIG_COMM_ENGINE_COMPRESS send encoded frames */
+    char text[BUFFER_SIZE];
+    int text_len = codec_render(&codec_stats, msg, len, text, sizeof(text));
+    if (text_len < 0) {
+        printf("[Server] Dropping corrupt frame (%zu bytes)\n", len);
+        return 0;
+    }
+    output_post(&output, OUTPUT_EV_RX, rx->user_ns, IPPROTO_TCP,
+                (struct sockaddr *)&client->addr, text, (size_t)text_len);
+
+    /* Echo back with a prefix */
+    char response[BUFFER_SIZE + 8];
+    snprintf(response, sizeof(response), "Echo: %s", text);
+    int64_t send_ns;
+    if (ts_sendto(client->fd, timestamping ? &client->tx_track : NULL, response, strlen(response),
+                  NULL, 0, &send_ns) < 0) {
+        perror("send");
+        return -1;
+    }
+    output_post(&output, OUTPUT_EV_TX, send_ns, IPPROTO_TCP,
+                (struct sockaddr *)&client->addr, response, strlen(response));
+
+    if (timestamping) {
+        ts_account(&report, rx, send_ns);
+        ts_poll_tx(client->fd, &client->tx_track, &report);
+        if (++messages % (unsigned long)report_interval == 0) {
+            ts_print_report(stdout, "[Server]", &report);
+        }
+    }
+    return 0;
+}
+
+/* Receive what the client sent and echo every complete message in it,
+ * returns -1 when the client is gone */
+static int handle_client(client_t *client, int timestamping, long report_interval)
+{
+    uint8_t *buffer = client->rx_buf + client->rx_used;
+
+    ts_rx_t rx;
+    ssize_t bytes = ts_recvmsg(client->fd, buffer, CODEC_MAX_FRAME - client->rx_used, 0,
+                               NULL, NULL, &rx);
+    if (bytes <= 0) {
+        if (bytes == 0)
+            output_post(&output, OUTPUT_EV_DISCONNECT, ts_now_ns(), IPPROTO_TCP,
+                        (struct sockaddr *)&client->addr, NULL, 0);
+        else
+            perror("recv");
+        return -1;
+    }
+
+    if (recording) {
+        capture_write(&capture, rx.sw_ns != 0 ? rx.sw_ns : rx.user_ns,
+                      rx.sw_ns != 0 ? CAPTURE_F_KERNEL_TS : 0, IPPROTO_TCP,
+                      (struct sockaddr *)&client->addr, buffer, (size_t)bytes);
+    }
+    client->rx_used += (size_t)bytes;
+
+    /* A frame waits for its last byte. Text has no length, it is cut at
+     * the next frame or at the end of what arrived, as before. */
+    size_t done = 0;
+    while (done < client->rx_used) {
+        const uint8_t *msg = client->rx_buf + done;
+        size_t avail = client->rx_used - done;
+        size_t len = codec_next_message(msg, avail);
+
+        if (len == 0 || len > avail) {
+            break;
+        }
+        if (!codec_is_frame(msg, len) && len > BUFFER_SIZE - 1) {
+            len = BUFFER_SIZE - 1;
+        }
+        if (echo_message(client, &rx, msg, len, timestamping, report_interval) < 0) {
+            return -1;
+        }
+        done += len;
+    }
+    memmove(client->rx_buf, client->rx_buf + done, client->rx_used - done);
+    client->rx_used -= done;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int server_fd;
+    int timestamping = 0;
+    const char *hw_iface = NULL;
+    long report_interval = DEFAULT_REPORT_INTERVAL;
+    const char *capture_path = NULL;
+    const char *output_path = NULL;
+    output_format_t output_format = OUTPUT_HUMAN;
+    int answer_discovery = 1;
+    discovery_t discovery;
+    int c;
+
+    while ((c = getopt(argc, argv, "ti:r:w:o:F:nh")) != -1) {
+        switch (c) {
+        case 't':
+            timestamping = 1;
+            break;
+        case 'i':
+            timestamping = 1;
+            hw_iface = optarg;
+            break;
+        case 'r':
+            report_interval = strtol(optarg, NULL, 10);
+            if (report_interval <= 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'w':
+            capture_path = optarg;
+            break;
+        case 'o':
+            output_path = optarg;
+            break;
+        case 'F':
+            if (output_parse_format(optarg, &output_format) < 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'n':
+            answer_discovery = 0;
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* Stop on Ctrl+C without restarting poll so the final report is printed */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Bind to all interfaces on PORT, IPv4 and IPv6 */
+    server_fd = netaddr_server_socket(SOCK_STREAM, PORT);
+    if (server_fd < 0) {
         exit(EXIT_FAILURE);
     }
 
     /* Listen for incoming connections */
-    if (listen(server_fd, 1) < 0) {
+    if (listen(server_fd, SOMAXCONN) < 0) {
         perror("listen");
         close(server_fd);
         exit(EXIT_FAILURE);
     }
 
-    /* Print all LAN IPv4 addresses so the client knows where to connect */
+    /* Print all LAN addresses so the client knows where to connect */
     {
         struct ifaddrs *ifaddr, *ifa;
-        char ip_str[INET_ADDRSTRLEN];
+        char ip_str[NETADDR_STRLEN];
         if (getifaddrs(&ifaddr) == 0) {
             printf("[Server] Listening on port %d — reachable at:\n", PORT);
             for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
                 if (ifa->ifa_addr == NULL) continue;
-                if (ifa->ifa_addr->sa_family != AF_INET) continue;
+                if (ifa->ifa_addr->sa_family != AF_INET &&
+                    ifa->ifa_addr->sa_family != AF_INET6) continue;
                 if (ifa->ifa_flags & IFF_LOOPBACK) continue;
-                inet_ntop(AF_INET,
-                          &((struct sockaddr_in *)ifa->ifa_addr)->sin_addr,
-                          ip_str, sizeof(ip_str));
+                netaddr_host(ifa->ifa_addr, ip_str, sizeof(ip_str));
                 printf("[Server]   %s  (iface: %s)\n", ip_str, ifa->ifa_name);
             }
             freeifaddrs(ifaddr);
@@ -71,43 +295,81 @@ int main(void)
         }
     }
 
-    /* Accept a single client */
-    client_fd = accept(server_fd, (struct sockaddr *)&address, &addr_len);
-    if (client_fd < 0) {
-        perror("accept");
+    if (capture_path != NULL) {
+        if (capture_writer_open(&capture, capture_path) < 0) {
+            close(server_fd);
+            exit(EXIT_FAILURE);
+        }
+        recording = 1;
+        printf("[Server] Recording to %s\n", capture_path);
+    }
+
+    if (output_open(&output, output_path, output_format) < 0) {
         close(server_fd);
         exit(EXIT_FAILURE);
     }
 
-    char client_ip[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &address.sin_addr, client_ip, sizeof(client_ip));
-    printf("[Server] Client connected from %s\n", client_ip);
-
-    /* Exchange messages in a loop */
-    for (;;) {
-        /* Receive message from client */
-        memset(buffer, 0, BUFFER_SIZE);
-        ssize_t bytes = recv(client_fd, buffer, BUFFER_SIZE - 1, 0);
-        if (bytes <= 0) {
-            if (bytes == 0)
-                printf("[Server] Client disconnected.\n");
-            else
-                perror("recv");
+    /* A failed responder only costs the boards their discovery, keep serving */
+    if (answer_discovery && discovery_start(&discovery, "echo-tcp", PORT) < 0) {
+        answer_discovery = 0;
+    }
+
+    memset(&report, 0, sizeof(report));
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        clients[i].fd = -1;
+    }
+    fds[0].fd     = server_fd;
+    fds[0].events = POLLIN;
+
+    /* Serve all clients from one poll loop until interrupted */
+    while (!stop_requested) {
+        int ready = poll(fds, (nfds_t)nfds, -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
             break;
         }
-        printf("[Server] Received: %s\n", buffer);
 
-        /* Echo back with a prefix */
-        char response[BUFFER_SIZE];
-        snprintf(response, sizeof(response), "Echo: %s", buffer);
-        if (send(client_fd, response, strlen(response), 0) < 0) {
-            perror("send");
-            break;
+        if (fds[0].revents & POLLIN) {
+            accept_client(server_fd, timestamping, hw_iface);
+        }
+
+        for (int i = 1; i < nfds; i++) {
+            client_t *client = &clients[i - 1];
+
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            /* TX timestamps on the error queue are signalled as POLLERR */
+            if (timestamping && (fds[i].revents & POLLERR)) {
+                ts_poll_tx(client->fd, &client->tx_track, &report);
+            }
+            if (fds[i].revents & (POLLIN | POLLHUP)) {
+                if (handle_client(client, timestamping, report_interval) < 0) {
+                    drop_client(i);
+                    i--;
+                }
+            }
         }
-        printf("[Server] Sent:     %s\n", response);
     }
 
-    close(client_fd);
+    if (timestamping) {
+        ts_print_report(stdout, "[Server]", &report);
+    }
+    codec_print_stats(stdout, "[Server]", &codec_stats);
+
+    while (nfds > 1) {
+        drop_client(1);
+    }
+    if (recording) {
+        capture_writer_close(&capture);
+    }
+    if (answer_discovery) {
+        discovery_stop(&discovery);
+    }
+    output_close(&output);
     close(server_fd);
     printf("[Server] Closed.\n");
     return 0;
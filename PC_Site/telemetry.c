@@ -0,0 +1,170 @@
+#include "telemetry.h"
+
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+_Static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "columns are read in host order");
+
+static size_t align4(size_t x)
+{
+    return (x + 3) & ~(size_t)3;
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+int telemetry_soa_init(telemetry_soa_t *soa, size_t capacity)
+{
+    memset(soa, 0, sizeof(*soa));
+    soa->capacity = capacity;
+    soa->t_us = malloc(capacity * sizeof(*soa->t_us));
+    if (soa->t_us == NULL) {
+        return -1;
+    }
+    for (int c = 0; c < TELEMETRY_MAX_COLUMNS; c++) {
+        soa->col[c] = malloc(capacity * sizeof(*soa->col[c]));
+        if (soa->col[c] == NULL) {
+            telemetry_soa_free(soa);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void telemetry_soa_free(telemetry_soa_t *soa)
+{
+    free(soa->t_us);
+    for (int c = 0; c < TELEMETRY_MAX_COLUMNS; c++) {
+        free(soa->col[c]);
+    }
+    memset(soa, 0, sizeof(*soa));
+}
+
+int telemetry_is_batch(const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+
+    return len >= TELEMETRY_HEADER && p[0] == TELEMETRY_MAGIC && p[1] == TELEMETRY_VERSION;
+}
+
+size_t telemetry_frame_len(const void *hdr)
+{
+    const uint8_t *p = hdr;
+    size_t count = get16(&p[4]);
+    unsigned columns = p[6];
+
+    if (p[0] != TELEMETRY_MAGIC || p[1] != TELEMETRY_VERSION || columns == 0 ||
+        columns > TELEMETRY_MAX_COLUMNS) {
+        return 0;
+    }
+
+    size_t len = align4(TELEMETRY_HEADER + count * sizeof(uint16_t));
+    for (unsigned c = 0; c < columns; c++) {
+        uint8_t w = p[24 + c];
+        if (w != 1 && w != 2 && w != 4) {
+            return 0;
+        }
+        len = align4(len + count * w);
+    }
+    return len;
+}
+
+/*
+ * t[i] = base + dt[0] + ... + dt[i]. The running sum fits 32 bits (at most
+ * 65535 deltas of at most 65535 us), so four sums are built at once in an
+ * SSE register with two shifted adds, then widened to 64 bits.
+ */
+static void decode_time(const uint8_t *restrict dt, size_t n, int64_t base, int64_t *restrict t)
+{
+    size_t i = 0;
+    uint32_t sum = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i base2 = _mm_set1_epi64x(base);
+    __m128i carry = zero;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(dt + 2 * i)), zero);
+        v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+        v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+        v = _mm_add_epi32(v, carry);
+        carry = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3));
+        _mm_storeu_si128((__m128i *)(t + i), _mm_add_epi64(_mm_unpacklo_epi32(v, zero), base2));
+        _mm_storeu_si128((__m128i *)(t + i + 2), _mm_add_epi64(_mm_unpackhi_epi32(v, zero), base2));
+    }
+    sum = (uint32_t)_mm_cvtsi128_si32(carry);
+#endif
+    for (; i < n; i++) {
+        sum += get16(dt + 2 * i);
+        t[i] = base + sum;
+    }
+}
+
+/* Column kernels: fixed width per call, restrict pointers, vectorizable */
+static void widen8(const uint8_t *restrict src, size_t n, int32_t *restrict dst)
+{
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = (int8_t)src[i];
+    }
+}
+
+static void widen16(const uint8_t *restrict src, size_t n, int32_t *restrict dst)
+{
+    for (size_t i = 0; i < n; i++) {
+        int16_t v;
+        memcpy(&v, src + 2 * i, sizeof(v));
+        dst[i] = v;
+    }
+}
+
+int telemetry_decode(const void *buf, size_t len, telemetry_soa_t *soa)
+{
+    const uint8_t *p = buf;
+
+    if (!telemetry_is_batch(buf, len)) {
+        return -1;
+    }
+    size_t frame_len = telemetry_frame_len(buf);
+    size_t n = get16(&p[4]);
+    if (frame_len == 0 || frame_len > len || n > soa->capacity) {
+        return -1;
+    }
+
+    soa->schema_id = get16(&p[2]);
+    soa->seq = get32(&p[8]);
+    soa->columns = p[6];
+    memcpy(soa->width, &p[24], soa->columns);
+    soa->count = n;
+
+    int64_t base = (int64_t)((uint64_t)get32(&p[16]) | (uint64_t)get32(&p[20]) << 32);
+    size_t off = TELEMETRY_HEADER;
+    decode_time(p + off, n, base, soa->t_us);
+    off = align4(off + n * sizeof(uint16_t));
+
+    for (unsigned c = 0; c < soa->columns; c++) {
+        switch (soa->width[c]) {
+        case 1:
+            widen8(p + off, n, soa->col[c]);
+            break;
+        case 2:
+            widen16(p + off, n, soa->col[c]);
+            break;
+        default:
+            memcpy(soa->col[c], p + off, n * sizeof(int32_t));
+            break;
+        }
+        off = align4(off + n * soa->width[c]);
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Decoder for the board's column-major telemetry batches
+ * (CONFIG_COMM_ENGINE_TELEMETRY, modules/comm_engine/comm_telemetry.c).
+ *
+ * A batch holds count samples of one schema: a 32 byte header with the
+ * timestamp of the first sample, a block of 16-bit timestamp deltas, then
+ * one block per column. The decoder never looks at a sample on its own:
+ * the deltas are prefix-summed and every column is widened to int32 with
+ * plain array loops (SSE2 for the prefix sum), straight into a
+ * struct-of-arrays the caller owns.
+ */
+
+#define TELEMETRY_MAGIC       0xB7
+#define TELEMETRY_VERSION     1
+#define TELEMETRY_HEADER      32
+#define TELEMETRY_MAX_COLUMNS 8
+#define TELEMETRY_MAX_SAMPLES UINT16_MAX
+
+typedef struct {
+    uint16_t schema_id;
+    uint32_t seq;
+    unsigned columns;
+    uint8_t  width[TELEMETRY_MAX_COLUMNS];
+    size_t   count;                             /* samples in the arrays */
+    size_t   capacity;
+    int64_t *t_us;                              /* absolute timestamps */
+    int32_t *col[TELEMETRY_MAX_COLUMNS];        /* every column widened to int32 */
+} telemetry_soa_t;
+
+/* Allocate arrays for capacity samples of up to TELEMETRY_MAX_COLUMNS */
+int  telemetry_soa_init(telemetry_soa_t *soa, size_t capacity);
+void telemetry_soa_free(telemetry_soa_t *soa);
+
+/* 1 when buf starts with a batch header */
+int telemetry_is_batch(const void *buf, size_t len);
+
+/* Size of the whole batch from its header, 0 if the header is invalid.
+ * Lets a stream reader (TCP) read exactly one batch. */
+size_t telemetry_frame_len(const void *hdr);
+
+/* Decode one batch into soa, -1 when it is corrupt or does not fit */
+int telemetry_decode(const void *buf, size_t len, telemetry_soa_t *soa);
+
+#endif /* TELEMETRY_H */
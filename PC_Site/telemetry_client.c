@@ -0,0 +1,336 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "netaddr.h"
+#include "telemetry.h"
+
+#define PORT            8080
+#define DEFAULT_BATCHES 100
+#define RECV_TIMEOUT_MS 2000
+#define FRAME_MAX       (TELEMETRY_HEADER + 4 * (TELEMETRY_MAX_COLUMNS + 1) + \
+                         TELEMETRY_MAX_SAMPLES * (2 + 4 * TELEMETRY_MAX_COLUMNS))
+#define UDP_IP_HEADERS  28      /* per datagram, before any WiFi overhead */
+
+/* The echo demo's test pattern (CONFIG_UDP_SOCKET_DEMO_TELEMETRY): sample
+ * g carries (int16)(7 g), (int16)(-3 g), g, so every sample checks itself */
+#define SCHEMA_PATTERN  1
+
+/*
+ * Asks the board for telemetry batches ("TELEMETRY <n>"), decodes them
+ * into struct-of-arrays buffers, checks the test pattern and reports the
+ * wire cost per sample and the decode time per batch. -B runs the decoder
+ * on locally built batches instead, without a board.
+ */
+
+typedef struct {
+    uint64_t batches;
+    uint64_t samples;
+    uint64_t bytes;
+    uint64_t lost;              /* batches missing from the sequence */
+    uint64_t bad;               /* samples not matching the pattern */
+    uint64_t text_bytes;        /* the same samples as one text datagram each */
+    int64_t  decode_ns;
+    int      have_seq;
+    uint32_t next_seq;
+} stats_t;
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-t] [-p <port>] [-b <batches>] <board-ip>\n"
+            "       %s -B <samples>\n"
+            "  -t            the echo demo runs over TCP (default UDP)\n"
+            "  -p <port>     port (default %d)\n"
+            "  -b <batches>  batches to request (default %d)\n"
+            "  -B <samples>  decode benchmark on local batches of <samples> samples\n",
+            prog, prog, PORT, DEFAULT_BATCHES);
+}
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Column checks over the decoded arrays, no per-sample branching */
+static uint64_t check_pattern(const telemetry_soa_t *soa)
+{
+    const int32_t *restrict x = soa->col[0];
+    const int32_t *restrict y = soa->col[1];
+    const int32_t *restrict g = soa->col[2];
+    uint64_t bad = 0;
+
+    for (size_t i = 0; i < soa->count; i++) {
+        bad += (x[i] != (int16_t)(uint16_t)(7u * (uint32_t)g[i])) |
+               (y[i] != (int16_t)(uint16_t)(0u - 3u * (uint32_t)g[i]));
+    }
+    for (size_t i = 1; i < soa->count; i++) {
+        bad += soa->t_us[i] < soa->t_us[i - 1];
+    }
+    return bad;
+}
+
+static void account(stats_t *st, const telemetry_soa_t *soa, size_t wire_len, int64_t decode_ns)
+{
+    if (st->have_seq && soa->seq != st->next_seq) {
+        st->lost += soa->seq - st->next_seq;
+    }
+    st->have_seq = 1;
+    st->next_seq = soa->seq + 1;
+
+    st->batches++;
+    st->samples += soa->count;
+    st->bytes += wire_len;
+    st->decode_ns += decode_ns;
+
+    if (soa->schema_id == SCHEMA_PATTERN && soa->columns == 3) {
+        st->bad += check_pattern(soa);
+    }
+
+    /* What "t,x,y,z" as its own datagram per sample would have cost */
+    char line[128];
+    for (size_t i = 0; i < soa->count; i++) {
+        int n = snprintf(line, sizeof(line), "%lld", (long long)soa->t_us[i]);
+        for (unsigned c = 0; c < soa->columns; c++) {
+            n += snprintf(line + n, sizeof(line) - (size_t)n, ",%d", soa->col[c][i]);
+        }
+        st->text_bytes += (uint64_t)n + UDP_IP_HEADERS;
+    }
+}
+
+static void print_stats(const stats_t *st, int datagram)
+{
+    if (st->batches == 0) {
+        printf("[Telemetry] No batch received\n");
+        return;
+    }
+    uint64_t wire = st->bytes + (datagram ? st->batches * UDP_IP_HEADERS : 0);
+
+    printf("\n=== Telemetry summary ===\n");
+    printf("Batches           : %llu (%llu lost), %.0f samples each\n", (unsigned long long)st->batches,
+           (unsigned long long)st->lost, (double)st->samples / (double)st->batches);
+    printf("Samples           : %llu, %llu not matching the test pattern\n", (unsigned long long)st->samples,
+           (unsigned long long)st->bad);
+    printf("Bytes per sample  : %.2f batched vs %.2f as one text datagram each\n",
+           (double)wire / (double)st->samples, (double)st->text_bytes / (double)st->samples);
+    printf("Decode            : %.2f us per batch, %.2f ns per sample\n",
+           (double)st->decode_ns / (double)st->batches / 1000.0,
+           (double)st->decode_ns / (double)st->samples);
+}
+
+/* Read exactly len bytes from a stream */
+static int read_full(int fd, uint8_t *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = recv(fd, buf + got, len - got, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        got += (size_t)n;
+    }
+    return 0;
+}
+
+/* One batch from the board, its length, or -1 on timeout / close */
+static ssize_t receive_batch(int fd, int datagram, uint8_t *buf, size_t cap)
+{
+    if (datagram) {
+        return recv(fd, buf, cap, 0);
+    }
+    if (read_full(fd, buf, TELEMETRY_HEADER) < 0) {
+        return -1;
+    }
+    size_t len = telemetry_frame_len(buf);
+    if (len == 0 || len > cap) {
+        fprintf(stderr, "[Telemetry] Invalid batch header, stream out of sync\n");
+        return -1;
+    }
+    if (read_full(fd, buf + TELEMETRY_HEADER, len - TELEMETRY_HEADER) < 0) {
+        return -1;
+    }
+    return (ssize_t)len;
+}
+
+static int run_board(const char *ip, uint16_t port, int datagram, int batches)
+{
+    static uint8_t buf[FRAME_MAX];
+    telemetry_soa_t soa;
+    stats_t st = { 0 };
+
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    if (netaddr_resolve(ip, port, datagram ? SOCK_DGRAM : SOCK_STREAM, &addr, &addr_len) < 0) {
+        return -1;
+    }
+
+    int fd = socket(addr.ss_family, datagram ? SOCK_DGRAM : SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    struct timeval tv = { .tv_sec = RECV_TIMEOUT_MS / 1000, .tv_usec = (RECV_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (connect(fd, (struct sockaddr *)&addr, addr_len) < 0) {
+        perror("connect");
+        close(fd);
+        return -1;
+    }
+    if (telemetry_soa_init(&soa, TELEMETRY_MAX_SAMPLES) < 0) {
+        perror("malloc");
+        close(fd);
+        return -1;
+    }
+
+    char request[32];
+    int len = snprintf(request, sizeof(request), "TELEMETRY %d", batches);
+    if (send(fd, request, (size_t)len, 0) < 0) {
+        perror("send");
+    }
+
+    int64_t start = now_ns();
+    while (st.batches + st.lost < (uint64_t)batches) {
+        ssize_t n = receive_batch(fd, datagram, buf, sizeof(buf));
+        if (n < 0) {
+            break;
+        }
+        if (!telemetry_is_batch(buf, (size_t)n)) {
+            printf("[Telemetry] Ignoring %zd bytes that are no batch\n", n);
+            continue;
+        }
+        int64_t t0 = now_ns();
+        if (telemetry_decode(buf, (size_t)n, &soa) < 0) {
+            fprintf(stderr, "[Telemetry] Corrupt batch (%zd bytes)\n", n);
+            continue;
+        }
+        account(&st, &soa, (size_t)n, now_ns() - t0);
+    }
+    double secs = (double)(now_ns() - start) / 1e9;
+
+    print_stats(&st, datagram);
+    if (st.batches > 0) {
+        printf("Throughput        : %.0f samples/s over %.2f s\n", (double)st.samples / secs, secs);
+    }
+    telemetry_soa_free(&soa);
+    close(fd);
+    return st.batches > 0 && st.bad == 0 ? 0 : -1;
+}
+
+/* The board's layout for the test pattern, to feed the decoder locally */
+static size_t build_batch(uint8_t *buf, size_t n, uint32_t seq, uint32_t first)
+{
+    memset(buf, 0, TELEMETRY_HEADER);
+    buf[0] = TELEMETRY_MAGIC;
+    buf[1] = TELEMETRY_VERSION;
+    buf[2] = SCHEMA_PATTERN;
+    buf[4] = (uint8_t)n;
+    buf[5] = (uint8_t)(n >> 8);
+    buf[6] = 3;
+    memcpy(&buf[8], &seq, sizeof(seq));
+    int64_t base = 1000000;
+    memcpy(&buf[16], &base, sizeof(base));
+    buf[24] = 2;
+    buf[25] = 2;
+    buf[26] = 4;
+
+    size_t off = TELEMETRY_HEADER;
+    for (size_t i = 0; i < n; i++) {
+        uint16_t dt = i == 0 ? 0 : (uint16_t)(900 + rand() % 200);
+        memcpy(buf + off + 2 * i, &dt, sizeof(dt));
+    }
+    off = (off + 2 * n + 3) & ~(size_t)3;
+    for (size_t i = 0; i < n; i++) {
+        int16_t x = (int16_t)(uint16_t)(7u * (first + (uint32_t)i));
+        memcpy(buf + off + 2 * i, &x, sizeof(x));
+    }
+    off = (off + 2 * n + 3) & ~(size_t)3;
+    for (size_t i = 0; i < n; i++) {
+        int16_t y = (int16_t)(uint16_t)(0u - 3u * (first + (uint32_t)i));
+        memcpy(buf + off + 2 * i, &y, sizeof(y));
+    }
+    off = (off + 2 * n + 3) & ~(size_t)3;
+    for (size_t i = 0; i < n; i++) {
+        int32_t g = (int32_t)(first + (uint32_t)i);
+        memcpy(buf + off + 4 * i, &g, sizeof(g));
+    }
+    return off + 4 * n;
+}
+
+static int run_benchmark(size_t samples)
+{
+    static uint8_t buf[FRAME_MAX];
+    telemetry_soa_t soa;
+    stats_t st = { 0 };
+    const int rounds = 2000;
+
+    if (telemetry_soa_init(&soa, samples) < 0) {
+        perror("malloc");
+        return -1;
+    }
+    size_t len = build_batch(buf, samples, 0, 12345);
+
+    /* Check once, then time the decoder alone */
+    if (telemetry_decode(buf, len, &soa) < 0) {
+        fprintf(stderr, "[Telemetry] Local batch does not decode\n");
+        telemetry_soa_free(&soa);
+        return -1;
+    }
+    account(&st, &soa, len, 0);
+
+    int64_t t0 = now_ns();
+    for (int r = 0; r < rounds; r++) {
+        telemetry_decode(buf, len, &soa);
+    }
+    int64_t ns = now_ns() - t0;
+
+    printf("[Telemetry] %zu samples, %zu bytes per batch, %llu pattern errors\n", samples, len,
+           (unsigned long long)st.bad);
+    printf("[Telemetry] Decode: %.2f us per batch, %.3f ns per sample, %.2f GB/s\n",
+           (double)ns / rounds / 1000.0, (double)ns / rounds / (double)samples,
+           (double)len * rounds / (double)ns);
+    telemetry_soa_free(&soa);
+    return st.bad == 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = PORT;
+    int datagram = 1;
+    int batches = DEFAULT_BATCHES;
+    long bench = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "tp:b:B:h")) != -1) {
+        switch (c) {
+        case 't': datagram = 0; break;
+        case 'p': port = (uint16_t)atoi(optarg); break;
+        case 'b': batches = atoi(optarg); break;
+        case 'B': bench = strtol(optarg, NULL, 10); break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (bench != 0) {
+        if (bench < 1 || bench > TELEMETRY_MAX_SAMPLES) {
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        return run_benchmark((size_t)bench) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (optind != argc - 1 || batches <= 0) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    return run_board(argv[optind], port, datagram, batches) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
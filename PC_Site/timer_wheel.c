@@ -0,0 +1,147 @@
+#include "timer_wheel.h"
+
+#include <string.h>
+
+#define MASK (TW_SLOTS - 1)
+
+/* First occupied slot at or after from, TW_SLOTS if none */
+static unsigned next_used(const uint64_t *used, unsigned from)
+{
+    for (unsigned w = from / 64; w < TW_SLOTS / 64; w++) {
+        uint64_t m = used[w];
+        if (w == from / 64) {
+            m &= ~0ULL << (from % 64);
+        }
+        if (m != 0) {
+            return w * 64 + (unsigned)__builtin_ctzll(m);
+        }
+    }
+    return TW_SLOTS;
+}
+
+/* The first level only takes ticks of the current turn. A timer for a
+ * later turn waits in the second level even when it is close: it moves
+ * down with the timers that were added before it, so ties keep their
+ * order. A timer TW_SLOTS or more turns ahead lands in a slot that comes
+ * up before its turn; set_now() puts it back there until it is due. */
+static void place(timer_wheel_t *tw, tw_entry_t *e)
+{
+    uint64_t turn  = e->tick >> TW_BITS;
+    int      level = turn == (tw->now >> TW_BITS) ? 0 : 1;
+    unsigned idx   = (unsigned)(level == 0 ? e->tick : turn) & MASK;
+    tw_slot_t *s   = &tw->slot[level][idx];
+
+    e->next = NULL;
+    if (s->tail != NULL) {
+        s->tail->next = e;
+    } else {
+        s->head = e;
+    }
+    s->tail = e;
+    tw->used[level][idx / 64] |= 1ULL << (idx % 64);
+}
+
+static tw_entry_t *take(timer_wheel_t *tw, int level, unsigned idx)
+{
+    tw_slot_t *s = &tw->slot[level][idx];
+    tw_entry_t *list = s->head;
+
+    s->head = NULL;
+    s->tail = NULL;
+    tw->used[level][idx / 64] &= ~(1ULL << (idx % 64));
+    return list;
+}
+
+/* Moves the clock to tick; a new turn brings its second level slot down */
+static void set_now(timer_wheel_t *tw, uint64_t tick)
+{
+    int new_turn = (tick >> TW_BITS) != (tw->now >> TW_BITS);
+
+    tw->now = tick;
+    if (new_turn) {
+        tw_entry_t *e = take(tw, 1, (unsigned)(tick >> TW_BITS) & MASK);
+        while (e != NULL) {
+            tw_entry_t *next = e->next;
+            place(tw, e);
+            e = next;
+        }
+    }
+}
+
+void tw_init(timer_wheel_t *tw, int64_t now_ns)
+{
+    memset(tw, 0, sizeof(*tw));
+    tw->start_ns = now_ns;
+}
+
+void tw_add(timer_wheel_t *tw, tw_entry_t *e, int64_t at_ns)
+{
+    int64_t  rel  = at_ns - tw->start_ns;
+    uint64_t tick = rel <= 0 ? 0 : (uint64_t)((rel + TW_TICK_NS - 1) / TW_TICK_NS);
+
+    if (tick < tw->now) {
+        tick = tw->now;
+    }
+    e->tick = tick;
+    place(tw, e);
+    tw->count++;
+}
+
+size_t tw_advance(timer_wheel_t *tw, int64_t now_ns, tw_expire_fn fn, void *ctx)
+{
+    size_t expired = 0;
+
+    if (now_ns < tw->start_ns) {
+        return 0;
+    }
+    uint64_t target = (uint64_t)((now_ns - tw->start_ns) / TW_TICK_NS);
+
+    while (tw->now <= target) {
+        if (tw->count == 0) {
+            set_now(tw, target + 1);
+            break;
+        }
+
+        unsigned idx = (unsigned)tw->now & MASK;
+        tw_entry_t *e;
+        /* Re-read the slot: fn may add timers for this very tick */
+        while ((e = take(tw, 0, idx)) != NULL) {
+            while (e != NULL) {
+                tw_entry_t *next = e->next;
+                tw->count--;
+                expired++;
+                fn(e, ctx);
+                e = next;
+            }
+        }
+
+        /* Skip to the next occupied slot of this turn, or the next turn */
+        uint64_t next = (tw->now & ~(uint64_t)MASK) + next_used(tw->used[0], idx + 1);
+        set_now(tw, next < target + 1 ? next : target + 1);
+    }
+    return expired;
+}
+
+int64_t tw_next(const timer_wheel_t *tw)
+{
+    if (tw->count == 0) {
+        return INT64_MAX;
+    }
+
+    uint64_t turn = tw->now >> TW_BITS;
+    unsigned idx  = next_used(tw->used[0], (unsigned)tw->now & MASK);
+    uint64_t tick;
+
+    if (idx < TW_SLOTS) {
+        tick = (turn << TW_BITS) + idx;
+    } else {
+        /* Second level slots of the following turns, in turn order */
+        unsigned from = (unsigned)(turn + 1) & MASK;
+        unsigned slot = next_used(tw->used[1], from);
+        if (slot == TW_SLOTS) {
+            slot = next_used(tw->used[1], 0);
+        }
+        tick = (turn + 1 + ((slot - from) & MASK)) << TW_BITS;
+    }
+    return tw->start_ns + (int64_t)tick * TW_TICK_NS;
+}
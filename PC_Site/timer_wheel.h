@@ -0,0 +1,62 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Hierarchical timer wheel for scheduling many short timers.
+ *
+ * Time is counted in ticks of TW_TICK_NS. The first level has one slot per
+ * tick of the current turn of TW_SLOTS ticks (~102 ms), the second one
+ * slot per turn for the turns after it (~105 s). A second level slot
+ * moves down into the first level when its turn starts. Timers further
+ * out share the slot of their turn modulo TW_SLOTS and go back into it
+ * until their own turn comes, so any time can be scheduled. Adding a timer
+ * and expiring one are O(1), and a bitmap of the occupied slots finds the
+ * next expiry without scanning empty slots. Timers of the same tick
+ * expire in the order they were added. Timers fire at most one tick late
+ * and never early. Entries are intrusive: embed a tw_entry_t in the
+ * object.
+ */
+
+#define TW_TICK_NS   100000LL   /* 0.1 ms */
+#define TW_BITS      10
+#define TW_SLOTS     (1 << TW_BITS)
+#define TW_LEVELS    2
+
+typedef struct tw_entry {
+    struct tw_entry *next;
+    uint64_t         tick;      /* expiry */
+} tw_entry_t;
+
+typedef struct {
+    tw_entry_t *head;
+    tw_entry_t *tail;
+} tw_slot_t;
+
+typedef struct {
+    int64_t   start_ns;         /* time of tick 0 */
+    uint64_t  now;              /* next tick to expire */
+    size_t    count;
+    tw_slot_t slot[TW_LEVELS][TW_SLOTS];
+    uint64_t  used[TW_LEVELS][TW_SLOTS / 64];
+} timer_wheel_t;
+
+typedef void (*tw_expire_fn)(tw_entry_t *e, void *ctx);
+
+void tw_init(timer_wheel_t *tw, int64_t now_ns);
+
+/* Schedule e at at_ns. Times in the past expire on the next tw_advance(). */
+void tw_add(timer_wheel_t *tw, tw_entry_t *e, int64_t at_ns);
+
+/* Expire every timer due at now_ns, in order of expiry; returns how many.
+ * fn may add new timers. */
+size_t tw_advance(timer_wheel_t *tw, int64_t now_ns, tw_expire_fn fn, void *ctx);
+
+/* Earliest time tw_advance() has something to do, INT64_MAX when empty.
+ * For timers in a later turn that is the start of their turn, when they
+ * move down, which is never later than their expiry. */
+int64_t tw_next(const timer_wheel_t *tw);
+
+#endif /* TIMER_WHEEL_H */
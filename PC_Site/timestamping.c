@@ -0,0 +1,234 @@
+#include "timestamping.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+
+#define TS_SW_FLAGS (SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE | \
+                     SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_ID |          \
+                     SOF_TIMESTAMPING_OPT_TSONLY)
+#define TS_HW_FLAGS (SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_TX_HARDWARE | \
+                     SOF_TIMESTAMPING_RAW_HARDWARE)
+
+static int64_t timespec_to_ns(const struct timespec *ts)
+{
+    return (int64_t)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+int64_t ts_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return timespec_to_ns(&ts);
+}
+
+/* Ask the NIC driver to stamp all packets. Needs CAP_NET_ADMIN. */
+static int enable_hw_stamping(int fd, const char *iface)
+{
+    struct hwtstamp_config cfg;
+    struct ifreq ifr;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.tx_type   = HWTSTAMP_TX_ON;
+    cfg.rx_filter = HWTSTAMP_FILTER_ALL;
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, iface, sizeof(ifr.ifr_name) - 1);
+    ifr.ifr_data = (char *)&cfg;
+
+    if (ioctl(fd, SIOCSHWTSTAMP, &ifr) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int ts_enable(int fd, const char *hw_iface)
+{
+    int flags = TS_SW_FLAGS;
+
+    if (hw_iface != NULL) {
+        if (enable_hw_stamping(fd, hw_iface) == 0) {
+            flags |= TS_HW_FLAGS;
+        } else {
+            perror("SIOCSHWTSTAMP (falling back to software timestamps)");
+        }
+    }
+
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) {
+        perror("setsockopt(SO_TIMESTAMPING)");
+        return -1;
+    }
+    return 0;
+}
+
+/* Extract ts[0] (software) and ts[2] (raw hardware) from a control message */
+static const struct scm_timestamping *find_timestamps(struct msghdr *msg)
+{
+    struct cmsghdr *cmsg;
+
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            return (const struct scm_timestamping *)CMSG_DATA(cmsg);
+        }
+    }
+    return NULL;
+}
+
+ssize_t ts_recvmsg(int fd, void *buf, size_t len, int flags,
+                   struct sockaddr *addr, socklen_t *addr_len, ts_rx_t *rx)
+{
+    char control[256];
+    struct iovec iov = { .iov_base = buf, .iov_len = len };
+    struct msghdr msg;
+    ssize_t bytes;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name       = addr;
+    msg.msg_namelen    = addr_len != NULL ? *addr_len : 0;
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    bytes = recvmsg(fd, &msg, flags);
+    rx->user_ns = ts_now_ns();
+    rx->sw_ns   = 0;
+    rx->hw_ns   = 0;
+    if (bytes < 0) {
+        return bytes;
+    }
+    if (addr_len != NULL) {
+        *addr_len = msg.msg_namelen;
+    }
+
+    const struct scm_timestamping *tss = find_timestamps(&msg);
+    if (tss != NULL) {
+        rx->sw_ns = timespec_to_ns(&tss->ts[0]);
+        rx->hw_ns = timespec_to_ns(&tss->ts[2]);
+    }
+    return bytes;
+}
+
+ssize_t ts_sendto(int fd, ts_tx_track_t *track, const void *buf, size_t len,
+                  const struct sockaddr *addr, socklen_t addr_len,
+                  int64_t *send_ns)
+{
+    ssize_t bytes;
+
+    *send_ns = ts_now_ns();
+    bytes = sendto(fd, buf, len, 0, addr, addr_len);
+    if (bytes <= 0 || track == NULL) {
+        return bytes;
+    }
+
+    /* The kernel reports TX stamps with the datagram index (UDP) or the
+     * offset of the last byte of the write (TCP) as identifier. */
+    uint32_t key;
+    if (track->bytestream) {
+        track->next_key += (uint32_t)bytes;
+        key = track->next_key - 1;
+    } else {
+        key = track->next_key++;
+    }
+    track->slot[key % TS_TX_SLOTS].key     = key;
+    track->slot[key % TS_TX_SLOTS].send_ns = *send_ns;
+    return bytes;
+}
+
+static void stat_add(ts_stat_t *stat, int64_t ns)
+{
+    if (stat->count == 0 || ns < stat->min_ns) {
+        stat->min_ns = ns;
+    }
+    if (stat->count == 0 || ns > stat->max_ns) {
+        stat->max_ns = ns;
+    }
+    stat->sum_ns += (double)ns;
+    stat->count++;
+}
+
+void ts_account(ts_report_t *report, const ts_rx_t *rx, int64_t send_ns)
+{
+    if (rx->hw_ns != 0 && rx->sw_ns != 0) {
+        stat_add(&report->nic, rx->sw_ns - rx->hw_ns);
+    }
+    if (rx->sw_ns != 0) {
+        stat_add(&report->stack, rx->user_ns - rx->sw_ns);
+    }
+    if (send_ns != 0) {
+        stat_add(&report->app, send_ns - rx->user_ns);
+    }
+}
+
+void ts_poll_tx(int fd, ts_tx_track_t *track, ts_report_t *report)
+{
+    for (;;) {
+        char control[512];
+        struct msghdr msg;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            return;  /* EAGAIN: queue drained */
+        }
+
+        const struct scm_timestamping *tss = NULL;
+        const struct sock_extended_err *serr = NULL;
+        struct cmsghdr *cmsg;
+
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+                tss = (const struct scm_timestamping *)CMSG_DATA(cmsg);
+            } else if ((cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                       (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+                serr = (const struct sock_extended_err *)CMSG_DATA(cmsg);
+            }
+        }
+
+        if (tss == NULL || serr == NULL || track == NULL ||
+            serr->ee_origin != SO_EE_ORIGIN_TIMESTAMPING || serr->ee_info != SCM_TSTAMP_SND) {
+            continue;
+        }
+
+        int64_t tx_ns = tss->ts[2].tv_sec || tss->ts[2].tv_nsec ?
+                        timespec_to_ns(&tss->ts[2]) : timespec_to_ns(&tss->ts[0]);
+        uint32_t key = serr->ee_data;
+        if (track->slot[key % TS_TX_SLOTS].key == key && track->slot[key % TS_TX_SLOTS].send_ns != 0) {
+            stat_add(&report->tx, tx_ns - track->slot[key % TS_TX_SLOTS].send_ns);
+            track->slot[key % TS_TX_SLOTS].send_ns = 0;
+        }
+    }
+}
+
+static void print_stat(FILE *out, const char *prefix, const char *name, const ts_stat_t *stat)
+{
+    if (stat->count == 0) {
+        fprintf(out, "%s   %-6s n/a\n", prefix, name);
+        return;
+    }
+    fprintf(out, "%s   %-6s avg %9.1f us  min %9.1f us  max %9.1f us  (n=%llu)\n",
+            prefix, name,
+            stat->sum_ns / (double)stat->count / 1000.0,
+            (double)stat->min_ns / 1000.0,
+            (double)stat->max_ns / 1000.0,
+            (unsigned long long)stat->count);
+}
+
+void ts_print_report(FILE *out, const char *prefix, const ts_report_t *report)
+{
+    fprintf(out, "%s Latency split (kernel vs. application):\n", prefix);
+    print_stat(out, prefix, "nic", &report->nic);
+    print_stat(out, prefix, "stack", &report->stack);
+    print_stat(out, prefix, "app", &report->app);
+    print_stat(out, prefix, "tx", &report->tx);
+    fflush(out);
+}
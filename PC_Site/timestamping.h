@@ -0,0 +1,81 @@
+#ifndef TIMESTAMPING_H
+#define TIMESTAMPING_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/*
+ * SO_TIMESTAMPING helpers for the PC_Site servers.
+ *
+ * Every receive goes through ts_recvmsg(), which pulls the kernel (and, if
+ * the NIC supports it, hardware) receive timestamp out of the control
+ * messages. Together with the time the application hands its reply back to
+ * the kernel, this splits the measured latency into:
+ *
+ *   nic   : hardware RX stamp -> kernel RX stamp (needs a PHC synced to
+ *           the system clock, e.g. with phc2sys, to be meaningful)
+ *   stack : kernel RX stamp   -> recvmsg() returned
+ *   app   : recvmsg() returned -> reply passed to send()
+ *   tx    : reply passed to send() -> kernel TX stamp
+ */
+
+#define TS_TX_SLOTS 64
+
+/* Running min/mean/max of one latency component */
+typedef struct {
+    uint64_t count;
+    int64_t  min_ns;
+    int64_t  max_ns;
+    double   sum_ns;
+} ts_stat_t;
+
+/* Timestamps of a single receive, all CLOCK_REALTIME in ns (0 = missing) */
+typedef struct {
+    int64_t hw_ns;
+    int64_t sw_ns;
+    int64_t user_ns;
+} ts_rx_t;
+
+/* Matches TX timestamps from the error queue to the send() that caused them */
+typedef struct {
+    int      bytestream;   /* TCP keys by byte offset, UDP by datagram count */
+    uint32_t next_key;
+    struct {
+        uint32_t key;
+        int64_t  send_ns;
+    } slot[TS_TX_SLOTS];
+} ts_tx_track_t;
+
+typedef struct {
+    ts_stat_t nic;
+    ts_stat_t stack;
+    ts_stat_t app;
+    ts_stat_t tx;
+} ts_report_t;
+
+int64_t ts_now_ns(void);
+
+/* Enable RX/TX timestamping on fd. hw_iface may be NULL for software only.
+ * Returns 0 on success, -1 if the kernel refused the socket option. */
+int ts_enable(int fd, const char *hw_iface);
+
+/* recvmsg() wrapper that fills rx with the timestamps of this receive */
+ssize_t ts_recvmsg(int fd, void *buf, size_t len, int flags,
+                   struct sockaddr *addr, socklen_t *addr_len, ts_rx_t *rx);
+
+/* send()/sendto() wrapper that remembers when the reply left the app */
+ssize_t ts_sendto(int fd, ts_tx_track_t *track, const void *buf, size_t len,
+                  const struct sockaddr *addr, socklen_t addr_len,
+                  int64_t *send_ns);
+
+/* Account one request/reply round in the report */
+void ts_account(ts_report_t *report, const ts_rx_t *rx, int64_t send_ns);
+
+/* Drain pending TX timestamps from the socket error queue (non-blocking) */
+void ts_poll_tx(int fd, ts_tx_track_t *track, ts_report_t *report);
+
+void ts_print_report(FILE *out, const char *prefix, const ts_report_t *report);
+
+#endif /* TIMESTAMPING_H */
@@ -0,0 +1,234 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include "netaddr.h"
+#include "tls_common.h"
+
+#define PORT        8080
+#define BUFFER_SIZE 1024
+#define REPLY_MS    2000
+
+/*
+ * Client side of tls_server, or a stand-in for the board when measuring
+ * what TLS costs on the PC: opens a number of connections one after the
+ * other, offering the previous session so the server can resume it, and
+ * reports the handshake time of full and resumed connections separately
+ * along with the write cost and round trip of every echoed message.
+ */
+
+typedef struct {
+    uint64_t count;
+    int64_t  total_ns;
+    int64_t  max_ns;
+} cost_t;
+
+static void add_cost(cost_t *c, int64_t ns)
+{
+    c->count++;
+    c->total_ns += ns;
+    if (ns > c->max_ns) {
+        c->max_ns = ns;
+    }
+}
+
+static double avg_ms(const cost_t *c)
+{
+    return c->count > 0 ? (double)c->total_ns / (double)c->count / 1e6 : 0.0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-u] [-p <port>] [-n <conns>] [-m <msgs>] [-s <size>] [-k <hex>] [-I <identity>]\n"
+            "          [-C <ca>] [-x] <server-ip>\n"
+            "  -u             DTLS over UDP (default TLS over TCP)\n"
+            "  -p <port>      port (default %d)\n"
+            "  -n <conns>     connections to open one after the other (default 5)\n"
+            "  -m <msgs>      messages echoed per connection (default 10)\n"
+            "  -s <size>      message size in bytes (default 64)\n"
+            "  -k <hex>       pre-shared key (default: the firmware's test key)\n"
+            "  -I <identity>  PSK identity (default %s)\n"
+            "  -C <ca>        certificate mode, verify the server against this CA\n"
+            "  -x             do not offer the previous session, every handshake is full\n",
+            prog, PORT, TLS_DEFAULT_IDENTITY);
+}
+
+static int open_socket(const struct sockaddr_storage *addr, socklen_t len, int datagram)
+{
+    int fd = socket(addr->ss_family, datagram ? SOCK_DGRAM : SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    struct timeval tv = { .tv_sec = REPLY_MS / 1000, .tv_usec = (REPLY_MS % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (!datagram) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    if (connect(fd, (const struct sockaddr *)addr, len) < 0) {
+        perror("connect");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[])
+{
+    tls_options_t opt = {
+        .psk_hex    = TLS_DEFAULT_PSK,
+        .identity   = TLS_DEFAULT_IDENTITY,
+        .resumption = 1,
+    };
+    uint16_t port = PORT;
+    int conns = 5;
+    int msgs = 10;
+    int size = 64;
+    int c;
+
+    while ((c = getopt(argc, argv, "up:n:m:s:k:I:C:xh")) != -1) {
+        switch (c) {
+        case 'u': opt.datagram   = 1; break;
+        case 'p': port           = (uint16_t)atoi(optarg); break;
+        case 'n': conns          = atoi(optarg); break;
+        case 'm': msgs           = atoi(optarg); break;
+        case 's': size           = atoi(optarg); break;
+        case 'k': opt.psk_hex    = optarg; break;
+        case 'I': opt.identity   = optarg; break;
+        case 'C': opt.ca_file    = optarg; opt.psk_hex = NULL; break;
+        case 'x': opt.resumption = 0; break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc - 1 || conns <= 0 || msgs < 0 || size <= 0 || size > BUFFER_SIZE - 16) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    if (netaddr_resolve(argv[optind], port, opt.datagram ? SOCK_DGRAM : SOCK_STREAM,
+                        &addr, &addr_len) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    SSL_CTX *ctx = tls_ctx_new(&opt);
+    if (ctx == NULL) {
+        exit(EXIT_FAILURE);
+    }
+
+    char payload[BUFFER_SIZE];
+    char reply[BUFFER_SIZE];
+    memset(payload, 'x', (size_t)size);
+    payload[size] = '\0';
+
+    SSL_SESSION *session = NULL;
+    cost_t full = { 0 }, resumed = { 0 }, writes = { 0 }, rtt = { 0 };
+    int failures = 0;
+    struct timespec t0, t1, t2;
+
+    for (int i = 0; i < conns; i++) {
+        int fd = open_socket(&addr, addr_len, opt.datagram);
+        if (fd < 0) {
+            failures++;
+            continue;
+        }
+
+        SSL *ssl = SSL_new(ctx);
+        if (opt.datagram) {
+            BIO *bio = BIO_new_dgram(fd, BIO_NOCLOSE);
+            BIO_ctrl(bio, BIO_CTRL_DGRAM_SET_CONNECTED, 0, &addr);
+            SSL_set_bio(ssl, bio, bio);
+        } else {
+            SSL_set_fd(ssl, fd);
+        }
+        if (opt.psk_hex == NULL) {
+            SSL_set1_host(ssl, argv[optind]);
+        }
+        if (opt.resumption && session != NULL) {
+            SSL_set_session(ssl, session);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        int ret = SSL_connect(ssl);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (ret != 1) {
+            fprintf(stderr, "[TLS] Connection %d: handshake failed\n", i + 1);
+            tls_print_errors("SSL_connect");
+            failures++;
+            SSL_free(ssl);
+            close(fd);
+            continue;
+        }
+
+        int64_t hs_ns = tls_elapsed_ns(&t0, &t1);
+        int was_resumed = SSL_session_reused(ssl);
+        add_cost(was_resumed ? &resumed : &full, hs_ns);
+
+        cost_t conn_rtt = { 0 };
+        for (int m = 0; m < msgs; m++) {
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            if (SSL_write(ssl, payload, size) <= 0) {
+                tls_print_errors("SSL_write");
+                break;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            int n = SSL_read(ssl, reply, sizeof(reply) - 1);
+            clock_gettime(CLOCK_MONOTONIC, &t2);
+            if (n <= 0) {
+                fprintf(stderr, "[TLS] Connection %d: no reply to message %d\n", i + 1, m + 1);
+                break;
+            }
+            add_cost(&writes, tls_elapsed_ns(&t0, &t1));
+            add_cost(&conn_rtt, tls_elapsed_ns(&t0, &t2));
+        }
+        rtt.count    += conn_rtt.count;
+        rtt.total_ns += conn_rtt.total_ns;
+        if (conn_rtt.max_ns > rtt.max_ns) {
+            rtt.max_ns = conn_rtt.max_ns;
+        }
+
+        printf("[TLS] Connection %d: %s handshake %.2f ms, %llu/%d echoes, avg RTT %.3f ms\n", i + 1,
+               was_resumed ? "resumed" : "full", hs_ns / 1e6, (unsigned long long)conn_rtt.count, msgs,
+               avg_ms(&conn_rtt));
+
+        /* Keep the newest session (it may carry a fresh ticket) for the next connection */
+        if (opt.resumption) {
+            SSL_SESSION_free(session);
+            session = SSL_get1_session(ssl);
+        }
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+        close(fd);
+    }
+
+    printf("\n=== %s summary (%d connections, %d failed) ===\n", opt.datagram ? "DTLS" : "TLS", conns, failures);
+    printf("Full handshakes   : %llu, avg %.2f ms, max %.2f ms\n", (unsigned long long)full.count, avg_ms(&full),
+           full.max_ns / 1e6);
+    printf("Resumed handshakes: %llu, avg %.2f ms, max %.2f ms\n", (unsigned long long)resumed.count,
+           avg_ms(&resumed), resumed.max_ns / 1e6);
+    printf("SSL_write         : avg %.1f us per %d-byte record\n", avg_ms(&writes) * 1000.0, size);
+    printf("Echo RTT          : avg %.3f ms, max %.3f ms over %llu messages\n", avg_ms(&rtt), rtt.max_ns / 1e6,
+           (unsigned long long)rtt.count);
+
+    SSL_SESSION_free(session);
+    SSL_CTX_free(ctx);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+#include "tls_common.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <openssl/crypto.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+/* One key per process is all the tools need */
+static unsigned char psk_key[TLS_PSK_MAX];
+static size_t        psk_len;
+static const char   *psk_identity;
+
+/* Secret for the stateless DTLS cookies */
+static unsigned char cookie_secret[32];
+
+void tls_print_errors(const char *what)
+{
+    unsigned long err;
+    char buf[256];
+
+    while ((err = ERR_get_error()) != 0) {
+        ERR_error_string_n(err, buf, sizeof(buf));
+        fprintf(stderr, "%s: %s\n", what, buf);
+    }
+}
+
+static int parse_hex(const char *hex)
+{
+    size_t len = strlen(hex);
+
+    if (len == 0 || len % 2 != 0 || len / 2 > sizeof(psk_key)) {
+        return -1;
+    }
+    for (size_t i = 0; i < len / 2; i++) {
+        unsigned int byte;
+        if (sscanf(hex + 2 * i, "%2x", &byte) != 1) {
+            return -1;
+        }
+        psk_key[i] = (unsigned char)byte;
+    }
+    psk_len = len / 2;
+    return 0;
+}
+
+static unsigned int psk_server_cb(SSL *ssl, const char *identity, unsigned char *psk, unsigned int max_len)
+{
+    (void)ssl;
+    if (identity == NULL || strcmp(identity, psk_identity) != 0 || psk_len > max_len) {
+        fprintf(stderr, "[TLS] Unknown PSK identity '%s'\n", identity != NULL ? identity : "");
+        return 0;
+    }
+    memcpy(psk, psk_key, psk_len);
+    return (unsigned int)psk_len;
+}
+
+static unsigned int psk_client_cb(SSL *ssl, const char *hint, char *identity, unsigned int max_identity_len,
+                                  unsigned char *psk, unsigned int max_psk_len)
+{
+    (void)ssl;
+    (void)hint;
+    if (strlen(psk_identity) + 1 > max_identity_len || psk_len > max_psk_len) {
+        return 0;
+    }
+    strcpy(identity, psk_identity);
+    memcpy(psk, psk_key, psk_len);
+    return (unsigned int)psk_len;
+}
+
+/* HMAC of the peer address, so DTLSv1_listen() keeps no state per client */
+static int cookie_for_peer(SSL *ssl, unsigned char *cookie, unsigned int *cookie_len)
+{
+    unsigned char raw[32];
+    size_t raw_len = 0;
+    BIO_ADDR *peer = BIO_ADDR_new();
+
+    if (peer == NULL || BIO_dgram_get_peer(SSL_get_rbio(ssl), peer) <= 0 ||
+        !BIO_ADDR_rawaddress(peer, NULL, &raw_len) || raw_len + 2 > sizeof(raw)) {
+        BIO_ADDR_free(peer);
+        return 0;
+    }
+    BIO_ADDR_rawaddress(peer, raw, &raw_len);
+    unsigned short port = BIO_ADDR_rawport(peer);
+    memcpy(raw + raw_len, &port, sizeof(port));
+    raw_len += sizeof(port);
+    BIO_ADDR_free(peer);
+
+    return HMAC(EVP_sha256(), cookie_secret, sizeof(cookie_secret), raw, raw_len, cookie, cookie_len) != NULL;
+}
+
+static int generate_cookie(SSL *ssl, unsigned char *cookie, unsigned int *cookie_len)
+{
+    return cookie_for_peer(ssl, cookie, cookie_len);
+}
+
+static int verify_cookie(SSL *ssl, const unsigned char *cookie, unsigned int cookie_len)
+{
+    unsigned char expect[EVP_MAX_MD_SIZE];
+    unsigned int expect_len;
+
+    return cookie_for_peer(ssl, expect, &expect_len) && cookie_len == expect_len &&
+           CRYPTO_memcmp(cookie, expect, expect_len) == 0;
+}
+
+SSL_CTX *tls_ctx_new(const tls_options_t *opt)
+{
+    const SSL_METHOD *method;
+
+    if (opt->datagram) {
+        method = opt->server ? DTLS_server_method() : DTLS_client_method();
+    } else {
+        method = opt->server ? TLS_server_method() : TLS_client_method();
+    }
+
+    SSL_CTX *ctx = SSL_CTX_new(method);
+    if (ctx == NULL) {
+        tls_print_errors("SSL_CTX_new");
+        return NULL;
+    }
+
+    /* mbedTLS on the board speaks (D)TLS 1.2, test what it negotiates */
+    SSL_CTX_set_max_proto_version(ctx, opt->datagram ? DTLS1_2_VERSION : TLS1_2_VERSION);
+
+    if (opt->psk_hex != NULL) {
+        if (parse_hex(opt->psk_hex) < 0) {
+            fprintf(stderr, "Invalid PSK '%s' (hex, up to %d bytes)\n", opt->psk_hex, TLS_PSK_MAX);
+            SSL_CTX_free(ctx);
+            return NULL;
+        }
+        psk_identity = opt->identity;
+        if (SSL_CTX_set_cipher_list(ctx, TLS_PSK_CIPHER) != 1) {
+            tls_print_errors("SSL_CTX_set_cipher_list");
+            SSL_CTX_free(ctx);
+            return NULL;
+        }
+        if (opt->server) {
+            SSL_CTX_set_psk_server_callback(ctx, psk_server_cb);
+        } else {
+            SSL_CTX_set_psk_client_callback(ctx, psk_client_cb);
+        }
+    } else if (opt->server) {
+        if (SSL_CTX_use_certificate_chain_file(ctx, opt->cert_file) != 1 ||
+            SSL_CTX_use_PrivateKey_file(ctx, opt->key_file, SSL_FILETYPE_PEM) != 1) {
+            tls_print_errors("certificate");
+            SSL_CTX_free(ctx);
+            return NULL;
+        }
+    } else if (opt->ca_file != NULL) {
+        if (SSL_CTX_load_verify_locations(ctx, opt->ca_file, NULL) != 1) {
+            tls_print_errors("CA file");
+            SSL_CTX_free(ctx);
+            return NULL;
+        }
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+    }
+
+    if (opt->server) {
+        static const unsigned char sid_ctx[] = "iris-echo";
+        SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1);
+        if (opt->datagram) {
+            RAND_bytes(cookie_secret, sizeof(cookie_secret));
+            SSL_CTX_set_cookie_generate_cb(ctx, generate_cookie);
+            SSL_CTX_set_cookie_verify_cb(ctx, verify_cookie);
+        }
+    }
+
+    /* Without resumption every connection pays for a full handshake */
+    if (!opt->resumption) {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    } else if (!opt->server) {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT);
+    }
+
+    return ctx;
+}
@@ -0,0 +1,43 @@
+#ifndef TLS_COMMON_H
+#define TLS_COMMON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <openssl/ssl.h>
+
+/*
+ * OpenSSL setup shared by tls_server and tls_client, matching the
+ * firmware's CONFIG_COMM_ENGINE_TLS: TLS 1.2 over TCP, DTLS 1.2 over UDP,
+ * authenticated either with a pre-shared key (the default, same test key
+ * and identity as the firmware defaults) or with a certificate.
+ */
+
+#define TLS_DEFAULT_PSK      "000102030405060708090a0b0c0d0e0f"
+#define TLS_DEFAULT_IDENTITY "iris-board"
+#define TLS_PSK_CIPHER       "PSK-AES128-GCM-SHA256"
+#define TLS_PSK_MAX          64
+
+typedef struct {
+    int         datagram;       /* DTLS instead of TLS */
+    int         server;
+    const char *psk_hex;        /* NULL = certificate mode */
+    const char *identity;
+    const char *cert_file;      /* server certificate (certificate mode) */
+    const char *key_file;
+    const char *ca_file;        /* client: verify the server against this */
+    int         resumption;     /* session cache and tickets */
+} tls_options_t;
+
+/* Returns NULL after printing the OpenSSL error queue */
+SSL_CTX *tls_ctx_new(const tls_options_t *opt);
+
+/* Print and clear the OpenSSL error queue */
+void tls_print_errors(const char *what);
+
+static inline int64_t tls_elapsed_ns(const struct timespec *a, const struct timespec *b)
+{
+    return (int64_t)(b->tv_sec - a->tv_sec) * 1000000000LL + (b->tv_nsec - a->tv_nsec);
+}
+
+#endif /* TLS_COMMON_H */
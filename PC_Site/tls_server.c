@@ -0,0 +1,314 @@
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include "netaddr.h"
+#include "tls_common.h"
+
+#define PORT        8080
+#define BUFFER_SIZE 1024
+#define IDLE_MS     10000   /* drop a silent DTLS peer, it has no FIN */
+
+/*
+ * TLS / DTLS echo server for the firmware's CONFIG_COMM_ENGINE_TLS, one
+ * client at a time like the board's own servers. For every connection it
+ * prints how long the handshake took and whether the session was resumed,
+ * and on close the average cost of reading and writing one record.
+ */
+
+typedef struct {
+    uint64_t count;
+    int64_t  total_ns;
+} cost_t;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static cost_t full_handshakes;
+static cost_t resumed_handshakes;
+static cost_t reads;
+static cost_t writes;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void add_cost(cost_t *c, int64_t ns)
+{
+    c->count++;
+    c->total_ns += ns;
+}
+
+static double avg_us(const cost_t *c)
+{
+    return c->count > 0 ? (double)c->total_ns / (double)c->count / 1000.0 : 0.0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-u] [-p <port>] [-k <hex>] [-I <identity>] [-c <cert> -K <key>] [-x]\n"
+            "  -u             DTLS over UDP (default TLS over TCP)\n"
+            "  -p <port>      port (default %d)\n"
+            "  -k <hex>       pre-shared key (default: the firmware's test key)\n"
+            "  -I <identity>  PSK identity the board must send (default %s)\n"
+            "  -c <cert>      use this certificate chain instead of a PSK\n"
+            "  -K <key>       private key of the certificate\n"
+            "  -x             no session resumption, every handshake is a full one\n",
+            prog, PORT, TLS_DEFAULT_IDENTITY);
+}
+
+/* Wait until the peer sent something, -1 on timeout or interruption */
+static int wait_readable(SSL *ssl, int fd, int timeout_ms)
+{
+    if (SSL_pending(ssl) > 0) {
+        return 0;
+    }
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    return poll(&pfd, 1, timeout_ms) > 0 ? 0 : -1;
+}
+
+static void serve(SSL *ssl, int fd, const char *peer)
+{
+    char buffer[BUFFER_SIZE];
+    char response[BUFFER_SIZE + 16];
+    struct timespec t0, t1;
+    cost_t conn_reads = { 0 }, conn_writes = { 0 };
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int ret = SSL_accept(ssl);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (ret != 1) {
+        fprintf(stderr, "[TLS] Handshake with %s failed\n", peer);
+        tls_print_errors("SSL_accept");
+        return;
+    }
+
+    int64_t hs_ns = tls_elapsed_ns(&t0, &t1);
+    int resumed = SSL_session_reused(ssl);
+    add_cost(resumed ? &resumed_handshakes : &full_handshakes, hs_ns);
+    printf("[TLS] %s: %s handshake in %.2f ms, %s, %s\n", peer, resumed ? "resumed" : "full",
+           hs_ns / 1e6, SSL_get_version(ssl), SSL_get_cipher_name(ssl));
+
+    while (!stop_requested) {
+        if (wait_readable(ssl, fd, IDLE_MS) < 0) {
+            if (!stop_requested) {
+                printf("[TLS] %s: idle for %d s\n", peer, IDLE_MS / 1000);
+            }
+            break;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        int n = SSL_read(ssl, buffer, sizeof(buffer) - 1);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (n <= 0) {
+            int err = SSL_get_error(ssl, n);
+            if (err == SSL_ERROR_WANT_READ) {
+                continue;   /* a DTLS record that was not application data */
+            }
+            if (err != SSL_ERROR_ZERO_RETURN) {
+                tls_print_errors("SSL_read");
+            }
+            break;
+        }
+        add_cost(&conn_reads, tls_elapsed_ns(&t0, &t1));
+        buffer[n] = '\0';
+
+        int len = snprintf(response, sizeof(response), "Echo: %s", buffer);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        ret = SSL_write(ssl, response, len);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (ret <= 0) {
+            tls_print_errors("SSL_write");
+            break;
+        }
+        add_cost(&conn_writes, tls_elapsed_ns(&t0, &t1));
+    }
+
+    SSL_shutdown(ssl);
+    printf("[TLS] %s: closed, %llu records in (%.1f us each), %llu out (%.1f us each)\n", peer,
+           (unsigned long long)conn_reads.count, avg_us(&conn_reads),
+           (unsigned long long)conn_writes.count, avg_us(&conn_writes));
+
+    reads.count    += conn_reads.count;
+    reads.total_ns += conn_reads.total_ns;
+    writes.count    += conn_writes.count;
+    writes.total_ns += conn_writes.total_ns;
+}
+
+static void run_tls(SSL_CTX *ctx, uint16_t port)
+{
+    int opt = 1;
+    int server_fd = netaddr_server_socket(SOCK_STREAM, port);
+    if (server_fd < 0) {
+        exit(EXIT_FAILURE);
+    }
+    if (listen(server_fd, 4) < 0) {
+        perror("listen");
+        exit(EXIT_FAILURE);
+    }
+    printf("[TLS] Listening on TCP port %u\n", port);
+
+    while (!stop_requested) {
+        struct sockaddr_storage peer;
+        socklen_t peer_len = sizeof(peer);
+        int fd = accept(server_fd, (struct sockaddr *)&peer, &peer_len);
+        if (fd < 0) {
+            if (errno != EINTR) {
+                perror("accept");
+            }
+            continue;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+        char name[NETADDR_STRLEN];
+        netaddr_str((struct sockaddr *)&peer, name, sizeof(name));
+
+        SSL *ssl = SSL_new(ctx);
+        SSL_set_fd(ssl, fd);
+        serve(ssl, fd, name);
+        SSL_free(ssl);
+        close(fd);
+    }
+    close(server_fd);
+}
+
+static void run_dtls(SSL_CTX *ctx, uint16_t port)
+{
+    int fd = netaddr_server_socket(SOCK_DGRAM, port);
+    if (fd < 0) {
+        exit(EXIT_FAILURE);
+    }
+    printf("[TLS] Listening for DTLS on UDP port %u\n", port);
+
+    /* Wake up once a second to notice Ctrl+C while waiting for a ClientHello */
+    struct timeval tv = { .tv_sec = 1 };
+    BIO_ADDR *peer = BIO_ADDR_new();
+
+    while (!stop_requested) {
+        SSL *ssl = SSL_new(ctx);
+        BIO *bio = BIO_new_dgram(fd, BIO_NOCLOSE);
+        BIO_ctrl(bio, BIO_CTRL_DGRAM_SET_RECV_TIMEOUT, 0, &tv);
+        SSL_set_bio(ssl, bio, bio);
+        SSL_set_options(ssl, SSL_OP_COOKIE_EXCHANGE);
+
+        /* Stateless cookie round trip before any handshake state exists */
+        int ret = 0;
+        while (!stop_requested && (ret = DTLSv1_listen(ssl, peer)) == 0) {
+        }
+        if (ret <= 0) {
+            if (ret < 0) {
+                tls_print_errors("DTLSv1_listen");
+            }
+            SSL_free(ssl);
+            continue;
+        }
+
+        /*
+         * Reply only to this peer until it is done. The socket stays
+         * unconnected: a connected one makes the kernel refuse the next
+         * board's ClientHello with an ICMP error instead of leaving it
+         * queued, and the board retransmits a dropped one anyway.
+         */
+        struct sockaddr_storage peer_addr;
+        memset(&peer_addr, 0, sizeof(peer_addr));
+        if (BIO_ADDR_family(peer) == AF_INET6) {
+            struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&peer_addr;
+            size_t alen = sizeof(in6->sin6_addr);
+            in6->sin6_family = AF_INET6;
+            in6->sin6_port   = BIO_ADDR_rawport(peer);
+            BIO_ADDR_rawaddress(peer, &in6->sin6_addr, &alen);
+        } else {
+            struct sockaddr_in *in = (struct sockaddr_in *)&peer_addr;
+            size_t alen = sizeof(in->sin_addr);
+            in->sin_family = AF_INET;
+            in->sin_port   = BIO_ADDR_rawport(peer);
+            BIO_ADDR_rawaddress(peer, &in->sin_addr, &alen);
+        }
+        BIO_dgram_set_peer(bio, peer);
+
+        char name[NETADDR_STRLEN];
+        netaddr_str((struct sockaddr *)&peer_addr, name, sizeof(name));
+
+        serve(ssl, fd, name);
+        SSL_free(ssl);
+    }
+
+    BIO_ADDR_free(peer);
+    close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    tls_options_t opt = {
+        .server     = 1,
+        .psk_hex    = TLS_DEFAULT_PSK,
+        .identity   = TLS_DEFAULT_IDENTITY,
+        .resumption = 1,
+    };
+    uint16_t port = PORT;
+    int c;
+
+    while ((c = getopt(argc, argv, "up:k:I:c:K:xh")) != -1) {
+        switch (c) {
+        case 'u': opt.datagram   = 1; break;
+        case 'p': port           = (uint16_t)atoi(optarg); break;
+        case 'k': opt.psk_hex    = optarg; break;
+        case 'I': opt.identity   = optarg; break;
+        case 'c': opt.cert_file  = optarg; break;
+        case 'K': opt.key_file   = optarg; break;
+        case 'x': opt.resumption = 0; break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (opt.cert_file != NULL) {
+        if (opt.key_file == NULL) {
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        opt.psk_hex = NULL;
+    }
+
+    /* No SA_RESTART, so accept() and poll() return on Ctrl+C */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    SSL_CTX *ctx = tls_ctx_new(&opt);
+    if (ctx == NULL) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (opt.datagram) {
+        run_dtls(ctx, port);
+    } else {
+        run_tls(ctx, port);
+    }
+
+    printf("[TLS] Handshakes: %llu full (avg %.2f ms), %llu resumed (avg %.2f ms)\n",
+           (unsigned long long)full_handshakes.count, avg_us(&full_handshakes) / 1000.0,
+           (unsigned long long)resumed_handshakes.count, avg_us(&resumed_handshakes) / 1000.0);
+    printf("[TLS] Records: %llu in (avg %.1f us), %llu out (avg %.1f us)\n",
+           (unsigned long long)reads.count, avg_us(&reads),
+           (unsigned long long)writes.count, avg_us(&writes));
+
+    SSL_CTX_free(ctx);
+    return 0;
+}
@@ -6,6 +6,8 @@
 #include <ifaddrs.h>
 #include <net/if.h>
 
+#include "netaddr.h"
+
 #define PORT        8080
 #define BUFFER_SIZE 1024
 
@@ -18,29 +20,34 @@ int main(int argc, char *argv[])
 
     const char *server_ip = argv[1];
     int sock_fd;
-    struct sockaddr_in server_addr;
+    struct sockaddr_storage server_addr;
+    socklen_t addr_len;
     char buffer[BUFFER_SIZE];
 
-    /* Create TCP socket */
-    sock_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    /* Build server address, IPv4 or IPv6 */
+    if (netaddr_resolve(server_ip, PORT, SOCK_DGRAM, &server_addr, &addr_len) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    /* Create socket of the server's family */
+    sock_fd = socket(server_addr.ss_family, SOCK_DGRAM, IPPROTO_UDP);
     if (sock_fd < 0) {
         perror("socket");
         exit(EXIT_FAILURE);
     }
 
-        /* Print all LAN IPv4 addresses so the client knows where to connect */
+        /* Print all LAN addresses so the client knows where to connect */
     {
         struct ifaddrs *ifaddr, *ifa;
-        char ip_str[INET_ADDRSTRLEN];
+        char ip_str[NETADDR_STRLEN];
         if (getifaddrs(&ifaddr) == 0) {
             printf("[Server] Listening on port %d — reachable at:\n", PORT);
             for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
                 if (ifa->ifa_addr == NULL) continue;
-                if (ifa->ifa_addr->sa_family != AF_INET) continue;
+                if (ifa->ifa_addr->sa_family != AF_INET &&
+                    ifa->ifa_addr->sa_family != AF_INET6) continue;
                 if (ifa->ifa_flags & IFF_LOOPBACK) continue;
-                inet_ntop(AF_INET,
-                          &((struct sockaddr_in *)ifa->ifa_addr)->sin_addr,
-                          ip_str, sizeof(ip_str));
+                netaddr_host(ifa->ifa_addr, ip_str, sizeof(ip_str));
                 printf("[Server]   %s  (iface: %s)\n", ip_str, ifa->ifa_name);
             }
             freeifaddrs(ifaddr);
@@ -49,19 +56,8 @@ int main(int argc, char *argv[])
         }
     }
 
-    /* Build server address */
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port   = htons(PORT);
-
-    if (inet_pton(AF_INET, server_ip, &server_addr.sin_addr) <= 0) {
-        perror("inet_pton");
-        close(sock_fd);
-        exit(EXIT_FAILURE);
-    }
-
     /* Connect to server */
-    if (connect(sock_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+    if (connect(sock_fd, (struct sockaddr *)&server_addr, addr_len) < 0) {
         perror("connect");
         close(sock_fd);
         exit(EXIT_FAILURE);
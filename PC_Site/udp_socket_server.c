@@ -1,3 +1,6 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,56 +9,270 @@
 #include <ifaddrs.h>
 #include <net/if.h>
 
+#include "capture.h"
+#include "discovery.h"
+#include "netaddr.h"
+#include "output.h"
+#include "probe.h"
+#include "session_table.h"
+#include "timestamping.h"
+
 #define PORT        8080
 #define BUFFER_SIZE 1024
+#define DEFAULT_REPORT_INTERVAL 1000
+#define DEFAULT_SESSION_CAPACITY 4096
+#define SESSION_RATE_TAU_S 5.0
+#define SESSION_IDLE_S 60.0
+
+static volatile sig_atomic_t stop_requested = 0;
+
+/* Per-peer health, copied out by the receive loop and printed by a
+ * separate thread so the terminal never stalls packet handling */
+static session_table_t sessions;
+static session_health_t *snapshot;
+static uint32_t snapshot_count;
+static uint64_t snapshot_untracked;
+static uint64_t snapshot_expired;
+static int snapshot_pending = 0;
+static int64_t snapshot_interval_ns = 0;
+static int64_t next_snapshot_ns = 0;
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t snapshot_cond = PTHREAD_COND_INITIALIZER;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void print_snapshot(void)
+{
+    printf("[Server] Session health: %u peers, %llu idle peers expired, "
+           "%llu packets from untracked peers\n", snapshot_count,
+           (unsigned long long)snapshot_expired, (unsigned long long)snapshot_untracked);
+    printf("[Server]   %-28s %10s %12s %9s %10s %7s %7s %5s %7s\n",
+           "peer", "packets", "bytes", "pps", "kbit/s", "loss%", "reorder", "dup", "idle_s");
+
+    for (uint32_t i = 0; i < snapshot_count; i++) {
+        const session_health_t *h = &snapshot[i];
+        char ip[INET6_ADDRSTRLEN];
+        char peer[INET6_ADDRSTRLEN + 8];
+
+        inet_ntop(h->peer.family, h->peer.addr, ip, sizeof(ip));
+        snprintf(peer, sizeof(peer), "%s:%u", ip, h->peer.port);
+
+        if (h->has_seq) {
+            printf("[Server]   %-28s %10llu %12llu %9.1f %10.1f %7.3f %7llu %5llu %7.1f\n",
+                   peer, (unsigned long long)h->packets, (unsigned long long)h->bytes,
+                   h->pps, h->bps / 1000.0, 100.0 * h->loss_ratio,
+                   (unsigned long long)h->reordered, (unsigned long long)h->duplicates,
+                   (double)h->idle_ns / 1e9);
+        } else {
+            printf("[Server]   %-28s %10llu %12llu %9.1f %10.1f %7s %7s %5s %7.1f\n",
+                   peer, (unsigned long long)h->packets, (unsigned long long)h->bytes,
+                   h->pps, h->bps / 1000.0, "-", "-", "-", (double)h->idle_ns / 1e9);
+        }
+    }
+    fflush(stdout);
+}
+
+static void *snapshot_thread(void *arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&snapshot_lock);
+    for (;;) {
+        while (!snapshot_pending && !stop_requested) {
+            pthread_cond_wait(&snapshot_cond, &snapshot_lock);
+        }
+        if (!snapshot_pending) {
+            break;
+        }
+        print_snapshot();
+        snapshot_pending = 0;
+    }
+    pthread_mutex_unlock(&snapshot_lock);
+    return NULL;
+}
 
-int main(void)
+/* Hand a copy of the table to the printer, skipped while it is still busy */
+static void maybe_snapshot(int64_t now_ns)
 {
-    int server_fd, client_fd;
-    struct sockaddr_in si_me, si_other;
-    int slen = sizeof(si_other);
+    if (snapshot_interval_ns == 0 || now_ns < next_snapshot_ns) {
+        return;
+    }
+    next_snapshot_ns = now_ns + snapshot_interval_ns;
+
+    if (pthread_mutex_trylock(&snapshot_lock) != 0) {
+        return;
+    }
+    snapshot_count     = session_snapshot(&sessions, now_ns, snapshot);
+    snapshot_untracked = sessions.untracked;
+    snapshot_expired   = sessions.expired;
+    snapshot_pending = 1;
+    pthread_cond_signal(&snapshot_cond);
+    pthread_mutex_unlock(&snapshot_lock);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-t] [-i <iface>] [-r <n>] [-w <file>] [-o <file>] [-F <format>]\n"
+            "          [-s <seconds>] [-S <peers>] [-n]\n"
+            "  -t          enable SO_TIMESTAMPING and report kernel vs. application latency\n"
+            "  -i <iface>  additionally request hardware timestamps from <iface> (implies -t)\n"
+            "  -r <n>      print the latency report every <n> messages (default %d)\n"
+            "  -w <file>   record every received datagram to a capture file\n"
+            "  -o <file>   write the message log to <file> instead of stdout\n"
+            "  -F <fmt>    message log format: human (default), csv or ndjson\n"
+            "  -s <secs>   print per-peer session health every <secs> seconds\n"
+            "  -S <peers>  number of peers the session table can track (default %d)\n"
+            "  -n          do not answer board discovery broadcasts\n",
+            prog, DEFAULT_REPORT_INTERVAL, DEFAULT_SESSION_CAPACITY);
+}
+
+int main(int argc, char *argv[])
+{
+    int server_fd;
+    struct sockaddr_storage si_other;
+    socklen_t slen = sizeof(si_other);
     char buffer[BUFFER_SIZE];
+    int timestamping = 0;
+    const char *hw_iface = NULL;
+    long report_interval = DEFAULT_REPORT_INTERVAL;
+    unsigned long messages = 0;
+    ts_report_t report;
+    ts_tx_track_t tx_track;
+    const char *capture_path = NULL;
+    capture_writer_t capture;
+    long session_capacity = DEFAULT_SESSION_CAPACITY;
+    pthread_t printer;
+    const char *output_path = NULL;
+    output_format_t output_format = OUTPUT_HUMAN;
+    int answer_discovery = 1;
+    discovery_t discovery;
+    output_t output;
+    int c;
+
+    while ((c = getopt(argc, argv, "ti:r:w:o:F:s:S:nh")) != -1) {
+        switch (c) {
+        case 't':
+            timestamping = 1;
+            break;
+        case 'i':
+            timestamping = 1;
+            hw_iface = optarg;
+            break;
+        case 'r':
+            report_interval = strtol(optarg, NULL, 10);
+            if (report_interval <= 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'w':
+            capture_path = optarg;
+            break;
+        case 'o':
+            output_path = optarg;
+            break;
+        case 'F':
+            if (output_parse_format(optarg, &output_format) < 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 's':
+            snapshot_interval_ns = (int64_t)(atof(optarg) * 1e9);
+            break;
+        case 'S':
+            session_capacity = strtol(optarg, NULL, 10);
+            if (session_capacity <= 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'n':
+            answer_discovery = 0;
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    /* Create TCP socket */
-    server_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);  // SOCK_STREAM for TCP
+    /* Stop on Ctrl+C without restarting recvfrom so the final report is printed */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    /* Bind to all interfaces on PORT, IPv4 and IPv6 */
+    server_fd = netaddr_server_socket(SOCK_DGRAM, PORT);
     if (server_fd < 0) {
-        perror("socket");
         exit(EXIT_FAILURE);
     }
 
-    /* Allow address reuse so we can restart quickly */
-    int opt = 1;
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        perror("setsockopt");
+    memset(&report, 0, sizeof(report));
+    memset(&tx_track, 0, sizeof(tx_track));
+    if (timestamping && ts_enable(server_fd, hw_iface) < 0) {
         close(server_fd);
         exit(EXIT_FAILURE);
     }
 
-    /* Bind to all interfaces on PORT */
-    memset(&si_me, 0, sizeof(si_me));
-    si_me.sin_family      = AF_INET;
-    si_me.sin_addr.s_addr = INADDR_ANY;
-    si_me.sin_port        = htons(PORT);
+    if (capture_path != NULL) {
+        if (capture_writer_open(&capture, capture_path) < 0) {
+            close(server_fd);
+            exit(EXIT_FAILURE);
+        }
+        printf("[Server] Recording to %s\n", capture_path);
+    }
+
+    if (output_open(&output, output_path, output_format) < 0) {
+        close(server_fd);
+        exit(EXIT_FAILURE);
+    }
+
+    /* A failed responder only costs the boards their discovery, keep serving */
+    if (answer_discovery && discovery_start(&discovery, "echo-udp", PORT) < 0) {
+        answer_discovery = 0;
+    }
 
-    if (bind(server_fd, (struct sockaddr *)&si_me, sizeof(si_me)) < 0) {
-        perror("bind");
+    if (session_table_init(&sessions, (uint32_t)session_capacity, SESSION_RATE_TAU_S,
+                           SESSION_IDLE_S) < 0 ||
+        (snapshot = calloc((size_t)session_capacity, sizeof(*snapshot))) == NULL) {
+        perror("session table");
         close(server_fd);
         exit(EXIT_FAILURE);
     }
 
-    /* Print all LAN IPv4 addresses so the client knows where to connect */
+    if (snapshot_interval_ns > 0) {
+        /* Wake up regularly so snapshots keep coming while it is quiet */
+        struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+        setsockopt(server_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        /* Signals must interrupt the receive loop, not the printer */
+        sigset_t block, old;
+        sigfillset(&block);
+        pthread_sigmask(SIG_BLOCK, &block, &old);
+        pthread_create(&printer, NULL, snapshot_thread, NULL);
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+        next_snapshot_ns = ts_now_ns() + snapshot_interval_ns;
+    }
+
+    /* Print all LAN addresses so the client knows where to connect */
     {
         struct ifaddrs *ifaddr, *ifa;
-        char ip_str[INET_ADDRSTRLEN];
+        char ip_str[NETADDR_STRLEN];
         if (getifaddrs(&ifaddr) == 0) {
             printf("[Server] Listening on port %d — reachable at:\n", PORT);
             for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
                 if (ifa->ifa_addr == NULL) continue;
-                if (ifa->ifa_addr->sa_family != AF_INET) continue;
+                if (ifa->ifa_addr->sa_family != AF_INET &&
+                    ifa->ifa_addr->sa_family != AF_INET6) continue;
                 if (ifa->ifa_flags & IFF_LOOPBACK) continue;
-                inet_ntop(AF_INET,
-                          &((struct sockaddr_in *)ifa->ifa_addr)->sin_addr,
-                          ip_str, sizeof(ip_str));
+                netaddr_host(ifa->ifa_addr, ip_str, sizeof(ip_str));
                 printf("[Server]   %s  (iface: %s)\n", ip_str, ifa->ifa_name);
             }
             freeifaddrs(ifaddr);
@@ -70,27 +287,84 @@ int main(void)
         /* Receive message from client */
         memset(buffer, 0, BUFFER_SIZE);
         //try to receive some data, this is a blocking call
-        ssize_t bytes = recvfrom(server_fd, buffer, BUFFER_SIZE - 1, 0, (struct sockaddr *) &si_other, &slen);
+        ts_rx_t rx;
+        slen = sizeof(si_other);
+        ssize_t bytes = ts_recvmsg(server_fd, buffer, BUFFER_SIZE - 1, 0, (struct sockaddr *) &si_other, &slen, &rx);
 		if (bytes == -1)
 		{
+            if (errno == EINTR && stop_requested) {
+                break;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                maybe_snapshot(rx.user_ns);
+                continue;
+            }
 			printf("recvfrom() failed\n");
             break;
 		}
-        printf("Received packet from %s:%d\n", inet_ntoa(si_other.sin_addr), ntohs(si_other.sin_port));
-        printf("Received: %s\n", buffer);
+
+        session_t *session = session_lookup(&sessions, (struct sockaddr *) &si_other, rx.user_ns);
+        if (session != NULL) {
+            probe_t probe;
+            int has_probe = probe_parse(buffer, (size_t)bytes, &probe) == 0;
+            session_update(&sessions, session, rx.user_ns, (size_t)bytes,
+                           has_probe ? probe.seq : UINT64_MAX);
+        }
+        maybe_snapshot(rx.user_ns);
+
+        if (capture_path != NULL) {
+            capture_write(&capture, rx.sw_ns != 0 ? rx.sw_ns : rx.user_ns,
+                          rx.sw_ns != 0 ? CAPTURE_F_KERNEL_TS : 0, IPPROTO_UDP,
+                          (struct sockaddr *) &si_other, buffer, (size_t)bytes);
+        }
+        output_post(&output, OUTPUT_EV_RX, rx.user_ns, IPPROTO_UDP,
+                    (struct sockaddr *) &si_other, buffer, (size_t)bytes);
 
         /* Echo back with a prefix */
         char response[BUFFER_SIZE];
         snprintf(response, sizeof(response), "Echo: %s", buffer);
-        if (sendto(server_fd, response, strlen(response), 0, (struct sockaddr*) &si_other, slen) == -1)
+        int64_t send_ns;
+        if (ts_sendto(server_fd, timestamping ? &tx_track : NULL, response, strlen(response),
+                      (struct sockaddr*) &si_other, slen, &send_ns) == -1)
 		{
 			perror("send");
             break;
 		}
-        printf("[Server] Sent:     %s\n", response);
+        output_post(&output, OUTPUT_EV_TX, send_ns, IPPROTO_UDP,
+                    (struct sockaddr *) &si_other, response, strlen(response));
+
+        if (timestamping) {
+            ts_account(&report, &rx, send_ns);
+            ts_poll_tx(server_fd, &tx_track, &report);
+            if (++messages % (unsigned long)report_interval == 0) {
+                ts_print_report(stdout, "[Server]", &report);
+            }
+        }
+    }
+
+    if (timestamping) {
+        ts_poll_tx(server_fd, &tx_track, &report);
+        ts_print_report(stdout, "[Server]", &report);
+    }
+
+    if (capture_path != NULL) {
+        capture_writer_close(&capture);
+    }
+
+    if (snapshot_interval_ns > 0) {
+        pthread_mutex_lock(&snapshot_lock);
+        stop_requested = 1;
+        pthread_cond_signal(&snapshot_cond);
+        pthread_mutex_unlock(&snapshot_lock);
+        pthread_join(printer, NULL);
+    }
+    session_table_free(&sessions);
+    free(snapshot);
+    if (answer_discovery) {
+        discovery_stop(&discovery);
     }
+    output_close(&output);
 
-    close(client_fd);
     close(server_fd);
     printf("[Server] Closed.\n");
     return 0;
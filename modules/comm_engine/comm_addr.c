@@ -0,0 +1,122 @@
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+
+#include "comm_engine.h"
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(comm_engine);
+
+/*
+ * Family-agnostic addresses. Peers are kept in a sockaddr_storage, and a
+ * dual-stack server sees IPv4 clients as IPv4-mapped IPv6 addresses
+ * (::ffff:a.b.c.d), so both forms of the same host compare equal and are
+ * printed the same way.
+ */
+
+/* IPv4 address of addr, plain or mapped; false for any other address */
+static bool addr_ipv4(const struct sockaddr_storage *addr, struct in_addr *v4)
+{
+	if (addr->ss_family == AF_INET) {
+		*v4 = net_sin((const struct sockaddr *)addr)->sin_addr;
+		return true;
+	}
+	if (addr->ss_family == AF_INET6) {
+		const struct in6_addr *v6 = &net_sin6((const struct sockaddr *)addr)->sin6_addr;
+
+		if (net_ipv6_addr_is_v4_mapped(v6)) {
+			memcpy(v4, &v6->s6_addr[12], sizeof(*v4));
+			return true;
+		}
+	}
+	return false;
+}
+
+int comm_socket_server(int type, int proto)
+{
+	int fd = zsock_socket(COMM_AF_SERVER, type, proto);
+
+	if (fd < 0) {
+		return -errno;
+	}
+	/* The stack default may be IPv6 only */
+	if (COMM_AF_SERVER == AF_INET6 && IS_ENABLED(CONFIG_NET_IPV4)) {
+		int off = 0;
+
+		if (zsock_setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off)) < 0) {
+			LOG_WRN("[Comm] IPv4 clients cannot reach the server (errno=%d)", errno);
+		}
+	}
+	return fd;
+}
+
+net_socklen_t comm_addr_any(uint16_t port, struct sockaddr_storage *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	if (COMM_AF_SERVER == AF_INET6) {
+		struct sockaddr_in6 *sin6 = net_sin6((struct sockaddr *)addr);
+
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_port = htons(port);
+		return sizeof(*sin6);
+	}
+
+	struct sockaddr_in *sin = net_sin((struct sockaddr *)addr);
+
+	sin->sin_family = AF_INET;
+	sin->sin_port = htons(port);
+	sin->sin_addr.s_addr = htonl(INADDR_ANY);
+	return sizeof(*sin);
+}
+
+int comm_addr_parse(const char *ip, uint16_t port, struct sockaddr_storage *addr,
+		    net_socklen_t *len)
+{
+	struct sockaddr_in *sin = net_sin((struct sockaddr *)addr);
+	struct sockaddr_in6 *sin6 = net_sin6((struct sockaddr *)addr);
+
+	memset(addr, 0, sizeof(*addr));
+	if (zsock_inet_pton(AF_INET, ip, &sin->sin_addr) == 1) {
+		sin->sin_family = AF_INET;
+		sin->sin_port = htons(port);
+		*len = sizeof(*sin);
+		return 0;
+	}
+	if (zsock_inet_pton(AF_INET6, ip, &sin6->sin6_addr) == 1) {
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_port = htons(port);
+		*len = sizeof(*sin6);
+		return 0;
+	}
+	return -EINVAL;
+}
+
+const char *comm_addr_to_string(const struct sockaddr_storage *addr, char *buf, size_t len)
+{
+	struct in_addr v4;
+
+	if (addr_ipv4(addr, &v4)) {
+		return net_addr_ntop(AF_INET, &v4, buf, len);
+	}
+	if (addr->ss_family == AF_INET6) {
+		return net_addr_ntop(AF_INET6, &net_sin6((const struct sockaddr *)addr)->sin6_addr,
+				     buf, len);
+	}
+	return NULL;
+}
+
+bool comm_addr_equal(const struct sockaddr_storage *a, const struct sockaddr_storage *b)
+{
+	struct in_addr a4;
+	struct in_addr b4;
+	bool a_is_v4 = addr_ipv4(a, &a4);
+	bool b_is_v4 = addr_ipv4(b, &b4);
+
+	if (a_is_v4 || b_is_v4) {
+		return a_is_v4 && b_is_v4 && a4.s_addr == b4.s_addr;
+	}
+	return a->ss_family == AF_INET6 && b->ss_family == AF_INET6 &&
+	       net_ipv6_addr_cmp(&net_sin6((const struct sockaddr *)a)->sin6_addr,
+				 &net_sin6((const struct sockaddr *)b)->sin6_addr);
+}
@@ -0,0 +1,585 @@
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#ifdef CONFIG_COMM_ENGINE_BULK_FLASH
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+#endif
+
+#include "comm_engine.h"
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(comm_engine);
+
+/*
+ * Chunked bulk transfer over the datagram transport, the peer is
+ * PC_Site/bulk_client.c. Every packet starts with a 16 byte header:
+ *
+ *   0   COMM_BULK_MAGIC, type
+ *   2   transfer id (16 bit, chosen by the PC)
+ *   4   chunk index; in ACK the first chunk still missing
+ *   8   payload length (16 bit), flags (16 bit)
+ *   12  CRC32C of header bytes 0..11 and the payload
+ *
+ * The PC opens a transfer with PUT (blob to the board) or GET (blob from
+ * the board), naming a store. The board answers with INFO: size, chunk
+ * size and window. Then the sender keeps up to a window of chunks in
+ * flight. The receiver answers with ACKs: the first missing chunk plus a
+ * bitmap of the chunks received behind it. It acks every few chunks, and
+ * at once when a chunk arrives out of order, twice, or as the last one.
+ *
+ * The receiver remembers every chunk in a bitmap. A PUT that is opened
+ * again with the same id and size resumes: the ACK after its INFO tells
+ * the PC what is still missing. Chunks are written to the store as they
+ * arrive, at their own offset, so nothing is held back for reordering.
+ */
+
+#define CHUNK           CONFIG_COMM_ENGINE_BULK_CHUNK
+#define MAX_CHUNKS      CONFIG_COMM_ENGINE_BULK_MAX_CHUNKS
+#define WINDOW          MIN(CONFIG_COMM_ENGINE_BULK_WINDOW, COMM_BULK_MAX_WINDOW)
+#define ACK_EVERY       8
+#define CRC_OFFSET      12
+#define IDLE_MS         10000   /* a GET without ACKs for this long is dropped */
+
+BUILD_ASSERT(COMM_BULK_HEADER + CHUNK <= CONFIG_COMM_ENGINE_BUFFER_SIZE - 8,
+	     "a chunk and its header must fit the receive buffer");
+
+/* Where a blob is read from or written to */
+struct bulk_store {
+	const char *name;
+	/* Writing: check size and prepare (erase) unless resuming. Reading:
+	 * return the size of the blob. */
+	int (*open)(bool write, uint32_t *size, bool resume);
+	int (*write)(uint32_t off, const uint8_t *buf, size_t len);
+	int (*read)(uint32_t off, uint8_t *buf, size_t len);
+	void (*done)(uint32_t size);    /* optional, after a complete PUT */
+};
+
+struct bulk_xfer {
+	const struct bulk_store *store;
+	uint16_t id;
+	bool sending;                   /* GET: the board sends */
+	bool active;
+	uint32_t size;
+	uint32_t chunks;
+	uint32_t base;                  /* first chunk not yet done */
+	uint32_t done_count;
+	uint32_t since_ack;             /* receiver */
+	uint32_t next_expected;         /* receiver, for in-order detection */
+	uint16_t window;                /* sender */
+	bool peer_ready;                /* sender: the PC told what it has */
+	int64_t last_ack_ms;            /* sender */
+	uint32_t sent_cyc[COMM_BULK_MAX_WINDOW];   /* sender, 0 = not sent yet */
+	struct sockaddr_storage peer;
+	net_socklen_t peer_len;
+	int64_t started_ms;
+};
+
+static struct bulk_xfer xfer;
+static uint8_t done_map[DIV_ROUND_UP(MAX_CHUNKS, 8)];  /* received / acked chunks */
+static uint8_t packet[COMM_BULK_HEADER + CHUNK];
+
+/* ---- stores ---- */
+
+static uint8_t ram_blob[CONFIG_COMM_ENGINE_BULK_RAM_SIZE];
+static uint32_t ram_size;
+
+static int ram_open(bool write, uint32_t *size, bool resume)
+{
+	ARG_UNUSED(resume);
+	if (!write) {
+		*size = ram_size;
+		return 0;
+	}
+	return *size <= sizeof(ram_blob) ? 0 : -EFBIG;
+}
+
+static int ram_write(uint32_t off, const uint8_t *buf, size_t len)
+{
+	memcpy(&ram_blob[off], buf, len);
+	return 0;
+}
+
+static int ram_read(uint32_t off, uint8_t *buf, size_t len)
+{
+	memcpy(buf, &ram_blob[off], len);
+	return 0;
+}
+
+static void ram_done(uint32_t size)
+{
+	ram_size = size;
+}
+
+/* Throughput tests: takes any size and discards it, reads a pattern */
+#define NULL_GET_SIZE (4U << 20)
+
+static int null_open(bool write, uint32_t *size, bool resume)
+{
+	ARG_UNUSED(resume);
+	if (!write) {
+		*size = NULL_GET_SIZE;
+	}
+	return 0;
+}
+
+static int null_write(uint32_t off, const uint8_t *buf, size_t len)
+{
+	ARG_UNUSED(off);
+	ARG_UNUSED(buf);
+	ARG_UNUSED(len);
+	return 0;
+}
+
+static int null_read(uint32_t off, uint8_t *buf, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		uint32_t pos = off + i;
+
+		buf[i] = (uint8_t)(pos * 31 + (pos >> 10));
+	}
+	return 0;
+}
+
+#ifdef CONFIG_COMM_ENGINE_BULK_FLASH
+static const struct flash_area *flash;
+static uint32_t flash_size;     /* of the last complete PUT, 0 = whole partition */
+
+static int flash_open(bool write, uint32_t *size, bool resume)
+{
+	int ret;
+
+	if (flash == NULL) {
+		ret = flash_area_open(FIXED_PARTITION_ID(storage_partition), &flash);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+	if (!write) {
+		*size = flash_size != 0 ? flash_size : flash->fa_size;
+		return 0;
+	}
+	if (*size > flash->fa_size) {
+		return -EFBIG;
+	}
+	if (resume || *size == 0) {
+		return 0;
+	}
+
+	/* Erase whole pages up to the end of the blob */
+	struct flash_pages_info info;
+
+	ret = flash_get_page_info_by_offs(flash_area_get_device(flash),
+					  flash->fa_off + *size - 1, &info);
+	if (ret < 0) {
+		return ret;
+	}
+	uint32_t len = info.start_offset + info.size - flash->fa_off;
+	uint32_t start = k_uptime_get_32();
+
+	ret = flash_area_erase(flash, 0, len);
+	LOG_INF("[Bulk] Erased %u bytes of flash in %u ms", len, k_uptime_get_32() - start);
+	return ret;
+}
+
+static int flash_write(uint32_t off, const uint8_t *buf, size_t len)
+{
+	size_t align = flash_area_align(flash);
+	size_t body = len - len % align;
+	int ret = 0;
+
+	if (body > 0) {
+		ret = flash_area_write(flash, off, buf, body);
+	}
+	/* Only the last chunk can end off the write block size */
+	if (ret == 0 && body < len) {
+		uint8_t tail[16];
+
+		if (align > sizeof(tail)) {
+			return -EINVAL;
+		}
+		memset(tail, 0xff, align);
+		memcpy(tail, buf + body, len - body);
+		ret = flash_area_write(flash, off + body, tail, align);
+	}
+	return ret;
+}
+
+static int flash_read(uint32_t off, uint8_t *buf, size_t len)
+{
+	return flash_area_read(flash, off, buf, len);
+}
+
+static void flash_done(uint32_t size)
+{
+	flash_size = size;
+}
+#endif
+
+static const struct bulk_store stores[] = {
+	{ "ram", ram_open, ram_write, ram_read, ram_done },
+	{ "null", null_open, null_write, null_read, NULL },
+#ifdef CONFIG_COMM_ENGINE_BULK_FLASH
+	{ "flash", flash_open, flash_write, flash_read, flash_done },
+#endif
+};
+
+static const struct bulk_store *find_store(const uint8_t *name, size_t len)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(stores); i++) {
+		if (strlen(stores[i].name) == len && memcmp(stores[i].name, name, len) == 0) {
+			return &stores[i];
+		}
+	}
+	return NULL;
+}
+
+/* ---- packets ---- */
+
+static uint32_t packet_crc(const uint8_t *hdr, const uint8_t *payload, size_t len)
+{
+	return comm_crc32c(comm_crc32c(0, hdr, CRC_OFFSET), payload, len);
+}
+
+static int send_packet(struct comm_context *ctx, uint8_t type, uint32_t index, uint16_t flags,
+		       const void *payload, size_t len)
+{
+	struct sockaddr_storage peer = ctx->peer_addr;
+	net_socklen_t peer_len = ctx->peer_addr_len;
+
+	packet[0] = COMM_BULK_MAGIC;
+	packet[1] = type;
+	sys_put_le16(xfer.id, &packet[2]);
+	sys_put_le32(index, &packet[4]);
+	sys_put_le16((uint16_t)len, &packet[8]);
+	sys_put_le16(flags, &packet[10]);
+	if (payload != &packet[COMM_BULK_HEADER]) {
+		memcpy(&packet[COMM_BULK_HEADER], payload, len);
+	}
+	sys_put_le32(packet_crc(packet, &packet[COMM_BULK_HEADER], len), &packet[CRC_OFFSET]);
+
+	/* Replies go to the PC that runs the transfer */
+	ctx->peer_addr = xfer.peer;
+	ctx->peer_addr_len = xfer.peer_len;
+	int ret = comm_send_prio(ctx, COMM_PRIO_BK, packet, COMM_BULK_HEADER + len);
+	ctx->peer_addr = peer;
+	ctx->peer_addr_len = peer_len;
+
+	/* A full queue is a lost packet, the protocol recovers from that */
+	return ret == -ENOBUFS ? 0 : ret;
+}
+
+static bool is_done(uint32_t chunk)
+{
+	return done_map[chunk / 8] & BIT(chunk % 8);
+}
+
+static uint32_t chunk_len(uint32_t chunk)
+{
+	return chunk + 1 < xfer.chunks ? CHUNK : xfer.size - chunk * CHUNK;
+}
+
+static void advance_base(void)
+{
+	while (xfer.base < xfer.chunks && is_done(xfer.base)) {
+		/* The slot is reused for the chunk one window further */
+		xfer.sent_cyc[xfer.base % COMM_BULK_MAX_WINDOW] = 0;
+		xfer.base++;
+	}
+}
+
+static int send_info(struct comm_context *ctx)
+{
+	uint8_t info[8];
+
+	sys_put_le32(xfer.size, &info[0]);
+	sys_put_le16(CHUNK, &info[4]);
+	sys_put_le16(xfer.window, &info[6]);
+	return send_packet(ctx, COMM_BULK_INFO, 0, 0, info, sizeof(info));
+}
+
+static int send_error(struct comm_context *ctx, int err)
+{
+	uint8_t payload[4];
+
+	sys_put_le32((uint32_t)err, payload);
+	return send_packet(ctx, COMM_BULK_ERROR, 0, 0, payload, sizeof(payload));
+}
+
+/* First missing chunk and which of the next COMM_BULK_MAX_WINDOW arrived */
+static int send_ack(struct comm_context *ctx)
+{
+	uint8_t map[COMM_BULK_MAX_WINDOW / 8] = { 0 };
+	bool complete = xfer.done_count == xfer.chunks;
+
+	for (uint32_t i = 0; i < COMM_BULK_MAX_WINDOW && xfer.base + i < xfer.chunks; i++) {
+		if (is_done(xfer.base + i)) {
+			map[i / 8] |= BIT(i % 8);
+		}
+	}
+	xfer.since_ack = 0;
+	return send_packet(ctx, COMM_BULK_ACK, xfer.base, complete ? COMM_BULK_FLAG_COMPLETE : 0,
+			   map, sizeof(map));
+}
+
+static void finish(struct comm_context *ctx)
+{
+	uint32_t ms = (uint32_t)(k_uptime_get() - xfer.started_ms);
+
+	LOG_INF("[Bulk] %s %s: %u bytes in %u ms (%u kB/s)", xfer.sending ? "GET" : "PUT",
+		xfer.store->name, xfer.size, ms, xfer.size / MAX(ms, 1));
+	if (!xfer.sending && xfer.store->done != NULL) {
+		xfer.store->done(xfer.size);
+	}
+	ctx->stats.bulk_transfers++;
+	xfer.active = false;
+}
+
+/* ---- PUT / GET ---- */
+
+static int open_xfer(struct comm_context *ctx, uint8_t type, uint16_t id, const uint8_t *payload,
+		     size_t len)
+{
+	bool sending = type == COMM_BULK_GET;
+	size_t fixed = sending ? 2 : 6;         /* window (GET) or size and window (PUT) */
+
+	if (len <= fixed) {
+		return -EINVAL;
+	}
+	const struct bulk_store *store = find_store(payload + fixed, len - fixed);
+	uint32_t size = sending ? 0 : sys_get_le32(payload);
+	uint16_t window = sys_get_le16(payload + fixed - 2);
+
+	/* The same PUT again: the PC lost the INFO or the link, keep going */
+	bool resume = !sending && !xfer.sending && xfer.id == id && xfer.store == store &&
+		      xfer.size == size && xfer.chunks != 0;
+	int ret = store != NULL ? store->open(!sending, &size, resume) : -ENOENT;
+
+	/* A new request replaces whatever ran before, also when it fails */
+	xfer.peer = ctx->peer_addr;
+	xfer.peer_len = ctx->peer_addr_len;
+	xfer.id = id;
+	if (ret == 0 && DIV_ROUND_UP(size, CHUNK) > MAX_CHUNKS) {
+		ret = -EFBIG;
+	}
+	if (ret < 0) {
+		xfer.active = false;
+		xfer.chunks = 0;
+		return ret;
+	}
+
+	if (!resume) {
+		memset(done_map, 0, sizeof(done_map));
+		memset(xfer.sent_cyc, 0, sizeof(xfer.sent_cyc));
+		xfer.store = store;
+		xfer.sending = sending;
+		xfer.size = size;
+		xfer.chunks = DIV_ROUND_UP(size, CHUNK);
+		xfer.base = 0;
+		xfer.done_count = 0;
+		xfer.next_expected = 0;
+		xfer.started_ms = k_uptime_get();
+	}
+	xfer.window = CLAMP(window, 1, WINDOW);
+	xfer.since_ack = 0;
+	xfer.peer_ready = false;
+	xfer.active = xfer.done_count < xfer.chunks;
+
+	LOG_INF("[Bulk] %s %s id %u: %u bytes, %u chunks%s", sending ? "GET" : "PUT", store->name,
+		id, size, xfer.chunks, resume ? ", resuming" : "");
+
+	ret = send_info(ctx);
+	if (ret >= 0 && !sending) {
+		/* Tells a resuming sender what is still missing */
+		ret = send_ack(ctx);
+	}
+	if (xfer.chunks == 0) {
+		finish(ctx);
+	}
+	return ret;
+}
+
+static int on_data(struct comm_context *ctx, uint32_t index, const uint8_t *payload, size_t len)
+{
+	if (xfer.sending || index >= xfer.chunks || len != chunk_len(index)) {
+		return 0;
+	}
+	if (is_done(index)) {
+		/* The sender missed an ACK, possibly the last one */
+		xfer.next_expected = index + 1;
+		return send_ack(ctx);
+	}
+	if (!xfer.active) {
+		return 0;
+	}
+
+	bool in_order = index == xfer.next_expected;
+
+	xfer.next_expected = index + 1;
+
+	int ret = xfer.store->write(index * CHUNK, payload, len);
+
+	if (ret < 0) {
+		LOG_ERR("[Bulk] Store %s failed at chunk %u (%d)", xfer.store->name, index, ret);
+		xfer.active = false;
+		return send_error(ctx, ret);
+	}
+	done_map[index / 8] |= BIT(index % 8);
+	xfer.done_count++;
+	xfer.since_ack++;
+	ctx->stats.bulk_rx_bytes += len;
+	advance_base();
+
+	if (xfer.done_count == xfer.chunks) {
+		ret = send_ack(ctx);
+		finish(ctx);
+		return ret;
+	}
+	if (!in_order || xfer.since_ack >= ACK_EVERY) {
+		return send_ack(ctx);
+	}
+	return 0;
+}
+
+static void on_ack(struct comm_context *ctx, uint32_t base, uint16_t flags, const uint8_t *map,
+		   size_t len)
+{
+	uint32_t newest = 0;
+	bool any = false;
+
+	if (!xfer.active || !xfer.sending) {
+		return;
+	}
+	xfer.peer_ready = true;
+	xfer.last_ack_ms = k_uptime_get();
+
+	/* All chunks before base and the ones set in the bitmap are through */
+	for (uint32_t i = xfer.base; i < MIN(base, xfer.chunks); i++) {
+		done_map[i / 8] |= BIT(i % 8);
+	}
+	for (uint32_t i = 0; i < len * 8 && base + i < xfer.chunks; i++) {
+		uint32_t c = base + i;
+		uint32_t sent = xfer.sent_cyc[c % COMM_BULK_MAX_WINDOW];
+
+		if (!(map[i / 8] & BIT(i % 8)) || is_done(c)) {
+			continue;
+		}
+		done_map[c / 8] |= BIT(c % 8);
+		if (sent != 0 && (!any || (int32_t)(sent - newest) > 0)) {
+			newest = sent;
+			any = true;
+		}
+	}
+
+	/* A chunk sent before one that got through is lost, not late: let
+	 * comm_bulk_poll() resend it without waiting for the RTO */
+	for (uint32_t i = base; any && i < MIN(base + xfer.window, xfer.chunks); i++) {
+		uint32_t *sent = &xfer.sent_cyc[i % COMM_BULK_MAX_WINDOW];
+
+		if (!is_done(i) && *sent != 0 && (int32_t)(newest - *sent) > 0) {
+			*sent = 1;
+		}
+	}
+	advance_base();
+
+	if ((flags & COMM_BULK_FLAG_COMPLETE) || xfer.base == xfer.chunks) {
+		finish(ctx);
+	}
+}
+
+int comm_bulk_handle(struct comm_context *ctx, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	int ret = 0;
+
+	if (len < COMM_BULK_HEADER || p[0] != COMM_BULK_MAGIC) {
+		return 0;
+	}
+
+	uint8_t type = p[1];
+	uint16_t id = sys_get_le16(&p[2]);
+	uint32_t index = sys_get_le32(&p[4]);
+	uint16_t plen = sys_get_le16(&p[8]);
+	uint16_t flags = sys_get_le16(&p[10]);
+
+	if (COMM_BULK_HEADER + (size_t)plen != len ||
+	    sys_get_le32(&p[CRC_OFFSET]) != packet_crc(p, p + COMM_BULK_HEADER, plen)) {
+		ctx->stats.bulk_crc_errors++;
+		return 0;
+	}
+	p += COMM_BULK_HEADER;
+
+	switch (type) {
+	case COMM_BULK_PUT:
+	case COMM_BULK_GET:
+		ret = open_xfer(ctx, type, id, p, plen);
+		if (ret < 0) {
+			LOG_WRN("[Bulk] Transfer %u refused (%d)", id, ret);
+			ret = send_error(ctx, ret);
+		}
+		break;
+	case COMM_BULK_DATA:
+		if (id == xfer.id) {
+			ret = on_data(ctx, index, p, plen);
+		}
+		break;
+	case COMM_BULK_ACK:
+		if (id == xfer.id) {
+			on_ack(ctx, index, flags, p, plen);
+		}
+		break;
+	default:
+		break;
+	}
+	return ret;
+}
+
+/* GET: fill the window, resend what was lost or not acked within the RTO.
+ * Sending starts with the PC's first ACK, which says what it already has. */
+int comm_bulk_poll(struct comm_context *ctx)
+{
+	if (!xfer.active || !xfer.sending || !xfer.peer_ready) {
+		return 0;
+	}
+	if (k_uptime_get() - xfer.last_ack_ms > IDLE_MS) {
+		LOG_WRN("[Bulk] GET id %u: no ACK for %u ms, dropped at chunk %u", xfer.id, IDLE_MS,
+			xfer.base);
+		xfer.active = false;
+		return 0;
+	}
+
+	uint32_t rto = k_ms_to_cyc_ceil32(CONFIG_COMM_ENGINE_BULK_RTO_MS);
+	uint32_t end = MIN(xfer.base + xfer.window, xfer.chunks);
+
+	for (uint32_t i = xfer.base; i < end; i++) {
+		uint32_t *sent = &xfer.sent_cyc[i % COMM_BULK_MAX_WINDOW];
+		uint32_t now = k_cycle_get_32() | 1;
+
+		if (is_done(i) || (*sent != 0 && now - *sent < rto)) {
+			continue;
+		}
+		if (comm_prio_space(ctx, COMM_PRIO_BK) < sizeof(packet)) {
+			break;
+		}
+
+		uint32_t len = chunk_len(i);
+		int ret = xfer.store->read(i * CHUNK, &packet[COMM_BULK_HEADER], len);
+
+		if (ret < 0) {
+			LOG_ERR("[Bulk] Store %s failed at chunk %u (%d)", xfer.store->name, i, ret);
+			xfer.active = false;
+			return send_error(ctx, ret);
+		}
+		if (*sent != 0) {
+			ctx->stats.bulk_retransmits++;
+		}
+		ret = send_packet(ctx, COMM_BULK_DATA, i, 0, &packet[COMM_BULK_HEADER], len);
+		if (ret < 0) {
+			return ret;
+		}
+		*sent = now;
+		ctx->stats.bulk_tx_bytes += len;
+	}
+	return 0;
+}
@@ -0,0 +1,261 @@
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "comm_engine.h"
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(comm_engine);
+
+/*
+ * Payload compression between the application and the transport, decoded
+ * by PC_Site/codec.c. Every frame starts with a 3 byte header:
+ *
+ *   COMM_CODEC_MAGIC | codec, payload length (16 bit little endian)
+ *
+ * The length counts the encoded bytes after the header, so the server can
+ * cut frames out of a TCP stream before decoding them.
+ *
+ * COMM_CODEC_LZ is the LZ4 block format. Matches may reach back into a
+ * small dictionary of strings the board sends often, so even short
+ * messages compress. COMM_CODEC_DELTA stores int32 samples as the
+ * zigzag-varint difference to the previous sample of the same channel,
+ * which turns slowly changing readings into one byte each.
+ *
+ * A frame that would not get smaller is sent as COMM_CODEC_NONE. All
+ * scratch memory is static and shared, so frames are encoded one at a
+ * time.
+ */
+
+/* Keep in sync with PC_Site/codec.c, changing it needs a new codec id */
+static const char dictionary[] =
+	"Hello, Server!How are you?Socket demo working.Goodbye!"
+	"{\"seq\":,\"uptime_ms\":,\"rssi\":,\"rtt_us\":,\"state\":\"EXCHANGING\"}"
+	"WIFI_CONNECTING WAITING_FOR_IP ESTABLISHING_LINK RECONNECTING ";
+
+#define DICT_LEN     (sizeof(dictionary) - 1)
+#define HASH_LOG     CONFIG_COMM_ENGINE_COMPRESS_HASH_LOG
+#define MIN_MATCH    4
+#define MFLIMIT      12     /* LZ4: no match starts in the last 12 bytes */
+#define LAST_LITERALS 5     /* LZ4: the last 5 bytes are always literals */
+#define MAX_INPUT    CONFIG_COMM_ENGINE_BUFFER_SIZE
+
+/* Worst case of both codecs: LZ4 adds one byte per 255 literals, a
+ * varint takes five bytes for four */
+#define OUT_BOUND    (COMM_CODEC_HEADER + 1 + MAX_INPUT + MAX_INPUT / 4 + 16)
+
+BUILD_ASSERT(DICT_LEN + MAX_INPUT <= UINT16_MAX, "LZ4 offsets are 16 bit");
+BUILD_ASSERT(COMM_CODEC_COUNT <= 8, "the codec shares the first byte with COMM_CODEC_MAGIC");
+
+static uint8_t window[DICT_LEN + MAX_INPUT];     /* dictionary, then the input */
+static uint16_t dict_table[1 << HASH_LOG];       /* hash table with only the dictionary */
+static uint16_t hash_table[1 << HASH_LOG];
+static uint8_t frame[OUT_BOUND];
+static bool dict_ready;
+
+K_MUTEX_DEFINE(codec_lock);
+
+static inline uint32_t read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t hash32(uint32_t v)
+{
+	return (v * 2654435761U) >> (32 - HASH_LOG);
+}
+
+static void prepare_dictionary(void)
+{
+	memcpy(window, dictionary, DICT_LEN);
+	memset(dict_table, 0, sizeof(dict_table));
+	for (size_t i = 0; i + MIN_MATCH <= DICT_LEN; i++) {
+		dict_table[hash32(read32(&window[i]))] = (uint16_t)i;
+	}
+	dict_ready = true;
+}
+
+static uint8_t *put_length(uint8_t *op, size_t len)
+{
+	for (; len >= 255; len -= 255) {
+		*op++ = 255;
+	}
+	*op++ = (uint8_t)len;
+	return op;
+}
+
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *literals, size_t lit_len,
+			     uint16_t offset, size_t match_len)
+{
+	uint8_t *token = op++;
+
+	*token = (uint8_t)(MIN(lit_len, 15) << 4);
+	if (lit_len >= 15) {
+		op = put_length(op, lit_len - 15);
+	}
+	memcpy(op, literals, lit_len);
+	op += lit_len;
+
+	if (match_len == 0) {
+		return op;      /* last sequence, literals only */
+	}
+	sys_put_le16(offset, op);
+	op += 2;
+	match_len -= MIN_MATCH;
+	*token |= (uint8_t)MIN(match_len, 15);
+	if (match_len >= 15) {
+		op = put_length(op, match_len - 15);
+	}
+	return op;
+}
+
+/* Greedy LZ4 block compression of window[DICT_LEN, DICT_LEN + len) */
+static size_t lz_compress(size_t len, uint8_t *out)
+{
+	const uint8_t *base = window;
+	const uint8_t *ip = window + DICT_LEN;
+	const uint8_t *anchor = ip;
+	const uint8_t *iend = ip + len;
+	const uint8_t *mflimit = iend - MIN(len, MFLIMIT);
+	const uint8_t *matchlimit = iend - MIN(len, LAST_LITERALS);
+	uint8_t *op = out;
+	uint32_t misses = 0;
+
+	memcpy(hash_table, dict_table, sizeof(hash_table));
+
+	while (ip < mflimit) {
+		uint32_t seq = read32(ip);
+		uint32_t h = hash32(seq);
+		const uint8_t *ref = base + hash_table[h];
+
+		hash_table[h] = (uint16_t)(ip - base);
+		if (ref >= ip || read32(ref) != seq) {
+			/* Skip faster through data that does not compress */
+			ip += 1 + (misses++ >> 5);
+			continue;
+		}
+		misses = 0;
+
+		size_t match_len = MIN_MATCH;
+
+		while (ip + match_len < matchlimit && ref[match_len] == ip[match_len]) {
+			match_len++;
+		}
+		op = put_sequence(op, anchor, ip - anchor, (uint16_t)(ip - ref), match_len);
+		ip += match_len;
+		anchor = ip;
+		if (ip < mflimit) {
+			hash_table[hash32(read32(ip - 2))] = (uint16_t)(ip - 2 - base);
+		}
+	}
+	return put_sequence(op, anchor, iend - anchor, 0, 0) - out;
+}
+
+static inline uint8_t *put_varint(uint8_t *op, uint32_t v)
+{
+	while (v >= 0x80) {
+		*op++ = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	*op++ = (uint8_t)v;
+	return op;
+}
+
+static size_t delta_encode(const int32_t *samples, size_t count, uint8_t channels, uint8_t *out)
+{
+	uint32_t prev[COMM_CODEC_MAX_CHANNELS] = { 0 };
+	uint8_t *op = out;
+
+	*op++ = channels;
+	for (size_t i = 0, ch = 0; i < count; i++) {
+		/* Unsigned arithmetic, wrapping is part of the format */
+		uint32_t d = (uint32_t)samples[i] - prev[ch];
+
+		prev[ch] = (uint32_t)samples[i];
+		op = put_varint(op, (d << 1) ^ (uint32_t)((int32_t)d >> 31));
+		if (++ch == channels) {
+			ch = 0;
+		}
+	}
+	return op - out;
+}
+
+static int send_frame(struct comm_context *ctx, comm_codec_t codec, const void *buf, size_t len,
+		      uint8_t channels)
+{
+	uint32_t start = k_cycle_get_32();
+	size_t out_len = len;
+
+	if (codec == COMM_CODEC_LZ) {
+		if (!dict_ready) {
+			prepare_dictionary();
+		}
+		memcpy(window + DICT_LEN, buf, len);
+		out_len = lz_compress(len, frame + COMM_CODEC_HEADER);
+	} else if (codec == COMM_CODEC_DELTA) {
+		out_len = delta_encode(buf, len / sizeof(int32_t), channels, frame + COMM_CODEC_HEADER);
+	}
+	if (codec == COMM_CODEC_NONE || out_len >= len) {
+		codec = COMM_CODEC_NONE;
+		memcpy(frame + COMM_CODEC_HEADER, buf, len);
+		out_len = len;
+	}
+	frame[0] = COMM_CODEC_MAGIC | codec;
+	sys_put_le16((uint16_t)out_len, &frame[1]);
+	out_len += COMM_CODEC_HEADER;
+
+	uint32_t us = k_cyc_to_us_floor64(k_cycle_get_32() - start);
+	struct comm_stats *st = &ctx->stats;
+
+	st->codec_frames++;
+	st->codec_in_bytes += len;
+	st->codec_out_bytes += out_len;
+	st->codec_time_us += us;
+	st->codec_time_max_us = MAX(st->codec_time_max_us, us);
+	LOG_DBG("[Codec] %s: %u -> %u bytes in %u us", comm_codec_to_string(codec),
+		(uint32_t)len, (uint32_t)out_len, us);
+
+	return comm_send(ctx, frame, out_len);
+}
+
+int comm_send_encoded(struct comm_context *ctx, comm_codec_t codec, const void *buf, size_t len)
+{
+	int ret;
+
+	/* Samples go through comm_send_samples(), which knows the channels */
+	if (codec == COMM_CODEC_DELTA || codec >= COMM_CODEC_COUNT || len > MAX_INPUT) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&codec_lock, K_FOREVER);
+	ret = send_frame(ctx, codec, buf, len, 0);
+	k_mutex_unlock(&codec_lock);
+	return ret;
+}
+
+int comm_send_samples(struct comm_context *ctx, const int32_t *samples, size_t count,
+		      uint8_t channels)
+{
+	int ret;
+
+	if (channels == 0 || channels > COMM_CODEC_MAX_CHANNELS || count % channels != 0 ||
+	    count * sizeof(int32_t) > MAX_INPUT) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&codec_lock, K_FOREVER);
+	ret = send_frame(ctx, COMM_CODEC_DELTA, samples, count * sizeof(int32_t), channels);
+	k_mutex_unlock(&codec_lock);
+	return ret;
+}
+
+const char *comm_codec_to_string(comm_codec_t codec)
+{
+	static const char *const names[COMM_CODEC_COUNT] = { "none", "lz", "delta" };
+
+	return codec < COMM_CODEC_COUNT ? names[codec] : "?";
+}
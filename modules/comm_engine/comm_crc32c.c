@@ -0,0 +1,156 @@
+#include <string.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#elif !defined(CONFIG_COMM_ENGINE_CRC32C_SLICE8)
+#include <zephyr/sys/crc.h>
+#endif
+
+#include "comm_engine.h"
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(comm_engine);
+
+/*
+ * CRC32C (Castagnoli), the same checksum as PC_Site/crc32c.c.
+ *
+ * Cores with the ARMv8 CRC extension use its crc32c instructions. The
+ * Cortex-M parts have none, and the RW612 CRC engine only knows the
+ * CRC-32/IEEE and CRC-16 polynomials, so they use slicing-by-8: eight
+ * 256 entry tables fold 8 bytes per step with independent lookups,
+ * several times faster than a table walk per byte. The tables take
+ * 8 KiB of RAM and are built at boot. CONFIG_COMM_ENGINE_CRC32C_SMALL
+ * uses Zephyr's crc32_c() instead, with a 16 entry table.
+ */
+
+#define POLY 0x82F63B78u                /* reflected */
+
+#if defined(__ARM_FEATURE_CRC32)
+#define IMPL "armv8 crc32c"
+
+uint32_t comm_crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+
+	crc = ~crc;
+	while (len >= 4) {
+		uint32_t v;
+
+		memcpy(&v, p, sizeof(v));
+		crc = __crc32cw(crc, sys_le32_to_cpu(v));
+		p += 4;
+		len -= 4;
+	}
+	while (len-- > 0) {
+		crc = __crc32cb(crc, *p++);
+	}
+	return ~crc;
+}
+
+#elif defined(CONFIG_COMM_ENGINE_CRC32C_SLICE8)
+#define IMPL "slicing-by-8"
+
+static uint32_t table[8][256];
+
+static void build_tables(void)
+{
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t c = i;
+
+		for (int k = 0; k < 8; k++) {
+			c = (c & 1) ? (c >> 1) ^ POLY : c >> 1;
+		}
+		table[0][i] = c;
+	}
+	for (uint32_t i = 0; i < 256; i++) {
+		for (int k = 1; k < 8; k++) {
+			table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+		}
+	}
+}
+
+uint32_t comm_crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+
+	crc = ~crc;
+	while (len >= 8) {
+		uint32_t lo, hi;
+
+		memcpy(&lo, p, sizeof(lo));
+		memcpy(&hi, p + 4, sizeof(hi));
+		lo = sys_le32_to_cpu(lo) ^ crc;
+		hi = sys_le32_to_cpu(hi);
+		crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF] ^
+		      table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24] ^
+		      table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF] ^
+		      table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
+		p += 8;
+		len -= 8;
+	}
+	while (len-- > 0) {
+		crc = table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+#else
+#define IMPL "crc32_c"
+
+uint32_t comm_crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	return crc32_c(~crc, buf, len, false, true);
+}
+#endif
+
+#ifdef CONFIG_COMM_ENGINE_CRC32C_BENCH
+static void bench(void)
+{
+	static uint8_t buf[4096];
+	const uint32_t budget = k_ms_to_cyc_ceil32(20);
+
+	for (size_t i = 0; i < sizeof(buf); i++) {
+		buf[i] = (uint8_t)(i * 151 + 7);
+	}
+	for (size_t size = 16; size <= sizeof(buf); size *= 4) {
+		uint32_t rounds = 0;
+		uint32_t crc = 0;
+		uint32_t start = k_cycle_get_32();
+		uint32_t cycles;
+
+		do {
+			crc = comm_crc32c(crc, buf, size);
+			rounds++;
+			cycles = k_cycle_get_32() - start;
+		} while (cycles < budget);
+
+		uint64_t ns = k_cyc_to_ns_floor64(cycles);
+
+		LOG_INF("[Comm] CRC32C %u bytes: %u ns, %u kB/s (crc %08x)", (uint32_t)size,
+			(uint32_t)(ns / rounds), (uint32_t)((uint64_t)size * rounds * 1000000 / ns),
+			crc);
+	}
+}
+#endif
+
+static int crc32c_init(void)
+{
+#if !defined(__ARM_FEATURE_CRC32) && defined(CONFIG_COMM_ENGINE_CRC32C_SLICE8)
+	build_tables();
+#endif
+	/* RFC 3720 B.4 check value */
+	if (comm_crc32c(0, "123456789", 9) != 0xE3069283u) {
+		LOG_ERR("[Comm] CRC32C (%s) self test failed", IMPL);
+		return -EIO;
+	}
+#ifdef CONFIG_COMM_ENGINE_CRC32C_BENCH
+	LOG_INF("[Comm] CRC32C uses %s", IMPL);
+	bench();
+#endif
+	return 0;
+}
+
+SYS_INIT(crc32c_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
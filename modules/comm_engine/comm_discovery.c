@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+
+#include "comm_engine.h"
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(comm_engine);
+
+/*
+ * Server discovery, answered by PC_Site/discovery.c:
+ *
+ *   board  -> broadcast  "DISCOVER <service> <nonce>"      (or ff02::1)
+ *   server -> board      "OFFER <service> <port> <nonce>"
+ *   board  -> server     "PING <nonce> <n>"        (per candidate, unicast)
+ *   server -> board      "PONG <nonce> <n>"
+ *
+ * The broadcast only finds the servers; an AP may hold broadcasts back
+ * until the next DTIM, so the RTT is measured with unicast probes.
+ *
+ * Without an IPv4 address yet (CONFIG_WIFI_UTILITIES_FIRST_ADDR) the query
+ * goes to the IPv6 all-nodes group instead, and the servers are found at
+ * their link-local addresses.
+ */
+
+#define DISCOVERY_POLL_MS  100
+#define DISCOVERY_MSG_MAX  96
+
+struct candidate {
+	struct sockaddr_storage addr;   /* discovery responder */
+	net_socklen_t addr_len;
+	uint16_t port;                  /* service port it offered */
+	uint32_t best_rtt_us;
+};
+
+static uint32_t cycles_to_us(uint32_t cycles)
+{
+	return (uint32_t)k_cyc_to_us_floor64(cycles);
+}
+
+static int add_candidate(struct candidate *list, int count, const struct sockaddr_storage *from,
+			 net_socklen_t from_len, const char *msg, const char *service, uint32_t nonce)
+{
+	char offered[32];
+	unsigned int port;
+	unsigned long echoed;
+
+	if (sscanf(msg, "OFFER %31s %u %lu", offered, &port, &echoed) != 3 ||
+	    strcmp(offered, service) != 0 || echoed != nonce || port == 0 || port > UINT16_MAX) {
+		return count;
+	}
+	for (int i = 0; i < count; i++) {
+		if (comm_addr_equal(&list[i].addr, from) && list[i].port == port) {
+			return count;
+		}
+	}
+	if (count == CONFIG_COMM_ENGINE_DISCOVERY_MAX_SERVERS) {
+		return count;
+	}
+
+	list[count].addr = *from;
+	list[count].addr_len = from_len;
+	list[count].port = (uint16_t)port;
+	list[count].best_rtt_us = UINT32_MAX;
+	return count + 1;
+}
+
+/* Lowest of a few unicast round trips, UINT32_MAX when none came back */
+static uint32_t probe_rtt(int fd, const struct candidate *c, uint32_t nonce)
+{
+	char msg[DISCOVERY_MSG_MAX];
+	char expect[DISCOVERY_MSG_MAX];
+	uint32_t best = UINT32_MAX;
+
+	for (int i = 0; i < CONFIG_COMM_ENGINE_DISCOVERY_PROBES; i++) {
+		int len = snprintf(msg, sizeof(msg), "PING %u %d", nonce, i);
+
+		snprintf(expect, sizeof(expect), "PONG %u %d", nonce, i);
+		uint32_t start = k_cycle_get_32();
+
+		if (zsock_sendto(fd, msg, len, 0, (const struct sockaddr *)&c->addr, c->addr_len) < 0) {
+			break;
+		}
+		/* Late replies to earlier probes are skipped, the timeout ends the wait */
+		for (;;) {
+			int n = zsock_recv(fd, msg, sizeof(msg) - 1, 0);
+
+			if (n < 0) {
+				break;
+			}
+			msg[n] = '\0';
+			if (strcmp(msg, expect) == 0) {
+				best = MIN(best, cycles_to_us(k_cycle_get_32() - start));
+				break;
+			}
+		}
+	}
+	return best;
+}
+
+int comm_discover(struct comm_context *ctx)
+{
+	struct candidate found[CONFIG_COMM_ENGINE_DISCOVERY_MAX_SERVERS];
+	struct sockaddr_storage bcast;
+	net_socklen_t bcast_len;
+	char ip[COMM_ADDR_LEN];
+	struct zsock_timeval tv = { .tv_sec = 0, .tv_usec = DISCOVERY_POLL_MS * 1000 };
+	char msg[DISCOVERY_MSG_MAX];
+	char reply[DISCOVERY_MSG_MAX];
+	uint32_t nonce = k_cycle_get_32() ^ (uint32_t)k_uptime_get();
+	int count = 0;
+	int one = 1;
+	int best = -1;
+	int fd;
+
+	/* Native_sim has no interface of its own (-ENODEV), the host has IPv4 */
+	bool ipv6 = IS_ENABLED(CONFIG_NET_IPV6) &&
+		    wifi_iface_get_ipv4(ctx->iface, ip, sizeof(ip)) == -EADDRNOTAVAIL;
+
+	comm_addr_parse(ipv6 ? "ff02::1" : "255.255.255.255", CONFIG_COMM_ENGINE_DISCOVERY_PORT,
+			&bcast, &bcast_len);
+	fd = zsock_socket(bcast.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+	if (fd < 0) {
+		int err = errno;
+
+		LOG_ERR("Could not create discovery socket (errno=%d)", err);
+		return -err;
+	}
+	comm_bind_socket(ctx, fd);
+	zsock_setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+	zsock_setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	int len = snprintf(msg, sizeof(msg), "DISCOVER %s %u", ctx->cfg->service, nonce);
+	int64_t end = k_uptime_get() + CONFIG_COMM_ENGINE_DISCOVERY_TIMEOUT_MS;
+	int64_t resend = 0;
+
+	/* Broadcasts are not acknowledged, so repeat the query a few times */
+	while (k_uptime_get() < end) {
+		if (k_uptime_get() >= resend) {
+			zsock_sendto(fd, msg, len, 0, (struct sockaddr *)&bcast, bcast_len);
+			resend = k_uptime_get() + CONFIG_COMM_ENGINE_DISCOVERY_TIMEOUT_MS / 3;
+		}
+
+		struct sockaddr_storage from;
+		net_socklen_t from_len = sizeof(from);
+		int n = zsock_recvfrom(fd, reply, sizeof(reply) - 1, 0,
+				       (struct sockaddr *)&from, &from_len);
+		if (n > 0) {
+			reply[n] = '\0';
+			count = add_candidate(found, count, &from, from_len, reply, ctx->cfg->service,
+					      nonce);
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		found[i].best_rtt_us = probe_rtt(fd, &found[i], nonce);
+		comm_addr_to_string(&found[i].addr, ip, sizeof(ip));
+		LOG_INF("[Discovery] %s:%u RTT %u us", ip, found[i].port, found[i].best_rtt_us);
+		if (found[i].best_rtt_us != UINT32_MAX &&
+		    (best < 0 || found[i].best_rtt_us < found[best].best_rtt_us)) {
+			best = i;
+		}
+	}
+	zsock_close(fd);
+
+	if (best < 0) {
+		LOG_WRN("[Discovery] No %s server answered", ctx->cfg->service);
+		return -ENOENT;
+	}
+
+	comm_addr_to_string(&found[best].addr, ctx->peer_ip, sizeof(ctx->peer_ip));
+	ctx->peer_port = found[best].port;
+	ctx->discovered_ms = k_uptime_get();
+	LOG_INF("[Discovery] Using %s:%u of %d servers", ctx->peer_ip, ctx->peer_port, count);
+	return 0;
+}
@@ -0,0 +1,626 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/net/socket.h>
+
+#include "wifi_utilities.h"
+#include "comm_engine.h"
+
+#include <zephyr/logging/log.h>
+
+#define LED0_NODE DT_ALIAS(led0)
+#define LED1_NODE DT_ALIAS(led1)
+#define LED2_NODE DT_ALIAS(led2)
+
+static const struct gpio_dt_spec led_red = GPIO_DT_SPEC_GET(LED0_NODE, gpios);
+static const struct gpio_dt_spec led_green = GPIO_DT_SPEC_GET(LED1_NODE, gpios);
+static const struct gpio_dt_spec led_blue = GPIO_DT_SPEC_GET(LED2_NODE, gpios);
+
+#define LED_TURN_OFF() do { gpio_pin_set_dt(&led_red, 0); gpio_pin_set_dt(&led_green, 0); gpio_pin_set_dt(&led_blue, 0); } while(0)
+#define LED_TURN_RED() do { gpio_pin_set_dt(&led_red, 1); gpio_pin_set_dt(&led_green, 0); gpio_pin_set_dt(&led_blue, 0); } while(0)
+#define LED_TURN_GREEN() do { gpio_pin_set_dt(&led_red, 0); gpio_pin_set_dt(&led_green, 1); gpio_pin_set_dt(&led_blue, 0); } while(0)
+#define LED_TURN_BLUE() do { gpio_pin_set_dt(&led_red, 0); gpio_pin_set_dt(&led_green, 0); gpio_pin_set_dt(&led_blue, 1); } while(0)
+#define LED_TURN_YELLOW() do { gpio_pin_set_dt(&led_red, 1); gpio_pin_set_dt(&led_green, 1); gpio_pin_set_dt(&led_blue, 0); } while(0)
+
+LOG_MODULE_REGISTER(comm_engine, LOG_LEVEL_DBG);
+
+/* How often an open link checks whether it should change interface */
+#define IFACE_CHECK_MS 1000
+
+/* Failed connects to a discovered server before looking for another one */
+#define REDISCOVER_AFTER 2
+#define DISCOVERY_RETRY_MS 1000
+
+struct comm_state_desc {
+	const char *name;
+	void (*entry)(struct comm_context *ctx);
+	communication_state_t (*run)(struct comm_context *ctx);
+	void (*exit)(struct comm_context *ctx);
+	int32_t timeout_ms;                 /* 0 = none */
+	communication_state_t on_timeout;
+};
+
+static void log_stats(const struct comm_context *ctx);
+
+/* ---- entry / exit hooks ---- */
+
+static void entry_wifi_connecting(struct comm_context *ctx)
+{
+	ARG_UNUSED(ctx);
+	LED_TURN_RED();
+}
+
+static void entry_waiting_for_ip(struct comm_context *ctx)
+{
+	ARG_UNUSED(ctx);
+	LED_TURN_BLUE();
+}
+
+static void entry_discovering(struct comm_context *ctx)
+{
+	ARG_UNUSED(ctx);
+	LED_TURN_BLUE();
+}
+
+static void entry_establishing_link(struct comm_context *ctx)
+{
+	ARG_UNUSED(ctx);
+	LED_TURN_GREEN();
+}
+
+static void entry_exchanging(struct comm_context *ctx)
+{
+	struct zsock_timeval tv = {
+		.tv_sec = CONFIG_COMM_ENGINE_RECV_TIMEOUT_MS / 1000,
+		.tv_usec = (CONFIG_COMM_ENGINE_RECV_TIMEOUT_MS % 1000) * 1000,
+	};
+
+	/* Never block forever, so the state timeout can be checked */
+	if (zsock_setsockopt(ctx->sock_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+		LOG_WRN("Could not set receive timeout (errno=%d)", errno);
+	}
+
+	/* Datagram servers have no link that could go stale */
+	if (ctx->cfg->transport->datagram) {
+		ctx->deadline_ms = 0;
+	}
+
+	ctx->retries = 0;
+	if (ctx->cfg->link_up != NULL) {
+		ctx->cfg->link_up(ctx);
+	}
+	LED_TURN_YELLOW();
+}
+
+static void exit_exchanging(struct comm_context *ctx)
+{
+	LOG_INF("[Comm] Link up for %u ms", (uint32_t)(k_uptime_get() - ctx->entered_ms));
+}
+
+static void entry_reconnecting(struct comm_context *ctx)
+{
+	ctx->cfg->transport->close(ctx);
+#ifdef CONFIG_COMM_ENGINE_PRIORITY
+	/* Replies for the old link, mostly stale by the time it is back */
+	comm_prio_discard(ctx);
+#endif
+	ctx->stats.reconnects++;
+	comm_perf_reconnect();
+	LED_TURN_GREEN();
+}
+
+/* ---- interface selection ---- */
+
+/* The configured interface while it is usable, otherwise another ready
+ * one. Returns true when the link has to move. */
+static bool iface_should_change(struct comm_context *ctx, wifi_iface_role_t *role)
+{
+	return wifi_iface_select(ctx->cfg->iface, role) == 0 && *role != ctx->iface;
+}
+
+static void select_iface(struct comm_context *ctx)
+{
+	wifi_iface_role_t role;
+
+	if (iface_should_change(ctx, &role)) {
+		LOG_WRN("[Comm] Moving link from %s to %s interface",
+			wifi_iface_role_to_string(ctx->iface), wifi_iface_role_to_string(role));
+		ctx->iface = role;
+		/* A listening socket is still bound to the old interface */
+		if (ctx->cfg->transport->release != NULL) {
+			ctx->cfg->transport->release(ctx);
+		}
+	}
+	/* Nothing ready (or no interfaces at all): keep the address we have */
+	wifi_iface_get_addr(ctx->iface, ctx->ip_addr, sizeof(ctx->ip_addr));
+}
+
+void comm_bind_socket(struct comm_context *ctx, int fd)
+{
+	int ret = wifi_iface_bind_socket(fd, ctx->iface);
+
+	if (ret < 0 && ret != -ENODEV) {
+		LOG_WRN("[Comm] Socket not bound to the %s interface (%d)",
+			wifi_iface_role_to_string(ctx->iface), ret);
+	}
+}
+
+/* Discover first when the server is found by name and the last result expired */
+static communication_state_t link_state(struct comm_context *ctx)
+{
+#ifdef CONFIG_COMM_ENGINE_DISCOVERY
+	if (ctx->cfg->service != NULL &&
+	    (ctx->discovered_ms == 0 ||
+	     k_uptime_get() - ctx->discovered_ms > CONFIG_COMM_ENGINE_DISCOVERY_CACHE_TTL_MS)) {
+		return COMM_DISCOVERING;
+	}
+#endif
+	return COMM_ESTABLISHING_LINK;
+}
+
+/* ---- run handlers ---- */
+
+static communication_state_t state_wifi_connecting(struct comm_context *ctx)
+{
+	if (my_wifi_init() != 0) {
+		LOG_ERR("Failed to initialize WiFi module");
+		return COMM_FAILURE;
+	}
+
+	LOG_INF("Connecting to WiFi...");
+
+	if (wifi_connect((char *)ctx->cfg->ssid, (char *)ctx->cfg->psk)) {
+		LOG_ERR("Failed to connect to WiFi");
+		if (wifi_iface_ready(WIFI_IFACE_SECONDARY)) {
+			select_iface(ctx);
+			return link_state(ctx);
+		}
+		return COMM_FAILURE;
+	}
+
+	ctx->wifi_connected = true;
+	return COMM_WAITING_FOR_IP;
+}
+
+static communication_state_t state_waiting_for_ip(struct comm_context *ctx)
+{
+	/* With a second interface, do not wait forever on a WiFi without DHCP */
+#if defined(CONFIG_COMM_ENGINE_IFACE_FAILOVER_MS)
+	int ret = wifi_wait_for_ip_addr_timeout(ctx->ip_addr, CONFIG_COMM_ENGINE_IFACE_FAILOVER_MS);
+#else
+	int ret = wifi_wait_for_ip_addr_timeout(ctx->ip_addr, -1);
+#endif
+
+	if (ret == -ETIMEDOUT) {
+		if (!wifi_iface_ready(WIFI_IFACE_SECONDARY)) {
+			return COMM_WAITING_FOR_IP;
+		}
+		LOG_WRN("No address on WiFi yet, starting on the secondary interface");
+	} else if (ret != 0) {
+		LOG_ERR("Failed while waiting for IPv4 address");
+		return COMM_FAILURE;
+	}
+
+	select_iface(ctx);
+	return link_state(ctx);
+}
+
+static communication_state_t state_discovering(struct comm_context *ctx)
+{
+	if (comm_discover(ctx) == 0) {
+		return COMM_ESTABLISHING_LINK;
+	}
+	if (ctx->cfg->peer_ip != NULL) {
+		LOG_WRN("Falling back to the configured server %s:%u", ctx->cfg->peer_ip, ctx->cfg->port);
+		strncpy(ctx->peer_ip, ctx->cfg->peer_ip, sizeof(ctx->peer_ip) - 1);
+		ctx->peer_port = ctx->cfg->port;
+		return COMM_ESTABLISHING_LINK;
+	}
+	k_sleep(K_MSEC(DISCOVERY_RETRY_MS));
+	return COMM_DISCOVERING;
+}
+
+static communication_state_t state_establishing_link(struct comm_context *ctx)
+{
+	if (ctx->cfg->transport->open(ctx) < 0) {
+		return ctx->cfg->reconnect ? COMM_RECONNECTING : COMM_FAILURE;
+	}
+	return COMM_EXCHANGING;
+}
+
+static communication_state_t state_exchanging(struct comm_context *ctx)
+{
+	wifi_iface_role_t role;
+	int64_t now = k_uptime_get();
+
+	/* Leave an interface that went down, and return to the preferred one */
+	if (now - ctx->iface_check_ms >= IFACE_CHECK_MS) {
+		ctx->iface_check_ms = now;
+		if (ctx->cfg->reconnect && iface_should_change(ctx, &role)) {
+			return COMM_RECONNECTING;
+		}
+	}
+
+	int ret = ctx->cfg->step(ctx);
+
+#ifdef CONFIG_COMM_ENGINE_PRIORITY
+	/* Whatever the step queued, a bounded amount per step so the next
+	 * step can queue a reply ahead of the rest */
+	if (ret >= 0) {
+		int err = comm_prio_flush(ctx, CONFIG_COMM_ENGINE_PRIO_BUDGET);
+
+		if (err < 0) {
+			ret = err;
+		}
+	}
+#endif
+	if (ret == COMM_STEP_AGAIN) {
+		return COMM_EXCHANGING;
+	}
+	if (ret == COMM_STEP_DONE) {
+		return COMM_CLEANUP;
+	}
+	return ctx->cfg->reconnect ? COMM_RECONNECTING : COMM_FAILURE;
+}
+
+static communication_state_t state_reconnecting(struct comm_context *ctx)
+{
+	if (CONFIG_COMM_ENGINE_MAX_RETRIES > 0 && ctx->retries >= CONFIG_COMM_ENGINE_MAX_RETRIES) {
+		LOG_ERR("Giving up after %u reconnect attempts", ctx->retries);
+		return COMM_FAILURE;
+	}
+
+	/* First attempt right away, then back off exponentially */
+	if (ctx->retries > 0) {
+		uint32_t shift = MIN(ctx->retries - 1, 16U);
+		uint32_t delay_ms = MIN((uint32_t)CONFIG_COMM_ENGINE_BACKOFF_MIN_MS << shift,
+					(uint32_t)CONFIG_COMM_ENGINE_BACKOFF_MAX_MS);
+
+		LOG_INF("Reconnecting in %u ms (attempt %u)", delay_ms, ctx->retries + 1);
+		k_sleep(K_MSEC(delay_ms));
+	}
+	ctx->retries++;
+
+	/* WiFi lost its AP, e.g. a roam that found no way back, and nothing
+	 * else can carry the link */
+	if (ctx->wifi_connected && !wifi_is_connected() &&
+	    !wifi_iface_ready(WIFI_IFACE_SECONDARY)) {
+		LOG_WRN("[Comm] WiFi disconnected, connecting again");
+		ctx->wifi_connected = false;
+		return COMM_WIFI_CONNECTING;
+	}
+	select_iface(ctx);
+
+	/* The server may have moved, a stale address costs a connect timeout each time */
+	if (ctx->cfg->service != NULL && ctx->retries > REDISCOVER_AFTER) {
+		ctx->discovered_ms = 0;
+	}
+	return link_state(ctx);
+}
+
+static communication_state_t state_failure(struct comm_context *ctx)
+{
+	LOG_ERR("[Failure] Called from: %s", comm_state_to_string(ctx->failure_from_state));
+	LOG_ERR("[Failure] Context: sock_fd=%d socket_open=%d wifi_connected=%d exit_code=%d",
+			ctx->sock_fd,
+			ctx->socket_open,
+			ctx->wifi_connected,
+			ctx->exit_code);
+	log_stats(ctx);
+
+	ctx->exit_code = -1;
+	while (1) {
+		LED_TURN_RED();
+		k_sleep(K_SECONDS(1));
+		LED_TURN_OFF();
+		k_sleep(K_SECONDS(1));
+	}
+	return COMM_CLEANUP;
+}
+
+static communication_state_t state_cleanup(struct comm_context *ctx)
+{
+#ifdef CONFIG_COMM_ENGINE_PRIORITY
+	/* Queued messages still go out over a link that ends on purpose */
+	comm_prio_flush(ctx, SIZE_MAX);
+	comm_prio_discard(ctx);
+#endif
+	ctx->cfg->transport->close(ctx);
+	if (ctx->cfg->transport->release != NULL) {
+		ctx->cfg->transport->release(ctx);
+	}
+
+	if (ctx->wifi_connected) {
+		wifi_disconnect();
+		ctx->wifi_connected = false;
+	}
+
+	log_stats(ctx);
+	return COMM_DONE;
+}
+
+static communication_state_t state_done(struct comm_context *ctx)
+{
+	ARG_UNUSED(ctx);
+	return COMM_DONE;
+}
+
+static const struct comm_state_desc comm_states[COMM_STATE_COUNT] = {
+	[COMM_WIFI_CONNECTING] = {
+		.name = "COMM_WIFI_CONNECTING",
+		.entry = entry_wifi_connecting,
+		.run = state_wifi_connecting,
+	},
+	[COMM_WAITING_FOR_IP] = {
+		.name = "COMM_WAITING_FOR_IP",
+		.entry = entry_waiting_for_ip,
+		.run = state_waiting_for_ip,
+	},
+	[COMM_DISCOVERING] = {
+		.name = "COMM_DISCOVERING",
+		.entry = entry_discovering,
+		.run = state_discovering,
+	},
+	[COMM_ESTABLISHING_LINK] = {
+		.name = "COMM_ESTABLISHING_LINK",
+		.entry = entry_establishing_link,
+		.run = state_establishing_link,
+	},
+	[COMM_EXCHANGING] = {
+		.name = "COMM_EXCHANGING",
+		.entry = entry_exchanging,
+		.run = state_exchanging,
+		.exit = exit_exchanging,
+		.timeout_ms = CONFIG_COMM_ENGINE_IDLE_TIMEOUT_MS,
+		.on_timeout = COMM_RECONNECTING,
+	},
+	[COMM_RECONNECTING] = {
+		.name = "COMM_RECONNECTING",
+		.entry = entry_reconnecting,
+		.run = state_reconnecting,
+	},
+	[COMM_FAILURE] = {
+		.name = "COMM_FAILURE",
+		.run = state_failure,
+	},
+	[COMM_CLEANUP] = {
+		.name = "COMM_CLEANUP",
+		.run = state_cleanup,
+	},
+	[COMM_DONE] = {
+		.name = "COMM_DONE",
+		.run = state_done,
+	},
+};
+
+const char *comm_state_to_string(communication_state_t state)
+{
+	if (state >= COMM_STATE_COUNT) {
+		return "COMM_UNKNOWN";
+	}
+	return comm_states[state].name;
+}
+
+static void log_stats(const struct comm_context *ctx)
+{
+	LOG_INF("[Comm] %u transitions, %u reconnects, tx %u msgs / %llu bytes, rx %u msgs / %llu bytes",
+		ctx->stats.transitions, ctx->stats.reconnects,
+		ctx->stats.tx_msgs, (unsigned long long)ctx->stats.tx_bytes,
+		ctx->stats.rx_msgs, (unsigned long long)ctx->stats.rx_bytes);
+	if (ctx->stats.tx_msgs > 0) {
+		LOG_INF("[Comm] %u us per send", (uint32_t)(ctx->stats.tx_time_us / ctx->stats.tx_msgs));
+	}
+	if (ctx->stats.codec_frames > 0) {
+		const struct comm_stats *st = &ctx->stats;
+
+		/* Bytes kept off the air against the CPU time it cost */
+		LOG_INF("[Comm] Codec: %u frames, %llu -> %llu bytes (%u%%), avg %u us, max %u us per frame",
+			st->codec_frames, (unsigned long long)st->codec_in_bytes,
+			(unsigned long long)st->codec_out_bytes,
+			(uint32_t)(st->codec_out_bytes * 100 / MAX(st->codec_in_bytes, 1)),
+			(uint32_t)(st->codec_time_us / st->codec_frames), st->codec_time_max_us);
+	}
+	if (ctx->stats.telemetry_batches > 0) {
+		LOG_INF("[Comm] Telemetry: %u batches, %llu samples", ctx->stats.telemetry_batches,
+			(unsigned long long)ctx->stats.telemetry_samples);
+	}
+#ifdef CONFIG_COMM_ENGINE_PRIORITY
+	for (int i = 0; i < COMM_PRIO_COUNT; i++) {
+		const struct comm_stats *st = &ctx->stats;
+
+		if (st->prio_msgs[i] == 0 && st->prio_drops[i] == 0) {
+			continue;
+		}
+		/* Time from comm_send_prio() until the message reached the socket */
+		LOG_INF("[Comm] Class %s: %u msgs, %u dropped, queued avg %u us, max %u us",
+			comm_prio_to_string((comm_prio_t)i), st->prio_msgs[i], st->prio_drops[i],
+			(uint32_t)(st->prio_wait_us[i] / MAX(st->prio_msgs[i], 1)), st->prio_wait_max_us[i]);
+	}
+#endif
+	if (ctx->stats.bulk_rx_bytes + ctx->stats.bulk_tx_bytes > 0) {
+		LOG_INF("[Comm] Bulk: %u transfers, rx %llu bytes, tx %llu bytes, %u retransmits, %u CRC errors",
+			ctx->stats.bulk_transfers, (unsigned long long)ctx->stats.bulk_rx_bytes,
+			(unsigned long long)ctx->stats.bulk_tx_bytes, ctx->stats.bulk_retransmits,
+			ctx->stats.bulk_crc_errors);
+	}
+	if (ctx->stats.handshakes > 0) {
+		LOG_INF("[Comm] %u link setups, avg %u ms, max %u ms",
+			ctx->stats.handshakes, ctx->stats.handshake_ms_total / ctx->stats.handshakes,
+			ctx->stats.handshake_ms_max);
+	}
+	for (int i = 0; i < COMM_STATE_COUNT; i++) {
+		if (ctx->stats.time_in_state_ms[i] != 0) {
+			LOG_INF("[Comm]   %-24s %u ms", comm_states[i].name, ctx->stats.time_in_state_ms[i]);
+		}
+	}
+}
+
+static void arm_timeout(struct comm_context *ctx, const struct comm_state_desc *desc)
+{
+	ctx->deadline_ms = desc->timeout_ms > 0 ? k_uptime_get() + desc->timeout_ms : 0;
+}
+
+static void enter_state(struct comm_context *ctx, communication_state_t state)
+{
+	const struct comm_state_desc *desc = &comm_states[state];
+
+	ctx->entered_ms = k_uptime_get();
+	arm_timeout(ctx, desc);
+	if (desc->entry != NULL) {
+		desc->entry(ctx);
+	}
+}
+
+static void transition(struct comm_context *ctx, communication_state_t from, communication_state_t to)
+{
+	const struct comm_state_desc *desc = &comm_states[from];
+	int64_t spent = k_uptime_get() - ctx->entered_ms;
+
+	if (desc->exit != NULL) {
+		desc->exit(ctx);
+	}
+	if (to == COMM_FAILURE || to == COMM_RECONNECTING) {
+		ctx->failure_from_state = from;
+	}
+
+	ctx->stats.time_in_state_ms[from] += (uint32_t)spent;
+	ctx->stats.transitions++;
+	LOG_DBG("[Comm] %s -> %s after %u ms", desc->name, comm_states[to].name, (uint32_t)spent);
+
+	enter_state(ctx, to);
+}
+
+void comm_record_handshake(struct comm_context *ctx, uint32_t ms)
+{
+	struct comm_stats *st = &ctx->stats;
+
+	st->handshakes++;
+	st->handshake_ms_last = ms;
+	st->handshake_ms_max = MAX(st->handshake_ms_max, ms);
+	st->handshake_ms_total += ms;
+	LOG_INF("[Comm] Link set up in %u ms (avg %u ms over %u)",
+		ms, st->handshake_ms_total / st->handshakes, st->handshakes);
+}
+
+int comm_send(struct comm_context *ctx, const void *buf, size_t len)
+{
+	LED_TURN_GREEN();
+	uint32_t start = k_cycle_get_32();
+	int ret = ctx->cfg->transport->send(ctx, buf, len);
+
+	/* With TLS this is where every record is encrypted */
+	uint32_t us = (uint32_t)k_cyc_to_us_floor64(k_cycle_get_32() - start);
+
+	ctx->stats.tx_time_us += us;
+	LED_TURN_YELLOW();
+	if (ret < 0) {
+		LOG_ERR("send failed (errno=%d)", -ret);
+		comm_perf_error(ret);
+		return ret;
+	}
+
+	ctx->stats.tx_msgs++;
+	ctx->stats.tx_bytes += (uint32_t)ret;
+	comm_perf_sent((size_t)ret, us);
+	return ret;
+}
+
+int comm_recv(struct comm_context *ctx, void *buf, size_t len)
+{
+#ifdef CONFIG_COMM_ENGINE_PRIORITY
+	/* Do not sit in the receive timeout while messages wait to be sent */
+	if (comm_prio_pending(ctx)) {
+		struct zsock_pollfd pfd = { .fd = ctx->sock_fd, .events = ZSOCK_POLLIN };
+
+		if (zsock_poll(&pfd, 1, 0) == 0) {
+			return -EAGAIN;
+		}
+	}
+#endif
+	LED_TURN_GREEN();
+	int ret = ctx->cfg->transport->recv(ctx, buf, len);
+	LED_TURN_YELLOW();
+	if (ret == -EAGAIN) {
+		return ret;
+	}
+	if (ret == 0) {
+		LOG_WRN("[Comm] Peer closed the connection");
+		comm_perf_error(-ENOTCONN);
+		return -ENOTCONN;
+	}
+	if (ret < 0) {
+		LOG_ERR("recv failed (errno=%d)", -ret);
+		comm_perf_error(ret);
+		return ret;
+	}
+
+	ctx->stats.rx_msgs++;
+	ctx->stats.rx_bytes += (uint32_t)ret;
+	comm_perf_received((size_t)ret);
+
+	/* Traffic keeps a connected link alive */
+	if (ctx->deadline_ms != 0) {
+		arm_timeout(ctx, &comm_states[COMM_EXCHANGING]);
+	}
+	return ret;
+}
+
+int comm_engine_run(const struct comm_config *cfg, void *user_data)
+{
+	communication_state_t state = COMM_WIFI_CONNECTING;
+
+	communication_context_t ctx = {
+		.cfg = cfg,
+		.user_data = user_data,
+		.sock_fd = -1,
+		.listen_fd = -1,
+		.wifi_connected = false,
+		.socket_open = false,
+		.exit_code = 0,
+		.failure_from_state = COMM_FAILURE,
+		.iface = cfg->iface,
+		.peer_port = cfg->port,
+	};
+
+	if (cfg->peer_ip != NULL) {
+		strncpy(ctx.peer_ip, cfg->peer_ip, sizeof(ctx.peer_ip) - 1);
+	}
+#ifdef CONFIG_COMM_ENGINE_PRIORITY
+	comm_prio_init(&ctx);
+#endif
+
+	int ret = gpio_pin_configure_dt(&led_red, GPIO_OUTPUT_INACTIVE);
+	ret |= gpio_pin_configure_dt(&led_green, GPIO_OUTPUT_INACTIVE);
+	ret |= gpio_pin_configure_dt(&led_blue, GPIO_OUTPUT_INACTIVE);
+	if (ret < 0) {
+		state = COMM_FAILURE;
+	}
+	LED_TURN_OFF();
+
+	LOG_INF("%s (%s)", cfg->name, cfg->transport->name);
+
+	enter_state(&ctx, state);
+	while (state != COMM_DONE) {
+		communication_state_t next = comm_states[state].run(&ctx);
+
+		if (next == state) {
+			if (ctx.deadline_ms == 0 || k_uptime_get() < ctx.deadline_ms) {
+				continue;
+			}
+			LOG_WRN("[Comm] %s timed out", comm_states[state].name);
+			next = comm_states[state].on_timeout;
+		}
+		if (next >= COMM_STATE_COUNT) {
+			ctx.failure_from_state = state;
+			next = COMM_FAILURE;
+		}
+
+		transition(&ctx, state, next);
+		state = next;
+	}
+	LED_TURN_OFF();
+
+	return ctx.exit_code;
+}
@@ -0,0 +1,471 @@
+#ifndef COMM_ENGINE_H
+#define COMM_ENGINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/net/socket.h>
+#include <zephyr/sys/slist.h>
+
+#include "wifi_utilities.h"
+
+/*
+ * Table-driven communication state machine shared by the socket demos.
+ *
+ * The engine brings up WiFi, waits for an address, opens a link through a
+ * transport plug-in and then calls the application's step function until
+ * it is done. Every state is described by one entry of a constant table
+ * (entry/exit hooks, run handler, timeout), so the demos only contain what
+ * is specific to them.
+ *
+ * A client can find its server with a broadcast query instead of a fixed
+ * address (CONFIG_COMM_ENGINE_DISCOVERY, see comm_discovery.c). The
+ * result is cached and only refreshed when it expires or the server
+ * stops accepting connections.
+ *
+ * When a link drops the engine closes it and re-opens it right away,
+ * keeping WiFi and the IP address. Further failed attempts back off
+ * exponentially (see the COMM_ENGINE_BACKOFF_* options).
+ *
+ * Payloads can be compressed on the way to the transport
+ * (CONFIG_COMM_ENGINE_COMPRESS, see comm_codec.c), with an LZ4-style
+ * codec for text and a delta codec for numeric samples.
+ *
+ * High-rate samples can be batched into column-major telemetry frames
+ * (CONFIG_COMM_ENGINE_TELEMETRY, see comm_telemetry.c) instead of being
+ * sent one message per sample.
+ *
+ * Messages can be sent in one of four priority classes, the WMM access
+ * categories (CONFIG_COMM_ENGINE_PRIORITY, see comm_prio.c). Every class
+ * has its own queue, drained between two steps by a strict or weighted
+ * scheduler, and is tagged with a DSCP value so the radio transmits it in
+ * the matching access category.
+ *
+ * Blobs larger than a message (logs, sensor dumps, configuration) are
+ * moved in chunks with a sliding window (CONFIG_COMM_ENGINE_BULK, see
+ * comm_bulk.c), resuming where an interrupted transfer stopped.
+ *
+ * Sockets are bound to one interface. A link uses the configured
+ * interface while it is usable and moves to the other one (see
+ * CONFIG_WIFI_UTILITIES_SECONDARY_IFACE) when it is not, and back again
+ * once it recovers.
+ *
+ * Addresses are kept family-agnostic (see comm_addr.c). With IPv6 the
+ * servers listen on one dual-stack socket, so a link can start on the
+ * IPv6 link-local address (CONFIG_WIFI_UTILITIES_FIRST_ADDR) and keep
+ * working for IPv4 clients once DHCPv4 is done.
+ */
+
+typedef enum {
+	COMM_WIFI_CONNECTING,
+	COMM_WAITING_FOR_IP,
+	COMM_DISCOVERING,
+	COMM_ESTABLISHING_LINK,
+	COMM_EXCHANGING,
+	COMM_RECONNECTING,
+	COMM_FAILURE,
+	COMM_CLEANUP,
+	COMM_DONE,
+	COMM_STATE_COUNT,
+} communication_state_t;
+
+/* Return values of a step function, negative values mean the link is lost */
+#define COMM_STEP_AGAIN 0
+#define COMM_STEP_DONE  1
+
+struct comm_context;
+
+/* Priority classes, numbered like the WMM access categories (ACI) */
+typedef enum {
+	COMM_PRIO_BE,                   /* best effort, the default */
+	COMM_PRIO_BK,                   /* background: bulk data */
+	COMM_PRIO_VI,                   /* video: streams with a deadline */
+	COMM_PRIO_VO,                   /* voice: control, latency critical */
+	COMM_PRIO_COUNT,
+} comm_prio_t;
+
+/* Socket plug-in, all functions return 0 / byte counts or -errno */
+struct comm_transport {
+	const char *name;
+	bool datagram;              /* no connection that could go stale */
+	int (*open)(struct comm_context *ctx);
+	int (*send)(struct comm_context *ctx, const void *buf, size_t len);
+	int (*recv)(struct comm_context *ctx, void *buf, size_t len);
+	void (*close)(struct comm_context *ctx);
+	void (*release)(struct comm_context *ctx);  /* optional, at cleanup */
+};
+
+/* With CONFIG_COMM_ENGINE_TLS the stream transports run TLS 1.2 and the
+ * datagram transport DTLS 1.2, on the same ports */
+#ifdef CONFIG_COMM_ENGINE_TLS
+#define COMM_PROTO_STREAM IPPROTO_TLS_1_2
+#define COMM_PROTO_DGRAM  IPPROTO_DTLS_1_2
+#else
+#define COMM_PROTO_STREAM IPPROTO_TCP
+#define COMM_PROTO_DGRAM  IPPROTO_UDP
+#endif
+
+/* Addresses of either family as text, e.g. "192.168.1.10" or "fe80::1" */
+#define COMM_ADDR_LEN NET_IPV6_ADDR_LEN
+
+/* Family of server sockets: IPv6 accepting IPv4 too where the stack maps
+ * IPv4 onto IPv6 sockets, otherwise the one family there is */
+#if defined(CONFIG_NET_IPV6) && (defined(CONFIG_NET_IPV4_MAPPING_TO_IPV6) || !defined(CONFIG_NET_IPV4))
+#define COMM_AF_SERVER AF_INET6
+#else
+#define COMM_AF_SERVER AF_INET
+#endif
+
+#ifdef CONFIG_COMM_ENGINE_TCP_CLIENT
+extern const struct comm_transport comm_transport_tcp_client;
+#endif
+#ifdef CONFIG_COMM_ENGINE_TCP_SERVER
+extern const struct comm_transport comm_transport_tcp_server;
+#endif
+#ifdef CONFIG_COMM_ENGINE_UDP
+extern const struct comm_transport comm_transport_udp;
+#endif
+
+struct comm_config {
+	const char *name;                       /* printed when the engine starts */
+	const char *ssid;
+	const char *psk;
+	const struct comm_transport *transport;
+	const char *peer_ip;                    /* TCP client only, fallback when discovery finds nothing */
+	const char *service;                    /* discover the server by this name, NULL = use peer_ip */
+	uint16_t port;
+	bool reconnect;                         /* re-open dropped links instead of failing */
+	wifi_iface_role_t iface;                /* preferred interface, WiFi by default */
+
+	/* One unit of work: COMM_STEP_AGAIN, COMM_STEP_DONE or -errno */
+	int (*step)(struct comm_context *ctx);
+	/* Optional, called every time a link has been (re-)opened */
+	void (*link_up)(struct comm_context *ctx);
+};
+
+struct comm_stats {
+	uint32_t transitions;
+	uint32_t reconnects;
+	uint32_t tx_msgs;
+	uint32_t rx_msgs;
+	uint64_t tx_bytes;
+	uint64_t rx_bytes;
+	uint64_t tx_time_us;                    /* inside transport send, i.e. per-record cost */
+	uint32_t handshakes;                    /* link setups timed by the transport */
+	uint32_t handshake_ms_last;
+	uint32_t handshake_ms_max;
+	uint32_t handshake_ms_total;
+	uint32_t codec_frames;                  /* frames through the compression stage */
+	uint64_t codec_in_bytes;                /* before encoding */
+	uint64_t codec_out_bytes;               /* on the wire, headers included */
+	uint64_t codec_time_us;
+	uint32_t codec_time_max_us;
+	uint32_t telemetry_batches;
+	uint64_t telemetry_samples;
+	uint32_t prio_msgs[COMM_PRIO_COUNT];     /* sent from the class queues */
+	uint32_t prio_drops[COMM_PRIO_COUNT];    /* queue full or link lost */
+	uint64_t prio_wait_us[COMM_PRIO_COUNT];  /* total time spent queued */
+	uint32_t prio_wait_max_us[COMM_PRIO_COUNT];
+	uint32_t bulk_transfers;                /* completed in either direction */
+	uint64_t bulk_rx_bytes;
+	uint64_t bulk_tx_bytes;                 /* retransmissions included */
+	uint32_t bulk_retransmits;
+	uint32_t bulk_crc_errors;
+	uint32_t time_in_state_ms[COMM_STATE_COUNT];
+};
+
+/* Class queues of one engine, see comm_prio.c */
+struct comm_prio_queues {
+	sys_slist_t queue[COMM_PRIO_COUNT];
+	uint32_t bytes[COMM_PRIO_COUNT];
+	int32_t deficit[COMM_PRIO_COUNT];       /* weighted scheduler only */
+	uint8_t turn;                           /* class the weighted scheduler serves */
+	bool granted;                           /* turn already got its quantum */
+	int8_t tagged;                          /* class the socket is tagged with, -1 = none */
+};
+
+typedef struct comm_context {
+	const struct comm_config *cfg;
+	void *user_data;
+	struct sockaddr_storage peer_addr;
+	net_socklen_t peer_addr_len;
+	char buffer[CONFIG_COMM_ENGINE_BUFFER_SIZE];
+	char ip_addr[COMM_ADDR_LEN];
+	char peer_ip[COMM_ADDR_LEN];            /* server in use, configured or discovered */
+	uint16_t peer_port;
+	int64_t discovered_ms;                  /* 0 = nothing discovered yet */
+	int sock_fd;
+	int listen_fd;
+	bool wifi_connected;
+	bool socket_open;
+	int exit_code;
+	wifi_iface_role_t iface;                /* interface of the current link */
+	int64_t iface_check_ms;
+	uint32_t retries;                       /* failed opens since the last link */
+	int64_t deadline_ms;                    /* 0 = current state has no timeout */
+	int64_t entered_ms;
+	communication_state_t failure_from_state;
+#ifdef CONFIG_COMM_ENGINE_PRIORITY
+	struct comm_prio_queues prio;
+#endif
+	struct comm_stats stats;
+} communication_context_t;
+
+/* Runs the state machine to completion, returns the exit code */
+int comm_engine_run(const struct comm_config *cfg, void *user_data);
+
+/* Send/receive on the current link, with LED activity and statistics.
+ * comm_recv() returns -EAGAIN when nothing arrived within the receive
+ * timeout and -ENOTCONN when the peer closed the connection. */
+int comm_send(struct comm_context *ctx, const void *buf, size_t len);
+int comm_recv(struct comm_context *ctx, void *buf, size_t len);
+
+/* For transports: pin a new socket to the interface of the link. Without
+ * such an interface (e.g. offloaded host sockets) routing decides. */
+void comm_bind_socket(struct comm_context *ctx, int fd);
+
+/* For transports: a socket of COMM_AF_SERVER, dual-stack when it is IPv6.
+ * Returns the descriptor or -errno. */
+int comm_socket_server(int type, int proto);
+
+/* For transports: the wildcard address of COMM_AF_SERVER */
+net_socklen_t comm_addr_any(uint16_t port, struct sockaddr_storage *addr);
+
+/* Parse an address of either family, -EINVAL when it is neither */
+int comm_addr_parse(const char *ip, uint16_t port, struct sockaddr_storage *addr,
+		    net_socklen_t *len);
+
+/* Address without the port; IPv4 mapped into IPv6 is printed as IPv4 */
+const char *comm_addr_to_string(const struct sockaddr_storage *addr, char *buf, size_t len);
+
+/* Same host, whichever family it was seen in */
+bool comm_addr_equal(const struct sockaddr_storage *a, const struct sockaddr_storage *b);
+
+/* For transports: credentials, cipher suites and session cache of a new
+ * (D)TLS socket; a no-op without CONFIG_COMM_ENGINE_TLS. */
+#ifdef CONFIG_COMM_ENGINE_TLS
+int comm_tls_setup(struct comm_context *ctx, int fd, bool server);
+#else
+static inline int comm_tls_setup(struct comm_context *ctx, int fd, bool server)
+{
+	ARG_UNUSED(ctx);
+	ARG_UNUSED(fd);
+	ARG_UNUSED(server);
+	return 0;
+}
+#endif
+
+/* For transports: record how long setting up a link took (connect and,
+ * with TLS, the handshake) */
+void comm_record_handshake(struct comm_context *ctx, uint32_t ms);
+
+/* Broadcast for ctx->cfg->service and store the lowest-RTT server in
+ * ctx->peer_ip / peer_port. -ENOENT when no server answered. */
+#ifdef CONFIG_COMM_ENGINE_DISCOVERY
+int comm_discover(struct comm_context *ctx);
+#else
+static inline int comm_discover(struct comm_context *ctx)
+{
+	ARG_UNUSED(ctx);
+	return -ENOTSUP;
+}
+#endif
+
+#ifdef CONFIG_COMM_ENGINE_PRIORITY
+/* Queue a message in a class; it goes out after the current step, in the
+ * order the scheduler picks. Datagram replies keep the peer of the moment
+ * they were queued. -ENOBUFS when the class queue is full. Must be called
+ * from the engine thread (the step function). */
+int comm_send_prio(struct comm_context *ctx, comm_prio_t prio, const void *buf, size_t len);
+
+/* Bytes a class queue can still take */
+size_t comm_prio_space(const struct comm_context *ctx, comm_prio_t prio);
+
+/* For the engine */
+void comm_prio_init(struct comm_context *ctx);
+bool comm_prio_pending(const struct comm_context *ctx);
+int comm_prio_flush(struct comm_context *ctx, size_t budget);
+void comm_prio_discard(struct comm_context *ctx);
+
+/* "be", "bk", "vi", "vo"; -EINVAL for anything else */
+int comm_prio_from_string(const char *name, comm_prio_t *prio);
+const char *comm_prio_to_string(comm_prio_t prio);
+#else
+/* Without classes every message is sent right away */
+static inline int comm_send_prio(struct comm_context *ctx, comm_prio_t prio, const void *buf, size_t len)
+{
+	ARG_UNUSED(prio);
+	return comm_send(ctx, buf, len);
+}
+
+static inline size_t comm_prio_space(const struct comm_context *ctx, comm_prio_t prio)
+{
+	ARG_UNUSED(ctx);
+	ARG_UNUSED(prio);
+	return SIZE_MAX;
+}
+#endif
+
+/* Compression stage, frames are decoded by PC_Site/codec.c */
+#define COMM_CODEC_MAGIC        0xF8    /* ORed with the codec, never in UTF-8 text */
+#define COMM_CODEC_HEADER       3       /* magic | codec, 16 bit payload length */
+#define COMM_CODEC_MAX_CHANNELS 16
+
+typedef enum {
+	COMM_CODEC_NONE,                /* framed but stored as is */
+	COMM_CODEC_LZ,                  /* LZ4 block with the built-in dictionary */
+	COMM_CODEC_DELTA,               /* int32 samples, per-channel delta + zigzag + varint */
+	COMM_CODEC_COUNT,
+} comm_codec_t;
+
+#ifdef CONFIG_COMM_ENGINE_COMPRESS
+/* Encode buf (at most CONFIG_COMM_ENGINE_BUFFER_SIZE bytes) and send it as
+ * one frame. Falls back to COMM_CODEC_NONE when it would not get smaller. */
+int comm_send_encoded(struct comm_context *ctx, comm_codec_t codec, const void *buf, size_t len);
+
+/* Send count samples of channels interleaved channels with COMM_CODEC_DELTA */
+int comm_send_samples(struct comm_context *ctx, const int32_t *samples, size_t count,
+		      uint8_t channels);
+
+const char *comm_codec_to_string(comm_codec_t codec);
+#endif
+
+/* Column-major sample batches, decoded by PC_Site/telemetry.c */
+#define COMM_TELEMETRY_MAGIC       0xB7    /* neither ASCII nor a codec frame */
+#define COMM_TELEMETRY_VERSION     1
+#define COMM_TELEMETRY_HEADER      32
+#define COMM_TELEMETRY_MAX_COLUMNS 8
+
+/* Buffer size for a batch of n samples of row_bytes bytes (sum of the
+ * column widths), including header and alignment padding */
+#define COMM_TELEMETRY_BUF_SIZE(n, row_bytes) \
+	(COMM_TELEMETRY_HEADER + 4 * (COMM_TELEMETRY_MAX_COLUMNS + 1) + (n) * (2 + (row_bytes)))
+
+struct comm_telemetry_schema {
+	uint16_t id;                                    /* tells the PC what the columns mean */
+	uint8_t columns;
+	uint8_t width[COMM_TELEMETRY_MAX_COLUMNS];      /* 1, 2 or 4 bytes, signed */
+};
+
+struct comm_telemetry_batch {
+	const struct comm_telemetry_schema *schema;
+	uint8_t *buf;
+	uint16_t capacity;                              /* samples that fit into buf */
+	uint16_t count;
+	uint32_t seq;
+	int64_t base_us;
+	int64_t last_us;
+	comm_prio_t prio;                               /* class the batches are sent in */
+	uint16_t *dt;                                   /* inside buf */
+	uint8_t *column[COMM_TELEMETRY_MAX_COLUMNS];    /* inside buf */
+};
+
+#ifdef CONFIG_COMM_ENGINE_TELEMETRY
+/* buf must be 4-byte aligned, see COMM_TELEMETRY_BUF_SIZE() */
+int comm_telemetry_init(struct comm_telemetry_batch *batch, const struct comm_telemetry_schema *schema,
+			void *buf, size_t size);
+
+/* Store one sample, one value per column. -ENOSPC when the batch is full
+ * or t_us is more than 65535 us after the previous sample: send the
+ * batch and add the sample again. */
+int comm_telemetry_add(struct comm_telemetry_batch *batch, int64_t t_us, const int32_t *values);
+
+/* Send the batch as one frame and start the next one */
+int comm_telemetry_send(struct comm_context *ctx, struct comm_telemetry_batch *batch);
+#endif
+
+#ifdef CONFIG_COMM_ENGINE_PERF
+/* Histogram bucket b counts [2^b, 2^(b+1)) us, the last one is open ended */
+#define COMM_PERF_BUCKETS 20
+
+/* A reading of all counters, see comm_perf_read(). 32 bit, wrapping. */
+struct comm_perf_counters {
+	uint32_t resets;                /* `net perf reset` since boot */
+	uint32_t tx_msgs;
+	uint32_t rx_msgs;
+	uint32_t tx_bytes;
+	uint32_t rx_bytes;
+	uint32_t reconnects;
+	uint32_t errors;                /* all errnos */
+	uint32_t send_us_sum;
+	uint32_t rtt_us_sum;
+	uint32_t send_us[COMM_PERF_BUCKETS];
+	uint32_t rtt_us[COMM_PERF_BUCKETS];
+};
+
+/* Counters behind the `net perf` shell commands (comm_perf.c), summed
+ * over all engines. Lock-free, safe from any thread. */
+void comm_perf_sent(size_t len, uint32_t us);
+void comm_perf_received(size_t len);
+void comm_perf_error(int err);
+void comm_perf_reconnect(void);
+/* For applications that time request and reply */
+void comm_perf_rtt(uint32_t us);
+/* Not a consistent snapshot while traffic flows: every counter is read
+ * on its own */
+void comm_perf_read(struct comm_perf_counters *c);
+#else
+/* Without CONFIG_COMM_ENGINE_PERF nothing is counted */
+static inline void comm_perf_sent(size_t len, uint32_t us)
+{
+	ARG_UNUSED(len);
+	ARG_UNUSED(us);
+}
+
+static inline void comm_perf_received(size_t len)
+{
+	ARG_UNUSED(len);
+}
+
+static inline void comm_perf_error(int err)
+{
+	ARG_UNUSED(err);
+}
+
+static inline void comm_perf_reconnect(void)
+{
+}
+
+static inline void comm_perf_rtt(uint32_t us)
+{
+	ARG_UNUSED(us);
+}
+#endif
+
+#ifdef CONFIG_COMM_ENGINE_CRC32C
+/* CRC32C (Castagnoli) like zlib's crc32(): start with 0, feed the result
+ * back in to continue */
+uint32_t comm_crc32c(uint32_t crc, const void *buf, size_t len);
+#endif
+
+/* Chunked bulk transfer, the PC side is PC_Site/bulk_client.c */
+#define COMM_BULK_MAGIC         0xB8
+#define COMM_BULK_HEADER        16
+#define COMM_BULK_MAX_WINDOW    256     /* chunks an ACK bitmap covers */
+#define COMM_BULK_FLAG_COMPLETE BIT(0)  /* ACK: every chunk is stored */
+
+enum comm_bulk_type {
+	COMM_BULK_PUT = 1,              /* PC -> board: size, window, store name */
+	COMM_BULK_GET,                  /* PC -> board: window, store name */
+	COMM_BULK_INFO,                 /* board -> PC: size, chunk size, window */
+	COMM_BULK_DATA,                 /* one chunk */
+	COMM_BULK_ACK,                  /* first missing chunk, bitmap of the next ones */
+	COMM_BULK_ERROR,                /* board -> PC: -errno */
+};
+
+#ifdef CONFIG_COMM_ENGINE_BULK
+static inline bool comm_bulk_is_packet(const void *buf, size_t len)
+{
+	return len >= COMM_BULK_HEADER && ((const uint8_t *)buf)[0] == COMM_BULK_MAGIC;
+}
+
+/* Handle one received bulk packet, replies go to its sender */
+int comm_bulk_handle(struct comm_context *ctx, const void *buf, size_t len);
+
+/* Call every step: sends new chunks and retransmissions of a GET */
+int comm_bulk_poll(struct comm_context *ctx);
+#endif
+
+const char *comm_state_to_string(communication_state_t state);
+
+#endif /* COMM_ENGINE_H */
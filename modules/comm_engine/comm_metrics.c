@@ -0,0 +1,268 @@
+#include <errno.h>
+#include <string.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/net_if.h>
+#include <zephyr/net/net_pkt.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/net/wifi_mgmt.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "comm_engine.h"
+#include "wifi_utilities.h"
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(comm_engine);
+
+/*
+ * Metrics snapshots for PC_Site/metrics_collector, one UDP datagram every
+ * CONFIG_COMM_ENGINE_METRICS_INTERVAL_MS. Little endian:
+ *
+ *   0   MAGIC, version
+ *   2   RSSI (signed, -128 when not associated), channel
+ *   4   MAC address of the WiFi interface, 2 reserved bytes
+ *   12  sequence number (32 bit), counts sent snapshots
+ *   16  uptime in ms (64 bit)
+ *   24  `net perf reset`s since boot (32 bit)
+ *   28  6 x 32 bit: messages sent and received, bytes sent and received,
+ *       reconnects, send and receive errors
+ *   52  8 x 16 bit: free and total net_pkt of the RX and TX slabs, then
+ *       free and total net_buf of the RX and TX data pools; free is
+ *       0xFFFF when unknown, total 0 without a native network stack
+ *   68  sums of the send times and RTTs in us (32 bit each)
+ *   76  send time histogram, COMM_PERF_BUCKETS x 32 bit
+ *   156 RTT histogram, COMM_PERF_BUCKETS x 32 bit
+ *   236 least unused stack of any thread in bytes (32 bit, 0xFFFFFFFF
+ *       without CONFIG_THREAD_STACK_INFO and CONFIG_INIT_STACKS)
+ *   240 name of that thread, NUL padded (16 bytes)
+ *
+ * Every counter is the raw wrapping value since boot or the last reset:
+ * the collector works out the increments, so a lost snapshot loses no
+ * counts. Snapshots are sent from their own low priority queue with
+ * MSG_DONTWAIT, they never hold up the engines or wait for a buffer.
+ */
+
+#define MAGIC           0xB9    /* next to the telemetry and bulk magics */
+#define VERSION         2
+#define STACK_OFFSET    (76 + 2 * 4 * COMM_PERF_BUCKETS)
+#define NAME_LEN        16
+#define SNAPSHOT_LEN    (STACK_OFFSET + 4 + NAME_LEN)
+#define UNKNOWN16       0xFFFF
+#define UNKNOWN32       0xFFFFFFFF
+
+static K_THREAD_STACK_DEFINE(metrics_stack, CONFIG_COMM_ENGINE_METRICS_STACK_SIZE);
+static struct k_work_q metrics_q;
+static struct k_work_delayable metrics_work;
+
+static struct sockaddr_storage collector;
+static net_socklen_t collector_len;
+static int sock = -1;
+static wifi_iface_role_t sock_iface;
+static uint32_t seq;
+
+static void put_wifi(uint8_t *p)
+{
+	struct net_if *iface = wifi_iface_get(WIFI_IFACE_WIFI);
+	struct wifi_iface_status status = { 0 };
+	struct net_linkaddr *mac;
+
+	p[2] = (uint8_t)INT8_MIN;
+	if (iface == NULL) {
+		return;
+	}
+	if (net_mgmt(NET_REQUEST_WIFI_IFACE_STATUS, iface, &status, sizeof(status)) == 0 &&
+	    status.state >= WIFI_STATE_ASSOCIATED) {
+		p[2] = (uint8_t)(int8_t)CLAMP(status.rssi, INT8_MIN + 1, INT8_MAX);
+		p[3] = (uint8_t)status.channel;
+	}
+	mac = net_if_get_link_addr(iface);
+	if (mac != NULL && mac->len == 6) {
+		memcpy(&p[4], mac->addr, 6);
+	}
+}
+
+static void put_pools(uint8_t *p)
+{
+#if defined(CONFIG_NET_NATIVE)
+	struct k_mem_slab *rx, *tx;
+	struct net_buf_pool *rx_data, *tx_data;
+
+	net_pkt_get_info(&rx, &tx, &rx_data, &tx_data);
+	sys_put_le16((uint16_t)k_mem_slab_num_free_get(rx), &p[0]);
+	sys_put_le16((uint16_t)(k_mem_slab_num_free_get(rx) + k_mem_slab_num_used_get(rx)), &p[2]);
+	sys_put_le16((uint16_t)k_mem_slab_num_free_get(tx), &p[4]);
+	sys_put_le16((uint16_t)(k_mem_slab_num_free_get(tx) + k_mem_slab_num_used_get(tx)), &p[6]);
+#ifdef CONFIG_NET_BUF_POOL_USAGE
+	sys_put_le16((uint16_t)atomic_get(&rx_data->avail_count), &p[8]);
+	sys_put_le16((uint16_t)atomic_get(&tx_data->avail_count), &p[12]);
+#else
+	/* Free buffers are only tracked with CONFIG_NET_BUF_POOL_USAGE */
+	sys_put_le16(UNKNOWN16, &p[8]);
+	sys_put_le16(UNKNOWN16, &p[12]);
+#endif
+	sys_put_le16(rx_data->buf_count, &p[10]);
+	sys_put_le16(tx_data->buf_count, &p[14]);
+#else
+	/* All sockets offloaded, no pools of our own: free unknown, none in total */
+	for (int i = 0; i < 4; i++) {
+		sys_put_le16(UNKNOWN16, &p[4 * i]);
+	}
+#endif
+}
+
+#if defined(CONFIG_THREAD_STACK_INFO) && defined(CONFIG_INIT_STACKS)
+struct headroom {
+	size_t unused;
+	const char *name;
+};
+
+static void least_headroom(const struct k_thread *cthread, void *user_data)
+{
+	struct k_thread *thread = (struct k_thread *)cthread;
+	struct headroom *h = user_data;
+	size_t unused;
+
+	if (k_thread_stack_space_get(thread, &unused) == 0 && unused < h->unused) {
+		h->unused = unused;
+		h->name = k_thread_name_get(thread);
+	}
+}
+#endif
+
+/* Stack watermarks only grow: a shrinking headroom over a long run is the
+ * warning, long before a stack overflow */
+static void put_stack(uint8_t *p)
+{
+#if defined(CONFIG_THREAD_STACK_INFO) && defined(CONFIG_INIT_STACKS)
+	struct headroom h = { .unused = SIZE_MAX };
+
+	k_thread_foreach_unlocked(least_headroom, &h);
+	sys_put_le32((uint32_t)MIN(h.unused, UNKNOWN32 - 1), &p[0]);
+	if (h.name != NULL) {
+		strncpy((char *)&p[4], h.name, NAME_LEN);
+	}
+#else
+	sys_put_le32(UNKNOWN32, &p[0]);
+#endif
+}
+
+static size_t build(uint8_t *p)
+{
+	struct comm_perf_counters c;
+
+	memset(p, 0, SNAPSHOT_LEN);
+	comm_perf_read(&c);
+
+	const uint32_t counters[] = {
+		c.tx_msgs, c.rx_msgs, c.tx_bytes, c.rx_bytes, c.reconnects, c.errors,
+	};
+
+	p[0] = MAGIC;
+	p[1] = VERSION;
+	put_wifi(p);
+	sys_put_le32(seq, &p[12]);
+	sys_put_le64((uint64_t)k_uptime_get(), &p[16]);
+	sys_put_le32(c.resets, &p[24]);
+	for (size_t i = 0; i < ARRAY_SIZE(counters); i++) {
+		sys_put_le32(counters[i], &p[28 + 4 * i]);
+	}
+	put_pools(&p[52]);
+	sys_put_le32(c.send_us_sum, &p[68]);
+	sys_put_le32(c.rtt_us_sum, &p[72]);
+	for (int b = 0; b < COMM_PERF_BUCKETS; b++) {
+		sys_put_le32(c.send_us[b], &p[76 + 4 * b]);
+		sys_put_le32(c.rtt_us[b], &p[76 + 4 * (COMM_PERF_BUCKETS + b)]);
+	}
+	put_stack(&p[STACK_OFFSET]);
+	return SNAPSHOT_LEN;
+}
+
+static void close_socket(void)
+{
+	if (sock >= 0) {
+		zsock_close(sock);
+		sock = -1;
+	}
+}
+
+/* A socket bound to the interface that is up, WiFi first. False while
+ * none is. */
+static bool open_socket(void)
+{
+	wifi_iface_role_t role;
+	int one = 1;
+
+	if (wifi_iface_select(WIFI_IFACE_WIFI, &role) != 0) {
+		/* Without a WiFi driver (native_sim) the sockets are the
+		 * host's, which routes them itself */
+		if (wifi_iface_get(WIFI_IFACE_WIFI) != NULL) {
+			close_socket();
+			return false;
+		}
+		role = WIFI_IFACE_WIFI;
+	}
+	if (sock >= 0 && role == sock_iface) {
+		return true;
+	}
+	close_socket();
+	sock = zsock_socket(collector.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0) {
+		LOG_ERR("[Metrics] socket() failed (errno=%d)", errno);
+		return false;
+	}
+	int ret = wifi_iface_bind_socket(sock, role);
+
+	if (ret < 0 && ret != -ENODEV) {
+		LOG_WRN("[Metrics] Socket not bound to the %s interface (%d)",
+			wifi_iface_role_to_string(role), ret);
+	}
+	zsock_setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+	sock_iface = role;
+	return true;
+}
+
+static void metrics_send(struct k_work *work)
+{
+	static uint8_t snapshot[SNAPSHOT_LEN];
+
+	ARG_UNUSED(work);
+
+	if (open_socket()) {
+		size_t len = build(snapshot);
+
+		if (zsock_sendto(sock, snapshot, len, ZSOCK_MSG_DONTWAIT,
+				 (struct sockaddr *)&collector, collector_len) == (int)len) {
+			seq++;
+		} else if (errno != EAGAIN && errno != ENOBUFS && errno != ENOMEM) {
+			/* Out of buffers is skipped, anything else gets a new socket */
+			LOG_DBG("[Metrics] sendto() failed (errno=%d)", errno);
+			close_socket();
+		}
+	}
+	k_work_reschedule_for_queue(&metrics_q, &metrics_work,
+				    K_MSEC(CONFIG_COMM_ENGINE_METRICS_INTERVAL_MS));
+}
+
+static int metrics_init(void)
+{
+	const char *server = CONFIG_COMM_ENGINE_METRICS_SERVER;
+
+	if (server[0] == '\0') {
+		server = "255.255.255.255";
+	}
+	if (comm_addr_parse(server, CONFIG_COMM_ENGINE_METRICS_PORT, &collector, &collector_len) < 0) {
+		LOG_ERR("[Metrics] Invalid collector address %s", server);
+		return -EINVAL;
+	}
+
+	k_work_queue_start(&metrics_q, metrics_stack, K_THREAD_STACK_SIZEOF(metrics_stack),
+			   CONFIG_COMM_ENGINE_METRICS_PRIORITY, NULL);
+	k_thread_name_set(&metrics_q.thread, "comm_metrics");
+	k_work_init_delayable(&metrics_work, metrics_send);
+	k_work_reschedule_for_queue(&metrics_q, &metrics_work,
+				    K_MSEC(CONFIG_COMM_ENGINE_METRICS_INTERVAL_MS));
+	return 0;
+}
+
+SYS_INIT(metrics_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
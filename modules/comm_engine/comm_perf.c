@@ -0,0 +1,298 @@
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/net_if.h>
+#include <zephyr/net/wifi_mgmt.h>
+#include <zephyr/sys/atomic.h>
+#ifdef CONFIG_NET_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include "comm_engine.h"
+#include "wifi_utilities.h"
+
+/*
+ * Live counters of all engines, for a board in the field without a
+ * reflash or a debugger: the `net perf` shell commands print them and
+ * comm_metrics.c sends them to PC_Site/metrics_collector.
+ *
+ * The send and receive paths only do atomic adds, so they never wait on
+ * a shell reading or resetting the counters. A reading taken while
+ * traffic flows is therefore not a consistent snapshot across counters.
+ * atomic_t is 32 bit on the MCU: the byte counters wrap at 4 GiB, reset
+ * them before a long measurement.
+ */
+
+#define BUCKETS COMM_PERF_BUCKETS
+
+/* Errnos counted separately, the rest goes to "other" */
+#define ERRNO(e) { e, #e }
+static const struct {
+	int err;
+	const char *name;
+} errnos[] = {
+	ERRNO(ECONNRESET), ERRNO(ECONNREFUSED), ERRNO(ECONNABORTED), ERRNO(ENOTCONN),
+	ERRNO(ETIMEDOUT), ERRNO(EHOSTUNREACH), ERRNO(ENETUNREACH), ERRNO(ENETDOWN),
+	ERRNO(ENOMEM), ERRNO(ENOBUFS), ERRNO(EPIPE), ERRNO(EIO),
+};
+
+static struct {
+	atomic_t tx_msgs;
+	atomic_t rx_msgs;
+	atomic_t tx_bytes;
+	atomic_t rx_bytes;
+	atomic_t reconnects;
+	atomic_t errors[ARRAY_SIZE(errnos) + 1];
+	atomic_t send_us[BUCKETS];      /* time inside the transport send */
+	atomic_t rtt_us[BUCKETS];       /* reported by the application */
+	atomic_t send_us_sum;
+	atomic_t rtt_us_sum;
+	atomic_t reset_ms;
+	atomic_t resets;
+} perf;
+
+static void record(atomic_t *hist, atomic_t *sum, uint32_t us)
+{
+	int b = us == 0 ? 0 : 31 - __builtin_clz(us);
+
+	atomic_inc(&hist[MIN(b, BUCKETS - 1)]);
+	atomic_add(sum, (atomic_val_t)us);
+}
+
+void comm_perf_sent(size_t len, uint32_t us)
+{
+	atomic_inc(&perf.tx_msgs);
+	atomic_add(&perf.tx_bytes, (atomic_val_t)len);
+	record(perf.send_us, &perf.send_us_sum, us);
+}
+
+void comm_perf_received(size_t len)
+{
+	atomic_inc(&perf.rx_msgs);
+	atomic_add(&perf.rx_bytes, (atomic_val_t)len);
+}
+
+void comm_perf_error(int err)
+{
+	size_t i = 0;
+
+	while (i < ARRAY_SIZE(errnos) && errnos[i].err != -err) {
+		i++;
+	}
+	atomic_inc(&perf.errors[i]);
+}
+
+void comm_perf_reconnect(void)
+{
+	atomic_inc(&perf.reconnects);
+}
+
+void comm_perf_rtt(uint32_t us)
+{
+	record(perf.rtt_us, &perf.rtt_us_sum, us);
+}
+
+void comm_perf_read(struct comm_perf_counters *c)
+{
+	c->resets = (uint32_t)atomic_get(&perf.resets);
+	c->tx_msgs = (uint32_t)atomic_get(&perf.tx_msgs);
+	c->rx_msgs = (uint32_t)atomic_get(&perf.rx_msgs);
+	c->tx_bytes = (uint32_t)atomic_get(&perf.tx_bytes);
+	c->rx_bytes = (uint32_t)atomic_get(&perf.rx_bytes);
+	c->reconnects = (uint32_t)atomic_get(&perf.reconnects);
+	c->errors = 0;
+	for (size_t i = 0; i < ARRAY_SIZE(perf.errors); i++) {
+		c->errors += (uint32_t)atomic_get(&perf.errors[i]);
+	}
+	c->send_us_sum = (uint32_t)atomic_get(&perf.send_us_sum);
+	c->rtt_us_sum = (uint32_t)atomic_get(&perf.rtt_us_sum);
+	for (int b = 0; b < BUCKETS; b++) {
+		c->send_us[b] = (uint32_t)atomic_get(&perf.send_us[b]);
+		c->rtt_us[b] = (uint32_t)atomic_get(&perf.rtt_us[b]);
+	}
+}
+
+/* ---- shell ---- */
+
+#ifdef CONFIG_NET_SHELL
+
+static uint32_t since_reset_ms(void)
+{
+	return k_uptime_get_32() - (uint32_t)atomic_get(&perf.reset_ms);
+}
+
+static void print_rssi(const struct shell *sh)
+{
+	struct net_if *iface = wifi_iface_get(WIFI_IFACE_WIFI);
+	struct wifi_iface_status status = { 0 };
+
+	if (iface == NULL ||
+	    net_mgmt(NET_REQUEST_WIFI_IFACE_STATUS, iface, &status, sizeof(status)) != 0 ||
+	    status.state < WIFI_STATE_ASSOCIATED) {
+		shell_print(sh, "RSSI        : not associated");
+		return;
+	}
+#ifdef CONFIG_WIFI_UTILITIES_MONITOR
+	wifi_link_metrics_t m;
+
+	if (wifi_get_link_metrics(&m) == 0) {
+		shell_print(sh, "RSSI        : %d dBm (avg %d, min %d, trend %+d dB), channel %d",
+			    status.rssi, m.rssi_avg, m.rssi_min, m.rssi_trend, status.channel);
+		return;
+	}
+#endif
+	shell_print(sh, "RSSI        : %d dBm, channel %d", status.rssi, status.channel);
+}
+
+static int cmd_counters(const struct shell *sh, size_t argc, char **argv)
+{
+	uint32_t secs = since_reset_ms() / 1000;
+	uint32_t tx = (uint32_t)atomic_get(&perf.tx_bytes);
+	uint32_t rx = (uint32_t)atomic_get(&perf.rx_bytes);
+
+	shell_print(sh, "Since reset : %u s", secs);
+	secs = MAX(secs, 1);
+	shell_print(sh, "Sent        : %u msgs, %u bytes (%u B/s)",
+		    (uint32_t)atomic_get(&perf.tx_msgs), tx, tx / secs);
+	shell_print(sh, "Received    : %u msgs, %u bytes (%u B/s)",
+		    (uint32_t)atomic_get(&perf.rx_msgs), rx, rx / secs);
+	shell_print(sh, "Reconnects  : %u", (uint32_t)atomic_get(&perf.reconnects));
+	print_rssi(sh);
+	return 0;
+}
+
+static int cmd_errors(const struct shell *sh, size_t argc, char **argv)
+{
+	uint32_t total = 0;
+
+	for (size_t i = 0; i <= ARRAY_SIZE(errnos); i++) {
+		uint32_t n = (uint32_t)atomic_get(&perf.errors[i]);
+
+		if (n == 0) {
+			continue;
+		}
+		if (i < ARRAY_SIZE(errnos)) {
+			shell_print(sh, "  %-14s %u", errnos[i].name, n);
+		} else {
+			shell_print(sh, "  %-14s %u", "other", n);
+		}
+		total += n;
+	}
+	shell_print(sh, "Send / receive errors: %u", total);
+	return 0;
+}
+
+static void print_histogram(const struct shell *sh, const char *name, atomic_t *hist)
+{
+	uint32_t counts[BUCKETS];
+	uint32_t total = 0;
+
+	for (int b = 0; b < BUCKETS; b++) {
+		counts[b] = (uint32_t)atomic_get(&hist[b]);
+		total += counts[b];
+	}
+	shell_print(sh, "%s: %u samples", name, total);
+	for (int b = 0; b < BUCKETS; b++) {
+		if (counts[b] == 0) {
+			continue;
+		}
+		if (b == BUCKETS - 1) {
+			shell_print(sh, "  >= %7u us  %8u  %3u%%", 1U << b, counts[b], counts[b] * 100 / total);
+		} else {
+			shell_print(sh, "  <  %7u us  %8u  %3u%%", 2U << b, counts[b], counts[b] * 100 / total);
+		}
+	}
+}
+
+static int cmd_latency(const struct shell *sh, size_t argc, char **argv)
+{
+	print_histogram(sh, "Send", perf.send_us);
+	print_histogram(sh, "RTT", perf.rtt_us);
+	return 0;
+}
+
+static void print_thread(const struct k_thread *cthread, void *user_data)
+{
+	struct k_thread *thread = (struct k_thread *)cthread;
+	const struct shell *sh = user_data;
+	const char *name = k_thread_name_get(thread);
+	char cpu[16] = "-";
+	char stack[32] = "-";
+
+#ifdef CONFIG_THREAD_RUNTIME_STATS
+	k_thread_runtime_stats_t rt, all;
+
+	if (k_thread_runtime_stats_get(thread, &rt) == 0 &&
+	    k_thread_runtime_stats_all_get(&all) == 0 && all.execution_cycles > 0) {
+		uint32_t permille = (uint32_t)(rt.execution_cycles * 1000 / all.execution_cycles);
+
+		snprintk(cpu, sizeof(cpu), "%u.%u%%", permille / 10, permille % 10);
+	}
+#endif
+#if defined(CONFIG_THREAD_STACK_INFO) && defined(CONFIG_INIT_STACKS)
+	size_t unused;
+
+	if (k_thread_stack_space_get(thread, &unused) == 0) {
+		size_t size = thread->stack_info.size;
+
+		snprintk(stack, sizeof(stack), "%u / %u", (uint32_t)(size - unused), (uint32_t)size);
+	}
+#endif
+	shell_print(sh, "  %-20s %8s  %s", name != NULL && name[0] != '\0' ? name : "?", cpu, stack);
+}
+
+static int cmd_threads(const struct shell *sh, size_t argc, char **argv)
+{
+	shell_print(sh, "  %-20s %8s  %s", "thread", "cpu", "stack peak / size");
+	k_thread_foreach_unlocked(print_thread, (void *)sh);
+#ifndef CONFIG_THREAD_RUNTIME_STATS
+	shell_print(sh, "CPU usage needs CONFIG_THREAD_RUNTIME_STATS");
+#endif
+#if !defined(CONFIG_THREAD_STACK_INFO) || !defined(CONFIG_INIT_STACKS)
+	shell_print(sh, "Stack peaks need CONFIG_THREAD_STACK_INFO and CONFIG_INIT_STACKS");
+#endif
+	return 0;
+}
+
+static int cmd_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	atomic_clear(&perf.tx_msgs);
+	atomic_clear(&perf.rx_msgs);
+	atomic_clear(&perf.tx_bytes);
+	atomic_clear(&perf.rx_bytes);
+	atomic_clear(&perf.reconnects);
+	for (size_t i = 0; i < ARRAY_SIZE(perf.errors); i++) {
+		atomic_clear(&perf.errors[i]);
+	}
+	for (int b = 0; b < BUCKETS; b++) {
+		atomic_clear(&perf.send_us[b]);
+		atomic_clear(&perf.rtt_us[b]);
+	}
+	atomic_clear(&perf.send_us_sum);
+	atomic_clear(&perf.rtt_us_sum);
+	atomic_set(&perf.reset_ms, (atomic_val_t)k_uptime_get_32());
+	/* Tells the metrics collector that the counters restarted */
+	atomic_inc(&perf.resets);
+	shell_print(sh, "Counters reset");
+	return 0;
+}
+
+static int cmd_perf(const struct shell *sh, size_t argc, char **argv)
+{
+	cmd_counters(sh, argc, argv);
+	cmd_errors(sh, argc, argv);
+	cmd_latency(sh, argc, argv);
+	cmd_threads(sh, argc, argv);
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(perf_cmds,
+	SHELL_CMD(counters, NULL, "Messages, bytes, reconnects and RSSI", cmd_counters),
+	SHELL_CMD(errors, NULL, "Send and receive errors by errno", cmd_errors),
+	SHELL_CMD(latency, NULL, "Send time and RTT histograms", cmd_latency),
+	SHELL_CMD(threads, NULL, "CPU usage since boot and stack peaks per thread", cmd_threads),
+	SHELL_CMD(reset, NULL, "Reset counters and histograms", cmd_reset),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_SUBCMD_ADD((net), perf, &perf_cmds, "comm_engine performance counters", cmd_perf, 1, 0);
+#endif /* CONFIG_NET_SHELL */
@@ -0,0 +1,292 @@
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+
+#include "comm_engine.h"
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(comm_engine);
+
+/*
+ * Priority classes on the send path.
+ *
+ * comm_send_prio() copies a message into the queue of its class. After
+ * every step the engine drains up to CONFIG_COMM_ENGINE_PRIO_BUDGET bytes,
+ * and comm_recv() does not block while something is queued, so a control
+ * reply queued behind a burst of bulk data leaves with the next drain
+ * instead of after the whole burst.
+ *
+ * The strict scheduler always serves the highest class that has data.
+ * The weighted one is a deficit round robin with a quantum of
+ * weight x CONFIG_COMM_ENGINE_PRIO_QUANTUM bytes per turn, so bulk data
+ * keeps a share of the link even while control traffic is busy.
+ *
+ * Before a message of another class than the previous one is sent, the
+ * socket is re-tagged: IP_TOS carries the DSCP value the AP and the
+ * radio map to the WMM access category, SO_PRIORITY selects the TX
+ * traffic class of the network stack (CONFIG_NET_TC_TX_COUNT).
+ */
+
+struct class_desc {
+	const char *name;
+	uint8_t dscp;
+	uint8_t net_prio;
+	uint8_t weight;                 /* weighted scheduler */
+};
+
+/* DSCP per RFC 8325; drivers that map by the precedence bits alone put
+ * EF into AC_VI, which still ranks above the bulk classes */
+static const struct class_desc classes[COMM_PRIO_COUNT] = {
+	[COMM_PRIO_BE] = { "be", 0,  NET_PRIORITY_BE, 2 },     /* CS0 */
+	[COMM_PRIO_BK] = { "bk", 8,  NET_PRIORITY_BK, 1 },     /* CS1 */
+	[COMM_PRIO_VI] = { "vi", 34, NET_PRIORITY_VI, 4 },     /* AF41 */
+	[COMM_PRIO_VO] = { "vo", 46, NET_PRIORITY_VO, 8 },     /* EF */
+};
+
+/* Order in which the classes are served, highest first */
+static const comm_prio_t rank[COMM_PRIO_COUNT] = {
+	COMM_PRIO_VO, COMM_PRIO_VI, COMM_PRIO_BE, COMM_PRIO_BK,
+};
+
+struct queued_msg {
+	sys_snode_t node;
+	uint32_t queued_cycles;
+	struct sockaddr_storage peer;   /* datagram transports reply to this peer */
+	net_socklen_t peer_len;
+	uint16_t len;
+	uint8_t data[];
+};
+
+/* Shared by all engines, each one limits its own classes */
+K_HEAP_DEFINE(prio_heap, COMM_PRIO_COUNT * CONFIG_COMM_ENGINE_PRIO_QUEUE_BYTES * 5 / 4);
+
+const char *comm_prio_to_string(comm_prio_t prio)
+{
+	return prio < COMM_PRIO_COUNT ? classes[prio].name : "??";
+}
+
+int comm_prio_from_string(const char *name, comm_prio_t *prio)
+{
+	for (int i = 0; i < COMM_PRIO_COUNT; i++) {
+		if (strcmp(name, classes[i].name) == 0) {
+			*prio = (comm_prio_t)i;
+			return 0;
+		}
+	}
+	return -EINVAL;
+}
+
+void comm_prio_init(struct comm_context *ctx)
+{
+	memset(&ctx->prio, 0, sizeof(ctx->prio));
+	for (int i = 0; i < COMM_PRIO_COUNT; i++) {
+		sys_slist_init(&ctx->prio.queue[i]);
+	}
+	ctx->prio.tagged = -1;
+}
+
+static size_t msg_cost(size_t len)
+{
+	return sizeof(struct queued_msg) + len;
+}
+
+size_t comm_prio_space(const struct comm_context *ctx, comm_prio_t prio)
+{
+	size_t used = ctx->prio.bytes[prio] + msg_cost(0);
+
+	return used < CONFIG_COMM_ENGINE_PRIO_QUEUE_BYTES ? CONFIG_COMM_ENGINE_PRIO_QUEUE_BYTES - used : 0;
+}
+
+bool comm_prio_pending(const struct comm_context *ctx)
+{
+	for (int i = 0; i < COMM_PRIO_COUNT; i++) {
+		if (!sys_slist_is_empty(&ctx->prio.queue[i])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+int comm_send_prio(struct comm_context *ctx, comm_prio_t prio, const void *buf, size_t len)
+{
+	struct queued_msg *msg = NULL;
+
+	if (prio >= COMM_PRIO_COUNT || len > UINT16_MAX) {
+		return -EINVAL;
+	}
+	if (len <= comm_prio_space(ctx, prio)) {
+		msg = k_heap_alloc(&prio_heap, msg_cost(len), K_NO_WAIT);
+	}
+	if (msg == NULL) {
+		ctx->stats.prio_drops[prio]++;
+		return -ENOBUFS;
+	}
+
+	msg->queued_cycles = k_cycle_get_32();
+	msg->peer = ctx->peer_addr;
+	msg->peer_len = ctx->peer_addr_len;
+	msg->len = (uint16_t)len;
+	memcpy(msg->data, buf, len);
+
+	sys_slist_append(&ctx->prio.queue[prio], &msg->node);
+	ctx->prio.bytes[prio] += msg_cost(len);
+	return (int)len;
+}
+
+static struct queued_msg *head_of(struct comm_context *ctx, comm_prio_t prio)
+{
+	sys_snode_t *node = sys_slist_peek_head(&ctx->prio.queue[prio]);
+
+	return node != NULL ? CONTAINER_OF(node, struct queued_msg, node) : NULL;
+}
+
+static void release(struct comm_context *ctx, comm_prio_t prio, struct queued_msg *msg)
+{
+	sys_slist_get(&ctx->prio.queue[prio]);
+	ctx->prio.bytes[prio] -= msg_cost(msg->len);
+	k_heap_free(&prio_heap, msg);
+}
+
+static void tag_socket(struct comm_context *ctx, comm_prio_t prio)
+{
+	int tos = classes[prio].dscp << 2;
+	uint8_t net_prio = classes[prio].net_prio;
+
+	if (ctx->prio.tagged == (int8_t)prio) {
+		return;
+	}
+	/* Tagging is best effort: without CONFIG_NET_CONTEXT_DSCP_ECN or
+	 * CONFIG_NET_CONTEXT_PRIORITY the classes still get their queues */
+	if (zsock_setsockopt(ctx->sock_fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) < 0 ||
+	    zsock_setsockopt(ctx->sock_fd, SOL_SOCKET, SO_PRIORITY, &net_prio, sizeof(net_prio)) < 0) {
+		if (ctx->prio.tagged == -1) {
+			LOG_WRN("[Comm] Could not tag the socket for class %s (errno=%d)",
+				classes[prio].name, errno);
+		}
+	}
+	ctx->prio.tagged = prio;
+}
+
+/* Send the head of a class: 1 when it went out, 0 when the stack is out
+ * of buffers and it stays queued, -errno when it was dropped */
+static int send_head(struct comm_context *ctx, comm_prio_t prio, struct queued_msg *msg)
+{
+	struct comm_stats *st = &ctx->stats;
+	struct sockaddr_storage peer = ctx->peer_addr;
+	net_socklen_t peer_len = ctx->peer_addr_len;
+
+	tag_socket(ctx, prio);
+
+	ctx->peer_addr = msg->peer;
+	ctx->peer_addr_len = msg->peer_len;
+	int ret = comm_send(ctx, msg->data, msg->len);
+	ctx->peer_addr = peer;
+	ctx->peer_addr_len = peer_len;
+
+	if (ret == -EAGAIN || ret == -ENOMEM || ret == -ENOBUFS) {
+		return 0;
+	}
+	if (ret < 0) {
+		st->prio_drops[prio]++;
+		release(ctx, prio, msg);
+		return ret;
+	}
+
+	uint32_t wait_us = (uint32_t)k_cyc_to_us_floor64(k_cycle_get_32() - msg->queued_cycles);
+
+	st->prio_msgs[prio]++;
+	st->prio_wait_us[prio] += wait_us;
+	st->prio_wait_max_us[prio] = MAX(st->prio_wait_max_us[prio], wait_us);
+	release(ctx, prio, msg);
+	return 1;
+}
+
+#ifdef CONFIG_COMM_ENGINE_PRIO_STRICT
+static int flush(struct comm_context *ctx, size_t budget)
+{
+	size_t sent = 0;
+
+	while (sent < budget) {
+		struct queued_msg *msg = NULL;
+		comm_prio_t prio = COMM_PRIO_BE;
+
+		for (int i = 0; i < COMM_PRIO_COUNT && msg == NULL; i++) {
+			prio = rank[i];
+			msg = head_of(ctx, prio);
+		}
+		if (msg == NULL) {
+			break;
+		}
+
+		size_t len = msg->len;
+		int ret = send_head(ctx, prio, msg);
+
+		if (ret < 0) {
+			return ret;
+		}
+		if (ret == 0) {
+			break;
+		}
+		sent += len;
+	}
+	return (int)sent;
+}
+#else
+static int flush(struct comm_context *ctx, size_t budget)
+{
+	struct comm_prio_queues *q = &ctx->prio;
+	size_t sent = 0;
+
+	while (sent < budget && comm_prio_pending(ctx)) {
+		comm_prio_t prio = rank[q->turn];
+		struct queued_msg *msg = head_of(ctx, prio);
+
+		if (msg == NULL) {
+			q->deficit[prio] = 0;
+		} else {
+			if (!q->granted) {
+				q->deficit[prio] += classes[prio].weight * CONFIG_COMM_ENGINE_PRIO_QUANTUM;
+				q->granted = true;
+			}
+			if (msg->len <= q->deficit[prio]) {
+				size_t len = msg->len;
+				int ret = send_head(ctx, prio, msg);
+
+				if (ret < 0) {
+					return ret;
+				}
+				if (ret == 0) {
+					break;
+				}
+				q->deficit[prio] -= len;
+				sent += len;
+				continue;
+			}
+		}
+		q->turn = (q->turn + 1) % COMM_PRIO_COUNT;
+		q->granted = false;
+	}
+	return (int)sent;
+}
+#endif
+
+int comm_prio_flush(struct comm_context *ctx, size_t budget)
+{
+	return comm_prio_pending(ctx) ? flush(ctx, budget) : 0;
+}
+
+void comm_prio_discard(struct comm_context *ctx)
+{
+	for (int i = 0; i < COMM_PRIO_COUNT; i++) {
+		struct queued_msg *msg;
+
+		while ((msg = head_of(ctx, (comm_prio_t)i)) != NULL) {
+			ctx->stats.prio_drops[i]++;
+			release(ctx, (comm_prio_t)i, msg);
+		}
+		ctx->prio.deficit[i] = 0;
+	}
+	/* The next link has a new socket */
+	ctx->prio.tagged = -1;
+}
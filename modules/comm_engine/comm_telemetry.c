@@ -0,0 +1,148 @@
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "comm_engine.h"
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(comm_engine);
+
+/*
+ * Column-major telemetry batches, decoded by PC_Site/telemetry.c.
+ *
+ *   0   magic (COMM_TELEMETRY_MAGIC), version
+ *   2   schema id (16 bit), sample count (16 bit)
+ *   6   column count, reserved
+ *   8   batch sequence number (32 bit), reserved (32 bit)
+ *   16  timestamp of the first sample in us (64 bit)
+ *   24  width of each column in bytes (1, 2 or 4), 0 for unused columns
+ *   32  count x 16 bit: us since the previous sample (0 for the first)
+ *       then every column: count signed values of its width
+ *
+ * Every block starts 4-byte aligned, everything is little endian. The
+ * buffer is laid out for a full batch while samples are added, so adding
+ * a sample is a few stores. Sending moves the columns together, one
+ * memmove() per column, and hands the result to the transport as is.
+ */
+
+BUILD_ASSERT(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "columns are stored in host order");
+
+#define ALIGN4(x) (((x) + 3) & ~(size_t)3)
+
+int comm_telemetry_init(struct comm_telemetry_batch *batch, const struct comm_telemetry_schema *schema,
+			void *buf, size_t size)
+{
+	size_t row = sizeof(uint16_t);
+	size_t fixed = COMM_TELEMETRY_HEADER + 4 * (COMM_TELEMETRY_MAX_COLUMNS + 1);
+
+	if (schema->columns == 0 || schema->columns > COMM_TELEMETRY_MAX_COLUMNS ||
+	    ((uintptr_t)buf & 3) != 0 || size <= fixed) {
+		return -EINVAL;
+	}
+	for (int c = 0; c < schema->columns; c++) {
+		uint8_t w = schema->width[c];
+
+		if (w != 1 && w != 2 && w != 4) {
+			return -EINVAL;
+		}
+		row += w;
+	}
+
+	memset(batch, 0, sizeof(*batch));
+	batch->schema = schema;
+	batch->buf = buf;
+	batch->capacity = (uint16_t)MIN((size - fixed) / row, UINT16_MAX);
+
+	size_t off = COMM_TELEMETRY_HEADER;
+
+	batch->dt = (uint16_t *)(batch->buf + off);
+	off = ALIGN4(off + batch->capacity * sizeof(uint16_t));
+	for (int c = 0; c < schema->columns; c++) {
+		batch->column[c] = batch->buf + off;
+		off = ALIGN4(off + batch->capacity * schema->width[c]);
+	}
+	return 0;
+}
+
+int comm_telemetry_add(struct comm_telemetry_batch *batch, int64_t t_us, const int32_t *values)
+{
+	const struct comm_telemetry_schema *schema = batch->schema;
+	uint16_t i = batch->count;
+
+	if (i == 0) {
+		batch->base_us = t_us;
+		batch->dt[0] = 0;
+	} else if (i == batch->capacity || t_us < batch->last_us || t_us - batch->last_us > UINT16_MAX) {
+		/* Full, or the gap does not fit a delta: start a new batch */
+		return -ENOSPC;
+	} else {
+		batch->dt[i] = (uint16_t)(t_us - batch->last_us);
+	}
+	batch->last_us = t_us;
+
+	for (int c = 0; c < schema->columns; c++) {
+		switch (schema->width[c]) {
+		case 1:
+			((int8_t *)batch->column[c])[i] = (int8_t)values[c];
+			break;
+		case 2:
+			((int16_t *)batch->column[c])[i] = (int16_t)values[c];
+			break;
+		default:
+			((int32_t *)batch->column[c])[i] = values[c];
+			break;
+		}
+	}
+	batch->count = i + 1;
+	return 0;
+}
+
+int comm_telemetry_send(struct comm_context *ctx, struct comm_telemetry_batch *batch)
+{
+	const struct comm_telemetry_schema *schema = batch->schema;
+	uint8_t *hdr = batch->buf;
+	uint16_t n = batch->count;
+	int ret;
+
+	if (n == 0) {
+		return 0;
+	}
+
+	uint32_t start = k_cycle_get_32();
+
+	memset(hdr, 0, COMM_TELEMETRY_HEADER);
+	hdr[0] = COMM_TELEMETRY_MAGIC;
+	hdr[1] = COMM_TELEMETRY_VERSION;
+	sys_put_le16(schema->id, &hdr[2]);
+	sys_put_le16(n, &hdr[4]);
+	hdr[6] = schema->columns;
+	sys_put_le32(batch->seq, &hdr[8]);
+	sys_put_le64((uint64_t)batch->base_us, &hdr[16]);
+	memcpy(&hdr[24], schema->width, schema->columns);
+
+	/* The dt block stays where it is, columns move down behind it */
+	size_t off = ALIGN4(COMM_TELEMETRY_HEADER + n * sizeof(uint16_t));
+
+	for (int c = 0; c < schema->columns; c++) {
+		size_t bytes = (size_t)n * schema->width[c];
+
+		memmove(batch->buf + off, batch->column[c], bytes);
+		off = ALIGN4(off + bytes);
+	}
+
+	uint32_t us = k_cyc_to_us_floor64(k_cycle_get_32() - start);
+
+	ret = comm_send_prio(ctx, batch->prio, batch->buf, off);
+	if (ret >= 0) {
+		ctx->stats.telemetry_batches++;
+		ctx->stats.telemetry_samples += n;
+		LOG_DBG("[Telemetry] Batch %u: %u samples in %u bytes, packed in %u us",
+			batch->seq, n, (uint32_t)off, us);
+	}
+
+	/* A failed batch is dropped too, its samples are stale by now */
+	batch->seq++;
+	batch->count = 0;
+	return ret;
+}
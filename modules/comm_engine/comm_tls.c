@@ -0,0 +1,109 @@
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/net/tls_credentials.h>
+#include <zephyr/sys/util.h>
+
+#include "comm_engine.h"
+#if defined(CONFIG_COMM_ENGINE_TLS_AUTH_CERT)
+#include "secret/tls_ca_cert.h"
+#endif
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(comm_engine);
+
+#define COMM_TLS_SEC_TAG 42
+
+#if defined(CONFIG_COMM_ENGINE_TLS_AUTH_PSK)
+/* TLS-PSK-WITH-AES-128-GCM-SHA256: no public-key operation in the handshake */
+static const int psk_ciphersuites[] = { 0x00A8 };
+static uint8_t psk[32];
+static size_t psk_len;
+#endif
+
+static bool credentials_added;
+
+static int add_credentials(void)
+{
+	int ret;
+
+	if (credentials_added) {
+		return 0;
+	}
+
+#if defined(CONFIG_COMM_ENGINE_TLS_AUTH_PSK)
+	psk_len = hex2bin(CONFIG_COMM_ENGINE_TLS_PSK, strlen(CONFIG_COMM_ENGINE_TLS_PSK), psk, sizeof(psk));
+	if (psk_len == 0) {
+		LOG_ERR("[TLS] CONFIG_COMM_ENGINE_TLS_PSK is not a hex string");
+		return -EINVAL;
+	}
+	ret = tls_credential_add(COMM_TLS_SEC_TAG, TLS_CREDENTIAL_PSK, psk, psk_len);
+	if (ret == 0) {
+		ret = tls_credential_add(COMM_TLS_SEC_TAG, TLS_CREDENTIAL_PSK_ID,
+					 CONFIG_COMM_ENGINE_TLS_PSK_IDENTITY,
+					 strlen(CONFIG_COMM_ENGINE_TLS_PSK_IDENTITY));
+	}
+#else
+	ret = tls_credential_add(COMM_TLS_SEC_TAG, TLS_CREDENTIAL_CA_CERTIFICATE,
+				 TLS_CA_CERT, sizeof(TLS_CA_CERT));
+#endif
+	if (ret < 0 && ret != -EEXIST) {
+		LOG_ERR("[TLS] Could not add credentials (%d)", ret);
+		return ret;
+	}
+
+	credentials_added = true;
+	return 0;
+}
+
+int comm_tls_setup(struct comm_context *ctx, int fd, bool server)
+{
+	sec_tag_t tags[] = { COMM_TLS_SEC_TAG };
+	int ret = add_credentials();
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (zsock_setsockopt(fd, SOL_TLS, TLS_SEC_TAG_LIST, tags, sizeof(tags)) < 0) {
+		ret = -errno;
+		LOG_ERR("[TLS] Could not set the credentials (%d)", ret);
+		return ret;
+	}
+
+#if defined(CONFIG_COMM_ENGINE_TLS_AUTH_PSK)
+	zsock_setsockopt(fd, SOL_TLS, TLS_CIPHERSUITE_LIST, psk_ciphersuites, sizeof(psk_ciphersuites));
+#else
+	/* The server sends a certificate, the board has none to send back */
+	if (!server && ctx->peer_ip[0] != '\0') {
+		zsock_setsockopt(fd, SOL_TLS, TLS_HOSTNAME, ctx->peer_ip, strlen(ctx->peer_ip) + 1);
+	}
+#endif
+
+#if defined(CONFIG_COMM_ENGINE_TLS_AUTH_CERT)
+	if (server) {
+		LOG_ERR("[TLS] Server transports need CONFIG_COMM_ENGINE_TLS_AUTH_PSK");
+		return -ENOTSUP;
+	}
+#endif
+
+	if (server) {
+		int role = TLS_DTLS_ROLE_SERVER;
+		int none = TLS_PEER_VERIFY_NONE;
+
+		if (ctx->cfg->transport->datagram) {
+			zsock_setsockopt(fd, SOL_TLS, TLS_DTLS_ROLE, &role, sizeof(role));
+		}
+		zsock_setsockopt(fd, SOL_TLS, TLS_PEER_VERIFY, &none, sizeof(none));
+	} else if (IS_ENABLED(CONFIG_COMM_ENGINE_TLS_RESUMPTION)) {
+		/* Keeps the session (ID and ticket) per peer, so a reconnect
+		 * after a link drop runs the abbreviated handshake */
+		int cache = TLS_SESSION_CACHE_ENABLED;
+
+		if (zsock_setsockopt(fd, SOL_TLS, TLS_SESSION_CACHE, &cache, sizeof(cache)) < 0) {
+			LOG_WRN("[TLS] Session cache unavailable (errno=%d)", errno);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,86 @@
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+
+#include "comm_engine.h"
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(comm_engine);
+
+static int tcp_client_open(struct comm_context *ctx)
+{
+	int ret;
+	int one = 1;
+
+	/* The socket has to match the family of the server address */
+	if (comm_addr_parse(ctx->peer_ip, ctx->peer_port, &ctx->peer_addr, &ctx->peer_addr_len) < 0) {
+		LOG_ERR("Invalid server address (%s)", ctx->peer_ip);
+		return -EINVAL;
+	}
+
+	ctx->sock_fd = zsock_socket(ctx->peer_addr.ss_family, SOCK_STREAM, COMM_PROTO_STREAM);
+	if (ctx->sock_fd < 0) {
+		int err = errno;
+
+		LOG_ERR("Could not create socket (errno=%d)", err);
+		return -err;
+	}
+	ctx->socket_open = true;
+	comm_bind_socket(ctx, ctx->sock_fd);
+
+	ret = comm_tls_setup(ctx, ctx->sock_fd, false);
+	if (ret < 0) {
+		return ret;
+	}
+
+	/* Echo traffic is small request/response, do not wait for Nagle */
+	zsock_setsockopt(ctx->sock_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	/* With TLS, connect() returns after the handshake */
+	int64_t start = k_uptime_get();
+
+	ret = zsock_connect(ctx->sock_fd, (struct sockaddr *)&ctx->peer_addr, ctx->peer_addr_len);
+	if (ret < 0) {
+		int err = errno;
+
+		LOG_ERR("Could not connect to server (errno=%d)", err);
+		return -err;
+	}
+	comm_record_handshake(ctx, (uint32_t)(k_uptime_get() - start));
+
+	LOG_INF("[Client] Connected to %s:%d", ctx->peer_ip, ctx->peer_port);
+	return 0;
+}
+
+static int tcp_client_send(struct comm_context *ctx, const void *buf, size_t len)
+{
+	int ret = zsock_send(ctx->sock_fd, buf, len, 0);
+
+	return ret < 0 ? -errno : ret;
+}
+
+static int tcp_client_recv(struct comm_context *ctx, void *buf, size_t len)
+{
+	int ret = zsock_recv(ctx->sock_fd, buf, len, 0);
+
+	return ret < 0 ? -errno : ret;
+}
+
+static void tcp_client_close(struct comm_context *ctx)
+{
+	if (ctx->socket_open) {
+		zsock_close(ctx->sock_fd);
+		ctx->socket_open = false;
+		ctx->sock_fd = -1;
+		LOG_INF("[Client] Closed");
+	}
+}
+
+const struct comm_transport comm_transport_tcp_client = {
+	.name = "TCP client",
+	.open = tcp_client_open,
+	.send = tcp_client_send,
+	.recv = tcp_client_recv,
+	.close = tcp_client_close,
+};
@@ -0,0 +1,123 @@
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+
+#include "comm_engine.h"
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(comm_engine);
+
+/* The listening socket outlives client connections, a reconnect only
+ * waits for the next client */
+static int tcp_server_listen(struct comm_context *ctx)
+{
+	struct sockaddr_storage addr;
+	net_socklen_t addr_len;
+	int one = 1;
+	int ret;
+
+	ctx->listen_fd = comm_socket_server(SOCK_STREAM, COMM_PROTO_STREAM);
+	if (ctx->listen_fd < 0) {
+		ret = ctx->listen_fd;
+		ctx->listen_fd = -1;
+		LOG_ERR("Could not create socket (errno=%d)", -ret);
+		return ret;
+	}
+	zsock_setsockopt(ctx->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	comm_bind_socket(ctx, ctx->listen_fd);
+
+	/* Accepted connections inherit the TLS settings */
+	ret = comm_tls_setup(ctx, ctx->listen_fd, true);
+	if (ret < 0) {
+		zsock_close(ctx->listen_fd);
+		ctx->listen_fd = -1;
+		return ret;
+	}
+
+	addr_len = comm_addr_any(ctx->cfg->port, &addr);
+	if (zsock_bind(ctx->listen_fd, (struct sockaddr *)&addr, addr_len) < 0 ||
+	    zsock_listen(ctx->listen_fd, 1) < 0) {
+		int err = errno;
+
+		LOG_ERR("Could not establish server (errno=%d)", err);
+		zsock_close(ctx->listen_fd);
+		ctx->listen_fd = -1;
+		return -err;
+	}
+
+	LOG_INF("[Server] listening at %s:%d", ctx->ip_addr, ctx->cfg->port);
+	return 0;
+}
+
+static int tcp_server_open(struct comm_context *ctx)
+{
+	char client_ip[COMM_ADDR_LEN];
+	int one = 1;
+	int ret;
+
+	if (ctx->listen_fd < 0) {
+		ret = tcp_server_listen(ctx);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	ctx->peer_addr_len = sizeof(ctx->peer_addr);
+	ctx->sock_fd = zsock_accept(ctx->listen_fd, (struct sockaddr *)&ctx->peer_addr, &ctx->peer_addr_len);
+	if (ctx->sock_fd < 0) {
+		int err = errno;
+
+		LOG_ERR("accept failed (errno=%d)", err);
+		return -err;
+	}
+	ctx->socket_open = true;
+	zsock_setsockopt(ctx->sock_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	if (comm_addr_to_string(&ctx->peer_addr, client_ip, sizeof(client_ip)) != NULL) {
+		LOG_INF("[Server] Client connected from %s", client_ip);
+	}
+	return 0;
+}
+
+static int tcp_server_send(struct comm_context *ctx, const void *buf, size_t len)
+{
+	int ret = zsock_send(ctx->sock_fd, buf, len, 0);
+
+	return ret < 0 ? -errno : ret;
+}
+
+static int tcp_server_recv(struct comm_context *ctx, void *buf, size_t len)
+{
+	int ret = zsock_recv(ctx->sock_fd, buf, len, 0);
+
+	return ret < 0 ? -errno : ret;
+}
+
+static void tcp_server_close(struct comm_context *ctx)
+{
+	if (ctx->socket_open) {
+		zsock_close(ctx->sock_fd);
+		ctx->socket_open = false;
+		ctx->sock_fd = -1;
+		LOG_INF("[Server] Client closed");
+	}
+}
+
+static void tcp_server_release(struct comm_context *ctx)
+{
+	if (ctx->listen_fd >= 0) {
+		zsock_close(ctx->listen_fd);
+		ctx->listen_fd = -1;
+		LOG_INF("[Server] Closed");
+	}
+}
+
+const struct comm_transport comm_transport_tcp_server = {
+	.name = "TCP server",
+	.open = tcp_server_open,
+	.send = tcp_server_send,
+	.recv = tcp_server_recv,
+	.close = tcp_server_close,
+	.release = tcp_server_release,
+};
@@ -0,0 +1,80 @@
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+
+#include "comm_engine.h"
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(comm_engine);
+
+static int udp_open(struct comm_context *ctx)
+{
+	struct sockaddr_storage addr;
+	net_socklen_t addr_len;
+	int ret;
+
+	ctx->sock_fd = comm_socket_server(SOCK_DGRAM, COMM_PROTO_DGRAM);
+	if (ctx->sock_fd < 0) {
+		ret = ctx->sock_fd;
+		ctx->sock_fd = -1;
+		LOG_ERR("Could not create socket (errno=%d)", -ret);
+		return ret;
+	}
+	ctx->socket_open = true;
+	comm_bind_socket(ctx, ctx->sock_fd);
+
+	/* DTLS: the handshake runs inside the first recvfrom() */
+	ret = comm_tls_setup(ctx, ctx->sock_fd, true);
+	if (ret < 0) {
+		return ret;
+	}
+
+	addr_len = comm_addr_any(ctx->cfg->port, &addr);
+	if (zsock_bind(ctx->sock_fd, (struct sockaddr *)&addr, addr_len) < 0) {
+		int err = errno;
+
+		LOG_ERR("Could not establish server (errno=%d)", err);
+		return -err;
+	}
+
+	LOG_INF("[Server] listening at %s:%d", ctx->ip_addr, ctx->cfg->port);
+	return 0;
+}
+
+/* Replies go to whoever sent the last datagram */
+static int udp_send(struct comm_context *ctx, const void *buf, size_t len)
+{
+	int ret = zsock_sendto(ctx->sock_fd, buf, len, 0,
+			       (struct sockaddr *)&ctx->peer_addr, ctx->peer_addr_len);
+
+	return ret < 0 ? -errno : ret;
+}
+
+static int udp_recv(struct comm_context *ctx, void *buf, size_t len)
+{
+	ctx->peer_addr_len = sizeof(ctx->peer_addr);
+	int ret = zsock_recvfrom(ctx->sock_fd, buf, len, 0,
+				 (struct sockaddr *)&ctx->peer_addr, &ctx->peer_addr_len);
+
+	return ret < 0 ? -errno : ret;
+}
+
+static void udp_close(struct comm_context *ctx)
+{
+	if (ctx->socket_open) {
+		zsock_close(ctx->sock_fd);
+		ctx->socket_open = false;
+		ctx->sock_fd = -1;
+		LOG_INF("[Server] Closed");
+	}
+}
+
+const struct comm_transport comm_transport_udp = {
+	.name = "UDP server",
+	.datagram = true,
+	.open = udp_open,
+	.send = udp_send,
+	.recv = udp_recv,
+	.close = udp_close,
+};
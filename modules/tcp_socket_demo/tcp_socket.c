@@ -2,25 +2,19 @@
 #include <string.h>
 #include <stdbool.h>
 #include <zephyr/kernel.h>
-#include <zephyr/drivers/gpio.h>
-#include <zephyr/net/socket.h>
 
-#include "wifi_utilities.h"
+#include "comm_engine.h"
+#if defined(CONFIG_WIFI)
 #include "secret/wifi_pswd.h"
+#else
+/* No credentials needed when running on the host network (native_sim) */
+#define BITCRAZE_SSID ""
+#define BITCRAZE_PASSWORD ""
+#endif
 #include "tcp_socket.h"
 
 #include <zephyr/logging/log.h>
 
-static const struct gpio_dt_spec led_red = GPIO_DT_SPEC_GET(LED0_NODE, gpios);
-static const struct gpio_dt_spec led_green = GPIO_DT_SPEC_GET(LED1_NODE, gpios);
-static const struct gpio_dt_spec led_blue = GPIO_DT_SPEC_GET(LED2_NODE, gpios);
-
-#define LED_TURN_OFF() do { gpio_pin_set_dt(&led_red, 0); gpio_pin_set_dt(&led_green, 0); gpio_pin_set_dt(&led_blue, 0); } while(0)
-#define LED_TURN_RED() do { gpio_pin_set_dt(&led_red, 1); gpio_pin_set_dt(&led_green, 0); gpio_pin_set_dt(&led_blue, 0); } while(0)
-#define LED_TURN_GREEN() do { gpio_pin_set_dt(&led_red, 0); gpio_pin_set_dt(&led_green, 1); gpio_pin_set_dt(&led_blue, 0); } while(0)
-#define LED_TURN_BLUE() do { gpio_pin_set_dt(&led_red, 0); gpio_pin_set_dt(&led_green, 0); gpio_pin_set_dt(&led_blue, 1); } while(0)
-#define LED_TURN_YELLOW() do { gpio_pin_set_dt(&led_red, 1); gpio_pin_set_dt(&led_green, 1); gpio_pin_set_dt(&led_blue, 0); } while(0)
-
 static const char *messages[] = {
 	"Hello, Server!",
 	"How are you?",
@@ -29,6 +23,15 @@ static const char *messages[] = {
 	NULL
 };
 
+struct client_state {
+	int next;                   /* index into messages */
+	bool awaiting_reply;
+	uint32_t sent_cycles;
+#ifdef CONFIG_TCP_SOCKET_DEMO_COMPRESS
+	int32_t rtt_us[ARRAY_SIZE(messages) - 1];
+	bool rtt_sent;              /* the RTTs went out as a sample frame */
+#endif
+};
 
 LOG_MODULE_REGISTER(tcp_socket_demo, LOG_LEVEL_DBG);
 
@@ -36,218 +39,113 @@ K_THREAD_DEFINE(BLINK_THREAD, CONFIG_TCP_SOCKET_THREAD_STACK_SIZE,
                 run_tcp_socket_demo, NULL, NULL, NULL,
                 SOCKET_THREAD_PRIORITY, 0, 0);
 
-static const char *state_to_string(communication_state_t state)
+/* After a reconnect the message that was in flight is sent again */
+static void on_link_up(struct comm_context *ctx)
 {
-	switch (state) {
-	case COMM_WIFI_CONNECTING:
-		return "COMM_WIFI_CONNECTING";
-	case COMM_WAITING_FOR_IP:
-		return "COMM_WAITING_FOR_IP";
-	case COMM_ESTABLISHING_SERVER:
-		return "COMM_CONNECTING_TO_SERVER";
-	case COMM_SENDING_MESSAGES:
-		return "COMM_SENDING_MESSAGES";
-	case COMM_FAILURE:
-		return "COMM_FAILURE";
-	case COMM_CLEANUP:
-		return "COMM_CLEANUP";
-	case COMM_DONE:
-		return "COMM_DONE";
-	default:
-		return "COMM_UNKNOWN";
-	}
+	struct client_state *state = ctx->user_data;
+
+	state->awaiting_reply = false;
 }
 
-static communication_state_t state_wifi_connecting(communication_context_t *ctx)
+/* send_next() returns COMM_STEP_AGAIN once something was sent,
+ * COMM_STEP_DONE when there is nothing left to send, or -errno */
+#ifdef CONFIG_TCP_SOCKET_DEMO_COMPRESS
+/* Text goes through the LZ codec and, once all messages are answered,
+ * their round trip times follow as one delta-coded sample frame */
+static int send_next(struct comm_context *ctx, struct client_state *state)
 {
-	LED_TURN_RED();
-	if (my_wifi_init() != 0) {
-		LOG_ERR("Failed to initialize WiFi module");
-		ctx->failure_from_state = COMM_WIFI_CONNECTING;
-		return COMM_FAILURE;
-	}
-
-	LOG_INF("Connecting to WiFi...");
+	const char *msg = messages[state->next];
+	int ret;
 
-	if (wifi_connect(BITCRAZE_SSID, BITCRAZE_PASSWORD)) {
-		LOG_ERR("Failed to connect to WiFi");
-		ctx->failure_from_state = COMM_WIFI_CONNECTING;
-		return COMM_FAILURE;
+	if (msg == NULL) {
+		if (state->rtt_sent) {
+			return COMM_STEP_DONE;
+		}
+		state->rtt_sent = true;
+		ret = comm_send_samples(ctx, state->rtt_us, state->next, 1);
+	} else {
+		ret = comm_send_encoded(ctx, COMM_CODEC_LZ, msg, strlen(msg));
 	}
-
-	ctx->wifi_connected = true;
-	LED_TURN_BLUE();
-	return COMM_WAITING_FOR_IP;
+	return MIN(ret, COMM_STEP_AGAIN);
 }
 
-static communication_state_t state_waiting_for_ip(communication_context_t *ctx)
+static void on_reply(struct client_state *state, uint32_t rtt_us)
 {
-	if (wifi_wait_for_ip_addr() != 0) {
-		LOG_ERR("Failed while waiting for IPv4 address");
-		ctx->failure_from_state = COMM_WAITING_FOR_IP;
-		return COMM_FAILURE;
+	if (messages[state->next] != NULL) {
+		state->rtt_us[state->next] = rtt_us;
+		state->next++;
 	}
-	LED_TURN_GREEN();
-	return COMM_ESTABLISHING_SERVER;
 }
-
-static communication_state_t state_connecting_to_server(communication_context_t *ctx)
+#else
+static int send_next(struct comm_context *ctx, struct client_state *state)
 {
-	int ret;
-
-	ctx->sock_fd = zsock_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-	if (ctx->sock_fd < 0) {
-		LOG_ERR("Could not create socket (errno=%d)", errno);
-		ctx->failure_from_state = COMM_ESTABLISHING_SERVER;
-		return COMM_FAILURE;
-	}
-	ctx->socket_open = true;
+	const char *msg = messages[state->next];
 
-	memset(&ctx->server_addr, 0, sizeof(ctx->server_addr));
-	ctx->server_addr.sin_family = AF_INET;
-	ctx->server_addr.sin_port = htons(SERVER_PORT);
-
-	ret = zsock_inet_pton(AF_INET, SERVER_IP, &ctx->server_addr.sin_addr);
-	if (ret != 1) {
-		LOG_ERR("Invalid SERVER_IP (%s)", SERVER_IP);
-		ctx->failure_from_state = COMM_ESTABLISHING_SERVER;
-		return COMM_FAILURE;
-	}
-
-	ret = zsock_connect(ctx->sock_fd, (struct sockaddr *)&ctx->server_addr, sizeof(ctx->server_addr));
-	if (ret < 0) {
-		LOG_ERR("Could not connect to server (errno=%d)", errno);
-		ctx->failure_from_state = COMM_ESTABLISHING_SERVER;
-		return COMM_FAILURE;
+	if (msg == NULL) {
+		return COMM_STEP_DONE;
 	}
+	return MIN(comm_send(ctx, msg, strlen(msg)), COMM_STEP_AGAIN);
+}
 
-	LOG_INF("[Client] Connected to %s:%d", SERVER_IP, SERVER_PORT);
-	LED_TURN_YELLOW();
-	return COMM_SENDING_MESSAGES;
+static void on_reply(struct client_state *state, uint32_t rtt_us)
+{
+	ARG_UNUSED(rtt_us);
+	state->next++;
 }
+#endif
 
-static communication_state_t state_sending_messages(communication_context_t *ctx)
+static int exchange_messages(struct comm_context *ctx)
 {
+	struct client_state *state = ctx->user_data;
 	int ret;
 
-	for (int i = 0; messages[i] != NULL; i++) {
-		LED_TURN_GREEN();
-		ret = zsock_send(ctx->sock_fd, messages[i], strlen(messages[i]), 0);
-		LED_TURN_YELLOW();
-		if (ret < 0) {
-			LOG_ERR("send failed (errno=%d)", errno);
-			ctx->failure_from_state = COMM_SENDING_MESSAGES;
-			return COMM_FAILURE;
+	if (!state->awaiting_reply) {
+		state->sent_cycles = k_cycle_get_32();
+		ret = send_next(ctx, state);
+		if (ret == COMM_STEP_DONE || ret < 0) {
+			return ret;
 		}
-
-		LOG_DBG("[Client] Sent: %s", messages[i]);
-		LED_TURN_GREEN();
-		ret = zsock_recv(ctx->sock_fd, ctx->buffer, sizeof(ctx->buffer) - 1, 0);
-		LED_TURN_YELLOW();
-		if (ret <= 0) {
-			if (ret == 0) {
-				LOG_WRN("[Client] Server closed the connection");
-			} else {
-				LOG_ERR("recv failed (errno=%d)", errno);
-			}
-			ctx->failure_from_state = COMM_SENDING_MESSAGES;
-			return COMM_FAILURE;
-		}
-
-		ctx->buffer[ret] = '\0';
-		LOG_DBG("[Client] Received: %s", ctx->buffer);
+		LOG_DBG("[Client] Sent: %s", messages[state->next] != NULL ? messages[state->next] : "RTT samples");
+		state->awaiting_reply = true;
 	}
 
-	return COMM_CLEANUP;
-}
-
-static communication_state_t state_failure(communication_context_t *ctx)
-{
-	LOG_ERR("[Failure] Called from: %s", state_to_string(ctx->failure_from_state));
-	LOG_ERR("[Failure] Context: sock_fd=%d socket_open=%d wifi_connected=%d exit_code=%d",
-			ctx->sock_fd,
-			ctx->socket_open,
-			ctx->wifi_connected,
-			ctx->exit_code);
-
-	ctx->exit_code = -1;
-	while (1) {
-		LED_TURN_RED();
-		k_sleep(K_SECONDS(1));
-		LED_TURN_OFF();
-		k_sleep(K_SECONDS(1));
+	ret = comm_recv(ctx, ctx->buffer, sizeof(ctx->buffer) - 1);
+	if (ret == -EAGAIN) {
+		return COMM_STEP_AGAIN;
 	}
-	return COMM_CLEANUP;
-}
-
-static communication_state_t state_cleanup(communication_context_t *ctx)
-{
-	if (ctx->socket_open) {
-		zsock_close(ctx->sock_fd);
-		ctx->socket_open = false;
-		LOG_INF("[Client] Closed");
+	if (ret < 0) {
+		return ret;
 	}
 
-	if (ctx->wifi_connected) {
-		wifi_disconnect();
-		ctx->wifi_connected = false;
-	}
+	ctx->buffer[ret] = '\0';
+	LOG_DBG("[Client] Received: %s", ctx->buffer);
+	state->awaiting_reply = false;
+
+	uint32_t rtt_us = k_cyc_to_us_floor32(k_cycle_get_32() - state->sent_cycles);
 
-	return COMM_DONE;
+	comm_perf_rtt(rtt_us);
+	on_reply(state, rtt_us);
+	return COMM_STEP_AGAIN;
 }
 
+static const struct comm_config tcp_demo_config = {
+	.name = "TCP ECHO CLIENT DEMO",
+	.ssid = BITCRAZE_SSID,
+	.psk = BITCRAZE_PASSWORD,
+	.transport = &comm_transport_tcp_client,
+	.peer_ip = SERVER_IP,
+#ifdef CONFIG_TCP_SOCKET_DEMO_DISCOVERY
+	.service = "echo-tcp",
+#endif
+	.port = SERVER_PORT,
+	.reconnect = true,
+	.step = exchange_messages,
+	.link_up = on_link_up,
+};
+
 int run_tcp_socket_demo(void)
 {
-	communication_state_t state = COMM_WIFI_CONNECTING;
-
-	communication_context_t ctx = {
-		.sock_fd = -1,
-		.wifi_connected = false,
-		.socket_open = false,
-		.exit_code = 0,
-		.failure_from_state = COMM_FAILURE,
-	};
-
-	int ret = gpio_pin_configure_dt(&led_red, GPIO_OUTPUT_INACTIVE);
-    ret |= gpio_pin_configure_dt(&led_green, GPIO_OUTPUT_INACTIVE);
-    ret |= gpio_pin_configure_dt(&led_blue, GPIO_OUTPUT_INACTIVE);
-    if (ret < 0) {
-        state = COMM_FAILURE;
-    }
-	LED_TURN_OFF();
-
-
-	LOG_INF("TCP ECHO CLIENT DEMO");
-
-	while (state != COMM_DONE) {
-		switch (state) {
-		case COMM_WIFI_CONNECTING:
-			state = state_wifi_connecting(&ctx);
-			break;
-		case COMM_WAITING_FOR_IP:
-			state = state_waiting_for_ip(&ctx);
-			break;
-		case COMM_ESTABLISHING_SERVER:
-			state = state_connecting_to_server(&ctx);
-			break;
-		case COMM_SENDING_MESSAGES:
-			state = state_sending_messages(&ctx);
-			break;
-		case COMM_FAILURE:
-			state = state_failure(&ctx);
-			break;
-		case COMM_CLEANUP:
-			state = state_cleanup(&ctx);
-			break;
-		case COMM_DONE:
-			break;
-		default:
-			ctx.failure_from_state = state;
-			state = COMM_FAILURE;
-			break;
-		}
-	}
-	LED_TURN_OFF();
+	static struct client_state state;
 
-	return ctx.exit_code;
+	return comm_engine_run(&tcp_demo_config, &state);
 }
@@ -1,27 +1,50 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <zephyr/kernel.h>
-#include <zephyr/drivers/gpio.h>
 #include <zephyr/net/socket.h>
 
+#include "comm_engine.h"
 #include "wifi_utilities.h"
+#if defined(CONFIG_WIFI)
 #include "secret/wifi_pswd.h"
-#include "zephyr/net/net_ip.h"
+#else
+/* No credentials needed when running on the host network (native_sim) */
+#define BITCRAZE_SSID ""
+#define BITCRAZE_PASSWORD ""
+#endif
 #include "udp_socket.h"
 
 #include <zephyr/logging/log.h>
 
-static const struct gpio_dt_spec led_red = GPIO_DT_SPEC_GET(LED0_NODE, gpios);
-static const struct gpio_dt_spec led_green = GPIO_DT_SPEC_GET(LED1_NODE, gpios);
-static const struct gpio_dt_spec led_blue = GPIO_DT_SPEC_GET(LED2_NODE, gpios);
-
-#define LED_TURN_OFF() do { gpio_pin_set_dt(&led_red, 0); gpio_pin_set_dt(&led_green, 0); gpio_pin_set_dt(&led_blue, 0); } while(0)
-#define LED_TURN_RED() do { gpio_pin_set_dt(&led_red, 1); gpio_pin_set_dt(&led_green, 0); gpio_pin_set_dt(&led_blue, 0); } while(0)
-#define LED_TURN_GREEN() do { gpio_pin_set_dt(&led_red, 0); gpio_pin_set_dt(&led_green, 1); gpio_pin_set_dt(&led_blue, 0); } while(0)
-#define LED_TURN_BLUE() do { gpio_pin_set_dt(&led_red, 0); gpio_pin_set_dt(&led_green, 0); gpio_pin_set_dt(&led_blue, 1); } while(0)
-#define LED_TURN_YELLOW() do { gpio_pin_set_dt(&led_red, 1); gpio_pin_set_dt(&led_green, 1); gpio_pin_set_dt(&led_blue, 0); } while(0)
-
+#define ECHO_PREFIX     "Echo: "
+#define ECHO_PREFIX_LEN (sizeof(ECHO_PREFIX) - 1)
+
+/* Control message of loadgen -W: "PROFILE <name>", answered with
+ * "PROFILE <name> OK" or "PROFILE <name> ERR <errno>" */
+#define PROFILE_CMD     "PROFILE "
+#define PROFILE_CMD_LEN (sizeof(PROFILE_CMD) - 1)
+
+#ifdef CONFIG_UDP_SOCKET_DEMO_TELEMETRY
+/* "TELEMETRY <batches>": stream that many batches of a test pattern to the
+ * requester, see PC_Site/telemetry_client.c */
+#define TELEMETRY_CMD     "TELEMETRY "
+#define TELEMETRY_CMD_LEN (sizeof(TELEMETRY_CMD) - 1)
+
+/* Sample g carries (int16)(7 g), (int16)(-3 g) and g, so the PC can check
+ * every sample on its own */
+#define TELEMETRY_SCHEMA_PATTERN 1
+#define TELEMETRY_ROW_BYTES      (2 + 2 + 4)
+
+static const struct comm_telemetry_schema pattern_schema = {
+	.id = TELEMETRY_SCHEMA_PATTERN,
+	.columns = 3,
+	.width = { 2, 2, 4 },
+};
+static uint32_t telemetry_buf[COMM_TELEMETRY_BUF_SIZE(CONFIG_UDP_SOCKET_DEMO_TELEMETRY_SAMPLES,
+						     TELEMETRY_ROW_BYTES) / sizeof(uint32_t)];
+#endif
 
 LOG_MODULE_REGISTER(udp_socket_demo, LOG_LEVEL_DBG);
 
@@ -29,225 +52,194 @@ K_THREAD_DEFINE(udp_thread, CONFIG_UDP_SOCKET_THREAD_STACK_SIZE,
                 run_udp_socket_demo, NULL, NULL, NULL,
                 SOCKET_THREAD_PRIORITY, 0, 0);
 
-static const char *state_to_string(communication_state_t state)
+static int handle_profile(struct comm_context *ctx, char *name)
 {
-	switch (state) {
-	case COMM_WIFI_CONNECTING:
-		return "COMM_WIFI_CONNECTING";
-	case COMM_WAITING_FOR_IP:
-		return "COMM_WAITING_FOR_IP";
-	case COMM_ESTABLISHING_SERVER:
-		return "COMM_CONNECTING_TO_SERVER";
-	case COMM_SENDING_MESSAGES:
-		return "COMM_SENDING_MESSAGES";
-	case COMM_FAILURE:
-		return "COMM_FAILURE";
-	case COMM_CLEANUP:
-		return "COMM_CLEANUP";
-	case COMM_DONE:
-		return "COMM_DONE";
-	default:
-		return "COMM_UNKNOWN";
-	}
-}
+	wifi_power_profile_t profile;
+	int len;
+	int ret;
 
-static communication_state_t state_wifi_connecting(communication_context_t *ctx)
-{
-	LED_TURN_RED();
-	if (my_wifi_init() != 0) {
-		LOG_ERR("Failed to initialize WiFi module");
-		ctx->failure_from_state = COMM_WIFI_CONNECTING;
-		return COMM_FAILURE;
+	name[strcspn(name, "\r\n")] = '\0';
+	ret = wifi_power_profile_from_string(name, &profile);
+	if (ret == 0) {
+		ret = wifi_set_power_profile(profile);
 	}
-
-	LOG_INF("Connecting to WiFi...");
-
-	if (wifi_connect(BITCRAZE_SSID, BITCRAZE_PASSWORD)) {
-		LOG_ERR("Failed to connect to WiFi");
-		ctx->failure_from_state = COMM_WIFI_CONNECTING;
-		return COMM_FAILURE;
+	LOG_INF("Power profile %s requested: %d", name, ret);
+
+	/* name lives in ctx->buffer, so format the reply into a copy */
+	char reply[64];
+	if (ret == 0) {
+		len = snprintf(reply, sizeof(reply), PROFILE_CMD "%s OK", name);
+	} else {
+		len = snprintf(reply, sizeof(reply), PROFILE_CMD "%s ERR %d", name, -ret);
+	}
+	if (len >= (int)sizeof(reply)) {
+		len = sizeof(reply) - 1;
 	}
 
-	ctx->wifi_connected = true;
-	LED_TURN_BLUE();
-	return COMM_WAITING_FOR_IP;
+	ret = comm_send_prio(ctx, COMM_PRIO_VO, reply, (size_t)len);
+	return ret < 0 && ret != -ENOBUFS ? ret : COMM_STEP_AGAIN;
 }
 
-static communication_state_t state_waiting_for_ip(communication_context_t *ctx)
-{
-	if (wifi_wait_for_ip_addr(ctx->ip_addr) != 0) {
-		LOG_ERR("Failed while waiting for IPv4 address");
-		ctx->failure_from_state = COMM_WAITING_FOR_IP;
-		return COMM_FAILURE;
-	}
-	LED_TURN_GREEN();
-	return COMM_ESTABLISHING_SERVER;
-}
+#ifdef CONFIG_UDP_SOCKET_DEMO_TELEMETRY
+static struct comm_telemetry_batch telemetry_batch;
+static uint32_t telemetry_next_sample;
+static int telemetry_left;
+static struct sockaddr_storage telemetry_peer;
+static net_socklen_t telemetry_peer_len;
 
-static communication_state_t state_establishing_server(communication_context_t *ctx)
+/* Fill and send batches while the bulk queue has room for them. Without
+ * priority classes the space is unlimited and all batches go at once. */
+static int telemetry_step(struct comm_context *ctx)
 {
-	int ret;
-
-	// init socket
-	ctx->sock_fd = zsock_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-	if (ctx->sock_fd < 0) {
-		LOG_ERR("Could not create socket (errno=%d)", errno);
-		ctx->failure_from_state = COMM_ESTABLISHING_SERVER;
-		return COMM_FAILURE;
-	}
-	ctx->socket_open = true;
-
-	// set port
-	memset(&ctx->server_addr, 0, sizeof(ctx->server_addr));
-	ctx->server_addr.sin_family = AF_INET;
-	ctx->server_addr.sin_port = htons(SERVER_PORT);
-	ctx->server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-
-	// bind socket to port
-	ret = zsock_bind(ctx->sock_fd, (struct sockaddr *) &ctx->server_addr, sizeof(ctx->server_addr));
-	if (ret < 0) {
-		LOG_ERR("Could not establish server (errno=%d)", errno);
-		ctx->failure_from_state = COMM_ESTABLISHING_SERVER;
-		return COMM_FAILURE;
-	}
-
-	LOG_INF("[Server] listening at %s:%d", ctx->ip_addr, SERVER_PORT);
-	LED_TURN_YELLOW();
-	return COMM_SENDING_MESSAGES;
-}
+	struct comm_telemetry_batch *batch = &telemetry_batch;
 
-static communication_state_t state_sending_messages(communication_context_t *ctx)
-{
-	struct net_sockaddr client_addr;
-	net_socklen_t client_addr_len = sizeof(client_addr);
-	int ret;
+	while (telemetry_left > 0 && comm_prio_space(ctx, batch->prio) >= sizeof(telemetry_buf)) {
+		for (;;) {
+			uint32_t g = telemetry_next_sample;
+			int32_t values[] = { (int16_t)(7 * g), (int16_t)(-3 * g), (int32_t)g };
 
-	ctx->failure_from_state = COMM_SENDING_MESSAGES;
-
-	for (;;) {
-		LED_TURN_GREEN();
-		ret = zsock_recvfrom(ctx->sock_fd, ctx->buffer, sizeof(ctx->buffer) - 1, 0, &client_addr, &client_addr_len);
-		LED_TURN_YELLOW();
-		if (ret <= 0) {
-			if (ret == 0) {
-				LOG_WRN("[Server] Client closed the connection");
-			} else {
-				LOG_ERR("recvfrom failed (errno=%d)", errno);
+			if (comm_telemetry_add(batch, k_ticks_to_us_floor64(k_uptime_ticks()), values) < 0) {
+				break;
 			}
-			return COMM_FAILURE;
+			telemetry_next_sample++;
 		}
 
-		if (net_addr_ntop(client_addr.sa_family,
-                 &((struct sockaddr_in *) &client_addr)->sin_addr,
-                 ctx->client_ip_addr,
-                 NET_IPV4_ADDR_LEN) == NULL) {
-        	LOG_ERR("Failed to convert gateway address to string");
-		}
+		/* Batches go to the requester, not to whoever sent last */
+		struct sockaddr_storage peer = ctx->peer_addr;
+		net_socklen_t peer_len = ctx->peer_addr_len;
 
-		ctx->buffer[ret] = '\0';
-		LOG_DBG("[Server] Received: %s from %s", ctx->buffer, ctx->client_ip_addr);
+		ctx->peer_addr = telemetry_peer;
+		ctx->peer_addr_len = telemetry_peer_len;
+		int ret = comm_telemetry_send(ctx, batch);
+		ctx->peer_addr = peer;
+		ctx->peer_addr_len = peer_len;
 
-		char response[BUFFER_SIZE + 10];
-        snprintf(response, sizeof(response), "Echo: %s", ctx->buffer);
-		LED_TURN_GREEN();
-		ret = zsock_sendto(ctx->sock_fd, response, strlen(response), 0, &client_addr, client_addr_len);
-		LED_TURN_YELLOW();
+		/* A batch that found no queue memory is lost, the PC counts it */
+		if (ret < 0 && ret != -ENOBUFS) {
+			return ret;
+		}
+		telemetry_left--;
+	}
+	return COMM_STEP_AGAIN;
+}
+
+static int handle_telemetry(struct comm_context *ctx, const char *arg)
+{
+	if (telemetry_batch.schema == NULL) {
+		int ret = comm_telemetry_init(&telemetry_batch, &pattern_schema, telemetry_buf,
+					      sizeof(telemetry_buf));
 		if (ret < 0) {
-			LOG_ERR("send failed (errno=%d)", errno);
-			return COMM_FAILURE;
+			LOG_ERR("Telemetry buffer too small (%d)", ret);
+			return COMM_STEP_AGAIN;
 		}
+		telemetry_batch.prio = COMM_PRIO_BK;
 	}
 
-	return COMM_CLEANUP;
+	/* "TELEMETRY 0" stops a running stream */
+	telemetry_left = MAX(atoi(arg), 0);
+	telemetry_peer = ctx->peer_addr;
+	telemetry_peer_len = ctx->peer_addr_len;
+	LOG_INF("Sending %d telemetry batches of %u samples", telemetry_left, telemetry_batch.capacity);
+	return telemetry_step(ctx);
 }
+#endif
 
-static communication_state_t state_failure(communication_context_t *ctx)
+/* "@<class> " in front of a message selects the class of its echo, see
+ * loadgen -Q. The prefix is echoed like the rest of the message. */
+static comm_prio_t echo_class(const char *payload)
 {
-	LOG_ERR("[Failure] Called from: %s", state_to_string(ctx->failure_from_state));
-	LOG_ERR("[Failure] Context: sock_fd=%d socket_open=%d wifi_connected=%d exit_code=%d",
-			ctx->sock_fd,
-			ctx->socket_open,
-			ctx->wifi_connected,
-			ctx->exit_code);
-
-	ctx->exit_code = -1;
-	while (1) {
-		LED_TURN_RED();
-		k_sleep(K_SECONDS(1));
-		LED_TURN_OFF();
-		k_sleep(K_SECONDS(1));
+#ifdef CONFIG_COMM_ENGINE_PRIORITY
+	comm_prio_t prio;
+	char name[3];
+
+	if (payload[0] == '@' && payload[1] != '\0' && payload[2] != '\0' && payload[3] == ' ') {
+		name[0] = payload[1];
+		name[1] = payload[2];
+		name[2] = '\0';
+		if (comm_prio_from_string(name, &prio) == 0) {
+			return prio;
+		}
 	}
-	return COMM_CLEANUP;
+#else
+	ARG_UNUSED(payload);
+#endif
+	return COMM_PRIO_BE;
 }
 
-static communication_state_t state_cleanup(communication_context_t *ctx)
+static int echo_message(struct comm_context *ctx)
 {
-	if (ctx->socket_open) {
-		zsock_close(ctx->sock_fd);
-		ctx->socket_open = false;
-		LOG_INF("[Server] Closed");
+	char client_ip_addr[COMM_ADDR_LEN];
+	int ret;
+
+	/* Receive behind the prefix so the reply is built in place */
+#ifdef CONFIG_UDP_SOCKET_DEMO_TELEMETRY
+	ret = telemetry_step(ctx);
+	if (ret < 0) {
+		return ret;
 	}
+#endif
+#ifdef CONFIG_UDP_SOCKET_DEMO_BULK
+	ret = comm_bulk_poll(ctx);
+	if (ret < 0) {
+		return ret;
+	}
+#endif
 
-	if (ctx->wifi_connected) {
-		wifi_disconnect();
-		ctx->wifi_connected = false;
+	char *payload = ctx->buffer + ECHO_PREFIX_LEN;
+	ret = comm_recv(ctx, payload, sizeof(ctx->buffer) - ECHO_PREFIX_LEN - 1);
+	if (ret == -EAGAIN) {
+		return COMM_STEP_AGAIN;
 	}
+	if (ret < 0) {
+		return ret;
+	}
+#ifdef CONFIG_UDP_SOCKET_DEMO_BULK
+	if (comm_bulk_is_packet(payload, (size_t)ret)) {
+		ret = comm_bulk_handle(ctx, payload, (size_t)ret);
+		return ret < 0 ? ret : COMM_STEP_AGAIN;
+	}
+#endif
+	payload[ret] = '\0';
+
+	if (strncmp(payload, PROFILE_CMD, PROFILE_CMD_LEN) == 0) {
+		return handle_profile(ctx, payload + PROFILE_CMD_LEN);
+	}
+#ifdef CONFIG_UDP_SOCKET_DEMO_TELEMETRY
+	if (strncmp(payload, TELEMETRY_CMD, TELEMETRY_CMD_LEN) == 0) {
+		return handle_telemetry(ctx, payload + TELEMETRY_CMD_LEN);
+	}
+#endif
 
-	return COMM_DONE;
+	if (comm_addr_to_string(&ctx->peer_addr, client_ip_addr, sizeof(client_ip_addr)) == NULL) {
+		LOG_ERR("Failed to convert client address to string");
+		client_ip_addr[0] = '\0';
+	}
+	LOG_DBG("[Server] Received: %s from %s", payload, client_ip_addr);
+
+	memcpy(ctx->buffer, ECHO_PREFIX, ECHO_PREFIX_LEN);
+	ret = comm_send_prio(ctx, echo_class(payload), ctx->buffer, ECHO_PREFIX_LEN + (size_t)ret);
+	/* A full queue drops the echo like a busy network would */
+	return ret < 0 && ret != -ENOBUFS ? ret : COMM_STEP_AGAIN;
 }
 
+static const struct comm_config udp_demo_config = {
+	.name = "ECHO SERVER DEMO",
+	.ssid = BITCRAZE_SSID,
+	.psk = BITCRAZE_PASSWORD,
+#ifdef CONFIG_UDP_SOCKET_DEMO_TCP
+	.transport = &comm_transport_tcp_server,
+#else
+	.transport = &comm_transport_udp,
+#endif
+	.port = SERVER_PORT,
+	.reconnect = true,
+#ifdef CONFIG_UDP_SOCKET_DEMO_SECONDARY_IFACE
+	.iface = WIFI_IFACE_SECONDARY,
+#endif
+	.step = echo_message,
+};
+
 int run_udp_socket_demo(void)
 {
-	communication_state_t state = COMM_WIFI_CONNECTING;
-
-	communication_context_t ctx = {
-		.sock_fd = -1,
-		.wifi_connected = false,
-		.socket_open = false,
-		.exit_code = 0,
-		.failure_from_state = COMM_FAILURE,
-	};
-
-	int ret = gpio_pin_configure_dt(&led_red, GPIO_OUTPUT_INACTIVE);
-    ret |= gpio_pin_configure_dt(&led_green, GPIO_OUTPUT_INACTIVE);
-    ret |= gpio_pin_configure_dt(&led_blue, GPIO_OUTPUT_INACTIVE);
-    if (ret < 0) {
-        state = COMM_FAILURE;
-    }
-	LED_TURN_OFF();
-
-
-	LOG_INF("TCP ECHO CLIENT DEMO");
-
-	while (state != COMM_DONE) {
-		switch (state) {
-		case COMM_WIFI_CONNECTING:
-			state = state_wifi_connecting(&ctx);
-			break;
-		case COMM_WAITING_FOR_IP:
-			state = state_waiting_for_ip(&ctx);
-			break;
-		case COMM_ESTABLISHING_SERVER:
-			state = state_establishing_server(&ctx);
-			break;
-		case COMM_SENDING_MESSAGES:
-			state = state_sending_messages(&ctx);
-			break;
-		case COMM_FAILURE:
-			state = state_failure(&ctx);
-			break;
-		case COMM_CLEANUP:
-			state = state_cleanup(&ctx);
-			break;
-		case COMM_DONE:
-			break;
-		default:
-			ctx.failure_from_state = state;
-			state = COMM_FAILURE;
-			break;
-		}
-	}
-	LED_TURN_OFF();
-
-	return ctx.exit_code;
+	return comm_engine_run(&udp_demo_config, NULL);
 }
@@ -0,0 +1,164 @@
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/net_if.h>
+#include <zephyr/net/net_ip.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/logging/log.h>
+#if defined(CONFIG_WIFI_UTILITIES_SECONDARY_IFACE)
+#include <zephyr/net/ethernet.h>
+#endif
+
+#include "wifi_utilities.h"
+
+LOG_MODULE_DECLARE(wifi);
+
+static const char *const role_names[WIFI_IFACE_COUNT] = {
+    [WIFI_IFACE_WIFI] = "wifi",
+    [WIFI_IFACE_SECONDARY] = "secondary",
+};
+
+#if defined(CONFIG_WIFI_UTILITIES_SECONDARY_IFACE)
+// first Ethernet interface that is not the WiFi one (wired port or native_sim TAP)
+static void pick_secondary(struct net_if *iface, void *user_data)
+{
+    struct net_if **found = user_data;
+
+    if (*found == NULL && !net_if_is_wifi(iface) &&
+        net_if_l2(iface) == &NET_L2_GET_NAME(ETHERNET)) {
+        *found = iface;
+    }
+}
+#endif
+
+const char *wifi_iface_role_to_string(wifi_iface_role_t role)
+{
+    return role < WIFI_IFACE_COUNT ? role_names[role] : "unknown";
+}
+
+// look the interface up by its L2 instead of relying on the default one
+struct net_if *wifi_iface_get(wifi_iface_role_t role)
+{
+    struct net_if *iface = NULL;
+
+    if (role == WIFI_IFACE_WIFI) {
+#if defined(CONFIG_WIFI)
+        iface = net_if_get_first_wifi();
+#endif
+    } else if (role == WIFI_IFACE_SECONDARY) {
+#if defined(CONFIG_WIFI_UTILITIES_SECONDARY_IFACE)
+        net_if_foreach(pick_secondary, &iface);
+#endif
+    }
+    return iface;
+}
+
+int wifi_iface_get_ipv4(wifi_iface_role_t role, char *ip_addr, size_t len)
+{
+    struct net_if *iface = wifi_iface_get(role);
+    struct in_addr *addr;
+
+    if (iface == NULL) {
+        return -ENODEV;
+    }
+    // a preferred address, wherever it sits in the unicast table
+    addr = net_if_ipv4_get_global_addr(iface, NET_ADDR_PREFERRED);
+    if (addr == NULL) {
+        return -EADDRNOTAVAIL;
+    }
+    if (net_addr_ntop(AF_INET, addr, ip_addr, len) == NULL) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+#if defined(CONFIG_NET_IPV6)
+// global before link-local; tentative addresses (DAD still running) cannot send yet
+static struct in6_addr *get_ipv6(struct net_if *iface)
+{
+    struct in6_addr *addr = net_if_ipv6_get_global_addr(NET_ADDR_PREFERRED, &iface);
+
+    return addr != NULL ? addr : net_if_ipv6_get_ll(iface, NET_ADDR_PREFERRED);
+}
+#endif
+
+int wifi_iface_get_addr(wifi_iface_role_t role, char *ip_addr, size_t len)
+{
+    int ret = wifi_iface_get_ipv4(role, ip_addr, len);
+
+#if defined(CONFIG_NET_IPV6)
+    struct in6_addr *addr;
+
+    if (ret != -EADDRNOTAVAIL) {
+        return ret;
+    }
+    addr = get_ipv6(wifi_iface_get(role));
+    if (addr == NULL) {
+        return -EADDRNOTAVAIL;
+    }
+    if (net_addr_ntop(AF_INET6, addr, ip_addr, len) == NULL) {
+        return -EINVAL;
+    }
+    return 0;
+#else
+    return ret;
+#endif
+}
+
+bool wifi_iface_ready(wifi_iface_role_t role)
+{
+    struct net_if *iface = wifi_iface_get(role);
+
+    if (iface == NULL || !net_if_is_up(iface)) {
+        return false;
+    }
+#if defined(CONFIG_WIFI_UTILITIES_FIRST_ADDR)
+    // whichever family came first, usually IPv6 link-local long before DHCPv4
+    if (get_ipv6(iface) != NULL) {
+        return true;
+    }
+#endif
+    return net_if_ipv4_get_global_addr(iface, NET_ADDR_PREFERRED) != NULL;
+}
+
+// the preferred role when it is usable, otherwise the other one
+int wifi_iface_select(wifi_iface_role_t preferred, wifi_iface_role_t *role)
+{
+    if (wifi_iface_ready(preferred)) {
+        *role = preferred;
+        return 0;
+    }
+    for (int i = 0; i < WIFI_IFACE_COUNT; i++) {
+        if (i != (int)preferred && wifi_iface_ready((wifi_iface_role_t)i)) {
+            *role = (wifi_iface_role_t)i;
+            return 0;
+        }
+    }
+    return -ENETDOWN;
+}
+
+// pin a socket to one interface, so it never leaves through another one
+int wifi_iface_bind_socket(int sock, wifi_iface_role_t role)
+{
+    struct net_if *iface = wifi_iface_get(role);
+    struct ifreq ifreq = { 0 };
+
+    if (iface == NULL) {
+        return -ENODEV;
+    }
+
+#if defined(CONFIG_NET_INTERFACE_NAME)
+    if (net_if_get_name(iface, ifreq.ifr_name, sizeof(ifreq.ifr_name)) < 0) {
+        return -EINVAL;
+    }
+#else
+    strncpy(ifreq.ifr_name, net_if_get_device(iface)->name, sizeof(ifreq.ifr_name) - 1);
+#endif
+
+    if (zsock_setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, &ifreq, sizeof(ifreq)) < 0) {
+        int err = errno;
+
+        LOG_WRN("Could not bind socket to %s (errno=%d)", ifreq.ifr_name, err);
+        return -err;
+    }
+    return 0;
+}
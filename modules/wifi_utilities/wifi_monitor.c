@@ -0,0 +1,247 @@
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/net_if.h>
+#include <zephyr/net/wifi_mgmt.h>
+#include <zephyr/logging/log.h>
+#if defined(CONFIG_NET_STATISTICS_WIFI)
+#include <zephyr/net/net_stats.h>
+#endif
+
+#include "wifi_utilities.h"
+
+LOG_MODULE_DECLARE(wifi);
+
+#define WINDOW CONFIG_WIFI_UTILITIES_MONITOR_WINDOW
+
+// The monitor runs on its own low-priority queue so a scan during a roam
+// never holds up the system work queue
+static K_THREAD_STACK_DEFINE(monitor_stack, CONFIG_WIFI_UTILITIES_MONITOR_STACK_SIZE);
+static struct k_work_q monitor_q;
+static struct k_work_delayable monitor_work;
+static bool monitor_q_started;
+
+static K_MUTEX_DEFINE(metrics_lock);
+static wifi_link_metrics_t metrics;
+static wifi_link_event_cb_t event_cb;
+
+// Sliding window of samples, indexed by sample_count % WINDOW
+static int8_t rssi_window[WINDOW];
+static uint32_t tx_window[WINDOW];
+static uint32_t tx_fail_window[WINDOW];
+static uint32_t beacon_miss_window[WINDOW];
+static uint32_t sample_count;
+
+static uint32_t degraded_samples;
+static int64_t last_roam_ms;
+
+#if defined(CONFIG_NET_STATISTICS_WIFI)
+static struct net_stats_wifi last_stats;
+#endif
+
+static void reset_window(void)
+{
+    sample_count = 0;
+    degraded_samples = 0;
+#if defined(CONFIG_NET_STATISTICS_WIFI)
+    memset(&last_stats, 0, sizeof(last_stats));
+#endif
+}
+
+// Record one status sample and recompute the window statistics
+static void add_sample(struct net_if *iface, const struct wifi_iface_status *status, wifi_link_metrics_t *m)
+{
+    uint32_t slot = sample_count % WINDOW;
+    uint32_t n, tx = 0, tx_fail = 0, beacons = 0;
+    int sum = 0;
+
+    rssi_window[slot] = (int8_t)status->rssi;
+    tx_window[slot] = 0;
+    tx_fail_window[slot] = 0;
+    beacon_miss_window[slot] = 0;
+
+#if defined(CONFIG_NET_STATISTICS_WIFI)
+    struct net_stats_wifi stats;
+
+    if (net_mgmt(NET_REQUEST_STATS_GET_WIFI, iface, &stats, sizeof(stats)) == 0) {
+        if (sample_count > 0) {
+            tx_window[slot] = stats.pkts.tx - last_stats.pkts.tx;
+            tx_fail_window[slot] = stats.errors.tx - last_stats.errors.tx;
+            beacon_miss_window[slot] = stats.sta_mgmt.beacons_miss - last_stats.sta_mgmt.beacons_miss;
+        }
+        last_stats = stats;
+    }
+#else
+    ARG_UNUSED(iface);
+#endif
+
+    sample_count++;
+    n = MIN(sample_count, WINDOW);
+
+    m->rssi = (int8_t)status->rssi;
+    m->rssi_min = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        sum += rssi_window[i];
+        tx += tx_window[i];
+        tx_fail += tx_fail_window[i];
+        beacons += beacon_miss_window[i];
+        if (i == 0 || rssi_window[i] < m->rssi_min) {
+            m->rssi_min = rssi_window[i];
+        }
+    }
+    m->rssi_avg = (int8_t)(sum / (int)n);
+    m->rssi_trend = (int8_t)(rssi_window[slot] - rssi_window[(sample_count - n) % WINDOW]);
+    m->tx_fail_permille = tx > 0 ? (uint16_t)MIN(1000U, tx_fail * 1000U / tx) : 0;
+    m->beacons_missed = beacons;
+    memcpy(m->bssid, status->bssid, WIFI_UTIL_BSSID_LEN);
+    m->channel = status->channel;
+    m->updated_ms = k_uptime_get();
+}
+
+// Thresholds with hysteresis, so a link at the edge does not flap
+static wifi_link_quality_t classify(const wifi_link_metrics_t *m, wifi_link_quality_t previous)
+{
+    int degraded = CONFIG_WIFI_UTILITIES_RSSI_DEGRADED;
+    int bad = CONFIG_WIFI_UTILITIES_RSSI_BAD;
+
+    if (previous == WIFI_LINK_DEGRADED || previous == WIFI_LINK_BAD) {
+        degraded += CONFIG_WIFI_UTILITIES_RSSI_HYSTERESIS;
+    }
+    if (previous == WIFI_LINK_BAD) {
+        bad += CONFIG_WIFI_UTILITIES_RSSI_HYSTERESIS;
+    }
+
+    if (m->rssi_avg < bad || m->tx_fail_permille > CONFIG_WIFI_UTILITIES_TX_FAIL_BAD_PERMILLE) {
+        return WIFI_LINK_BAD;
+    }
+    if (m->rssi_avg < degraded || m->tx_fail_permille > CONFIG_WIFI_UTILITIES_TX_FAIL_DEGRADED_PERMILLE) {
+        return WIFI_LINK_DEGRADED;
+    }
+    return WIFI_LINK_GOOD;
+}
+
+static const char *quality_to_string(wifi_link_quality_t quality)
+{
+    switch (quality) {
+    case WIFI_LINK_GOOD:
+        return "good";
+    case WIFI_LINK_DEGRADED:
+        return "degraded";
+    case WIFI_LINK_BAD:
+        return "bad";
+    default:
+        return "down";
+    }
+}
+
+// Roam while the link still works: right away when it is bad, after a
+// full window when it is only degraded
+static void maybe_roam(wifi_link_metrics_t *m)
+{
+    int64_t now = k_uptime_get();
+
+    if (m->quality == WIFI_LINK_GOOD || m->quality == WIFI_LINK_DOWN) {
+        degraded_samples = 0;
+        return;
+    }
+    degraded_samples++;
+
+    if (m->quality == WIFI_LINK_DEGRADED && degraded_samples < WINDOW) {
+        return;
+    }
+    if (last_roam_ms != 0 && now - last_roam_ms < CONFIG_WIFI_UTILITIES_ROAM_HOLDOFF_MS) {
+        return;
+    }
+    last_roam_ms = now;
+
+    int ret = wifi_roam_to_better_ap(m->bssid, m->rssi_avg, CONFIG_WIFI_UTILITIES_ROAM_MARGIN_DB);
+
+    if (ret == 0) {
+        m->roams++;
+        reset_window();
+    } else if (ret != -ENOENT && ret != -EBUSY) {
+        // Not associated any more, the application reconnects
+        m->quality = WIFI_LINK_DOWN;
+        reset_window();
+    }
+}
+
+static void monitor_poll(struct k_work *work)
+{
+    struct net_if *iface = wifi_iface_get(WIFI_IFACE_WIFI);
+    struct wifi_iface_status status = { 0 };
+    wifi_link_metrics_t m;
+    wifi_link_quality_t previous;
+
+    ARG_UNUSED(work);
+
+    k_mutex_lock(&metrics_lock, K_FOREVER);
+    m = metrics;
+    k_mutex_unlock(&metrics_lock);
+    previous = m.quality;
+
+    if (iface != NULL &&
+        net_mgmt(NET_REQUEST_WIFI_IFACE_STATUS, iface, &status, sizeof(status)) == 0 &&
+        status.state >= WIFI_STATE_ASSOCIATED) {
+        add_sample(iface, &status, &m);
+        m.quality = classify(&m, previous);
+        maybe_roam(&m);
+    } else {
+        m.quality = WIFI_LINK_DOWN;
+        reset_window();
+    }
+
+    k_mutex_lock(&metrics_lock, K_FOREVER);
+    metrics = m;
+    k_mutex_unlock(&metrics_lock);
+
+    if (m.quality != previous) {
+        LOG_INF("Link %s: RSSI %d dBm (avg %d, trend %d), tx fail %u permille",
+                quality_to_string(m.quality), m.rssi, m.rssi_avg, m.rssi_trend, m.tx_fail_permille);
+        if (event_cb != NULL) {
+            event_cb(m.quality, &m);
+        }
+    }
+
+    k_work_reschedule_for_queue(&monitor_q, &monitor_work,
+                                K_MSEC(CONFIG_WIFI_UTILITIES_MONITOR_INTERVAL_MS));
+}
+
+int wifi_monitor_start(void)
+{
+    if (!monitor_q_started) {
+        k_work_queue_start(&monitor_q, monitor_stack, K_THREAD_STACK_SIZEOF(monitor_stack),
+                           CONFIG_WIFI_UTILITIES_MONITOR_PRIORITY, NULL);
+        k_thread_name_set(&monitor_q.thread, "wifi_monitor");
+        k_work_init_delayable(&monitor_work, monitor_poll);
+        monitor_q_started = true;
+    }
+
+    reset_window();
+    k_work_reschedule_for_queue(&monitor_q, &monitor_work, K_NO_WAIT);
+    return 0;
+}
+
+void wifi_monitor_stop(void)
+{
+    if (!monitor_q_started) {
+        return;
+    }
+    k_work_cancel_delayable_sync(&monitor_work, &(struct k_work_sync){});
+
+    k_mutex_lock(&metrics_lock, K_FOREVER);
+    metrics.quality = WIFI_LINK_DOWN;
+    k_mutex_unlock(&metrics_lock);
+}
+
+void wifi_monitor_set_callback(wifi_link_event_cb_t cb)
+{
+    event_cb = cb;
+}
+
+int wifi_get_link_metrics(wifi_link_metrics_t *out)
+{
+    k_mutex_lock(&metrics_lock, K_FOREVER);
+    *out = metrics;
+    k_mutex_unlock(&metrics_lock);
+    return out->quality == WIFI_LINK_DOWN ? -ENOTCONN : 0;
+}
@@ -1,19 +1,85 @@
 #include <string.h>
 #include <zephyr/kernel.h>
-#include <zephyr/net/wifi_mgmt.h>
+#include <zephyr/net/net_ip.h>
+#include <zephyr/sys/atomic.h>
 #include <zephyr/logging/log.h>
 
-#include "wifi.h"
+#include "wifi_utilities.h"
 
 LOG_MODULE_REGISTER(wifi, LOG_LEVEL_DBG);
 
+static const char *const power_profile_names[WIFI_POWER_PROFILE_COUNT] = {
+    [WIFI_POWER_LOW_LATENCY] = "low-latency",
+    [WIFI_POWER_BALANCED] = "balanced",
+    [WIFI_POWER_LOW_POWER] = "low-power",
+};
+
+static wifi_power_profile_t power_profile = WIFI_POWER_PROFILE_COUNT;  // driver default
+
+const char *wifi_power_profile_to_string(wifi_power_profile_t profile)
+{
+    return profile < WIFI_POWER_PROFILE_COUNT ? power_profile_names[profile] : "driver-default";
+}
+
+int wifi_power_profile_from_string(const char *name, wifi_power_profile_t *profile)
+{
+    for (int i = 0; i < WIFI_POWER_PROFILE_COUNT; i++) {
+        if (strcmp(name, power_profile_names[i]) == 0) {
+            *profile = (wifi_power_profile_t)i;
+            return 0;
+        }
+    }
+    return -EINVAL;
+}
+
+wifi_power_profile_t wifi_get_power_profile(void)
+{
+    return power_profile;
+}
+
+#if defined(CONFIG_WIFI)
+
+#include <zephyr/net/wifi_mgmt.h>
+
+BUILD_ASSERT(WIFI_UTIL_BSSID_LEN == WIFI_MAC_ADDR_LEN, "BSSID length mismatch");
+
 // Event callbacks
 static struct net_mgmt_event_callback wifi_cb;
 static struct net_mgmt_event_callback ipv4_cb;
+#if defined(CONFIG_WIFI_UTILITIES_FIRST_ADDR)
+static struct net_mgmt_event_callback ipv6_cb;
+#endif
+static struct net_mgmt_event_callback scan_cb;
 
 // Semaphores
 static K_SEM_DEFINE(sem_wifi, 0, 1);
-static K_SEM_DEFINE(sem_ipv4, 0, 1);
+static K_SEM_DEFINE(sem_addr, 0, 1);
+static K_SEM_DEFINE(sem_scan, 0, 1);
+static K_SEM_DEFINE(sem_disconnected, 0, 1);
+
+// Serialises wifi_connect() and roaming, both use sem_wifi
+static K_MUTEX_DEFINE(connect_lock);
+
+// Associated with an AP, per the last connect or disconnect result
+static atomic_t connected;
+
+// Set while an individual TWT agreement from the low-power profile exists,
+// an agreement ends with the association
+static bool twt_active;
+
+// Credentials of the current connection, needed to roam
+static char conn_ssid[WIFI_UTIL_SSID_MAX_LEN + 1];
+static char conn_psk[WIFI_UTIL_PSK_MAX_LEN + 1];
+
+// Raw results of the running scan, filled from the net_mgmt callback
+static wifi_ap_t scan_results[WIFI_SCAN_MAX_RESULTS];
+static int scan_count;
+
+// Ranked results of the last scan, best first
+static K_MUTEX_DEFINE(cache_lock);
+static wifi_ap_t ap_cache[WIFI_SCAN_CACHE_SIZE];
+static int ap_cache_count;
+static int64_t ap_cache_time_ms;
 
 // called when the WiFi is connected
 static void on_wifi_connection_event(struct net_mgmt_event_callback *cb, 
@@ -25,8 +91,10 @@ static void on_wifi_connection_event(struct net_mgmt_event_callback *cb,
     if (mgmt_event == NET_EVENT_WIFI_CONNECT_RESULT) {
         if (status->status) {
             LOG_ERR("WiFi connection failed with status: %d", status->status);
+            twt_active = false;
         } else {
             LOG_INF("Connected!");
+            atomic_set(&connected, 1);
             k_sem_give(&sem_wifi);
         }
     } else if (mgmt_event == NET_EVENT_WIFI_DISCONNECT_RESULT) {
@@ -35,8 +103,36 @@ static void on_wifi_connection_event(struct net_mgmt_event_callback *cb,
         }
         else {
             LOG_INF("Disconnected");
+            atomic_set(&connected, 0);
+            twt_active = false;
             k_sem_take(&sem_wifi, K_NO_WAIT);
+            k_sem_give(&sem_disconnected);
+        }
+    }
+}
+
+// called for every AP found and once when the scan is complete
+static void on_wifi_scan_event(struct net_mgmt_event_callback *cb,
+                               uint64_t mgmt_event,
+                               struct net_if *iface)
+{
+    if (mgmt_event == NET_EVENT_WIFI_SCAN_RESULT) {
+        const struct wifi_scan_result *res = (const struct wifi_scan_result *)cb->info;
+        wifi_ap_t *ap;
+
+        if (scan_count >= WIFI_SCAN_MAX_RESULTS || res->mac_length != WIFI_MAC_ADDR_LEN) {
+            return;
         }
+        ap = &scan_results[scan_count++];
+        memset(ap, 0, sizeof(*ap));
+        memcpy(ap->ssid, res->ssid, MIN(res->ssid_length, WIFI_UTIL_SSID_MAX_LEN));
+        memcpy(ap->bssid, res->mac, WIFI_MAC_ADDR_LEN);
+        ap->rssi = res->rssi;
+        ap->band = res->band;
+        ap->channel = res->channel;
+        ap->security = res->security;
+    } else if (mgmt_event == NET_EVENT_WIFI_SCAN_DONE) {
+        k_sem_give(&sem_scan);
     }
 }
 
@@ -45,16 +141,38 @@ static void on_ipv4_obtained(struct net_mgmt_event_callback *cb,
                              uint64_t mgmt_event, 
                              struct net_if *iface)
 {
-    // Signal that the IP address has been obtained (for ipv6, change accordingly)
-    if (mgmt_event == NET_EVENT_IPV4_ADDR_ADD) {
-        k_sem_give(&sem_ipv4);
+    // Signal that the IP address has been obtained,
+    // addresses of the secondary interface must not wake up the WiFi wait
+    if (mgmt_event == NET_EVENT_IPV4_ADDR_ADD && iface == wifi_iface_get(WIFI_IFACE_WIFI)) {
+        k_sem_give(&sem_addr);
     }
 }
 
+#if defined(CONFIG_WIFI_UTILITIES_FIRST_ADDR)
+// an added IPv6 address is tentative until DAD succeeds, the wait checks which one it is
+static void on_ipv6_obtained(struct net_mgmt_event_callback *cb,
+                             uint64_t mgmt_event,
+                             struct net_if *iface)
+{
+    if ((mgmt_event == NET_EVENT_IPV6_ADDR_ADD || mgmt_event == NET_EVENT_IPV6_DAD_SUCCEED) &&
+        iface == wifi_iface_get(WIFI_IFACE_WIFI)) {
+        k_sem_give(&sem_addr);
+    }
+}
+#endif
+
 
 // initialize the WIFi event callbacks
 int my_wifi_init(void)
 {
+    static bool initialized;
+
+    // Called again when the engine reconnects, a callback must not be added twice
+    if (initialized) {
+        return 0;
+    }
+    initialized = true;
+
     // Initialize the event callback
     net_mgmt_init_event_callback(&wifi_cb, 
                         on_wifi_connection_event, 
@@ -62,63 +180,429 @@ int my_wifi_init(void)
     net_mgmt_init_event_callback(&ipv4_cb,
                         on_ipv4_obtained,
                 NET_EVENT_IPV4_ADDR_ADD);
+#if defined(CONFIG_WIFI_UTILITIES_FIRST_ADDR)
+    // a callback of its own, event masks of different layer codes must not be mixed
+    net_mgmt_init_event_callback(&ipv6_cb,
+                        on_ipv6_obtained,
+                NET_EVENT_IPV6_ADDR_ADD | NET_EVENT_IPV6_DAD_SUCCEED);
+#endif
+    net_mgmt_init_event_callback(&scan_cb,
+                        on_wifi_scan_event,
+                NET_EVENT_WIFI_SCAN_RESULT | NET_EVENT_WIFI_SCAN_DONE);
 
     // Add the event callback
     net_mgmt_add_event_callback(&wifi_cb);
     net_mgmt_add_event_callback(&ipv4_cb);
+#if defined(CONFIG_WIFI_UTILITIES_FIRST_ADDR)
+    net_mgmt_add_event_callback(&ipv6_cb);
+#endif
+    net_mgmt_add_event_callback(&scan_cb);
 
     return 0;
 }
 
-// connect to WiFi (blocking)
-int wifi_connect(char *ssid, char *psk)
+// Higher is better: signal first, then 5/6 GHz, minus crowded channels
+static int16_t score_ap(const wifi_ap_t *ap)
+{
+    int score = ap->rssi;
+
+    if (ap->band == WIFI_FREQ_BAND_5_GHZ || ap->band == WIFI_FREQ_BAND_6_GHZ) {
+        score += CONFIG_WIFI_UTILITIES_5GHZ_BONUS;
+    }
+    score -= CONFIG_WIFI_UTILITIES_CHANNEL_PENALTY * ap->channel_aps;
+    return (int16_t)score;
+}
+
+// Cache order: APs of the SSID in use first, so a crowded scan cannot push
+// them out, then by score
+static bool ranks_before(const wifi_ap_t *a, const wifi_ap_t *b)
+{
+    bool a_ours = strcmp(a->ssid, conn_ssid) == 0;
+    bool b_ours = strcmp(b->ssid, conn_ssid) == 0;
+
+    if (a_ours != b_ours) {
+        return a_ours;
+    }
+    return a->score > b->score;
+}
+
+// Rank the raw scan results and replace the cache with the best of them
+static void update_cache(int64_t now_ms)
+{
+    // Channel load: other APs heard on the same channel
+    for (int i = 0; i < scan_count; i++) {
+        scan_results[i].channel_aps = 0;
+        for (int j = 0; j < scan_count; j++) {
+            if (j != i && scan_results[j].channel == scan_results[i].channel &&
+                scan_results[j].band == scan_results[i].band) {
+                scan_results[i].channel_aps++;
+            }
+        }
+        scan_results[i].score = score_ap(&scan_results[i]);
+        scan_results[i].seen_ms = now_ms;
+    }
+
+    k_mutex_lock(&cache_lock, K_FOREVER);
+    ap_cache_count = 0;
+    for (int i = 0; i < scan_count; i++) {
+        // Insertion sort, the cache is tiny; the weakest entry falls off the end
+        int pos = ap_cache_count;
+        while (pos > 0 && ranks_before(&scan_results[i], &ap_cache[pos - 1])) {
+            if (pos < WIFI_SCAN_CACHE_SIZE) {
+                ap_cache[pos] = ap_cache[pos - 1];
+            }
+            pos--;
+        }
+        if (pos < WIFI_SCAN_CACHE_SIZE) {
+            ap_cache[pos] = scan_results[i];
+            if (ap_cache_count < WIFI_SCAN_CACHE_SIZE) {
+                ap_cache_count++;
+            }
+        }
+    }
+    ap_cache_time_ms = now_ms;
+    k_mutex_unlock(&cache_lock);
+}
+
+// scan for APs and refresh the cache (blocking)
+int wifi_scan(void)
+{
+    struct net_if *iface = wifi_iface_get(WIFI_IFACE_WIFI);
+    int ret;
+
+    if (iface == NULL) {
+        return -ENODEV;
+    }
+    scan_count = 0;
+    k_sem_reset(&sem_scan);
+
+    ret = net_mgmt(NET_REQUEST_WIFI_SCAN, iface, NULL, 0);
+    if (ret) {
+        LOG_ERR("Scan request failed (%d)", ret);
+        return ret;
+    }
+    if (k_sem_take(&sem_scan, K_MSEC(CONFIG_WIFI_UTILITIES_SCAN_TIMEOUT_MS)) != 0) {
+        LOG_WRN("Scan did not complete, using %d partial results", scan_count);
+    }
+
+    update_cache(k_uptime_get());
+    LOG_INF("Scan found %d APs", scan_count);
+    return 0;
+}
+
+// best cached AP for an SSID, as long as the cache is fresh
+int wifi_get_best_ap(const char *ssid, wifi_ap_t *ap)
+{
+    int ret = -ENOENT;
+
+    k_mutex_lock(&cache_lock, K_FOREVER);
+    if (ap_cache_time_ms == 0 ||
+        k_uptime_get() - ap_cache_time_ms > CONFIG_WIFI_UTILITIES_SCAN_CACHE_TTL_MS) {
+        ret = -ESTALE;
+    } else {
+        for (int i = 0; i < ap_cache_count; i++) {
+            if (strcmp(ap_cache[i].ssid, ssid) == 0) {
+                *ap = ap_cache[i];
+                ret = 0;
+                break;
+            }
+        }
+    }
+    k_mutex_unlock(&cache_lock);
+    return ret;
+}
+
+// Send a connect request for the stored credentials, pinned to ap if given
+static int request_connect(const wifi_ap_t *ap, k_timeout_t timeout)
 {
-    // printk("h");
     int ret;
     struct net_if *iface;
     struct wifi_connect_req_params params = {};
 
     // Get the default network interface
-    iface = net_if_get_default();  // might need to change this, if the IRIS' wifi is not the default interface
+    iface = wifi_iface_get(WIFI_IFACE_WIFI);
+    if (iface == NULL) {
+        LOG_ERR("No WiFi interface found");
+        return -ENODEV;
+    }
 
     // Fill in the connection request parameters
-    params.ssid = (const uint8_t *)ssid;
-    params.ssid_length = strlen(ssid);
-    params.psk = (const uint8_t *)psk;
-    params.psk_length = strlen(psk);
-    params.security = WIFI_SECURITY_TYPE_PSK;  // WPA2-PSK security
+    params.ssid = (const uint8_t *)conn_ssid;
+    params.ssid_length = strlen(conn_ssid);
+    params.psk = (const uint8_t *)conn_psk;
+    params.psk_length = strlen(conn_psk);
+    params.security = WIFI_SECURITY_TYPE_PSK;  // WPA2-PSK unless the scan says otherwise
     params.band = WIFI_FREQ_BAND_UNKNOWN;  // Auto-select the band
     params.channel = WIFI_CHANNEL_ANY;  // Auto-select the channel
     params.mfp = WIFI_MFP_OPTIONAL;
 
+    // Pin the AP; without a scan hit (e.g. hidden SSID) let the driver pick
+    if (ap != NULL) {
+        memcpy(params.bssid, ap->bssid, WIFI_MAC_ADDR_LEN);
+        params.band = ap->band;
+        params.channel = ap->channel;
+        params.security = ap->security;
+        if (ap->security == WIFI_SECURITY_TYPE_NONE) {
+            params.psk = NULL;
+            params.psk_length = 0;
+        }
+        LOG_INF("Connecting to %s via %02x:%02x:%02x:%02x:%02x:%02x (RSSI %d dBm, channel %u, %u other APs)",
+                ap->ssid, ap->bssid[0], ap->bssid[1], ap->bssid[2],
+                ap->bssid[3], ap->bssid[4], ap->bssid[5],
+                ap->rssi, ap->channel, ap->channel_aps);
+    }
+
     // Connect to the WiFi network
     ret = net_mgmt(NET_REQUEST_WIFI_CONNECT, 
                   iface,
              &params,
                sizeof(struct wifi_connect_req_params));
+    if (ret) {
+        return ret;
+    }
 
     // Wait for the connection to complete
-    k_sem_take(&sem_wifi, K_FOREVER);
+    if (k_sem_take(&sem_wifi, timeout) != 0) {
+        return -ETIMEDOUT;
+    }
+    return 0;
+}
+
+bool wifi_is_connected(void)
+{
+    return atomic_get(&connected) != 0;
+}
+
+// connect to WiFi (blocking)
+int wifi_connect(char *ssid, char *psk)
+{
+    int ret;
+    wifi_ap_t best;
+
+    // A roam in progress ends within CONFIG_WIFI_UTILITIES_ROAM_TIMEOUT_MS,
+    // and may well have brought the link back by then
+    k_mutex_lock(&connect_lock, K_FOREVER);
+    if (wifi_is_connected() && strcmp(conn_ssid, ssid) == 0) {
+        k_mutex_unlock(&connect_lock);
+        return 0;
+    }
+
+    // Kept for roaming, which reconnects without the caller
+    strncpy(conn_ssid, ssid, sizeof(conn_ssid) - 1);
+    strncpy(conn_psk, psk, sizeof(conn_psk) - 1);
+
+    // Within the cache TTL reuse the last scan, otherwise scan first
+    ret = wifi_get_best_ap(ssid, &best);
+    if (ret == -ESTALE && wifi_scan() == 0) {
+        ret = wifi_get_best_ap(ssid, &best);
+    }
+
+    k_sem_reset(&sem_wifi);
+    ret = request_connect(ret == 0 ? &best : NULL,
+                          CONFIG_WIFI_UTILITIES_CONNECT_TIMEOUT_MS > 0 ?
+                          K_MSEC(CONFIG_WIFI_UTILITIES_CONNECT_TIMEOUT_MS) : K_FOREVER);
+    k_mutex_unlock(&connect_lock);
+    return ret;
+}
+
+// Move to a cached AP of the current SSID that is clearly better (blocking)
+int wifi_roam_to_better_ap(const uint8_t *current_bssid, int8_t current_rssi, int margin_db)
+{
+    struct net_if *iface = wifi_iface_get(WIFI_IFACE_WIFI);
+    wifi_ap_t candidate;
+    bool found = false;
+    int ret;
+
+    if (conn_ssid[0] == '\0' || iface == NULL) {
+        return -ENOTCONN;
+    }
+
+    // Roaming is the moment a fresh view of the neighbourhood pays off
+    if (wifi_get_best_ap(conn_ssid, &candidate) == -ESTALE) {
+        wifi_scan();
+    }
+
+    k_mutex_lock(&cache_lock, K_FOREVER);
+    for (int i = 0; i < ap_cache_count; i++) {
+        if (strcmp(ap_cache[i].ssid, conn_ssid) == 0 &&
+            memcmp(ap_cache[i].bssid, current_bssid, WIFI_MAC_ADDR_LEN) != 0 &&
+            ap_cache[i].rssi >= current_rssi + margin_db) {
+            candidate = ap_cache[i];
+            found = true;
+            break;
+        }
+    }
+    k_mutex_unlock(&cache_lock);
+
+    if (!found) {
+        return -ENOENT;
+    }
+    // The application is (re)connecting itself, that wins
+    if (k_mutex_lock(&connect_lock, K_NO_WAIT) != 0) {
+        return -EBUSY;
+    }
+
+    LOG_INF("Roaming from RSSI %d dBm to %d dBm", current_rssi, candidate.rssi);
+    k_sem_reset(&sem_disconnected);
+    net_mgmt(NET_REQUEST_WIFI_DISCONNECT, iface, NULL, 0);
+    k_sem_take(&sem_disconnected, K_MSEC(CONFIG_WIFI_UTILITIES_ROAM_TIMEOUT_MS));
+    k_sem_reset(&sem_wifi);
+
+    // Every wait is bounded: the monitor's work item runs this, and
+    // wifi_disconnect() waits for that work item to finish
+    ret = request_connect(&candidate, K_MSEC(CONFIG_WIFI_UTILITIES_ROAM_TIMEOUT_MS));
+    if (ret) {
+        LOG_WRN("Roaming failed (%d), reconnecting to any AP", ret);
+        k_sem_reset(&sem_wifi);
+        ret = request_connect(NULL, K_MSEC(CONFIG_WIFI_UTILITIES_ROAM_TIMEOUT_MS));
+    }
+    k_mutex_unlock(&connect_lock);
+    if (ret) {
+        LOG_ERR("Reconnect after roaming failed (%d), left to the application", ret);
+    } else if (power_profile < WIFI_POWER_PROFILE_COUNT) {
+        // The new association starts with the driver's power settings
+        wifi_set_power_profile(power_profile);
+    }
+    return ret;
+}
+
+static int set_ps_param(struct net_if *iface, struct wifi_ps_params *params)
+{
+    int ret = net_mgmt(NET_REQUEST_WIFI_PS, iface, params, sizeof(*params));
+
+    if (ret) {
+        LOG_WRN("Power-save parameter %d rejected (%d, reason %d)",
+                params->type, ret, params->fail_reason);
+    }
+    return ret;
+}
+
+static int twt_request(struct net_if *iface, bool setup)
+{
+    struct wifi_twt_params twt = { 0 };
+
+    twt.negotiation_type = WIFI_TWT_INDIVIDUAL;
+    twt.setup_cmd = WIFI_TWT_SETUP_CMD_REQUEST;
+    twt.dialog_token = 1;
+    twt.flow_id = 1;
+
+    if (setup) {
+        twt.operation = WIFI_TWT_SETUP;
+        twt.setup.twt_wake_interval = CONFIG_WIFI_UTILITIES_TWT_WAKE_DURATION_US;
+        twt.setup.twt_interval = CONFIG_WIFI_UTILITIES_TWT_INTERVAL_US;
+        twt.setup.implicit = true;
+        twt.setup.trigger = false;
+        twt.setup.announce = false;
+    } else {
+        twt.operation = WIFI_TWT_TEARDOWN;
+        twt.teardown.teardown_all = true;
+    }
+
+    return net_mgmt(NET_REQUEST_WIFI_TWT, iface, &twt, sizeof(twt));
+}
+
+// switch the radio to one of the power-save profiles
+int wifi_set_power_profile(wifi_power_profile_t profile)
+{
+    struct net_if *iface = wifi_iface_get(WIFI_IFACE_WIFI);
+    struct wifi_iface_status status = { 0 };
+    struct wifi_ps_params ps = { 0 };
+    int ret;
+
+    if (profile >= WIFI_POWER_PROFILE_COUNT) {
+        return -EINVAL;
+    }
+    if (iface == NULL) {
+        return -ENODEV;
+    }
+
+    // An agreement left over from low-power keeps the radio asleep between service periods
+    if (twt_active && profile != WIFI_POWER_LOW_POWER) {
+        twt_request(iface, false);
+        twt_active = false;
+    }
+
+    switch (profile) {
+    case WIFI_POWER_LOW_LATENCY:
+        ps.type = WIFI_PS_PARAM_STATE;
+        ps.enabled = WIFI_PS_DISABLED;
+        ret = set_ps_param(iface, &ps);
+        break;
+
+    case WIFI_POWER_BALANCED:
+        ps.type = WIFI_PS_PARAM_MODE;
+        ps.mode = WIFI_PS_MODE_WMM;
+        set_ps_param(iface, &ps);
+        ps.type = WIFI_PS_PARAM_WAKEUP_MODE;
+        ps.wakeup_mode = WIFI_PS_WAKEUP_MODE_DTIM;
+        set_ps_param(iface, &ps);
+        ps.type = WIFI_PS_PARAM_STATE;
+        ps.enabled = WIFI_PS_ENABLED;
+        ret = set_ps_param(iface, &ps);
+        break;
+
+    case WIFI_POWER_LOW_POWER:
+    default:
+        ps.type = WIFI_PS_PARAM_LISTEN_INTERVAL;
+        ps.listen_interval = CONFIG_WIFI_UTILITIES_PS_LISTEN_INTERVAL;
+        set_ps_param(iface, &ps);
+        ps.type = WIFI_PS_PARAM_WAKEUP_MODE;
+        ps.wakeup_mode = WIFI_PS_WAKEUP_MODE_LISTEN_INTERVAL;
+        set_ps_param(iface, &ps);
+        ps.type = WIFI_PS_PARAM_STATE;
+        ps.enabled = WIFI_PS_ENABLED;
+        ret = set_ps_param(iface, &ps);
 
+        // TWT on top, only where the AP offers it
+        if (ret == 0 && !twt_active &&
+            net_mgmt(NET_REQUEST_WIFI_IFACE_STATUS, iface, &status, sizeof(status)) == 0 &&
+            status.twt_capable) {
+            if (twt_request(iface, true) == 0) {
+                twt_active = true;
+            } else {
+                LOG_WRN("TWT setup rejected, using power save only");
+            }
+        }
+        break;
+    }
+
+    if (ret == 0) {
+        power_profile = profile;
+        LOG_INF("Power profile: %s%s", power_profile_names[profile], twt_active ? " (TWT)" : "");
+    }
     return ret;
 }
 
 // Wait for an IP address to be obtained (blocking)
 int wifi_wait_for_ip_addr(char *ip_addr)
+{
+    return wifi_wait_for_ip_addr_timeout(ip_addr, -1);
+}
+
+// Wait for an IP address on the WiFi interface, timeout_ms < 0 waits forever
+int wifi_wait_for_ip_addr_timeout(char *ip_addr, int32_t timeout_ms)
 {
     struct wifi_iface_status status;
     struct net_if *iface;
     char gw_addr[NET_IPV4_ADDR_LEN];
+    int64_t end = k_uptime_get() + timeout_ms;
 
     // Get interface
-    iface = net_if_get_default();  // might need to change this, if the IRIS' wifi is not the default interface
+    iface = wifi_iface_get(WIFI_IFACE_WIFI);
     if (iface == NULL) {
-        LOG_ERR("No default network interface found");
-        return -1;
+        LOG_ERR("No WiFi interface found");
+        return -ENODEV;
     }
 
-    // Wait for an IPv4 address to be obtained
-    k_sem_take(&sem_ipv4, K_FOREVER);
+    // Wait for an address to be obtained, unless DHCP (or SLAAC) was faster than us.
+    // Not every event is a usable address, e.g. a tentative IPv6 one, so check again
+    while (!wifi_iface_ready(WIFI_IFACE_WIFI)) {
+        k_timeout_t wait = timeout_ms < 0 ? K_FOREVER : K_MSEC(MAX(end - k_uptime_get(), 0));
+
+        if (k_sem_take(&sem_addr, wait) != 0) {
+            return -ETIMEDOUT;
+        }
+    }
 
     // Get the WiFi status
     if (net_mgmt(NET_REQUEST_WIFI_IFACE_STATUS,
@@ -131,18 +615,17 @@ int wifi_wait_for_ip_addr(char *ip_addr)
     }
 
     // Get the IP address
-    memset(ip_addr, 0, NET_IPV4_ADDR_LEN);  // Clear the buffer
-    if (net_addr_ntop(AF_INET,
-                &iface->config.ip.ipv4->unicast[0].ipv4.address.in_addr,
-                ip_addr, 
-                NET_IPV4_ADDR_LEN) == NULL) {
-        LOG_ERR("Failed to convert IP address to string");
+    memset(ip_addr, 0, WIFI_UTIL_ADDR_LEN);  // Clear the buffer
+    if (wifi_iface_get_addr(WIFI_IFACE_WIFI, ip_addr, WIFI_UTIL_ADDR_LEN) != 0) {
+        LOG_ERR("No preferred address on the WiFi interface");
         return -1;
     } 
 
-    // Get the gateway address
+    // Get the gateway address, only DHCPv4 provides one
     memset(gw_addr, 0, sizeof(gw_addr));  // Clear the buffer
-    if (net_addr_ntop(AF_INET,
+    if (strchr(ip_addr, ':') != NULL) {
+        strcpy(gw_addr, "none");
+    } else if (net_addr_ntop(AF_INET,
                  &iface->config.ip.ipv4->gw,
                  gw_addr,
                  sizeof(gw_addr)) == NULL) {
@@ -160,6 +643,20 @@ int wifi_wait_for_ip_addr(char *ip_addr)
         LOG_INF("  RSSI: %d dBm", status.rssi);
         LOG_INF("  IP Address: %s", ip_addr);
         LOG_INF("  Gateway: %s", gw_addr);
+#if defined(CONFIG_WIFI_UTILITIES_MONITOR)
+        wifi_monitor_start();
+#endif
+        // Power save and TWT end with the association: re-apply the profile
+        // chosen last, or the configured default on the first connect
+        wifi_power_profile_t profile = power_profile;
+#if defined(WIFI_UTILITIES_DEFAULT_POWER_PROFILE)
+        if (profile == WIFI_POWER_PROFILE_COUNT) {
+            profile = WIFI_UTILITIES_DEFAULT_POWER_PROFILE;
+        }
+#endif
+        if (profile < WIFI_POWER_PROFILE_COUNT) {
+            wifi_set_power_profile(profile);
+        }
         return 0;
     }
 
@@ -173,8 +670,17 @@ int wifi_disconnect(void)
     int ret;
     struct net_if *iface;
 
+#if defined(CONFIG_WIFI_UTILITIES_MONITOR)
+    wifi_monitor_stop();
+#endif
+    conn_ssid[0] = '\0';
+    twt_active = false;
+
     // Get the default network interface
-    iface = net_if_get_default();  // might need to change this, if the IRIS' wifi is not the default interface
+    iface = wifi_iface_get(WIFI_IFACE_WIFI);
+    if (iface == NULL) {
+        return -ENODEV;
+    }
 
     // Disconnect from the WiFi network
     ret = net_mgmt(NET_REQUEST_WIFI_DISCONNECT, 
@@ -184,3 +690,70 @@ int wifi_disconnect(void)
 
     return ret;
 }
+
+#else /* !CONFIG_WIFI */
+
+/*
+ * Stubs for targets without a WiFi driver, e.g. native_sim with offloaded
+ * host sockets. The host is already "connected", and sockets bound to
+ * INADDR_ANY are reachable on its loopback address.
+ */
+
+int my_wifi_init(void)
+{
+    LOG_INF("WiFi disabled, using the host network");
+    return 0;
+}
+
+int wifi_connect(char *ssid, char *psk)
+{
+    ARG_UNUSED(ssid);
+    ARG_UNUSED(psk);
+    return 0;
+}
+
+bool wifi_is_connected(void)
+{
+    return true;
+}
+
+int wifi_scan(void)
+{
+    return 0;
+}
+
+// Nothing to save on the host, only remember the choice
+int wifi_set_power_profile(wifi_power_profile_t profile)
+{
+    if (profile >= WIFI_POWER_PROFILE_COUNT) {
+        return -EINVAL;
+    }
+    power_profile = profile;
+    return 0;
+}
+
+int wifi_get_best_ap(const char *ssid, wifi_ap_t *ap)
+{
+    ARG_UNUSED(ssid);
+    ARG_UNUSED(ap);
+    return -ENOENT;
+}
+
+int wifi_wait_for_ip_addr(char *ip_addr)
+{
+    strncpy(ip_addr, "127.0.0.1", WIFI_UTIL_ADDR_LEN);
+    return 0;
+}
+
+int wifi_wait_for_ip_addr_timeout(char *ip_addr, int32_t timeout_ms)
+{
+    ARG_UNUSED(timeout_ms);
+    return wifi_wait_for_ip_addr(ip_addr);
+}
+
+int wifi_disconnect(void)
+{
+    return 0;
+}
+
+#endif /* CONFIG_WIFI */
@@ -1,9 +1,125 @@
 #ifndef WIFI_H
 #define WIFI_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define WIFI_UTIL_SSID_MAX_LEN 32
+#define WIFI_UTIL_BSSID_LEN    6
+#define WIFI_UTIL_PSK_MAX_LEN  64
+#define WIFI_UTIL_ADDR_LEN     46   // an IPv6 address as text, NET_IPV6_ADDR_LEN
+
+#define WIFI_SCAN_MAX_RESULTS  32   // APs kept from one scan
+#define WIFI_SCAN_CACHE_SIZE   16   // best of them kept for connecting
+
+// One AP from a scan; the cache keeps these sorted by score, best first, with the
+// APs of the SSID being connected ahead of all others
+typedef struct {
+    char ssid[WIFI_UTIL_SSID_MAX_LEN + 1];
+    uint8_t bssid[WIFI_UTIL_BSSID_LEN];
+    int8_t rssi;            // dBm
+    uint8_t band;           // enum wifi_frequency_bands
+    uint8_t channel;
+    uint8_t security;       // enum wifi_security_type
+    uint8_t channel_aps;    // other APs heard on the same channel
+    int16_t score;
+    int64_t seen_ms;        // k_uptime_get() of the scan
+} wifi_ap_t;
+
 int my_wifi_init(void); // rename, currently wifi_init has a name clash with nxp library
+// gives up after CONFIG_WIFI_UTILITIES_CONNECT_TIMEOUT_MS (0 = never) with -ETIMEDOUT
 int wifi_connect(char *ssid, char *psk);
+// associated with an AP; false after a roam whose reconnect failed, until wifi_connect()
+bool wifi_is_connected(void);
+// ip_addr holds WIFI_UTIL_ADDR_LEN bytes, see wifi_iface_get_addr() for the address
 int wifi_wait_for_ip_addr(char *ip_addr);
+// -ETIMEDOUT when the WiFi interface got no address within timeout_ms
+int wifi_wait_for_ip_addr_timeout(char *ip_addr, int32_t timeout_ms);
 int wifi_disconnect(void);
 
-#endif /* WIFI_H */
\ No newline at end of file
+int wifi_scan(void);
+// -ESTALE when the cache is older than CONFIG_WIFI_UTILITIES_SCAN_CACHE_TTL_MS
+int wifi_get_best_ap(const char *ssid, wifi_ap_t *ap);
+// -ENOENT when no cached AP of the current SSID beats current_rssi by margin_db,
+// -EBUSY while wifi_connect() runs. Gives up after CONFIG_WIFI_UTILITIES_ROAM_TIMEOUT_MS
+// per step; an error other than those two leaves the WiFi disconnected
+int wifi_roam_to_better_ap(const uint8_t *current_bssid, int8_t current_rssi, int margin_db);
+
+// Network interfaces the utilities know about
+typedef enum {
+    WIFI_IFACE_WIFI,        // the WiFi L2 interface
+    WIFI_IFACE_SECONDARY,   // Ethernet or native_sim TAP, see CONFIG_WIFI_UTILITIES_SECONDARY_IFACE
+    WIFI_IFACE_COUNT,
+} wifi_iface_role_t;
+
+struct net_if;
+
+// NULL when the interface does not exist
+struct net_if *wifi_iface_get(wifi_iface_role_t role);
+const char *wifi_iface_role_to_string(wifi_iface_role_t role);
+// up and holding a preferred IPv4 address, or with CONFIG_WIFI_UTILITIES_FIRST_ADDR
+// any preferred IPv6 one, link-local included
+bool wifi_iface_ready(wifi_iface_role_t role);
+int wifi_iface_get_ipv4(wifi_iface_role_t role, char *ip_addr, size_t len);
+// IPv4 if there is one, otherwise (CONFIG_NET_IPV6) a global or link-local IPv6 address
+int wifi_iface_get_addr(wifi_iface_role_t role, char *ip_addr, size_t len);
+// preferred if ready, otherwise any other ready interface; -ENETDOWN if none
+int wifi_iface_select(wifi_iface_role_t preferred, wifi_iface_role_t *role);
+// SO_BINDTODEVICE, -ENODEV when the interface does not exist
+int wifi_iface_bind_socket(int sock, wifi_iface_role_t role);
+
+// Power-save profiles, from fastest echo to longest battery life
+typedef enum {
+    WIFI_POWER_LOW_LATENCY,     // power save off, no TWT
+    WIFI_POWER_BALANCED,        // power save, wake on every DTIM
+    WIFI_POWER_LOW_POWER,       // power save on the listen interval, plus TWT when the AP supports it
+    WIFI_POWER_PROFILE_COUNT,
+} wifi_power_profile_t;
+
+#if defined(CONFIG_WIFI_UTILITIES_POWER_PROFILE_LOW_LATENCY)
+#define WIFI_UTILITIES_DEFAULT_POWER_PROFILE WIFI_POWER_LOW_LATENCY
+#elif defined(CONFIG_WIFI_UTILITIES_POWER_PROFILE_BALANCED)
+#define WIFI_UTILITIES_DEFAULT_POWER_PROFILE WIFI_POWER_BALANCED
+#elif defined(CONFIG_WIFI_UTILITIES_POWER_PROFILE_LOW_POWER)
+#define WIFI_UTILITIES_DEFAULT_POWER_PROFILE WIFI_POWER_LOW_POWER
+#endif
+
+int wifi_set_power_profile(wifi_power_profile_t profile);
+wifi_power_profile_t wifi_get_power_profile(void);
+// "low-latency", "balanced", "low-power"
+const char *wifi_power_profile_to_string(wifi_power_profile_t profile);
+int wifi_power_profile_from_string(const char *name, wifi_power_profile_t *profile);
+
+// Link quality as seen by the background monitor
+typedef enum {
+    WIFI_LINK_DOWN,
+    WIFI_LINK_GOOD,
+    WIFI_LINK_DEGRADED,
+    WIFI_LINK_BAD,
+} wifi_link_quality_t;
+
+typedef struct {
+    wifi_link_quality_t quality;
+    int8_t rssi;                // last sample, dBm
+    int8_t rssi_avg;            // mean over the window
+    int8_t rssi_min;
+    int8_t rssi_trend;          // newest minus oldest sample in the window, dB
+    uint16_t tx_fail_permille;  // failed / sent frames over the window
+    uint32_t beacons_missed;    // over the window
+    uint8_t bssid[WIFI_UTIL_BSSID_LEN];
+    uint8_t channel;
+    uint32_t roams;
+    int64_t updated_ms;
+} wifi_link_metrics_t;
+
+// Called from the monitor's work queue whenever the quality changes
+typedef void (*wifi_link_event_cb_t)(wifi_link_quality_t quality, const wifi_link_metrics_t *metrics);
+
+// Started automatically once an IP address is obtained, stopped by wifi_disconnect()
+int wifi_monitor_start(void);
+void wifi_monitor_stop(void);
+void wifi_monitor_set_callback(wifi_link_event_cb_t cb);
+int wifi_get_link_metrics(wifi_link_metrics_t *metrics);
+
+#endif /* WIFI_H */
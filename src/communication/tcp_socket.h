@@ -1,6 +0,0 @@
-#ifndef TCP_SOCKET_H
-#define TCP_SOCKET_H
-
-int run_tcp_socket_demo(void);
-
-#endif /* TCP_SOCKET_H */
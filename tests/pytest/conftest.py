@@ -0,0 +1,44 @@
+import subprocess
+from pathlib import Path
+
+import pytest
+
+REPO_ROOT = Path(__file__).resolve().parents[2]
+
+
+def pytest_addoption(parser):
+    parser.addoption(
+        "--update-baselines",
+        action="store_true",
+        default=False,
+        help="store the measured results as the new baselines instead of checking them",
+    )
+    parser.addoption(
+        "--soak-minutes",
+        type=float,
+        default=30,
+        help="duration of each soak test",
+    )
+
+
+@pytest.fixture(scope="session")
+def pc_site(tmp_path_factory):
+    """Build the PC_Site tools once per session and return their directory."""
+    build_dir = tmp_path_factory.mktemp("pc_site")
+    subprocess.run(["cmake", "-S", str(REPO_ROOT / "PC_Site"), "-B", str(build_dir)],
+                   check=True, stdout=subprocess.DEVNULL)
+    subprocess.run(["cmake", "--build", str(build_dir), "--target", "loadgen",
+                    "udp_socket_server", "tcp_socket_server", "metrics_collector",
+                    "impair_proxy"],
+                   check=True, stdout=subprocess.DEVNULL)
+    return build_dir
+
+
+@pytest.fixture(scope="session")
+def update_baselines(request):
+    return request.config.getoption("--update-baselines")
+
+
+@pytest.fixture(scope="session")
+def soak_minutes(request):
+    return request.config.getoption("--soak-minutes")
@@ -0,0 +1,32 @@
+"""Runs PC_Site/loadgen and parses its summary, for the Twister suites."""
+
+import logging
+import re
+import subprocess
+
+logger = logging.getLogger(__name__)
+
+# "total  sent recv lost errors reconn stalls p50_us p90_us p99_us max_us"
+TOTAL_RE = re.compile(r"^total\s+(\d+)\s+(\d+)\s+(\d+)\s+(\d+)\s+\d+\s+\d+\s+"
+                      r"([\d.]+)\s+([\d.]+)\s+([\d.]+)\s+([\d.]+)", re.MULTILINE)
+# The measured rate, not the configured one of the header line
+RATE_RE = re.compile(r"errors: .*?, ([\d.]+) msg/s")
+
+
+def run_loadgen(pc_site, args, host="127.0.0.1"):
+    cmd = [str(pc_site / "loadgen")] + args + [host]
+    logger.info("running %s", " ".join(cmd))
+    out = subprocess.run(cmd, check=True, capture_output=True, text=True, timeout=120).stdout
+    logger.info(out)
+
+    total = TOTAL_RE.search(out)
+    rate = RATE_RE.search(out)
+    assert total and rate, "unexpected loadgen output"
+    sent, received = int(total.group(1)), int(total.group(2))
+    return {
+        "throughput_msg_s": float(rate.group(1)),
+        "loss": (sent - received) / sent if sent else 1.0,
+        "errors": int(total.group(4)),
+        "p50_us": float(total.group(5)),
+        "p99_us": float(total.group(7)),
+    }
@@ -0,0 +1,258 @@
+"""
+Fault injection and resource tracking shared by the soak suites
+(test_soak.py for the firmware on native_sim, test_soak_pc.py for the
+PC_Site servers).
+
+A soak runs in rounds. Each round first injects random faults into the
+echo server for CHAOS_S seconds, then measures it with loadgen for
+MEASURE_S seconds and samples its resources once it is quiet again.
+A resource leaks when the last quarter of the run never gets back to
+where the first quarter was; throughput degrades when the last quarter
+falls below the first by more than THROUGHPUT_TOLERANCE.
+"""
+
+import logging
+import os
+import random
+import socket
+import statistics
+import struct
+import time
+from collections import Counter
+from pathlib import Path
+
+from loadgen import run_loadgen
+
+logger = logging.getLogger(__name__)
+
+CHAOS_S = 20
+MEASURE_S = 10
+SETTLE_S = 2
+THROUGHPUT_TOLERANCE = 0.25
+ROUND_LOSS_LIMIT = 0.01
+IO_TIMEOUT_S = 2.0
+
+# First bytes the firmware reads as a frame header: telemetry, bulk,
+# metrics, codec frames and a priority class prefix
+MAGICS = (0xB7, 0xB8, 0xB9, 0xF8, 0xF9, 0xFA, 0xFB, ord("@"))
+
+
+class Chaos:
+    """Random faults against the echo server at host:port."""
+
+    def __init__(self, host, port, udp, seed):
+        self.addr = (host, port)
+        self.udp = udp
+        self.rng = random.Random(seed)
+        self.counts = Counter()
+
+    def run(self, seconds):
+        faults = UDP_FAULTS if self.udp else TCP_FAULTS
+        end = time.monotonic() + seconds
+        while time.monotonic() < end:
+            fault = self.rng.choice(faults)
+            try:
+                fault(self)
+                self.counts[fault.__name__] += 1
+            except OSError as e:
+                # A refused or reset connection is what the server is
+                # expected to survive, not a test failure
+                self.counts[f"{fault.__name__}: {e.__class__.__name__}"] += 1
+
+    def payload(self, size):
+        return self.rng.randbytes(size)
+
+    # ---- UDP ----
+
+    def udp_socket(self):
+        s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        s.settimeout(IO_TIMEOUT_S)
+        return s
+
+    def udp_burst(self):
+        """Back-to-back datagrams, far more than the board's queues hold"""
+        with self.udp_socket() as s:
+            for _ in range(self.rng.randint(200, 2000)):
+                s.sendto(self.payload(self.rng.choice((16, 64, 512, 1400))), self.addr)
+            drain(s, 0.2)
+
+    def udp_oversize(self):
+        """Larger than the receive buffer, up to the largest UDP datagram"""
+        with self.udp_socket() as s:
+            for size in (1025, 1500, 8192, 65507):
+                s.sendto(self.payload(size), self.addr)
+            drain(s, 0.2)
+
+    def udp_garbage(self):
+        """Empty datagrams and truncated frame headers"""
+        with self.udp_socket() as s:
+            for _ in range(20):
+                size = self.rng.randint(0, 48)
+                data = bytes([self.rng.choice(MAGICS)]) + self.payload(size) if size else b""
+                s.sendto(data, self.addr)
+            drain(s, 0.2)
+
+    def udp_vanish(self):
+        """The peer is gone before the replies arrive"""
+        with self.udp_socket() as s:
+            for _ in range(50):
+                s.sendto(self.payload(64), self.addr)
+
+    # ---- TCP ----
+
+    def tcp_connect(self):
+        s = socket.create_connection(self.addr, timeout=IO_TIMEOUT_S)
+        s.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        return s
+
+    def tcp_reset(self):
+        """Abortive close in the middle of a message"""
+        s = self.tcp_connect()
+        s.sendall(self.payload(self.rng.randint(1, 200)))
+        s.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, struct.pack("ii", 1, 0))
+        s.close()
+
+    def tcp_trickle(self):
+        """One message split over many segments: partial reads"""
+        with self.tcp_connect() as s:
+            for b in self.payload(self.rng.randint(10, 100)):
+                s.send(bytes([b]))
+                time.sleep(self.rng.uniform(0.001, 0.02))
+            drain(s, 0.2)
+
+    def tcp_oversize(self):
+        """One write much larger than the receive buffer"""
+        with self.tcp_connect() as s:
+            s.sendall(self.payload(65536))
+            drain(s, 0.5)
+
+    def tcp_burst(self):
+        with self.tcp_connect() as s:
+            for _ in range(500):
+                s.sendall(self.payload(32))
+            drain(s, 0.5)
+
+    def tcp_half_close(self):
+        """The peer stops sending but still reads"""
+        with self.tcp_connect() as s:
+            s.sendall(self.payload(64))
+            s.shutdown(socket.SHUT_WR)
+            drain(s, 1.0)
+
+    def tcp_churn(self):
+        for _ in range(20):
+            self.tcp_connect().close()
+
+    def tcp_idle(self):
+        """Connected and silent, the server's idle path"""
+        with self.tcp_connect():
+            time.sleep(self.rng.uniform(0.5, 3.0))
+
+
+UDP_FAULTS = (Chaos.udp_burst, Chaos.udp_oversize, Chaos.udp_garbage, Chaos.udp_vanish)
+TCP_FAULTS = (Chaos.tcp_reset, Chaos.tcp_trickle, Chaos.tcp_oversize, Chaos.tcp_burst,
+              Chaos.tcp_half_close, Chaos.tcp_churn, Chaos.tcp_idle)
+
+
+def drain(s, seconds):
+    """Read replies for a while, whatever comes"""
+    s.settimeout(0.05)
+    end = time.monotonic() + seconds
+    while time.monotonic() < end:
+        try:
+            if not s.recv(65536) and s.type == socket.SOCK_STREAM:
+                return
+        except socket.timeout:
+            pass
+        except OSError:
+            return
+
+
+# ---- resources ----
+
+def find_pid(exe):
+    """pid of the process running exe"""
+    exe = Path(exe).resolve()
+    for pid in filter(str.isdigit, os.listdir("/proc")):
+        try:
+            if Path(os.readlink(f"/proc/{pid}/exe")) == exe:
+                return int(pid)
+        except OSError:
+            continue
+    return None
+
+
+def process_sample(pid):
+    """Resident memory, open descriptors and threads of a host process"""
+    sample = {"fds": len(os.listdir(f"/proc/{pid}/fd"))}
+    for line in Path(f"/proc/{pid}/status").read_text().splitlines():
+        key, _, value = line.partition(":")
+        if key == "VmRSS":
+            sample["rss_kib"] = int(value.split()[0])
+        elif key == "Threads":
+            sample["threads"] = int(value)
+    return sample
+
+
+class Resource:
+    """A sampled value that must stay flat. leak is +1 when growth is the
+    leak (descriptors, memory), -1 when shrinking is (free buffers)."""
+
+    def __init__(self, name, leak, slack):
+        self.name = name
+        self.leak = leak
+        self.slack = slack
+
+    def check(self, values):
+        quarter = len(values) // 4
+        if quarter == 0:
+            return None
+        first, last = values[:quarter], values[-quarter:]
+        if self.leak > 0 and min(last) > max(first) + self.slack:
+            return f"{self.name} grew from {max(first)} to {min(last)}"
+        if self.leak < 0 and max(last) < min(first) - self.slack:
+            return f"{self.name} fell from {min(first)} to {max(last)}"
+        return None
+
+
+def soak(minutes, chaos, pc_site, loadgen_args, sample, resources, alive):
+    """Rounds of chaos and measurement for minutes. sample() returns the
+    resource values by name, alive() raises when the server died."""
+    rounds = []
+    end = time.monotonic() + minutes * 60
+    while not rounds or time.monotonic() < end:
+        chaos.run(CHAOS_S)
+        alive()
+        result = run_loadgen(pc_site, loadgen_args + ["-d", str(MEASURE_S)])
+        time.sleep(SETTLE_S)
+        alive()
+        values = sample()
+        rounds.append((result, values))
+        logger.info("round %d: %.1f msg/s, loss %.4f, %s", len(rounds),
+                    result["throughput_msg_s"], result["loss"], values)
+
+    logger.info("faults: %s", dict(chaos.counts))
+    failures = []
+    for i, (result, _) in enumerate(rounds, 1):
+        if result["loss"] > ROUND_LOSS_LIMIT:
+            failures.append(f"round {i}: loss {result['loss']:.4f}")
+    throughput = [result["throughput_msg_s"] for result, _ in rounds]
+    quarter = len(throughput) // 4
+    if quarter > 0:
+        reference = statistics.median(throughput[:quarter])
+        if max(throughput[-quarter:]) < reference * (1.0 - THROUGHPUT_TOLERANCE):
+            failures.append(f"throughput fell from {reference:.1f} to "
+                            f"{max(throughput[-quarter:]):.1f} msg/s")
+    else:
+        logger.warning("%d rounds are too few to judge trends", len(rounds))
+    for resource in resources:
+        values = [v[resource.name] for _, v in rounds if resource.name in v]
+        if not values:
+            # A check without samples would pass without checking anything
+            failures.append(f"{resource.name} was never sampled")
+            continue
+        failure = resource.check(values)
+        if failure:
+            failures.append(failure)
+    assert not failures, "soak failed: " + "; ".join(failures)
+    return rounds
@@ -0,0 +1,127 @@
+"""
+Checks PC_Site/impair_proxy against the PC_Site echo servers: the delay,
+loss and bandwidth it is told to add are what loadgen and a plain socket
+measure through it, and the same seed loses the same packets. Runs
+without Twister:
+
+    pytest tests/pytest/test_impair_pc.py
+"""
+
+import signal
+import socket
+import subprocess
+import threading
+import time
+
+import pytest
+
+from loadgen import run_loadgen
+
+PORT = 8080
+PROXY_PORT = 9080
+
+
+def start(pc_site, name, *args):
+    proc = subprocess.Popen([str(pc_site / name), *args],
+                            stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    time.sleep(0.5)
+    assert proc.poll() is None, f"{name} exited: {proc.stdout.read()}"
+    return proc
+
+
+def stop(proc):
+    """Ctrl+C, returns what it printed"""
+    proc.send_signal(signal.SIGINT)
+    try:
+        return proc.communicate(timeout=10)[0]
+    except subprocess.TimeoutExpired:
+        proc.kill()
+        pytest.fail(f"{proc.args[0]} did not stop on SIGINT")
+
+
+@pytest.fixture
+def server(pc_site, request):
+    proc = start(pc_site, request.param, "-n")
+    yield proc
+    stop(proc)
+
+
+@pytest.fixture
+def proxy(pc_site):
+    """Starts impair_proxy with the given arguments, stops it at the end"""
+    procs = []
+
+    def run(*args):
+        proc = start(pc_site, "impair_proxy", "-l", str(PROXY_PORT), *args,
+                     "127.0.0.1", str(PORT))
+        procs.append(proc)
+        return proc
+    yield run
+    for proc in procs:
+        if proc.poll() is None:
+            stop(proc)
+
+
+@pytest.mark.parametrize("server", ["udp_socket_server"], indirect=True)
+def test_impair_delay_and_loss(server, proxy, pc_site):
+    proxy("-e", "delay 10; jitter 1; loss 10")
+    result = run_loadgen(pc_site, ["-u", "-p", str(PROXY_PORT), "-n", "4", "-T", "1",
+                                   "-r", "250", "-d", "5"])
+
+    # Both directions: 20 ms more RTT, 1 - 0.9^2 = 19% lost
+    assert 20000 <= result["p50_us"] <= 24000, result
+    assert 0.16 <= result["loss"] <= 0.22, result
+
+
+def echoed(count, seed_args, proxy):
+    """Sequence numbers of the datagrams that made it there and back"""
+    proc = proxy(*seed_args)
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as s:
+        s.settimeout(0.5)
+        for seq in range(count):
+            s.sendto(f"seq {seq}\n".encode(), ("127.0.0.1", PROXY_PORT))
+            time.sleep(0.001)
+        got = set()
+        try:
+            while True:
+                got.add(int(s.recv(1024).split()[-1]))
+        except socket.timeout:
+            pass
+    stop(proc)
+    return got
+
+
+@pytest.mark.parametrize("server", ["udp_socket_server"], indirect=True)
+def test_impair_repeatable(server, proxy):
+    profile = ["-e", "loss_ge 5 30; duplicate 1"]
+    first = echoed(2000, profile + ["-s", "7"], proxy)
+    second = echoed(2000, profile + ["-s", "7"], proxy)
+    other = echoed(2000, profile + ["-s", "8"], proxy)
+
+    assert 0 < len(first) < 2000
+    assert first == second, "the same seed lost different packets"
+    assert first != other
+
+
+@pytest.mark.parametrize("server", ["tcp_socket_server"], indirect=True)
+def test_impair_tcp_rate(server, proxy):
+    proxy("-t", "-e", "up.rate 8000; delay 5")
+    size = 1000000
+    received = 0
+
+    with socket.create_connection(("127.0.0.1", PROXY_PORT), timeout=10) as s:
+        def read():
+            nonlocal received
+            while chunk := s.recv(65536):
+                received += len(chunk)
+        reader = threading.Thread(target=read)
+        start_s = time.monotonic()
+        reader.start()
+        s.sendall(b"x" * size)
+        s.shutdown(socket.SHUT_WR)
+        reader.join(timeout=30)
+        elapsed = time.monotonic() - start_s
+
+    # 1 MB at 8000 kbit/s is 1 s on the way up, the echo is not capped
+    assert received >= size
+    assert 0.95 <= elapsed <= 1.3, f"{elapsed:.2f} s"
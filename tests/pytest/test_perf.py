@@ -0,0 +1,58 @@
+"""
+Boots the echo server firmware on native_sim, drives it with the PC_Site
+load generator over the host's loopback and compares throughput and
+latency with baselines.json.
+"""
+
+import json
+from pathlib import Path
+
+import pytest
+from twister_harness import DeviceAdapter
+
+from loadgen import run_loadgen
+
+BASELINES = Path(__file__).with_name("baselines.json")
+BASELINE_KEYS = ("throughput_msg_s", "loss", "p50_us", "p99_us")
+
+
+def check_against_baseline(name, result, update):
+    baselines = json.loads(BASELINES.read_text())
+
+    if update:
+        baselines[name] = {key: round(result[key], 3) for key in BASELINE_KEYS}
+        BASELINES.write_text(json.dumps(baselines, indent=2) + "\n")
+        return
+
+    base = baselines.get(name)
+    if base is None:
+        pytest.skip(f"no {name} baseline recorded yet, run with --update-baselines")
+    tolerance = baselines["tolerance"]
+    failures = []
+    if result["throughput_msg_s"] < base["throughput_msg_s"] * (1.0 - tolerance):
+        failures.append(f"throughput {result['throughput_msg_s']:.1f} msg/s, "
+                        f"baseline {base['throughput_msg_s']:.1f}")
+    if result["loss"] > base["loss"] + baselines["loss_slack"]:
+        failures.append(f"loss {result['loss']:.4f}, baseline {base['loss']:.4f}")
+    for key in ("p50_us", "p99_us"):
+        if result[key] > base[key] * (1.0 + tolerance):
+            failures.append(f"{key} {result[key]:.1f}, baseline {base[key]:.1f}")
+
+    assert not failures, f"{name} regressed: " + "; ".join(failures)
+
+
+def wait_for_server(dut):
+    dut.readlines_until(regex=r"\[Server\] listening at", timeout=30)
+
+
+def test_udp_echo(dut: DeviceAdapter, pc_site, update_baselines):
+    wait_for_server(dut)
+    result = run_loadgen(pc_site, ["-u", "-n", "4", "-T", "1", "-r", "250", "-d", "10"])
+    check_against_baseline("udp_echo", result, update_baselines)
+
+
+def test_tcp_echo(dut: DeviceAdapter, pc_site, update_baselines):
+    wait_for_server(dut)
+    # The firmware's TCP server takes one client at a time
+    result = run_loadgen(pc_site, ["-n", "1", "-T", "1", "-r", "1000", "-d", "10"])
+    check_against_baseline("tcp_echo", result, update_baselines)
@@ -0,0 +1,140 @@
+"""
+Soaks the echo server firmware on native_sim: rounds of random
+disconnects, partial reads, oversize datagrams and bursts, each followed
+by a loadgen measurement. The board reports its stack headroom, and its
+buffer pools when its sockets use them, through its metrics snapshots
+(CONFIG_COMM_ENGINE_METRICS) to PC_Site/metrics_collector; the host side
+of its offloaded sockets shows up as descriptors of zephyr.exe. All of them, and the throughput, have
+to stay flat, and the firmware must never reach COMM_FAILURE.
+"""
+
+import os
+import re
+import socket
+import subprocess
+import time
+import urllib.request
+from pathlib import Path
+
+import pytest
+from twister_harness import DeviceAdapter
+
+from soak import Chaos, Resource, find_pid, process_sample, soak
+
+PORT = 8080
+METRICS_PORT = 8082
+STACK_MARGIN = 256          # bytes every thread has to keep unused
+SNAPSHOT_MAX_AGE_S = 5      # snapshots come every second (testcase.yaml)
+
+FAILURE_RE = re.compile(r"\[Failure\]|ASSERTION FAIL|ZEPHYR FATAL ERROR")
+METRIC_RE = re.compile(r"^iris_(\w+?)(?:\{(.*)\})? (\S+)$", re.MULTILINE)
+LABEL_RE = re.compile(r'(\w+)="([^"]*)"')
+
+PROCESS_RESOURCES = [
+    Resource("fds", leak=+1, slack=2),
+    Resource("rss_kib", leak=+1, slack=4096),
+]
+PKT_RESOURCES = [
+    Resource("free_rx_pkt", leak=-1, slack=2),
+    Resource("free_tx_pkt", leak=-1, slack=2),
+]
+BUF_RESOURCES = [
+    Resource("free_rx_buf", leak=-1, slack=2),
+    Resource("free_tx_buf", leak=-1, slack=2),
+]
+
+
+def kconfig(build_dir):
+    """{symbol: value} of the build's .config"""
+    config = {}
+    for line in (Path(build_dir) / "zephyr" / ".config").read_text().splitlines():
+        name, sep, value = line.partition("=")
+        if sep and not name.startswith("#"):
+            config[name] = value
+    return config
+
+
+def resources(config):
+    """What this build can leak. Offloaded sockets go straight to the
+    host and leave the net_pkt and net_buf pools alone, free buffers are
+    only counted with CONFIG_NET_BUF_POOL_USAGE."""
+    tracked = list(PROCESS_RESOURCES)
+    if config.get("CONFIG_NET_NATIVE") == "y" and \
+            config.get("CONFIG_NET_NATIVE_OFFLOADED_SOCKETS") != "y":
+        tracked += PKT_RESOURCES
+        if config.get("CONFIG_NET_BUF_POOL_USAGE") == "y":
+            tracked += BUF_RESOURCES
+    return tracked
+
+
+@pytest.fixture
+def collector(pc_site):
+    """metrics_collector on a free HTTP port, returns that port"""
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        http_port = s.getsockname()[1]
+    proc = subprocess.Popen([str(pc_site / "metrics_collector"), "-p", str(METRICS_PORT),
+                             "-l", str(http_port)], stdout=subprocess.DEVNULL)
+    time.sleep(0.5)
+    yield http_port
+    proc.terminate()
+    proc.wait(timeout=10)
+
+
+def scrape(http_port):
+    """{metric: [(labels, value), ...]} of the collector's /metrics"""
+    url = f"http://127.0.0.1:{http_port}/metrics"
+    text = urllib.request.urlopen(url, timeout=5).read().decode()
+    metrics = {}
+    for name, labels, value in METRIC_RE.findall(text):
+        metrics.setdefault(name, []).append((dict(LABEL_RE.findall(labels)), float(value)))
+    return metrics
+
+
+def board_sample(http_port, pid):
+    metrics = scrape(http_port)
+    sample = process_sample(pid)
+
+    age = metrics.get("snapshot_age_seconds")
+    assert age, "no metrics snapshot from the board"
+    assert age[0][1] < SNAPSHOT_MAX_AGE_S, f"last snapshot {age[0][1]:.1f} s ago"
+    for labels, value in metrics.get("pool_free", []):
+        sample[f"free_{labels['pool']}"] = int(value)
+    for labels, value in metrics.get("stack_free_min_bytes", []):
+        sample["stack_free"] = int(value)
+        assert value >= STACK_MARGIN, \
+            f"thread {labels['thread']} has only {value:.0f} bytes of stack left"
+    for name in ("errors_total", "reconnects_total"):
+        sample[name] = int(metrics.get(name, [({}, 0)])[0][1])
+    return sample
+
+
+def board_alive(dut, pid):
+    def check():
+        for line in dut.readlines(print_output=False):
+            assert not FAILURE_RE.search(line), f"firmware failed: {line}"
+        assert os.path.exists(f"/proc/{pid}"), "zephyr.exe exited"
+    return check
+
+
+def run_soak(dut, pc_site, collector, minutes, udp, loadgen_args):
+    dut.readlines_until(regex=r"\[Server\] listening at", timeout=30)
+    build_dir = dut.device_config.build_dir
+    exe = Path(build_dir) / "zephyr" / "zephyr.exe"
+    pid = find_pid(exe)
+    assert pid is not None, f"{exe} is not running"
+
+    chaos = Chaos("127.0.0.1", PORT, udp=udp, seed=1)
+    soak(minutes, chaos, pc_site, loadgen_args, lambda: board_sample(collector, pid),
+         resources(kconfig(build_dir)), board_alive(dut, pid))
+
+
+def test_soak_udp_echo(dut: DeviceAdapter, pc_site, collector, soak_minutes):
+    run_soak(dut, pc_site, collector, soak_minutes, True,
+             ["-u", "-n", "4", "-T", "1", "-r", "250"])
+
+
+def test_soak_tcp_echo(dut: DeviceAdapter, pc_site, collector, soak_minutes):
+    # The firmware's TCP server takes one client at a time
+    run_soak(dut, pc_site, collector, soak_minutes, False,
+             ["-n", "1", "-T", "1", "-r", "1000"])
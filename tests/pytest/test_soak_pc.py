@@ -0,0 +1,60 @@
+"""
+Soaks the PC_Site echo servers: hours of random disconnects, partial
+reads, oversize datagrams and bursts, with their memory, descriptors and
+throughput checked for leaks and slow degradation. Runs without Twister:
+
+    pytest tests/pytest/test_soak_pc.py --soak-minutes=240
+"""
+
+import signal
+import subprocess
+import time
+
+import pytest
+
+from soak import Chaos, Resource, process_sample, soak
+
+PORT = 8080
+
+RESOURCES = [
+    Resource("rss_kib", leak=+1, slack=4096),
+    Resource("fds", leak=+1, slack=2),
+    Resource("threads", leak=+1, slack=0),
+]
+
+
+@pytest.fixture
+def server(pc_site, request):
+    """Start the server named by the test parameter and stop it with Ctrl+C"""
+    proc = subprocess.Popen([str(pc_site / request.param), "-n"],
+                            stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    time.sleep(0.5)
+    yield proc
+    proc.send_signal(signal.SIGINT)
+    try:
+        proc.wait(timeout=10)
+    except subprocess.TimeoutExpired:
+        proc.kill()
+        pytest.fail(f"{request.param} did not stop on SIGINT")
+
+
+def alive(proc):
+    def check():
+        if proc.poll() is not None:
+            raise AssertionError(f"server exited with {proc.returncode}: "
+                                 f"{proc.stderr.read().decode(errors='replace')}")
+    return check
+
+
+@pytest.mark.parametrize("server", ["udp_socket_server"], indirect=True)
+def test_soak_udp_server(server, pc_site, soak_minutes):
+    chaos = Chaos("127.0.0.1", PORT, udp=True, seed=1)
+    soak(soak_minutes, chaos, pc_site, ["-u", "-n", "8", "-T", "2", "-r", "500"],
+         lambda: process_sample(server.pid), RESOURCES, alive(server))
+
+
+@pytest.mark.parametrize("server", ["tcp_socket_server"], indirect=True)
+def test_soak_tcp_server(server, pc_site, soak_minutes):
+    chaos = Chaos("127.0.0.1", PORT, udp=False, seed=1)
+    soak(soak_minutes, chaos, pc_site, ["-n", "8", "-T", "2", "-r", "500", "-c", "5"],
+         lambda: process_sample(server.pid), RESOURCES, alive(server))